@@ -60,6 +60,7 @@ enum poll_method {
 	METHOD_EPOLL,
 	METHOD_ACTSCHED,
 	METHOD_KQUEUE,
+	METHOD_IOURING,
 	/* sep */
 	METHOD_MAX
 };
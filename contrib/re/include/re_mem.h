@@ -23,6 +23,15 @@ struct memstat {
 	size_t size_max;     /**< Largest block size allocated */
 };
 
+/** Memory pool statistics, one per size class */
+struct mempool_stat {
+	size_t size;         /**< Block size of the class      */
+	size_t hits;         /**< Allocations served from pool */
+	size_t misses;       /**< Allocations from the system  */
+	size_t depot;        /**< Blocks in the shared depot   */
+	size_t released;     /**< Blocks returned to system    */
+};
+
 #define mem_alloc(s, d) \
 	mem_alloc_rl(s, d, __FILE__, __LINE__)
 
@@ -32,9 +41,14 @@ struct memstat {
 #define mem_realloc(s, d) \
 	mem_realloc_rl(s, d, __FILE__, __LINE__)
 
+#define mem_pool_alloc(s, d) \
+	mem_pool_alloc_rl(s, d, __FILE__, __LINE__)
+
 void    *mem_alloc_rl(size_t size, mem_destroy_h *dh, const char *f, int l);
 void    *mem_zalloc_rl(size_t size, mem_destroy_h *dh, const char *f, int l);
 void    *mem_realloc_rl(void *data, size_t size, const char *f, int l);
+void    *mem_pool_alloc_rl(size_t size, mem_destroy_h *dh,
+			   const char *f, int l);
 void    *mem_reallocarray(void *ptr, size_t nmemb,
 			  size_t membsize, mem_destroy_h *dh);
 void    *mem_ref(void *data);
@@ -46,3 +60,5 @@ void     mem_threshold_set(ssize_t n);
 struct re_printf;
 int      mem_status(struct re_printf *pf, void *unused);
 int      mem_get_stat(struct memstat *mstat);
+int      mem_pool_stat(struct mempool_stat *statv, size_t *n);
+void     mem_pool_flush(void);
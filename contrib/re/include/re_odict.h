@@ -15,8 +15,10 @@ enum odict_type {
 };
 
 struct odict {
-	struct list lst;
+	struct list lst;           /* must be first, see entry.c */
 	struct hash *ht;
+	struct odict_entry **vec;  /* the entries in order, by index */
+	size_t n, sz;
 };
 
 struct odict_entry {
@@ -34,6 +36,7 @@ struct odict_entry {
 
 int odict_alloc(struct odict **op, uint32_t hash_size);
 const struct odict_entry *odict_lookup(const struct odict *o, const char *key);
+const struct odict_entry *odict_at(const struct odict *o, size_t idx);
 size_t odict_count(const struct odict *o, bool nested);
 int odict_debug(struct re_printf *pf, const struct odict *o);
 
@@ -191,6 +191,7 @@ struct rtcp_stats {
 struct sa;
 struct re_printf;
 struct rtp_sock;
+struct udp_sock;
 
 typedef void (rtp_recv_h)(const struct sa *src, const struct rtp_header *hdr,
 			  struct mbuf *mb, void *arg);
@@ -202,6 +203,9 @@ int   rtp_alloc(struct rtp_sock **rsp);
 int   rtp_listen(struct rtp_sock **rsp, int proto, const struct sa *ip,
 		 uint16_t min_port, uint16_t max_port, bool enable_rtcp,
 		 rtp_recv_h *recvh, rtcp_recv_h *rtcph, void *arg);
+int   rtp_listen_sock(struct rtp_sock **rsp, struct udp_sock *us,
+		      bool enable_rtcp,
+		      rtp_recv_h *recvh, rtcp_recv_h *rtcph, void *arg);
 int   rtp_hdr_encode(struct mbuf *mb, const struct rtp_header *hdr);
 int   rtp_hdr_decode(struct rtp_header *hdr, struct mbuf *mb);
 int   rtp_encode(struct rtp_sock *rs, bool marker, uint8_t pt,
@@ -10,6 +10,8 @@ enum srtp_suite {
 	SRTP_AES_CM_128_HMAC_SHA1_80,
 	SRTP_AES_256_CM_HMAC_SHA1_32,
 	SRTP_AES_256_CM_HMAC_SHA1_80,
+	SRTP_AES_128_GCM,   /**< AEAD_AES_128_GCM (RFC 7714) */
+	SRTP_AES_256_GCM,   /**< AEAD_AES_256_GCM (RFC 7714) */
 };
 
 enum srtp_flags {
@@ -22,6 +24,10 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	       const uint8_t *key, size_t key_bytes, int flags);
 int srtp_encrypt(struct srtp *srtp, struct mbuf *mb);
 int srtp_decrypt(struct srtp *srtp, struct mbuf *mb);
+int srtp_encrypt_batch(struct srtp *srtp, struct mbuf *mbv[], int errv[],
+		       size_t n);
+int srtp_decrypt_batch(struct srtp *srtp, struct mbuf *mbv[], int errv[],
+		       size_t n);
 int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb);
 int srtcp_decrypt(struct srtp *srtp, struct mbuf *mb);
 
@@ -24,6 +24,8 @@ int  udp_listen(struct udp_sock **usp, const struct sa *local,
 		udp_recv_h *rh, void *arg);
 int  udp_connect(struct udp_sock *us, const struct sa *peer);
 int  udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb);
+int  udp_send_batch(struct udp_sock *us, const struct sa *dst,
+		    struct mbuf * const *mbv, size_t mbc);
 int  udp_send_anon(const struct sa *dst, struct mbuf *mb);
 int  udp_local_get(const struct udp_sock *us, struct sa *local);
 int  udp_setsockopt(struct udp_sock *us, int level, int optname,
@@ -36,6 +38,10 @@ void udp_error_handler_set(struct udp_sock *us, udp_error_h *eh);
 int  udp_thread_attach(struct udp_sock *us);
 void udp_thread_detach(struct udp_sock *us);
 int  udp_sock_fd(const struct udp_sock *us, int af);
+int  udp_alloc_shared(struct udp_sock **usp, struct udp_sock *parent,
+		      udp_recv_h *rh, void *arg);
+void udp_recv_packet(struct udp_sock *us, const struct sa *src,
+		     struct mbuf *mb);
 
 int  udp_multicast_join(struct udp_sock *us, const struct sa *group);
 int  udp_multicast_leave(struct udp_sock *us, const struct sa *group);
@@ -18,7 +18,9 @@
 #   RELEASE        Release build
 #   SYSROOT        System root of library and include files
 #   SYSROOT_ALT    Alternative system root of library and include files
+#   USE_MEM_POOL   If non-empty, recycle small memory blocks in size classes
 #   USE_OPENSSL    If non-empty, link to libssl library
+#   USE_TMR_WHEEL  If non-empty, use a hierarchical timer wheel
 #   USE_ZLIB       If non-empty, link to libz library
 #   VERSION        Version number
 #
@@ -465,6 +467,14 @@ USE_ZLIB    := $(shell [ -f $(SYSROOT)/include/zlib.h ] || \
 	[ -f $(SYSROOT)/local/include/zlib.h ] || \
 	[ -f $(SYSROOT_ALT)/include/zlib.h ] && echo "yes")
 
+ifneq ($(USE_TMR_WHEEL),)
+CFLAGS  += -DUSE_TMR_WHEEL
+endif
+
+ifneq ($(USE_MEM_POOL),)
+CFLAGS  += -DUSE_MEM_POOL
+endif
+
 ifneq ($(USE_ZLIB),)
 CFLAGS  += -DUSE_ZLIB
 LIBS    += -lz
@@ -534,6 +544,15 @@ ifneq ($(OS),darwin)
 HAVE_EPOLL   := $(shell [ -f $(SYSROOT)/include/sys/epoll.h ] || \
 			[ -f $(SYSROOT)/include/$(MACHINE)/sys/epoll.h ] \
 			&& echo "1")
+HAVE_EVENTFD := $(shell [ -f $(SYSROOT)/include/sys/eventfd.h ] || \
+			[ -f $(SYSROOT)/include/$(MACHINE)/sys/eventfd.h ] \
+			&& echo "1")
+ifeq ($(OS),linux)
+HAVE_MMSG    := 1
+HAVE_UDP_GSO := 1
+HAVE_IO_URING := $(shell [ -f $(SYSROOT)/include/linux/io_uring.h ] \
+			&& echo "1")
+endif
 endif
 ifneq ($(OS),openbsd)
 HAVE_LIBRESOLV := $(shell [ -f $(SYSROOT)/include/resolv.h ] && echo "1")
@@ -571,9 +590,21 @@ CFLAGS  += -DHAVE_SYS_TIME_H
 ifneq ($(HAVE_EPOLL),)
 CFLAGS  += -DHAVE_EPOLL
 endif
+ifneq ($(HAVE_EVENTFD),)
+CFLAGS  += -DHAVE_EVENTFD
+endif
+ifneq ($(HAVE_MMSG),)
+CFLAGS  += -DHAVE_MMSG
+ifneq ($(HAVE_UDP_GSO),)
+CFLAGS  += -DHAVE_UDP_GSO
+endif
+endif
 ifneq ($(HAVE_KQUEUE),)
 CFLAGS  += -DHAVE_KQUEUE
 endif
+ifneq ($(HAVE_IO_URING),)
+CFLAGS  += -DHAVE_IO_URING
+endif
 CFLAGS  += -DHAVE_UNAME
 CFLAGS  += -DHAVE_UNISTD_H
 ifneq ($(OS),cygwin)
@@ -667,6 +698,8 @@ info:
 	@echo "  USE_DTLS:      $(USE_DTLS)"
 	@echo "  USE_DTLS_SRTP: $(USE_DTLS_SRTP)"
 	@echo "  USE_ZLIB:      $(USE_ZLIB)"
+	@echo "  USE_TMR_WHEEL: $(USE_TMR_WHEEL)"
+	@echo "  USE_MEM_POOL:  $(USE_MEM_POOL)"
 	@echo "  GCOV:          $(GCOV)"
 	@echo "  GPROF:         $(GPROF)"
 	@echo "  CROSS_COMPILE: $(CROSS_COMPILE)"
@@ -123,3 +123,45 @@ int aes_decr(struct aes *st, uint8_t *out, const uint8_t *in, size_t len)
 {
 	return aes_encr(st, out, in, len);
 }
+
+
+int aes_encr_batch(struct aes *aes, uint8_t * const bufv[],
+		   const size_t lenv[], const uint8_t ivv[][AES_BLOCK_SIZE],
+		   size_t n)
+{
+	size_t i;
+	int err;
+
+	if (!aes || (n && (!bufv || !lenv || !ivv)))
+		return EINVAL;
+
+	for (i = 0; i < n; i++) {
+
+		aes_set_iv(aes, ivv[i]);
+
+		err = aes_encr(aes, bufv[i], bufv[i], lenv[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+/* GCM is not part of the public CommonCrypto API */
+int aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen)
+{
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+	return ENOTSUP;
+}
+
+
+int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
+{
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+	return ENOTSUP;
+}
@@ -16,8 +16,18 @@
 #ifdef EVP_CIPH_CTR_MODE
 
 
+enum {
+	BATCH_BLOCKS     = 128,  /**< Counter blocks per ECB call         */
+	AES_BATCH_MAXLEN = 256,  /**< Longer buffers are not interleaved  */
+};
+
+
 struct aes {
-	EVP_CIPHER_CTX ctx;
+	EVP_CIPHER_CTX *ctx;
+	EVP_CIPHER_CTX *ecb;         /**< CTR: keystream for batches      */
+	enum aes_mode mode;
+	uint8_t iv[AES_BLOCK_SIZE];  /**< GCM: IV for the next message   */
+	bool iv_pending;             /**< GCM: IV not yet loaded into ctx */
 };
 
 
@@ -25,7 +35,51 @@ static void destructor(void *arg)
 {
 	struct aes *st = arg;
 
-	EVP_CIPHER_CTX_cleanup(&st->ctx);
+	if (st->ctx)
+		EVP_CIPHER_CTX_free(st->ctx);
+	if (st->ecb)
+		EVP_CIPHER_CTX_free(st->ecb);
+}
+
+
+static const EVP_CIPHER *aes_ecb(size_t key_bits)
+{
+	switch (key_bits) {
+
+	case 128: return EVP_aes_128_ecb();
+	case 192: return EVP_aes_192_ecb();
+	case 256: return EVP_aes_256_ecb();
+	default:  return NULL;
+	}
+}
+
+
+static const EVP_CIPHER *aes_cipher(enum aes_mode mode, size_t key_bits)
+{
+	switch (mode) {
+
+	case AES_MODE_CTR:
+		switch (key_bits) {
+
+		case 128: return EVP_aes_128_ctr();
+		case 192: return EVP_aes_192_ctr();
+		case 256: return EVP_aes_256_ctr();
+		default:  return NULL;
+		}
+
+#ifdef EVP_CIPH_GCM_MODE
+	case AES_MODE_GCM:
+		switch (key_bits) {
+
+		case 128: return EVP_aes_128_gcm();
+		case 256: return EVP_aes_256_gcm();
+		default:  return NULL;
+		}
+#endif
+
+	default:
+		return NULL;
+	}
 }
 
 
@@ -40,30 +94,56 @@ int aes_alloc(struct aes **aesp, enum aes_mode mode,
 	if (!aesp || !key)
 		return EINVAL;
 
-	if (mode != AES_MODE_CTR)
+	if (mode != AES_MODE_CTR && mode != AES_MODE_GCM)
 		return ENOTSUP;
 
+	cipher = aes_cipher(mode, key_bits);
+	if (!cipher) {
+		re_fprintf(stderr, "aes: unknown key: %zu bits\n", key_bits);
+		return EINVAL;
+	}
+
 	st = mem_zalloc(sizeof(*st), destructor);
 	if (!st)
 		return ENOMEM;
 
-	EVP_CIPHER_CTX_init(&st->ctx);
+	st->mode = mode;
 
-	switch (key_bits) {
-
-	case 128: cipher = EVP_aes_128_ctr(); break;
-	case 192: cipher = EVP_aes_192_ctr(); break;
-	case 256: cipher = EVP_aes_256_ctr(); break;
-	default:
-		re_fprintf(stderr, "aes: unknown key: %zu bits\n", key_bits);
-		err = EINVAL;
+	st->ctx = EVP_CIPHER_CTX_new();
+	if (!st->ctx) {
+		err = ENOMEM;
 		goto out;
 	}
 
-	r = EVP_EncryptInit_ex(&st->ctx, cipher, NULL, key, iv);
+	/* GCM loads the IV lazily, once the direction is known */
+	r = EVP_EncryptInit_ex(st->ctx, cipher, NULL, key,
+			       mode == AES_MODE_GCM ? NULL : iv);
 	if (!r) {
 		ERR_clear_error();
 		err = EPROTO;
+		goto out;
+	}
+
+	if (mode == AES_MODE_GCM && iv)
+		aes_set_iv(st, iv);
+
+	if (mode == AES_MODE_CTR) {
+
+		st->ecb = EVP_CIPHER_CTX_new();
+		if (!st->ecb) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		r = EVP_EncryptInit_ex(st->ecb, aes_ecb(key_bits), NULL,
+				       key, NULL);
+		if (!r) {
+			ERR_clear_error();
+			err = EPROTO;
+			goto out;
+		}
+
+		EVP_CIPHER_CTX_set_padding(st->ecb, 0);
 	}
 
  out:
@@ -83,25 +163,323 @@ void aes_set_iv(struct aes *aes, const uint8_t iv[AES_BLOCK_SIZE])
 	if (!aes || !iv)
 		return;
 
-	r = EVP_EncryptInit_ex(&aes->ctx, NULL, NULL, NULL, iv);
+	if (aes->mode == AES_MODE_GCM) {
+		memcpy(aes->iv, iv, sizeof(aes->iv));
+		aes->iv_pending = true;
+		return;
+	}
+
+	r = EVP_EncryptInit_ex(aes->ctx, NULL, NULL, NULL, iv);
 	if (!r)
 		ERR_clear_error();
 }
 
 
-int aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+/*
+ * One GCM context serves one direction per message: the pending IV
+ * is loaded together with the direction on the first update.
+ */
+static int gcm_begin(struct aes *aes, int enc)
+{
+	if (!aes->iv_pending)
+		return 0;
+
+	if (!EVP_CipherInit_ex(aes->ctx, NULL, NULL, NULL, aes->iv, enc)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	aes->iv_pending = false;
+
+	return 0;
+}
+
+
+static int cipher_update(struct aes *aes, int enc, uint8_t *out,
+			 const uint8_t *in, size_t len)
 {
 	int c_len = (int)len;
+	int r;
 
-	if (!aes || !out || !in)
+	if (!aes || !in)
+		return EINVAL;
+
+	/* out == NULL feeds Additional Authenticated Data (GCM only) */
+	if (!out && aes->mode != AES_MODE_GCM)
+		return EINVAL;
+
+	if (aes->mode == AES_MODE_GCM) {
+		r = gcm_begin(aes, enc);
+		if (r)
+			return r;
+	}
+
+	if (enc || aes->mode == AES_MODE_CTR)
+		r = EVP_EncryptUpdate(aes->ctx, out, &c_len, in, (int)len);
+	else
+		r = EVP_DecryptUpdate(aes->ctx, out, &c_len, in, (int)len);
+
+	if (!r) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	return 0;
+}
+
+
+int aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+{
+	return cipher_update(aes, 1, out, in, len);
+}
+
+
+int aes_decr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+{
+	return cipher_update(aes, 0, out, in, len);
+}
+
+
+static inline uint64_t load_be64(const uint8_t *p)
+{
+	return (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 |
+	       (uint64_t)p[2] << 40 | (uint64_t)p[3] << 32 |
+	       (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16 |
+	       (uint64_t)p[6] <<  8 | (uint64_t)p[7];
+}
+
+
+static inline void store_be64(uint8_t *p, uint64_t v)
+{
+	p[0] = (uint8_t)(v >> 56);
+	p[1] = (uint8_t)(v >> 48);
+	p[2] = (uint8_t)(v >> 40);
+	p[3] = (uint8_t)(v >> 32);
+	p[4] = (uint8_t)(v >> 24);
+	p[5] = (uint8_t)(v >> 16);
+	p[6] = (uint8_t)(v >>  8);
+	p[7] = (uint8_t)v;
+}
+
+
+/** Part of a buffer that is covered by the current keystream chunk */
+struct ks_seg {
+	uint8_t *dst;
+	size_t len;
+	size_t ks_off;
+};
+
+
+static int keystream_apply(struct aes *aes, uint8_t *ks, size_t nb,
+			   const struct ks_seg *segv, size_t segc)
+{
+	int c_len = (int)(nb * AES_BLOCK_SIZE);
+	size_t i, j;
+
+	if (!EVP_EncryptUpdate(aes->ecb, ks, &c_len, ks, c_len)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	for (i = 0; i < segc; i++) {
+		uint8_t *dst = segv[i].dst;
+		const uint8_t *k = ks + segv[i].ks_off;
+		const size_t len = segv[i].len;
+
+		for (j = 0; j + 8 <= len; j += 8) {
+			uint64_t d, w;
+
+			memcpy(&d, dst + j, 8);
+			memcpy(&w, k + j, 8);
+			d ^= w;
+			memcpy(dst + j, &d, 8);
+		}
+
+		for (; j < len; j++)
+			dst[j] ^= k[j];
+	}
+
+	return 0;
+}
+
+
+/**
+ * Encrypt or decrypt a batch of buffers in place with AES-CTR
+ *
+ * Each buffer has its own initial counter block. The counter blocks of
+ * all buffers are encrypted together, so that short buffers share the
+ * cipher pipeline and the context is set up only once. Buffers longer
+ * than AES_BATCH_MAXLEN already fill the pipeline on their own and are
+ * encrypted one by one.
+ *
+ * @param aes  AES Context (AES_MODE_CTR)
+ * @param bufv Buffers to encrypt in place
+ * @param lenv Length of each buffer in bytes
+ * @param ivv  Initial counter block of each buffer
+ * @param n    Number of buffers
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aes_encr_batch(struct aes *aes, uint8_t * const bufv[],
+		   const size_t lenv[], const uint8_t ivv[][AES_BLOCK_SIZE],
+		   size_t n)
+{
+	uint8_t ks[BATCH_BLOCKS * AES_BLOCK_SIZE];
+	struct ks_seg segv[BATCH_BLOCKS];
+	size_t i, nb = 0, segc = 0;
+	int err;
+
+	if (!aes || (n && (!bufv || !lenv || !ivv)))
+		return EINVAL;
+
+	if (aes->mode != AES_MODE_CTR || !aes->ecb)
+		return ENOTSUP;
+
+	for (i = 0; i < n; i++) {
+		uint64_t hi, lo;
+		size_t off = 0;
+
+		if (lenv[i] > AES_BATCH_MAXLEN) {
+
+			aes_set_iv(aes, ivv[i]);
+
+			err = aes_encr(aes, bufv[i], bufv[i], lenv[i]);
+			if (err)
+				return err;
+
+			continue;
+		}
+
+		hi = load_be64(&ivv[i][0]);
+		lo = load_be64(&ivv[i][8]);
+
+		while (off < lenv[i]) {
+			size_t len = min(lenv[i] - off,
+					 (BATCH_BLOCKS - nb) * AES_BLOCK_SIZE);
+			size_t k;
+
+			segv[segc].dst = bufv[i] + off;
+			segv[segc].len = len;
+			segv[segc].ks_off = nb * AES_BLOCK_SIZE;
+			++segc;
+
+			/* 128-bit big-endian counter */
+			for (k = 0; k < len; k += AES_BLOCK_SIZE) {
+				uint8_t *blk = &ks[nb++ * AES_BLOCK_SIZE];
+
+				store_be64(blk, hi);
+				store_be64(blk + 8, lo);
+				if (++lo == 0)
+					++hi;
+			}
+
+			off += len;
+
+			if (nb < BATCH_BLOCKS)
+				continue;
+
+			err = keystream_apply(aes, ks, nb, segv, segc);
+			if (err)
+				return err;
+
+			nb = segc = 0;
+		}
+	}
+
+	if (nb)
+		return keystream_apply(aes, ks, nb, segv, segc);
+
+	return 0;
+}
+
+
+/**
+ * Finish a GCM encryption and get the authentication tag
+ *
+ * @param aes    AES Context
+ * @param tag    Buffer for the authentication tag
+ * @param taglen Authentication tag length in bytes
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen)
+{
+#ifdef EVP_CIPH_GCM_MODE
+	uint8_t dummy[AES_BLOCK_SIZE];
+	int tmplen;
+
+	if (!aes || !tag || !taglen)
+		return EINVAL;
+
+	if (aes->mode != AES_MODE_GCM)
+		return ENOTSUP;
+
+	if (gcm_begin(aes, 1))
+		return EPROTO;
+
+	if (!EVP_EncryptFinal_ex(aes->ctx, dummy, &tmplen)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	if (!EVP_CIPHER_CTX_ctrl(aes->ctx, EVP_CTRL_GCM_GET_TAG,
+				 (int)taglen, tag)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	return 0;
+#else
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+	return ENOTSUP;
+#endif
+}
+
+
+/**
+ * Finish a GCM decryption and verify the authentication tag
+ *
+ * @param aes    AES Context
+ * @param tag    Received authentication tag
+ * @param taglen Authentication tag length in bytes
+ *
+ * @return 0 if authentic, EAUTH if not, otherwise errorcode
+ */
+int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
+{
+#ifdef EVP_CIPH_GCM_MODE
+	uint8_t dummy[AES_BLOCK_SIZE];
+	int tmplen;
+
+	if (!aes || !tag || !taglen)
 		return EINVAL;
 
-	if (!EVP_EncryptUpdate(&aes->ctx, out, &c_len, in, (int)len)) {
+	if (aes->mode != AES_MODE_GCM)
+		return ENOTSUP;
+
+	if (gcm_begin(aes, 0))
+		return EPROTO;
+
+	if (!EVP_CIPHER_CTX_ctrl(aes->ctx, EVP_CTRL_GCM_SET_TAG,
+				 (int)taglen, (void *)tag)) {
 		ERR_clear_error();
 		return EPROTO;
 	}
 
+	if (EVP_DecryptFinal_ex(aes->ctx, dummy, &tmplen) <= 0) {
+		ERR_clear_error();
+		return EAUTH;
+	}
+
 	return 0;
+#else
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+	return ENOTSUP;
+#endif
 }
 
 
@@ -181,15 +559,51 @@ int aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
 }
 
 
-#endif /* EVP_CIPH_CTR_MODE */
+int aes_decr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+{
+	return aes_encr(aes, out, in, len);
+}
 
 
-/*
- * Common code:
- */
+int aes_encr_batch(struct aes *aes, uint8_t * const bufv[],
+		   const size_t lenv[], const uint8_t ivv[][AES_BLOCK_SIZE],
+		   size_t n)
+{
+	size_t i;
+	int err;
 
+	if (!aes || (n && (!bufv || !lenv || !ivv)))
+		return EINVAL;
 
-int aes_decr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+	for (i = 0; i < n; i++) {
+
+		aes_set_iv(aes, ivv[i]);
+
+		err = aes_encr(aes, bufv[i], bufv[i], lenv[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+int aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen)
 {
-	return aes_encr(aes, out, in, len);
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+	return ENOTSUP;
+}
+
+
+int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
+{
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+	return ENOTSUP;
 }
+
+
+#endif /* EVP_CIPH_CTR_MODE */
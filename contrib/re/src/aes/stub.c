@@ -45,3 +45,34 @@ int aes_decr(struct aes *st, uint8_t *out, const uint8_t *in, size_t len)
 	(void)len;
 	return ENOSYS;
 }
+
+
+int aes_encr_batch(struct aes *aes, uint8_t * const bufv[],
+		   const size_t lenv[], const uint8_t ivv[][AES_BLOCK_SIZE],
+		   size_t n)
+{
+	(void)aes;
+	(void)bufv;
+	(void)lenv;
+	(void)ivv;
+	(void)n;
+	return ENOSYS;
+}
+
+
+int aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen)
+{
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+	return ENOSYS;
+}
+
+
+int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
+{
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+	return ENOSYS;
+}
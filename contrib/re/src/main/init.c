@@ -6,6 +6,7 @@
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_list.h>
+#include <re_mem.h>
 #include <re_net.h>
 #include <re_sys.h>
 #include <re_main.h>
@@ -58,4 +59,5 @@ void libre_close(void)
 #ifdef USE_OPENSSL
 	openssl_close();
 #endif
+	mem_pool_flush();
 }
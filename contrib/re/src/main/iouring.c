@@ -0,0 +1,579 @@
+/**
+ * @file iouring.c  io_uring specific routines
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#define _GNU_SOURCE 1
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_main.h>
+#include "main.h"
+
+
+#define DEBUG_MODULE "iouring"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+/*
+ * The fd_listen() contract is level-triggered: a handler may consume only
+ * part of the pending input and expects to be called again. Multishot poll
+ * only fires on new wakeups, so every fd is armed with a one-shot
+ * POLL_ADD instead, which completes immediately if the fd is already
+ * ready. Re-arms are queued after the handler ran and go to the kernel
+ * together with the next wait, i.e. one io_uring_enter() per loop.
+ *
+ * The user_data of each poll carries the fd and a per-fd generation, so
+ * that completions belonging to a previous fd_listen() of the same fd
+ * number are dropped.
+ */
+
+
+enum {
+	SQ_ENTRIES = 256,
+};
+
+#define UDATA_CANCEL ((uint64_t)~0ULL)
+
+
+#ifdef IORING_FEAT_EXT_ARG
+
+struct urfd {
+	uint32_t gen;
+	bool armed;
+};
+
+struct iouring {
+	int fd;
+
+	void *sq_ring;
+	size_t sq_ring_sz;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	struct io_uring_sqe *sqes;
+	size_t sqes_sz;
+	unsigned to_submit;
+
+	void *cq_ring;
+	size_t cq_ring_sz;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct urfd *fdv;
+	int maxfds;
+};
+
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete,
+		     unsigned flags, const void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, arg, argsz);
+}
+
+
+static void destructor(void *arg)
+{
+	struct iouring *ur = arg;
+
+	if (ur->sqes)
+		(void)munmap(ur->sqes, ur->sqes_sz);
+	if (ur->cq_ring && ur->cq_ring != ur->sq_ring)
+		(void)munmap(ur->cq_ring, ur->cq_ring_sz);
+	if (ur->sq_ring)
+		(void)munmap(ur->sq_ring, ur->sq_ring_sz);
+
+	if (ur->fd >= 0)
+		(void)close(ur->fd);
+
+	mem_deref(ur->fdv);
+}
+
+
+static int ring_map(struct iouring *ur, const struct io_uring_params *p)
+{
+	unsigned *sq_array;
+	uint8_t *sq, *cq;
+	unsigned i;
+
+	ur->sq_ring_sz = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+	ur->cq_ring_sz = p->cq_off.cqes +
+		p->cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP)
+		ur->sq_ring_sz = ur->cq_ring_sz = max(ur->sq_ring_sz,
+						      ur->cq_ring_sz);
+
+	sq = mmap(NULL, ur->sq_ring_sz, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		return errno;
+	ur->sq_ring = sq;
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	}
+	else {
+		cq = mmap(NULL, ur->cq_ring_sz, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ur->fd,
+			  IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			return errno;
+	}
+	ur->cq_ring = cq;
+
+	ur->sqes_sz = p->sq_entries * sizeof(struct io_uring_sqe);
+	ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+	if (ur->sqes == MAP_FAILED) {
+		ur->sqes = NULL;
+		return errno;
+	}
+
+	ur->sq_head    = (unsigned *)(void *)(sq + p->sq_off.head);
+	ur->sq_tail    = (unsigned *)(void *)(sq + p->sq_off.tail);
+	ur->sq_mask    = *(unsigned *)(void *)(sq + p->sq_off.ring_mask);
+	ur->sq_entries = p->sq_entries;
+
+	ur->cq_head = (unsigned *)(void *)(cq + p->cq_off.head);
+	ur->cq_tail = (unsigned *)(void *)(cq + p->cq_off.tail);
+	ur->cq_mask = *(unsigned *)(void *)(cq + p->cq_off.ring_mask);
+	ur->cqes    = (struct io_uring_cqe *)(void *)(cq + p->cq_off.cqes);
+
+	/* SQE slots are consumed in order, so the index array is fixed */
+	sq_array = (unsigned *)(void *)(sq + p->sq_off.array);
+	for (i=0; i<p->sq_entries; i++)
+		sq_array[i] = i;
+
+	return 0;
+}
+
+
+static int submit(struct iouring *ur)
+{
+	int r;
+
+	while (ur->to_submit) {
+
+		r = sys_enter(ur->fd, ur->to_submit, 0, 0, NULL, 0);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		ur->to_submit -= r;
+	}
+
+	return 0;
+}
+
+
+static struct io_uring_sqe *sqe_get(struct iouring *ur)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head, tail;
+
+	tail = *ur->sq_tail;
+	head = __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+
+	if (tail - head >= ur->sq_entries) {
+
+		if (submit(ur))
+			return NULL;
+
+		head = __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+		if (tail - head >= ur->sq_entries)
+			return NULL;
+	}
+
+	sqe = &ur->sqes[tail & ur->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+
+	return sqe;
+}
+
+
+static void sqe_push(struct iouring *ur)
+{
+	__atomic_store_n(ur->sq_tail, *ur->sq_tail + 1, __ATOMIC_RELEASE);
+	++ur->to_submit;
+}
+
+
+static inline uint64_t udata(int fd, uint32_t gen)
+{
+	return (uint64_t)gen << 32 | (uint32_t)fd;
+}
+
+
+static int poll_arm(struct iouring *ur, int fd, int flags)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t events = 0;
+
+	sqe = sqe_get(ur);
+	if (!sqe)
+		return EBUSY;
+
+	if (flags & FD_READ)
+		events |= POLLIN;
+	if (flags & FD_WRITE)
+		events |= POLLOUT;
+	if (flags & FD_EXCEPT)
+		events |= POLLERR;
+
+	sqe->opcode        = IORING_OP_POLL_ADD;
+	sqe->fd            = fd;
+	sqe->poll32_events = events;
+	sqe->user_data     = udata(fd, ur->fdv[fd].gen);
+
+	sqe_push(ur);
+
+	ur->fdv[fd].armed = true;
+
+	return 0;
+}
+
+
+static int poll_cancel(struct iouring *ur, int fd)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = sqe_get(ur);
+	if (!sqe)
+		return EBUSY;
+
+	sqe->opcode    = IORING_OP_POLL_REMOVE;
+	sqe->fd        = -1;
+	sqe->addr      = udata(fd, ur->fdv[fd].gen);
+	sqe->user_data = UDATA_CANCEL;
+
+	sqe_push(ur);
+
+	ur->fdv[fd].armed = false;
+
+	return 0;
+}
+
+
+/**
+ * Check for working io_uring kernel support
+ *
+ * @return true if support, false if not
+ */
+bool iouring_check(void)
+{
+	struct io_uring_params p;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+
+	fd = sys_setup(2, &p);
+	if (fd < 0) {
+		DEBUG_INFO("io_uring_setup: %m\n", errno);
+		return false;
+	}
+
+	(void)close(fd);
+
+	if (!(p.features & IORING_FEAT_EXT_ARG)) {
+		DEBUG_INFO("io_uring: kernel lacks EXT_ARG\n");
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Allocate an io_uring instance for polling file descriptors
+ *
+ * @param urp    Pointer to allocated io_uring instance
+ * @param maxfds Maximum number of file descriptors
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int iouring_alloc(struct iouring **urp, int maxfds)
+{
+	struct io_uring_params p;
+	struct iouring *ur;
+	int err;
+
+	if (!urp || maxfds <= 0)
+		return EINVAL;
+
+	ur = mem_zalloc(sizeof(*ur), destructor);
+	if (!ur)
+		return ENOMEM;
+
+	ur->fd = -1;
+	ur->maxfds = maxfds;
+
+	ur->fdv = mem_zalloc(maxfds * sizeof(*ur->fdv), NULL);
+	if (!ur->fdv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	/* room for one poll and one cancel completion per fd, clamped
+	 * to what the kernel allows, which keeps an overflow instead of
+	 * dropping it (IORING_FEAT_NODROP)
+	 */
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+	p.cq_entries = 2 * maxfds;
+
+	ur->fd = sys_setup(SQ_ENTRIES, &p);
+	if (ur->fd < 0) {
+		err = errno;
+		DEBUG_WARNING("io_uring_setup: %m\n", err);
+		goto out;
+	}
+
+	err = ring_map(ur, &p);
+	if (err) {
+		DEBUG_WARNING("io_uring mmap: %m\n", err);
+		goto out;
+	}
+
+	DEBUG_INFO("io_uring: fd=%d sq=%u cq=%u features=0x%x\n",
+		   ur->fd, p.sq_entries, p.cq_entries, p.features);
+
+ out:
+	if (err)
+		mem_deref(ur);
+	else
+		*urp = ur;
+
+	return err;
+}
+
+
+/**
+ * Set the wanted events for a file descriptor
+ *
+ * @param ur    io_uring instance
+ * @param fd    File descriptor
+ * @param flags Wanted event flags, 0 to stop polling
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int iouring_set(struct iouring *ur, int fd, int flags)
+{
+	int err = 0;
+
+	if (!ur || fd < 0 || fd >= ur->maxfds)
+		return EINVAL;
+
+	if (ur->fdv[fd].armed)
+		err = poll_cancel(ur, fd);
+
+	++ur->fdv[fd].gen;
+
+	if (!err && flags)
+		err = poll_arm(ur, fd, flags);
+
+	return err;
+}
+
+
+/**
+ * Re-arm a file descriptor after its event was handled
+ *
+ * @param ur    io_uring instance
+ * @param fd    File descriptor
+ * @param flags Wanted event flags
+ */
+void iouring_rearm(struct iouring *ur, int fd, int flags)
+{
+	int err;
+
+	if (!ur || fd < 0 || fd >= ur->maxfds)
+		return;
+
+	if (!flags || ur->fdv[fd].armed)
+		return;
+
+	err = poll_arm(ur, fd, flags);
+	if (err) {
+		DEBUG_WARNING("rearm: fd=%d (%m)\n", fd, err);
+	}
+}
+
+
+static int reap(struct iouring *ur, struct iouring_event *evv, int maxev)
+{
+	unsigned head, tail;
+	int n = 0;
+
+	head = *ur->cq_head;
+	tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail && n < maxev; head++) {
+
+		const struct io_uring_cqe *cqe = &ur->cqes[head & ur->cq_mask];
+		int fd, flags = 0;
+		uint32_t gen;
+
+		if (cqe->user_data == UDATA_CANCEL)
+			continue;
+
+		fd  = (int)(uint32_t)cqe->user_data;
+		gen = (uint32_t)(cqe->user_data >> 32);
+
+		if (fd < 0 || fd >= ur->maxfds || gen != ur->fdv[fd].gen)
+			continue;
+
+		ur->fdv[fd].armed = false;
+
+		if (cqe->res < 0) {
+			if (cqe->res == -ECANCELED)
+				continue;
+
+			DEBUG_WARNING("poll: fd=%d (%m)\n", fd, -cqe->res);
+
+			/* do not re-arm, the handler has to act */
+			evv[n].fd = fd;
+			evv[n].flags = FD_EXCEPT;
+			evv[n].rearm = false;
+			++n;
+			continue;
+		}
+
+		if (cqe->res & POLLIN)
+			flags |= FD_READ;
+		if (cqe->res & POLLOUT)
+			flags |= FD_WRITE;
+		if (cqe->res & (POLLERR|POLLHUP|POLLNVAL))
+			flags |= FD_EXCEPT;
+
+		evv[n].fd = fd;
+		evv[n].flags = flags;
+		evv[n].rearm = !(cqe->res & POLLNVAL);
+		++n;
+	}
+
+	__atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+
+/**
+ * Submit pending requests and wait for events
+ *
+ * @param ur    io_uring instance
+ * @param evv   Event vector
+ * @param maxev Size of event vector
+ * @param to    Timeout in [ms], 0 to wait forever
+ *
+ * @return Number of events, or -1 on error with errno set
+ */
+int iouring_wait(struct iouring *ur, struct iouring_event *evv, int maxev,
+		 uint64_t to)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned flags = IORING_ENTER_GETEVENTS;
+	int n, r;
+
+	if (!ur || !evv || maxev <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	n = reap(ur, evv, maxev);
+	if (n > 0) {
+		if (submit(ur))
+			return -1;
+		return n;
+	}
+
+	memset(&arg, 0, sizeof(arg));
+	if (to) {
+		ts.tv_sec  = (int64_t)(to / 1000);
+		ts.tv_nsec = (long long)(to % 1000) * 1000000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+	}
+	flags |= IORING_ENTER_EXT_ARG;
+
+	r = sys_enter(ur->fd, ur->to_submit, 1, flags, &arg, sizeof(arg));
+	if (r < 0) {
+		if (errno != ETIME && errno != EINTR && errno != EBUSY)
+			return -1;
+	}
+	else {
+		ur->to_submit -= r;
+	}
+
+	/* SQEs left over after an interrupted wait go out with the next */
+	return reap(ur, evv, maxev);
+}
+
+
+#else
+
+
+bool iouring_check(void)
+{
+	DEBUG_INFO("io_uring: built without EXT_ARG support\n");
+	return false;
+}
+
+
+int iouring_alloc(struct iouring **urp, int maxfds)
+{
+	(void)urp;
+	(void)maxfds;
+	return ENOSYS;
+}
+
+
+int iouring_set(struct iouring *ur, int fd, int flags)
+{
+	(void)ur;
+	(void)fd;
+	(void)flags;
+	return ENOSYS;
+}
+
+
+void iouring_rearm(struct iouring *ur, int fd, int flags)
+{
+	(void)ur;
+	(void)fd;
+	(void)flags;
+}
+
+
+int iouring_wait(struct iouring *ur, struct iouring_event *evv, int maxev,
+		 uint64_t to)
+{
+	(void)ur;
+	(void)evv;
+	(void)maxev;
+	(void)to;
+	errno = ENOSYS;
+	return -1;
+}
+
+
+#endif
@@ -101,6 +101,9 @@ struct re {
 	bool polling;                /**< Is polling flag                   */
 	int sig;                     /**< Last caught signal                */
 	struct list tmrl;            /**< List of timers                    */
+#ifdef USE_TMR_WHEEL
+	struct tmrw *tmrw;           /**< Hierarchical timer wheel          */
+#endif
 
 #ifdef HAVE_POLL
 	struct pollfd *fds;          /**< Event set for poll()              */
@@ -116,6 +119,11 @@ struct re {
 	int kqfd;
 #endif
 
+#ifdef HAVE_IO_URING
+	struct iouring *ur;          /**< io_uring instance                 */
+	struct iouring_event *urev;  /**< Event set for io_uring            */
+#endif
+
 #ifdef HAVE_PTHREAD
 	pthread_mutex_t mutex;       /**< Mutex for thread synchronization  */
 	pthread_mutex_t *mutexp;     /**< Pointer to active mutex           */
@@ -131,6 +139,9 @@ static struct re global_re = {
 	false,
 	0,
 	LIST_INIT,
+#ifdef USE_TMR_WHEEL
+	NULL,
+#endif
 #ifdef HAVE_POLL
 	NULL,
 #endif
@@ -142,6 +153,10 @@ static struct re global_re = {
 	NULL,
 	-1,
 #endif
+#ifdef HAVE_IO_URING
+	NULL,
+	NULL,
+#endif
 #ifdef HAVE_PTHREAD
 #if MAIN_DEBUG && defined (PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP)
 	PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP,
@@ -413,6 +428,12 @@ static int rebuild_fds(struct re *re)
 			break;
 #endif
 
+#ifdef HAVE_IO_URING
+		case METHOD_IOURING:
+			err = iouring_set(re->ur, i, re->fhs[i].flags);
+			break;
+#endif
+
 		default:
 			break;
 		}
@@ -490,6 +511,32 @@ static int poll_init(struct re *re)
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IOURING:
+		if (!re->urev) {
+			size_t sz = re->maxfds * sizeof(*re->urev);
+			re->urev = mem_zalloc(sz, NULL);
+			if (!re->urev)
+				return ENOMEM;
+		}
+
+		if (!re->ur) {
+			int err = iouring_alloc(&re->ur, re->maxfds);
+			if (err) {
+#ifdef HAVE_EPOLL
+				DEBUG_WARNING("io_uring: %m,"
+					      " falling back to epoll\n", err);
+				re->urev = mem_deref(re->urev);
+				re->method = METHOD_EPOLL;
+				return poll_init(re);
+#else
+				return err;
+#endif
+			}
+		}
+		break;
+#endif
+
 	default:
 		break;
 	}
@@ -527,6 +574,11 @@ static void poll_close(struct re *re)
 
 	re->evlist = mem_deref(re->evlist);
 #endif
+
+#ifdef HAVE_IO_URING
+	re->ur   = mem_deref(re->ur);
+	re->urev = mem_deref(re->urev);
+#endif
 }
 
 
@@ -625,6 +677,14 @@ int fd_listen(int fd, int flags, fd_h *fh, void *arg)
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IOURING:
+		if (!re->ur)
+			return EBADFD;
+		err = iouring_set(re->ur, fd, flags);
+		break;
+#endif
+
 	default:
 		break;
 	}
@@ -736,6 +796,14 @@ static int fd_poll(struct re *re)
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IOURING:
+		re_unlock(re);
+		n = iouring_wait(re->ur, re->urev, re->maxfds, to);
+		re_lock(re);
+		break;
+#endif
+
 	default:
 		(void)to;
 		DEBUG_WARNING("no polling method set\n");
@@ -837,6 +905,13 @@ static int fd_poll(struct re *re)
 			break;
 #endif
 
+#ifdef HAVE_IO_URING
+		case METHOD_IOURING:
+			fd    = re->urev[i].fd;
+			flags = re->urev[i].flags;
+			break;
+#endif
+
 		default:
 			return EINVAL;
 		}
@@ -852,6 +927,12 @@ static int fd_poll(struct re *re)
 #endif
 		}
 
+#ifdef HAVE_IO_URING
+		/* One-shot polls must be re-armed once handled */
+		if (METHOD_IOURING == re->method && re->urev[i].rearm)
+			iouring_rearm(re->ur, fd, re->fhs[fd].flags);
+#endif
+
 		/* Check if polling method was changed */
 		if (re->update) {
 			re->update = false;
@@ -879,6 +960,10 @@ int fd_setsize(int maxfds)
 	if (!maxfds) {
 		fd_debug();
 		poll_close(re);
+#ifdef USE_TMR_WHEEL
+		tmrw_free(re->tmrw);
+		re->tmrw = NULL;
+#endif
 		return 0;
 	}
 
@@ -1100,6 +1185,12 @@ int poll_method_set(enum poll_method method)
 #ifdef HAVE_KQUEUE
 	case METHOD_KQUEUE:
 		break;
+#endif
+#ifdef HAVE_IO_URING
+	case METHOD_IOURING:
+		if (!iouring_check())
+			return EINVAL;
+		break;
 #endif
 	default:
 		DEBUG_WARNING("poll method not supported: '%s'\n",
@@ -1117,7 +1208,12 @@ int poll_method_set(enum poll_method method)
 	if (err)
 		return err;
 
-	return rebuild_fds(re);
+	err = rebuild_fds(re);
+	if (err)
+		return err;
+
+	/* poll_init() falls back to epoll if io_uring cannot be set up */
+	return re->method == method ? 0 : ENOTSUP;
 }
 
 
@@ -1177,6 +1273,9 @@ void re_thread_close(void)
 	re = pthread_getspecific(pt_key);
 	if (re) {
 		poll_close(re);
+#ifdef USE_TMR_WHEEL
+		tmrw_free(re->tmrw);
+#endif
 		free(re);
 		pthread_setspecific(pt_key, NULL);
 	}
@@ -1235,3 +1334,19 @@ struct list *tmrl_get(void)
 {
 	return &re_get()->tmrl;
 }
+
+
+#ifdef USE_TMR_WHEEL
+/**
+ * Get the timer wheel for this thread
+ *
+ * @return Pointer to the timer wheel, allocated on first use
+ *
+ * @note only used by tmr module
+ */
+struct tmrw **tmrw_get(void);
+struct tmrw **tmrw_get(void)
+{
+	return &re_get()->tmrw;
+}
+#endif
@@ -10,6 +10,25 @@ bool epoll_check(void);
 #endif
 
 
+#ifdef HAVE_IO_URING
+struct iouring;
+
+/** An event harvested from the io_uring completion queue */
+struct iouring_event {
+	int fd;      /**< File descriptor                   */
+	int flags;   /**< Event flags (FD_READ etc.)        */
+	bool rearm;  /**< Re-arm the poll after handling    */
+};
+
+bool iouring_check(void);
+int  iouring_alloc(struct iouring **urp, int maxfds);
+int  iouring_set(struct iouring *ur, int fd, int flags);
+void iouring_rearm(struct iouring *ur, int fd, int flags);
+int  iouring_wait(struct iouring *ur, struct iouring_event *evv, int maxev,
+		  uint64_t to);
+#endif
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -21,6 +40,11 @@ void actsched_stop(void);
 void actsched_restart_timer(void);
 #endif
 
+#ifdef USE_TMR_WHEEL
+struct tmrw;
+void tmrw_free(struct tmrw *tmrw);
+#endif
+
 #ifdef USE_OPENSSL
 int  openssl_init(void);
 void openssl_close(void);
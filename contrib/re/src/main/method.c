@@ -15,6 +15,7 @@ static const char str_select[] = "select";   /**< POSIX.1-2001 select     */
 static const char str_epoll[]  = "epoll";    /**< Linux epoll             */
 static const char str_as[]     = "actsched"; /**< Symbian ActiveScheduler */
 static const char str_kqueue[] = "kqueue";
+static const char str_iouring[] = "io_uring"; /**< Linux io_uring     */
 
 
 /**
@@ -34,6 +35,14 @@ enum poll_method poll_method_best(void)
 	}
 #endif
 
+#ifdef HAVE_IO_URING
+	/* Only where there is no epoll, use poll_method_set() to try it */
+	if (METHOD_NULL == m) {
+		if (iouring_check())
+			m = METHOD_IOURING;
+	}
+#endif
+
 #ifdef HAVE_KQUEUE
 	if (METHOD_NULL == m) {
 		m = METHOD_KQUEUE;
@@ -76,6 +85,7 @@ const char *poll_method_name(enum poll_method method)
 	case METHOD_EPOLL:     return str_epoll;
 	case METHOD_ACTSCHED:  return str_as;
 	case METHOD_KQUEUE:    return str_kqueue;
+	case METHOD_IOURING:   return str_iouring;
 	default:               return "???";
 	}
 }
@@ -104,6 +114,8 @@ int poll_method_type(enum poll_method *method, const struct pl *name)
 		*method = METHOD_ACTSCHED;
 	else if (0 == pl_strcasecmp(name, str_kqueue))
 		*method = METHOD_KQUEUE;
+	else if (0 == pl_strcasecmp(name, str_iouring))
+		*method = METHOD_IOURING;
 	else
 		return ENOENT;
 
@@ -37,10 +37,12 @@ struct mbuf *mbuf_alloc(size_t size)
 {
 	struct mbuf *mb;
 
-	mb = mem_zalloc(sizeof(*mb), mbuf_destructor);
+	mb = mem_pool_alloc(sizeof(*mb), mbuf_destructor);
 	if (!mb)
 		return NULL;
 
+	mbuf_init(mb);
+
 	if (mbuf_resize(mb, size ? size : DEFAULT_SIZE))
 		return mem_deref(mb);
 
@@ -62,7 +64,7 @@ struct mbuf *mbuf_alloc_ref(struct mbuf *mbr)
 	if (!mbr)
 		return NULL;
 
-	mb = mem_zalloc(sizeof(*mb), mbuf_destructor);
+	mb = mem_pool_alloc(sizeof(*mb), mbuf_destructor);
 	if (!mb)
 		return NULL;
 
@@ -122,7 +124,8 @@ int mbuf_resize(struct mbuf *mb, size_t size)
 	if (!mb)
 		return EINVAL;
 
-	buf = mb->buf ? mem_realloc(mb->buf, size) : mem_alloc(size, NULL);
+	buf = mb->buf ? mem_realloc(mb->buf, size)
+		: mem_pool_alloc(size, NULL);
 	if (!buf)
 		return ENOMEM;
 
@@ -29,6 +29,9 @@
 /** Defines a reference-counting memory object */
 struct mem {
 	uint32_t nrefs;     /**< Number of references  */
+#ifdef USE_MEM_POOL
+	uint32_t cls;       /**< Pool size class       */
+#endif
 	mem_destroy_h *dh;  /**< Destroy handler       */
 #if MEM_DEBUG
 	struct le le;       /**< Linked list element   */
@@ -117,15 +120,387 @@ static inline void mem_unlock(void)
 #endif
 
 
-/**
- * Allocate a new reference-counted memory object
+#ifdef USE_MEM_POOL
+/*
+ * Size-class pool for mem_pool_alloc(), used by the packet path (mbuf).
+ * Blocks up to POOL_MAXSIZE are rounded up to a power of two and recycled
+ * through a per-thread free list instead of going back to malloc.
  *
- * @param size Size of memory object
- * @param dh   Optional destructor, called when destroyed
+ * A block may be freed on any thread; it then simply ends up in that
+ * thread's cache. Threads that mostly free (e.g. the re thread sending
+ * packets produced by an encoder thread) hand a full cache as one
+ * magazine to a shared depot, where threads that mostly allocate pick it
+ * up again, both in O(1). The free lists are linked through the payload;
+ * the first block of a magazine also carries the magazine header.
  *
- * @return Pointer to allocated object
+ * Only thread-local data is touched per block; the hit and miss counters
+ * are folded into the shared statistics now and then.
  */
-void *mem_alloc_rl(size_t size, mem_destroy_h *dh, const char *f, int l)
+
+enum {
+	POOL_MINSHIFT = 6,                 /**< Smallest class is 64 bytes  */
+	POOL_CLASSES  = 7,                 /**< 64 .. 4096 bytes            */
+	POOL_MAXSIZE  = 1 << (POOL_MINSHIFT + POOL_CLASSES - 1),
+	POOL_DEPTH    = 256,               /**< Max cached blocks per class */
+	POOL_DEPOT    = 4,                 /**< Max magazines per class     */
+	POOL_NONE     = POOL_CLASSES,      /**< Block is not pooled         */
+};
+
+struct pool_cache {
+	struct mem *freel[POOL_CLASSES];
+	uint32_t n[POOL_CLASSES];
+	size_t hits[POOL_CLASSES];
+	size_t misses[POOL_CLASSES];
+};
+
+/** Payload of a free block; only the first block of a magazine uses mag */
+struct pool_link {
+	struct mem *next;
+	struct {
+		struct mem *next;
+		uint32_t n;
+	} mag;
+};
+
+/** Shared depot of magazines, protected by pool_lock() */
+static struct {
+	struct mem *magl;
+	uint32_t n;
+} pool_depot[POOL_CLASSES];
+
+static struct pool_stat {
+	size_t hits;
+	size_t misses;
+	size_t released;
+} pool_statv[POOL_CLASSES];
+
+#define POOL_STAT_ADD(cls, field, v) \
+	(void)__atomic_add_fetch(&pool_statv[cls].field, (v), __ATOMIC_RELAXED)
+
+#ifdef HAVE_PTHREAD
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  pool_key;
+
+static inline void pool_lock(void)
+{
+	pthread_mutex_lock(&pool_mutex);
+}
+
+
+static inline void pool_unlock(void)
+{
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+
+static void pool_cache_flush(struct pool_cache *pc);
+
+static void pool_cache_destructor(void *arg)
+{
+	struct pool_cache *pc = arg;
+
+	pool_cache_flush(pc);
+	free(pc);
+}
+
+
+static void pool_once_handler(void)
+{
+	(void)pthread_key_create(&pool_key, pool_cache_destructor);
+}
+
+
+static struct pool_cache *pool_cache_get(void)
+{
+	struct pool_cache *pc;
+
+	pthread_once(&pool_once, pool_once_handler);
+
+	pc = pthread_getspecific(pool_key);
+	if (!pc) {
+		pc = calloc(1, sizeof(*pc));
+		if (pc && pthread_setspecific(pool_key, pc)) {
+			free(pc);
+			pc = NULL;
+		}
+	}
+
+	return pc;
+}
+
+#else
+
+static struct pool_cache pool_cache;
+
+#define pool_lock()    /**< Stub */
+#define pool_unlock()  /**< Stub */
+
+static inline struct pool_cache *pool_cache_get(void)
+{
+	return &pool_cache;
+}
+
+#endif
+
+
+static inline struct pool_link *pool_lnk(struct mem *m)
+{
+	return (struct pool_link *)(void *)(m + 1);
+}
+
+
+static inline void pool_stat_fold(struct pool_cache *pc, uint32_t cls)
+{
+	if (pc->hits[cls]) {
+		POOL_STAT_ADD(cls, hits, pc->hits[cls]);
+		pc->hits[cls] = 0;
+	}
+	if (pc->misses[cls]) {
+		POOL_STAT_ADD(cls, misses, pc->misses[cls]);
+		pc->misses[cls] = 0;
+	}
+}
+
+
+/* Refill an empty thread cache with a magazine from the depot */
+static void pool_depot_get(struct pool_cache *pc, uint32_t cls)
+{
+	struct mem *mag;
+
+	/* unlocked peek, so that misses do not contend on the lock */
+	if (!__atomic_load_n(&pool_depot[cls].n, __ATOMIC_RELAXED))
+		return;
+
+	pool_stat_fold(pc, cls);
+
+	pool_lock();
+
+	mag = pool_depot[cls].magl;
+	if (mag) {
+		pool_depot[cls].magl = pool_lnk(mag)->mag.next;
+		__atomic_store_n(&pool_depot[cls].n, pool_depot[cls].n - 1,
+				 __ATOMIC_RELAXED);
+	}
+
+	pool_unlock();
+
+	if (!mag)
+		return;
+
+	pc->freel[cls] = mag;
+	pc->n[cls]     = pool_lnk(mag)->mag.n;
+}
+
+
+/* Hand a full thread cache to the depot, or to the system */
+static void pool_depot_put(struct pool_cache *pc, uint32_t cls)
+{
+	struct mem *mag = pc->freel[cls];
+	const uint32_t n = pc->n[cls];
+
+	pool_stat_fold(pc, cls);
+
+	pc->freel[cls] = NULL;
+	pc->n[cls]     = 0;
+
+	pool_lock();
+
+	if (pool_depot[cls].n < POOL_DEPOT) {
+		pool_lnk(mag)->mag.next = pool_depot[cls].magl;
+		pool_lnk(mag)->mag.n    = n;
+		pool_depot[cls].magl = mag;
+		__atomic_store_n(&pool_depot[cls].n, pool_depot[cls].n + 1,
+				 __ATOMIC_RELAXED);
+		mag = NULL;
+	}
+
+	pool_unlock();
+
+	if (!mag)
+		return;
+
+	while (mag) {
+		struct mem *m = mag;
+
+		mag = pool_lnk(m)->next;
+		free(m);
+	}
+
+	POOL_STAT_ADD(cls, released, n);
+}
+
+
+static inline uint32_t pool_class(size_t size)
+{
+	uint32_t cls = 0;
+
+	if (size > POOL_MAXSIZE)
+		return POOL_NONE;
+
+	while (size > ((size_t)1 << (POOL_MINSHIFT + cls)))
+		++cls;
+
+	return cls;
+}
+
+
+static inline size_t pool_size(uint32_t cls)
+{
+	return (size_t)1 << (POOL_MINSHIFT + cls);
+}
+
+
+static struct mem *pool_alloc(size_t size)
+{
+	const uint32_t cls = pool_class(size);
+	struct pool_cache *pc;
+	struct mem *m;
+
+	if (cls == POOL_NONE) {
+		m = malloc(sizeof(*m) + size);
+		if (m)
+			m->cls = POOL_NONE;
+		return m;
+	}
+
+	pc = pool_cache_get();
+	if (pc && !pc->freel[cls])
+		pool_depot_get(pc, cls);
+
+	if (pc && pc->freel[cls]) {
+
+		m = pc->freel[cls];
+		pc->freel[cls] = pool_lnk(m)->next;
+		--pc->n[cls];
+		++pc->hits[cls];
+	}
+	else {
+		m = malloc(sizeof(*m) + pool_size(cls));
+		if (!m)
+			return NULL;
+
+		if (!pc)
+			POOL_STAT_ADD(cls, misses, 1);
+		else if (++pc->misses[cls] >= POOL_DEPTH)
+			pool_stat_fold(pc, cls);
+	}
+
+	m->cls = cls;
+
+	return m;
+}
+
+
+static void pool_free(struct mem *m, uint32_t cls)
+{
+	struct pool_cache *pc;
+
+	if (cls == POOL_NONE) {
+		free(m);
+		return;
+	}
+
+	pc = pool_cache_get();
+	if (!pc) {
+		free(m);
+		POOL_STAT_ADD(cls, released, 1);
+		return;
+	}
+
+	if (pc->n[cls] >= POOL_DEPTH)
+		pool_depot_put(pc, cls);
+
+	pool_lnk(m)->next = pc->freel[cls];
+	pc->freel[cls] = m;
+	++pc->n[cls];
+}
+
+
+static void pool_cache_flush(struct pool_cache *pc)
+{
+	uint32_t cls;
+
+	if (!pc)
+		return;
+
+	for (cls=0; cls<POOL_CLASSES; cls++) {
+
+		pool_stat_fold(pc, cls);
+
+		while (pc->freel[cls]) {
+			struct mem *m = pc->freel[cls];
+
+			pc->freel[cls] = pool_lnk(m)->next;
+			free(m);
+
+			POOL_STAT_ADD(cls, released, 1);
+		}
+
+		pc->n[cls] = 0;
+	}
+}
+
+
+/* A pooled block can grow in place up to the size of its class */
+static struct mem *pool_realloc(struct mem *m, size_t size)
+{
+	struct mem *m2;
+	uint32_t cls;
+	size_t cap;
+
+	if (m->cls == POOL_NONE) {
+		m2 = realloc(m, sizeof(*m2) + size);
+		if (m2)
+			m2->cls = POOL_NONE;
+		return m2;
+	}
+
+	cap = pool_size(m->cls);
+	if (size <= cap)
+		return m;
+
+	m2 = pool_alloc(size);
+	if (!m2)
+		return NULL;
+
+	cls = m2->cls;
+	memcpy(m2, m, sizeof(*m) + cap);
+	m2->cls = cls;
+
+	pool_free(m, m->cls);
+
+	return m2;
+}
+
+
+static struct mem *mem_block_alloc(size_t size, bool pool)
+{
+	struct mem *m;
+
+	if (pool)
+		return pool_alloc(size);
+
+	m = malloc(sizeof(*m) + size);
+	if (m)
+		m->cls = POOL_NONE;
+
+	return m;
+}
+
+#define mem_block_realloc(m, size) pool_realloc((m), (size))
+#define mem_block_free(m, cls)     pool_free((m), (cls))
+#else
+#define mem_block_alloc(size, pool) \
+	((void)(pool), malloc(sizeof(struct mem) + (size)))
+#define mem_block_realloc(m, size) realloc((m), sizeof(struct mem) + (size))
+#define mem_block_free(m, cls)     free(m)
+#endif
+
+
+static void *alloc_rl(size_t size, mem_destroy_h *dh, bool pool,
+		      const char *f, int l)
 {
 	struct mem *m;
 
@@ -138,7 +513,7 @@ void *mem_alloc_rl(size_t size, mem_destroy_h *dh, const char *f, int l)
 	mem_unlock();
 #endif
 
-	m = malloc(sizeof(*m) + size);
+	m = mem_block_alloc(size, pool);
 	if (!m)
 		return NULL;
 
@@ -160,6 +535,40 @@ void *mem_alloc_rl(size_t size, mem_destroy_h *dh, const char *f, int l)
 }
 
 
+/**
+ * Allocate a new reference-counted memory object
+ *
+ * @param size Size of memory object
+ * @param dh   Optional destructor, called when destroyed
+ *
+ * @return Pointer to allocated object
+ */
+void *mem_alloc_rl(size_t size, mem_destroy_h *dh, const char *f, int l)
+{
+	return alloc_rl(size, dh, false, f, l);
+}
+
+
+/**
+ * Allocate a new reference-counted memory object from the memory pool.
+ * Intended for short-lived objects on hot paths, such as packet buffers.
+ * Without USE_MEM_POOL this is the same as mem_alloc().
+ *
+ * @param size Size of memory object
+ * @param dh   Optional destructor, called when destroyed
+ *
+ * @return Pointer to allocated object
+ */
+void *mem_pool_alloc_rl(size_t size, mem_destroy_h *dh, const char *f, int l)
+{
+#ifdef USE_MEM_POOL
+	return alloc_rl(size, dh, true, f, l);
+#else
+	return alloc_rl(size, dh, false, f, l);
+#endif
+}
+
+
 /**
  * Allocate a new reference-counted memory object. Memory is zeroed.
  *
@@ -218,7 +627,7 @@ void *mem_realloc_rl(void *data, size_t size, const char *f, int l)
 	mem_unlock();
 #endif
 
-	m2 = realloc(m, sizeof(*m2) + size);
+	m2 = mem_block_realloc(m, size);
 
 #if MEM_DEBUG
 	mem_lock();
@@ -307,6 +716,9 @@ void *mem_ref(void *data)
 void *mem_deref(void *data)
 {
 	struct mem *m;
+#ifdef USE_MEM_POOL
+	uint32_t cls;
+#endif
 
 	if (!data)
 		return NULL;
@@ -331,9 +743,13 @@ void *mem_deref(void *data)
 	mem_unlock();
 #endif
 
+#ifdef USE_MEM_POOL
+	cls = m->cls;  /* the header is poisoned by STAT_DEREF */
+#endif
+
 	STAT_DEREF(m);
 
-	free(m);
+	mem_block_free(m, cls);
 
 	return NULL;
 }
@@ -405,6 +821,32 @@ static bool debug_handler(struct le *le, void *arg)
 #endif
 
 
+#ifdef USE_MEM_POOL
+static int pool_status(struct re_printf *pf, void *unused)
+{
+	struct mempool_stat statv[POOL_CLASSES];
+	size_t i, n = POOL_CLASSES;
+	int err;
+
+	(void)unused;
+
+	(void)mem_pool_stat(statv, &n);
+
+	err = re_hprintf(pf, "Memory pool:   size       hits     misses"
+			 "    depot   released\n");
+
+	for (i=0; i<n; i++) {
+		err |= re_hprintf(pf, "            %6zu %10zu %10zu %8zu %10zu\n",
+				  statv[i].size, statv[i].hits,
+				  statv[i].misses, statv[i].depot,
+				  statv[i].released);
+	}
+
+	return err;
+}
+#endif
+
+
 /**
  * Debug all allocated memory objects
  */
@@ -412,7 +854,13 @@ void mem_debug(void)
 {
 #if MEM_DEBUG
 	uint32_t n;
+#endif
+
+#ifdef USE_MEM_POOL
+	(void)re_fprintf(stderr, "%H", pool_status, NULL);
+#endif
 
+#if MEM_DEBUG
 	mem_lock();
 	n = list_count(&meml);
 	mem_unlock();
@@ -482,6 +930,9 @@ int mem_status(struct re_printf *pf, void *unused)
 	err |= re_hprintf(pf, " Block size: min=%u, max=%u\n",
 			  stat.size_min, stat.size_max);
 	err |= re_hprintf(pf, " Total %u blocks allocated\n", c);
+#ifdef USE_MEM_POOL
+	err |= pool_status(pf, NULL);
+#endif
 
 	return err;
 #else
@@ -512,3 +963,93 @@ int mem_get_stat(struct memstat *mstat)
 	return ENOSYS;
 #endif
 }
+
+
+/**
+ * Get the statistics of the memory pool, one entry per size class
+ *
+ * @param statv Array of returned statistics
+ * @param n     Size of array on input, number of entries on output
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mem_pool_stat(struct mempool_stat *statv, size_t *n)
+{
+#ifdef USE_MEM_POOL
+	struct pool_cache *pc;
+	size_t i;
+
+	if (!statv || !n)
+		return EINVAL;
+
+	*n = min(*n, (size_t)POOL_CLASSES);
+
+	/* other threads fold their hits on their next slow path */
+	pc = pool_cache_get();
+	for (i=0; pc && i<POOL_CLASSES; i++)
+		pool_stat_fold(pc, (uint32_t)i);
+
+	pool_lock();
+	for (i=0; i<*n; i++) {
+		struct mem *mag;
+
+		statv[i].depot = 0;
+		for (mag = pool_depot[i].magl; mag;
+		     mag = pool_lnk(mag)->mag.next)
+			statv[i].depot += pool_lnk(mag)->mag.n;
+	}
+	pool_unlock();
+
+	for (i=0; i<*n; i++) {
+		struct pool_stat *ps = &pool_statv[i];
+
+		statv[i].size     = pool_size((uint32_t)i);
+		statv[i].hits     = __atomic_load_n(&ps->hits,
+						    __ATOMIC_RELAXED);
+		statv[i].misses   = __atomic_load_n(&ps->misses,
+						    __ATOMIC_RELAXED);
+		statv[i].released = __atomic_load_n(&ps->released,
+						    __ATOMIC_RELAXED);
+	}
+
+	return 0;
+#else
+	(void)statv;
+	(void)n;
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Return the memory pool cache of the calling thread to the system
+ */
+void mem_pool_flush(void)
+{
+#ifdef USE_MEM_POOL
+	struct pool_cache tmp;
+	struct mem *magv[POOL_CLASSES];
+	uint32_t cls;
+
+	pool_cache_flush(pool_cache_get());
+
+	pool_lock();
+	for (cls=0; cls<POOL_CLASSES; cls++) {
+		magv[cls] = pool_depot[cls].magl;
+		pool_depot[cls].magl = NULL;
+		pool_depot[cls].n = 0;
+	}
+	pool_unlock();
+
+	memset(&tmp, 0, sizeof(tmp));
+
+	for (cls=0; cls<POOL_CLASSES; cls++) {
+
+		while (magv[cls]) {
+			tmp.freel[cls] = magv[cls];
+			magv[cls] = pool_lnk(magv[cls])->mag.next;
+			pool_cache_flush(&tmp);
+		}
+	}
+#endif
+}
@@ -4,6 +4,9 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <unistd.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_mem.h>
@@ -29,6 +32,30 @@
  * receiving thread must run the re_main() loop which will be woken up on
  * incoming messages from other threads. The sender thread can be any thread.
  */
+#ifdef HAVE_EVENTFD
+
+/*
+ * Linux backend: producers push messages onto a lock-free stack and
+ * only the push that finds the stack empty writes to the eventfd. The
+ * consumer takes the whole stack at once and handles the batch in
+ * order of pushing.
+ */
+
+struct mqueue {
+	int efd;
+	struct msg *head;
+	mqueue_h *h;
+	void *arg;
+};
+
+struct msg {
+	struct msg *next;
+	int id;
+	void *data;
+};
+
+#else
+
 struct mqueue {
 	int pfd[2];
 	mqueue_h *h;
@@ -41,6 +68,169 @@ struct msg {
 	uint32_t magic;
 };
 
+#endif
+
+
+#ifdef HAVE_EVENTFD
+
+static void msg_flush(struct msg *msg)
+{
+	while (msg) {
+		struct msg *next = msg->next;
+
+		mem_deref(msg);
+		msg = next;
+	}
+}
+
+
+static void destructor(void *arg)
+{
+	struct mqueue *q = arg;
+
+	if (q->efd >= 0) {
+		fd_close(q->efd);
+		(void)close(q->efd);
+	}
+
+	msg_flush(q->head);
+}
+
+
+static void event_handler(int flags, void *arg)
+{
+	struct mqueue *mq = arg;
+	struct msg *msg, *prev = NULL;
+	uint64_t cnt;
+
+	if (!(flags & FD_READ))
+		return;
+
+	/* Clear the eventfd before taking the stack, so that a push
+	 * racing with us signals a new wakeup.
+	 */
+	if (read(mq->efd, &cnt, sizeof(cnt)) < 0)
+		return;
+
+	msg = __atomic_exchange_n(&mq->head, NULL, __ATOMIC_ACQUIRE);
+
+	/* the stack is LIFO, reverse it */
+	while (msg) {
+		struct msg *next = msg->next;
+
+		msg->next = prev;
+		prev = msg;
+		msg = next;
+	}
+	msg = prev;
+
+	/* A handler may drop the last reference to the queue */
+	mem_ref(mq);
+
+	while (msg) {
+		struct msg *next = msg->next;
+
+		if (mem_nrefs(mq) > 1)
+			mq->h(msg->id, msg->data, mq->arg);
+
+		mem_deref(msg);
+		msg = next;
+	}
+
+	mem_deref(mq);
+}
+
+
+/**
+ * Allocate a new Message Queue
+ *
+ * @param mqp Pointer to allocated Message Queue
+ * @param h   Message handler
+ * @param arg Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mqueue_alloc(struct mqueue **mqp, mqueue_h *h, void *arg)
+{
+	struct mqueue *mq;
+	int err = 0;
+
+	if (!mqp || !h)
+		return EINVAL;
+
+	mq = mem_zalloc(sizeof(*mq), destructor);
+	if (!mq)
+		return ENOMEM;
+
+	mq->h   = h;
+	mq->arg = arg;
+
+	mq->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (mq->efd < 0) {
+		err = errno;
+		goto out;
+	}
+
+	err = fd_listen(mq->efd, FD_READ, event_handler, mq);
+	if (err)
+		goto out;
+
+ out:
+	if (err)
+		mem_deref(mq);
+	else
+		*mqp = mq;
+
+	return err;
+}
+
+
+/**
+ * Push a new message onto the Message Queue
+ *
+ * @param mq   Message Queue
+ * @param id   General purpose Identifier
+ * @param data Application data
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mqueue_push(struct mqueue *mq, int id, void *data)
+{
+	struct msg *msg, *head;
+	uint64_t one = 1;
+
+	if (!mq)
+		return EINVAL;
+
+	msg = mem_alloc(sizeof(*msg), NULL);
+	if (!msg)
+		return ENOMEM;
+
+	msg->id   = id;
+	msg->data = data;
+
+	head = __atomic_load_n(&mq->head, __ATOMIC_RELAXED);
+	do {
+		msg->next = head;
+	} while (!__atomic_compare_exchange_n(&mq->head, &head, msg, true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+	/* empty -> non-empty: wake up the consumer. The message is on
+	 * the stack already and will be handled, so a failed write must
+	 * not be reported; EAGAIN means the eventfd is readable anyway.
+	 */
+	if (!head) {
+		ssize_t n = write(mq->efd, &one, sizeof(one));
+		(void)n;
+	}
+
+	return 0;
+}
+
+#else
+
+
 
 static void destructor(void *arg)
 {
@@ -155,3 +345,5 @@ int mqueue_push(struct mqueue *mq, int id, void *data)
 
 	return (n != sizeof(msg)) ? EPIPE : 0;
 }
+
+#endif
@@ -4,6 +4,7 @@
  * Copyright (C) 2010 - 2015 Creytiv.com
  */
 
+#include <string.h>
 #include "re_types.h"
 #include "re_fmt.h"
 #include "re_mem.h"
@@ -12,10 +13,55 @@
 #include "re_odict.h"
 
 
+static void vec_remove(struct odict *o, const struct odict_entry *e)
+{
+	size_t i;
+
+	if (!o || !o->vec)
+		return;
+
+	for (i = o->n; i > 0; i--) {
+
+		if (o->vec[i-1] != e)
+			continue;
+
+		memmove(&o->vec[i-1], &o->vec[i],
+			(o->n - i) * sizeof(*o->vec));
+		--o->n;
+		break;
+	}
+}
+
+
+static int vec_reserve(struct odict *o)
+{
+	struct odict_entry **vec;
+	size_t sz;
+
+	if (o->n < o->sz)
+		return 0;
+
+	sz = o->sz ? o->sz * 2 : 8;
+
+	vec = o->vec ? mem_realloc(o->vec, sz * sizeof(*vec))
+		     : mem_alloc(sz * sizeof(*vec), NULL);
+	if (!vec)
+		return ENOMEM;
+
+	o->vec = vec;
+	o->sz = sz;
+
+	return 0;
+}
+
+
 static void destructor(void *arg)
 {
 	struct odict_entry *e = arg;
 
+	/* the list is the first member of struct odict */
+	vec_remove((struct odict *)e->le.list, e);
+
 	switch (e->type) {
 
 	case ODICT_OBJECT:
@@ -95,6 +141,11 @@ int odict_entry_add(struct odict *o, const char *key,
 	if (err)
 		goto out;
 
+	err = vec_reserve(o);
+	if (err)
+		goto out;
+
+	o->vec[o->n++] = e;
 	list_append(&o->lst, &e->le, e);
 	hash_append(o->ht, hash_fast_str(e->key), &e->he, e);
 
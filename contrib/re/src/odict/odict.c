@@ -15,6 +15,10 @@ static void destructor(void *arg)
 {
 	struct odict *o = arg;
 
+	/* the entries need not remove themselves one by one */
+	o->vec = mem_deref(o->vec);
+	o->n = 0;
+
 	hash_clear(o->ht);
 	list_flush(&o->lst);
 	mem_deref(o->ht);
@@ -69,6 +73,23 @@ const struct odict_entry *odict_lookup(const struct odict *o, const char *key)
 }
 
 
+/**
+ * Get an entry by its position, e.g. an array element
+ *
+ * @param o   Ordered Dictionary
+ * @param idx Index of the entry
+ *
+ * @return Entry if found, otherwise NULL
+ */
+const struct odict_entry *odict_at(const struct odict *o, size_t idx)
+{
+	if (!o || idx >= o->n)
+		return NULL;
+
+	return o->vec[idx];
+}
+
+
 size_t odict_count(const struct odict *o, bool nested)
 {
 	struct le *le;
@@ -78,7 +99,7 @@ size_t odict_count(const struct odict *o, bool nested)
 		return 0;
 
 	if (!nested)
-		return list_count(&o->lst);
+		return o->n;
 
 	for (le=o->lst.head; le; le=le->next) {
 
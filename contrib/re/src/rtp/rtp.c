@@ -345,6 +345,63 @@ int rtp_listen(struct rtp_sock **rsp, int proto, const struct sa *ip,
 }
 
 
+/**
+ * Use an existing UDP Socket for RTP, with RTCP multiplexed on it
+ *
+ * @param rsp         Pointer to returned RTP socket
+ * @param us          UDP Socket, its receive handler is replaced
+ * @param enable_rtcp True to enable RTCP Session
+ * @param recvh       RTP Receive handler
+ * @param rtcph       RTCP Receive handler
+ * @param arg         Handler argument
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtp_listen_sock(struct rtp_sock **rsp, struct udp_sock *us,
+		    bool enable_rtcp,
+		    rtp_recv_h *recvh, rtcp_recv_h *rtcph, void *arg)
+{
+	struct rtp_sock *rs;
+	int err;
+
+	if (!rsp || !us || !recvh)
+		return EINVAL;
+
+	err = rtp_alloc(&rs);
+	if (err)
+		return err;
+
+	rs->proto = IPPROTO_UDP;
+	rs->recvh = recvh;
+	rs->rtcph = rtcph;
+	rs->arg   = arg;
+	rs->rtcp_mux = true;
+
+	if (enable_rtcp) {
+		err = rtcp_sess_alloc(&rs->rtcp, rs);
+		if (err)
+			goto out;
+	}
+
+	err = udp_local_get(us, &rs->local);
+	if (err)
+		goto out;
+
+	rs->sock_rtp  = mem_ref(us);
+	rs->sock_rtcp = mem_ref(us);
+
+	udp_handler_set(us, udp_recv_handler, rs);
+
+ out:
+	if (err)
+		mem_deref(rs);
+	else
+		*rsp = rs;
+
+	return err;
+}
+
+
 /**
  * Encode a new RTP header into the beginning of the buffer
  *
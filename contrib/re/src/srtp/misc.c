@@ -86,6 +86,28 @@ void srtp_iv_calc(union vect128 *iv, const union vect128 *k_s,
 }
 
 
+/*
+ * RFC 7714 8.1 and 9.1: the 96-bit IV is the salt XOR'ed with
+ * 00 00 || SSRC || ROC || SEQ for SRTP and 00 00 || SSRC || 00 00 ||
+ * SRTCP index for SRTCP, i.e. with the 48-bit packet index in both.
+ */
+void srtp_iv_calc_gcm(union vect128 *iv, const union vect128 *k_s,
+		      uint32_t ssrc, uint64_t ix)
+{
+	if (!iv || !k_s)
+		return;
+
+	iv->u16[0] = k_s->u16[0];
+	iv->u16[1] = k_s->u16[1] ^ htons((uint16_t)(ssrc >> 16));
+	iv->u16[2] = k_s->u16[2] ^ htons((uint16_t)ssrc);
+	iv->u16[3] = k_s->u16[3] ^ htons((uint16_t)(ix >> 32));
+	iv->u16[4] = k_s->u16[4] ^ htons((uint16_t)(ix >> 16));
+	iv->u16[5] = k_s->u16[5] ^ htons((uint16_t)ix);
+	iv->u16[6] = 0;
+	iv->u16[7] = 0;
+}
+
+
 const char *srtp_suite_name(enum srtp_suite suite)
 {
 	switch (suite) {
@@ -94,6 +116,8 @@ const char *srtp_suite_name(enum srtp_suite suite)
 	case SRTP_AES_CM_128_HMAC_SHA1_80:  return "AES_CM_128_HMAC_SHA1_80";
 	case SRTP_AES_256_CM_HMAC_SHA1_32:  return "AES_256_CM_HMAC_SHA1_32";
 	case SRTP_AES_256_CM_HMAC_SHA1_80:  return "AES_256_CM_HMAC_SHA1_80";
+	case SRTP_AES_128_GCM:              return "AEAD_AES_128_GCM";
+	case SRTP_AES_256_GCM:              return "AEAD_AES_256_GCM";
 	default:                            return "?";
 	}
 }
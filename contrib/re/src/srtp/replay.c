@@ -3,15 +3,18 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_aes.h>
 #include <re_srtp.h>
 #include "srtp.h"
 
 
 enum {
-	SRTP_WINDOW_SIZE = 64
+	SRTP_WINDOW_SIZE = SRTP_REPLAY_WINDOW,
+	REPLAY_WORDS     = SRTP_REPLAY_WINDOW / 64,
 };
 
 
@@ -20,17 +23,40 @@ void srtp_replay_init(struct replay *replay)
 	if (!replay)
 		return;
 
-	replay->bitmap = 0;
+	memset(replay->bitmap, 0, sizeof(replay->bitmap));
 	replay->lix    = 0;
 }
 
 
+/* Move the window forward by n packets (0 < n < SRTP_WINDOW_SIZE) */
+static void bitmap_shift(uint64_t *bm, uint64_t n)
+{
+	const size_t w = (size_t)(n / 64);
+	const unsigned b = (unsigned)(n % 64);
+	size_t i;
+
+	for (i = REPLAY_WORDS; i-- > 0;) {
+		uint64_t v = 0;
+
+		if (i >= w) {
+			v = bm[i - w] << b;
+
+			if (b && i > w)
+				v |= bm[i - w - 1] >> (64 - b);
+		}
+
+		bm[i] = v;
+	}
+}
+
+
 /*
  * Returns false if packet disallowed, true if packet permitted
  */
 bool srtp_replay_check(struct replay *replay, uint64_t ix)
 {
-	uint64_t diff;
+	uint64_t diff, bit;
+	size_t word;
 
 	if (!replay)
 		return false;
@@ -39,11 +65,13 @@ bool srtp_replay_check(struct replay *replay, uint64_t ix)
 		diff = ix - replay->lix;
 
 		if (diff < SRTP_WINDOW_SIZE) {   /* In window */
-			replay->bitmap <<= diff;
-			replay->bitmap |= 1;     /* set bit for this packet */
+			bitmap_shift(replay->bitmap, diff);
 		}
-		else
-			replay->bitmap = 1;
+		else {
+			memset(replay->bitmap, 0, sizeof(replay->bitmap));
+		}
+
+		replay->bitmap[0] |= 1;  /* set bit for this packet */
 
 		replay->lix = ix;
 		return true;
@@ -53,11 +81,14 @@ bool srtp_replay_check(struct replay *replay, uint64_t ix)
 	if (diff >= SRTP_WINDOW_SIZE)
 		return false;
 
-	if (replay->bitmap & (1ULL << diff))
+	word = (size_t)(diff / 64);
+	bit  = 1ULL << (diff % 64);
+
+	if (replay->bitmap[word] & bit)
 		return false; /* already seen */
 
 	/* mark as seen */
-	replay->bitmap |= (1ULL << diff);
+	replay->bitmap[word] |= bit;
 
 	return true;
 }
@@ -28,6 +28,88 @@ static int get_rtcp_ssrc(uint32_t *ssrc, struct mbuf *mb)
 }
 
 
+/*
+ * RFC 7714 9: the RTCP header and the E-flag/SRTCP index are
+ * Associated Data. The tag goes between the payload and the index.
+ */
+static int gcm_encrypt(struct comp *rtcp, struct mbuf *mb, size_t start,
+		       uint32_t ssrc, uint32_t index)
+{
+	const uint32_t eix = htonl(1u<<31 | index);
+	uint8_t tag[GCM_TAG_SIZE];
+	union vect128 iv;
+	uint8_t *p = mbuf_buf(mb);
+	int err;
+
+	srtp_iv_calc_gcm(&iv, &rtcp->k_s, ssrc, index);
+
+	aes_set_iv(rtcp->aes, iv.u8);
+
+	err  = aes_encr(rtcp->aes, NULL, &mb->buf[start], mb->pos - start);
+	err |= aes_encr(rtcp->aes, NULL, (const uint8_t *)&eix, sizeof(eix));
+	err |= aes_encr(rtcp->aes, p, p, mbuf_get_left(mb));
+	if (err)
+		return err;
+
+	err = aes_get_authtag(rtcp->aes, tag, sizeof(tag));
+	if (err)
+		return err;
+
+	mb->pos = mb->end;
+	err  = mbuf_write_mem(mb, tag, sizeof(tag));
+	err |= mbuf_write_u32(mb, eix);
+
+	return err;
+}
+
+
+static int gcm_decrypt(struct comp *rtcp, struct srtp_stream *strm,
+		       struct mbuf *mb, size_t start, uint32_t ssrc)
+{
+	size_t pld_start = mb->pos, tag_start, eix_start;
+	union vect128 iv;
+	uint32_t v, ix;
+	int err;
+
+	if (mbuf_get_left(mb) < (GCM_TAG_SIZE + 4))
+		return EBADMSG;
+
+	eix_start = mb->end - 4;
+	tag_start = eix_start - GCM_TAG_SIZE;
+
+	mb->pos = eix_start;
+	v = ntohl(mbuf_read_u32(mb));
+
+	/* authentication-only SRTCP is not supported with GCM */
+	if (!(v >> 31))
+		return EPROTO;
+
+	ix = v & 0x7fffffff;
+
+	srtp_iv_calc_gcm(&iv, &rtcp->k_s, ssrc, ix);
+
+	aes_set_iv(rtcp->aes, iv.u8);
+
+	err  = aes_decr(rtcp->aes, NULL, &mb->buf[start], pld_start - start);
+	err |= aes_decr(rtcp->aes, NULL, &mb->buf[eix_start], 4);
+	err |= aes_decr(rtcp->aes, &mb->buf[pld_start], &mb->buf[pld_start],
+			tag_start - pld_start);
+	if (err)
+		return err;
+
+	err = aes_authenticate(rtcp->aes, &mb->buf[tag_start], GCM_TAG_SIZE);
+	if (err)
+		return err;
+
+	if (!srtp_replay_check(&strm->replay_rtcp, ix))
+		return EALREADY;
+
+	mb->end = tag_start;
+
+	return 0;
+}
+
+
 int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb)
 {
 	struct srtp_stream *strm;
@@ -53,6 +135,17 @@ int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb)
 
 	strm->rtcp_index = (strm->rtcp_index+1) & 0x7fffffff;
 
+	if (rtcp->mode == AES_MODE_GCM) {
+
+		err = gcm_encrypt(rtcp, mb, start, ssrc, strm->rtcp_index);
+		if (err)
+			return err;
+
+		mb->pos = start;
+
+		return 0;
+	}
+
 	if (rtcp->aes) {
 		union vect128 iv;
 		uint8_t *p = mbuf_buf(mb);
@@ -99,7 +192,7 @@ int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb)
 int srtcp_decrypt(struct srtp *srtp, struct mbuf *mb)
 {
 	size_t start, eix_start, pld_start;
-	struct srtp_stream *strm;
+	struct srtp_stream *strm, tmp;
 	struct comp *rtcp;
 	uint32_t v, ix;
 	uint32_t ssrc;
@@ -116,9 +209,18 @@ int srtcp_decrypt(struct srtp *srtp, struct mbuf *mb)
 	if (err)
 		return err;
 
-	err = stream_get(&strm, srtp, ssrc);
-	if (err)
-		return err;
+	strm = stream_lookup(srtp, &tmp, ssrc);
+
+	if (rtcp->mode == AES_MODE_GCM) {
+
+		err = gcm_decrypt(rtcp, strm, mb, start, ssrc);
+		if (err)
+			return err;
+
+		mb->pos = start;
+
+		goto out;
+	}
 
 	pld_start = mb->pos;
 
@@ -180,5 +282,10 @@ int srtcp_decrypt(struct srtp *srtp, struct mbuf *mb)
 
 	mb->pos = start;
 
+ out:
+	/* the packet is authentic, a new SSRC may take a slot now */
+	if (strm == &tmp)
+		return stream_add(srtp, &tmp);
+
 	return 0;
 }
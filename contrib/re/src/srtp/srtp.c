@@ -33,7 +33,7 @@ static inline int seq_diff(uint16_t x, uint16_t y)
 static int comp_init(struct comp *c, unsigned offs,
 		     const uint8_t *key, size_t key_b,
 		     const uint8_t *s, size_t s_b,
-		     size_t tag_len, bool encrypted)
+		     size_t tag_len, bool encrypted, enum aes_mode mode)
 {
 	uint8_t k_e[MAX_KEYLEN], k_a[SHA_DIGEST_LENGTH];
 	int err = 0;
@@ -41,11 +41,24 @@ static int comp_init(struct comp *c, unsigned offs,
 	if (key_b > sizeof(k_e))
 		return EINVAL;
 
+	c->tag_len = tag_len;
+	c->mode = mode;
+
+	if (mode == AES_MODE_GCM) {
+
+		/* RFC 7714 11: AES-CM PRF, no authentication key */
+		err |= srtp_derive(k_e, key_b, 0x00+offs, key, key_b, s, s_b);
+		err |= srtp_derive(c->k_s.u8, GCM_SALT_SIZE, 0x02+offs,
+				   key, key_b, s, s_b);
+		if (err)
+			return err;
+
+		return aes_alloc(&c->aes, AES_MODE_GCM, k_e, key_b*8, NULL);
+	}
+
 	if (tag_len > SHA_DIGEST_LENGTH)
 		return EINVAL;
 
-	c->tag_len = tag_len;
-
 	err |= srtp_derive(k_e, key_b,       0x00+offs, key, key_b, s, s_b);
 	err |= srtp_derive(k_a, sizeof(k_a), 0x01+offs, key, key_b, s, s_b);
 	err |= srtp_derive(c->k_s.u8, 14,    0x02+offs, key, key_b, s, s_b);
@@ -75,7 +88,7 @@ static void destructor(void *arg)
 	mem_deref(srtp->rtp.hmac);
 	mem_deref(srtp->rtcp.hmac);
 
-	list_flush(&srtp->streaml);
+	stream_flush(srtp);
 }
 
 
@@ -84,7 +97,8 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 {
 	struct srtp *srtp;
 	const uint8_t *master_salt;
-	size_t cipher_bytes, auth_bytes;
+	size_t cipher_bytes, auth_bytes, salt_bytes = SRTP_SALT_SIZE;
+	enum aes_mode mode = AES_MODE_CTR;
 	int err = 0;
 
 	if (!srtpp || !key)
@@ -112,13 +126,31 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 		auth_bytes   =  4;
 		break;
 
+	case SRTP_AES_128_GCM:
+		cipher_bytes = 16;
+		auth_bytes   = GCM_TAG_SIZE;
+		salt_bytes   = GCM_SALT_SIZE;
+		mode         = AES_MODE_GCM;
+		break;
+
+	case SRTP_AES_256_GCM:
+		cipher_bytes = 32;
+		auth_bytes   = GCM_TAG_SIZE;
+		salt_bytes   = GCM_SALT_SIZE;
+		mode         = AES_MODE_GCM;
+		break;
+
 	default:
 		return ENOTSUP;
 	};
 
-	if ((cipher_bytes + SRTP_SALT_SIZE) != key_bytes)
+	if ((cipher_bytes + salt_bytes) != key_bytes)
 		return EINVAL;
 
+	/* RFC 7714 SRTCP authentication without encryption is not done */
+	if (mode == AES_MODE_GCM && (flags & SRTP_UNENCRYPTED_SRTCP))
+		return ENOTSUP;
+
 	master_salt = &key[cipher_bytes];
 
 	srtp = mem_zalloc(sizeof(*srtp), destructor);
@@ -126,10 +158,10 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 		return ENOMEM;
 
 	err |= comp_init(&srtp->rtp,  0, key, cipher_bytes,
-			 master_salt, SRTP_SALT_SIZE, auth_bytes, true);
+			 master_salt, salt_bytes, auth_bytes, true, mode);
 	err |= comp_init(&srtp->rtcp, 3, key, cipher_bytes,
-			 master_salt, SRTP_SALT_SIZE, auth_bytes,
-			 !(flags & SRTP_UNENCRYPTED_SRTCP));
+			 master_salt, salt_bytes, auth_bytes,
+			 !(flags & SRTP_UNENCRYPTED_SRTCP), mode);
 	if (err)
 		goto out;
 
@@ -143,21 +175,68 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 }
 
 
-int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
+/*
+ * Packet protection runs in three stages, so that a batch of packets
+ * can share one keystream pass:
+ *
+ *   prepare  -- header, stream state, ROC and IV; sequential per packet
+ *   crypt    -- AES-CTR, per packet or for the whole batch
+ *   finish   -- authentication tag (encrypt only)
+ *
+ * AEAD (GCM) packets are completed in the prepare stage.
+ */
+
+
+/** Per-packet state between the stages */
+struct srtp_pkt {
+	size_t start;         /**< Start of the RTP header           */
+	uint32_t roc;         /**< ROC for the authentication tag    */
+	union vect128 iv;     /**< AES-CTR initial counter block     */
+	bool ctr;             /**< Payload needs the AES-CTR stage   */
+};
+
+
+static int gcm_encrypt(struct comp *comp, struct mbuf *mb,
+		       const struct srtp_pkt *pkt, uint32_t ssrc,
+		       uint64_t ix)
+{
+	union vect128 iv;
+	uint8_t *p = mbuf_buf(mb);
+	uint8_t tag[GCM_TAG_SIZE];
+	int err;
+
+	srtp_iv_calc_gcm(&iv, &comp->k_s, ssrc, ix);
+
+	aes_set_iv(comp->aes, iv.u8);
+
+	/* the RTP header is Associated Data */
+	err  = aes_encr(comp->aes, NULL, &mb->buf[pkt->start],
+			mb->pos - pkt->start);
+	err |= aes_encr(comp->aes, p, p, mbuf_get_left(mb));
+	if (err)
+		return err;
+
+	err = aes_get_authtag(comp->aes, tag, sizeof(tag));
+	if (err)
+		return err;
+
+	mb->pos = mb->end;
+
+	return mbuf_write_mem(mb, tag, sizeof(tag));
+}
+
+
+static int encrypt_prepare(struct srtp *srtp, struct mbuf *mb,
+			   struct srtp_pkt *pkt)
 {
 	struct srtp_stream *strm;
 	struct rtp_header hdr;
-	struct comp *comp;
-	size_t start;
+	struct comp *comp = &srtp->rtp;
 	uint64_t ix;
 	int err;
 
-	if (!srtp || !mb)
-		return EINVAL;
-
-	comp = &srtp->rtp;
-
-	start = mb->pos;
+	pkt->start = mb->pos;
+	pkt->ctr = false;
 
 	err = rtp_hdr_decode(&hdr, mb);
 	if (err)
@@ -174,18 +253,30 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 	}
 
 	ix = 65536ULL * strm->roc + hdr.seq;
+	pkt->roc = strm->roc;
 
-	if (comp->aes) {
-		union vect128 iv;
-		uint8_t *p = mbuf_buf(mb);
-
-		srtp_iv_calc(&iv, &comp->k_s, strm->ssrc, ix);
-
-		aes_set_iv(comp->aes, iv.u8);
-		err = aes_encr(comp->aes, p, p, mbuf_get_left(mb));
+	if (comp->mode == AES_MODE_GCM) {
+		err = gcm_encrypt(comp, mb, pkt, strm->ssrc, ix);
 		if (err)
 			return err;
 	}
+	else if (comp->aes) {
+		srtp_iv_calc(&pkt->iv, &comp->k_s, strm->ssrc, ix);
+		pkt->ctr = true;
+	}
+
+	if (hdr.seq > strm->s_l)
+		strm->s_l = hdr.seq;
+
+	return 0;
+}
+
+
+static int encrypt_finish(struct srtp *srtp, struct mbuf *mb,
+			  const struct srtp_pkt *pkt)
+{
+	struct comp *comp = &srtp->rtp;
+	int err;
 
 	if (comp->hmac) {
 		const size_t tag_start = mb->end;
@@ -193,11 +284,11 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 
 		mb->pos = tag_start;
 
-		err = mbuf_write_u32(mb, htonl(strm->roc));
+		err = mbuf_write_u32(mb, htonl(pkt->roc));
 		if (err)
 			return err;
 
-		mb->pos = start;
+		mb->pos = pkt->start;
 
 		err = hmac_digest(comp->hmac, tag, sizeof(tag),
 				  mbuf_buf(mb), mbuf_get_left(mb));
@@ -211,40 +302,150 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 			return err;
 	}
 
-	if (hdr.seq > strm->s_l)
-		strm->s_l = hdr.seq;
-
-	mb->pos = start;
+	mb->pos = pkt->start;
 
 	return 0;
 }
 
 
-int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
+int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 {
-	struct srtp_stream *strm;
-	struct rtp_header hdr;
-	struct comp *comp;
-	uint64_t ix;
-	size_t start;
-	int diff;
+	struct srtp_pkt pkt;
 	int err;
 
 	if (!srtp || !mb)
 		return EINVAL;
 
-	comp = &srtp->rtp;
+	err = encrypt_prepare(srtp, mb, &pkt);
+	if (err)
+		return err;
 
-	start = mb->pos;
+	if (pkt.ctr) {
+		uint8_t *p = mbuf_buf(mb);
 
-	err = rtp_hdr_decode(&hdr, mb);
+		aes_set_iv(srtp->rtp.aes, pkt.iv.u8);
+		err = aes_encr(srtp->rtp.aes, p, p, mbuf_get_left(mb));
+		if (err)
+			return err;
+	}
+
+	return encrypt_finish(srtp, mb, &pkt);
+}
+
+
+static int gcm_decrypt(struct comp *comp, struct srtp_stream *strm,
+		       struct mbuf *mb, size_t start, uint64_t ix)
+{
+	union vect128 iv;
+	uint8_t *p;
+	size_t tag_start;
+	int err;
+
+	if (mbuf_get_left(mb) < GCM_TAG_SIZE)
+		return EBADMSG;
+
+	tag_start = mb->end - GCM_TAG_SIZE;
+	p = mbuf_buf(mb);
+
+	srtp_iv_calc_gcm(&iv, &comp->k_s, strm->ssrc, ix);
+
+	aes_set_iv(comp->aes, iv.u8);
+
+	err  = aes_decr(comp->aes, NULL, &mb->buf[start], mb->pos - start);
+	err |= aes_decr(comp->aes, p, p, tag_start - mb->pos);
 	if (err)
 		return err;
 
-	err = stream_get_seq(&strm, srtp, hdr.ssrc, hdr.seq);
+	err = aes_authenticate(comp->aes, &mb->buf[tag_start], GCM_TAG_SIZE);
 	if (err)
 		return err;
 
+	if (!srtp_replay_check(&strm->replay_rtp, ix))
+		return EALREADY;
+
+	mb->end = tag_start;
+
+	return 0;
+}
+
+
+static int hmac_verify(struct comp *comp, struct srtp_stream *strm,
+		       struct mbuf *mb, size_t start, uint64_t ix)
+{
+	uint8_t tag_calc[SHA_DIGEST_LENGTH];
+	uint8_t tag_pkt[SHA_DIGEST_LENGTH];
+	size_t pld_start, tag_start;
+	int err;
+
+	if (mbuf_get_left(mb) < comp->tag_len)
+		return EBADMSG;
+
+	pld_start = mb->pos;
+	tag_start = mb->end - comp->tag_len;
+
+	mb->pos = tag_start;
+
+	err = mbuf_read_mem(mb, tag_pkt, comp->tag_len);
+	if (err)
+		return err;
+
+	mb->pos = mb->end = tag_start;
+
+	err = mbuf_write_u32(mb, htonl(strm->roc));
+	if (err)
+		return err;
+
+	mb->pos = start;
+
+	err = hmac_digest(comp->hmac, tag_calc, sizeof(tag_calc),
+			  mbuf_buf(mb), mbuf_get_left(mb));
+	if (err)
+		return err;
+
+	mb->pos = pld_start;
+	mb->end = tag_start;
+
+	if (0 != memcmp(tag_calc, tag_pkt, comp->tag_len))
+		return EAUTH;
+
+	/*
+	 * 3.3.2.  Replay Protection
+	 *
+	 * Secure replay protection is only possible when
+	 * integrity protection is present.
+	 */
+	if (!srtp_replay_check(&strm->replay_rtp, ix))
+		return EALREADY;
+
+	return 0;
+}
+
+
+static int decrypt_prepare(struct srtp *srtp, struct mbuf *mb,
+			   struct srtp_pkt *pkt)
+{
+	struct srtp_stream *strm, tmp;
+	struct rtp_header hdr;
+	struct comp *comp = &srtp->rtp;
+	uint64_t ix;
+	int diff;
+	int err;
+
+	pkt->start = mb->pos;
+	pkt->ctr = false;
+
+	err = rtp_hdr_decode(&hdr, mb);
+	if (err)
+		return err;
+
+	strm = stream_lookup(srtp, &tmp, hdr.ssrc);
+
+	/* Set the initial sequence number once only */
+	if (!strm->s_l_set) {
+		strm->s_l = hdr.seq;
+		strm->s_l_set = true;
+	}
+
 	diff = seq_diff(strm->s_l, hdr.seq);
 	if (diff > 32768)
 		return ETIMEDOUT;
@@ -257,69 +458,182 @@ int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
 
 	ix = srtp_get_index(strm->roc, strm->s_l, hdr.seq);
 
-	if (comp->hmac) {
-		uint8_t tag_calc[SHA_DIGEST_LENGTH];
-		uint8_t tag_pkt[SHA_DIGEST_LENGTH];
-		size_t pld_start, tag_start;
+	if (comp->mode == AES_MODE_GCM) {
+		err = gcm_decrypt(comp, strm, mb, pkt->start, ix);
+		if (err)
+			return err;
+	}
+	else {
+		if (comp->hmac) {
+			err = hmac_verify(comp, strm, mb, pkt->start, ix);
+			if (err)
+				return err;
+		}
+
+		if (comp->aes) {
+			srtp_iv_calc(&pkt->iv, &comp->k_s, strm->ssrc, ix);
+			pkt->ctr = true;
+		}
+	}
 
-		if (mbuf_get_left(mb) < comp->tag_len)
-			return EBADMSG;
+	if (hdr.seq > strm->s_l)
+		strm->s_l = hdr.seq;
 
-		pld_start = mb->pos;
-		tag_start = mb->end - comp->tag_len;
+	/* the packet is authentic, a new SSRC may take a slot now */
+	if (strm == &tmp)
+		return stream_add(srtp, &tmp);
 
-		mb->pos = tag_start;
+	return 0;
+}
 
-		err = mbuf_read_mem(mb, tag_pkt, comp->tag_len);
-		if (err)
-			return err;
 
-		mb->pos = mb->end = tag_start;
+int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
+{
+	struct srtp_pkt pkt;
+	int err;
 
-		err = mbuf_write_u32(mb, htonl(strm->roc));
-		if (err)
-			return err;
+	if (!srtp || !mb)
+		return EINVAL;
 
-		mb->pos = start;
+	err = decrypt_prepare(srtp, mb, &pkt);
+	if (err)
+		return err;
 
-		err = hmac_digest(comp->hmac, tag_calc, sizeof(tag_calc),
-				  mbuf_buf(mb), mbuf_get_left(mb));
+	if (pkt.ctr) {
+		uint8_t *p = mbuf_buf(mb);
+
+		aes_set_iv(srtp->rtp.aes, pkt.iv.u8);
+		err = aes_decr(srtp->rtp.aes, p, p, mbuf_get_left(mb));
 		if (err)
 			return err;
+	}
+
+	mb->pos = pkt.start;
+
+	return 0;
+}
+
+
+/*
+ * Run the AES-CTR stage for all packets of a batch that need it,
+ * with one keystream pass per SRTP_BATCH_MAX packets.
+ */
+static int batch_crypt(struct srtp *srtp, struct mbuf *mbv[],
+		       const struct srtp_pkt *pktv, int errv[], size_t n)
+{
+	uint8_t ivv[SRTP_BATCH_MAX][AES_BLOCK_SIZE];
+	uint8_t *bufv[SRTP_BATCH_MAX];
+	size_t lenv[SRTP_BATCH_MAX];
+	size_t i, m = 0;
 
-		mb->pos = pld_start;
-		mb->end = tag_start;
+	for (i = 0; i < n; i++) {
 
-		if (0 != memcmp(tag_calc, tag_pkt, comp->tag_len))
-			return EAUTH;
+		if (errv[i] || !pktv[i].ctr)
+			continue;
 
-		/*
-		 * 3.3.2.  Replay Protection
-		 *
-		 * Secure replay protection is only possible when
-		 * integrity protection is present.
-		 */
-		if (!srtp_replay_check(&strm->replay_rtp, ix))
-			return EALREADY;
+		memcpy(ivv[m], pktv[i].iv.u8, AES_BLOCK_SIZE);
+		bufv[m] = mbuf_buf(mbv[i]);
+		lenv[m] = mbuf_get_left(mbv[i]);
+		++m;
 	}
 
-	if (comp->aes) {
+	if (!m)
+		return 0;
 
-		union vect128 iv;
-		uint8_t *p = mbuf_buf(mb);
+	return aes_encr_batch(srtp->rtp.aes, bufv, lenv,
+			      (const uint8_t (*)[AES_BLOCK_SIZE])ivv, m);
+}
 
-		srtp_iv_calc(&iv, &comp->k_s, strm->ssrc, ix);
 
-		aes_set_iv(comp->aes, iv.u8);
-		err = aes_decr(comp->aes, p, p, mbuf_get_left(mb));
-		if (err)
-			return err;
+static int batch_run(struct srtp *srtp, struct mbuf *mbv[], int errv[],
+		     size_t n, bool encrypt)
+{
+	struct srtp_pkt pktv[SRTP_BATCH_MAX];
+	int resv[SRTP_BATCH_MAX];
+	size_t i, off, c;
+	int err, first = 0;
+
+	if (!srtp || (n && !mbv))
+		return EINVAL;
+
+	for (off = 0; off < n; off += c) {
+
+		c = min(n - off, (size_t)SRTP_BATCH_MAX);
+
+		for (i = 0; i < c; i++) {
+			struct mbuf *mb = mbv[off + i];
+
+			if (!mb)
+				resv[i] = EINVAL;
+			else if (encrypt)
+				resv[i] = encrypt_prepare(srtp, mb, &pktv[i]);
+			else
+				resv[i] = decrypt_prepare(srtp, mb, &pktv[i]);
+		}
+
+		err = batch_crypt(srtp, &mbv[off], pktv, resv, c);
+
+		for (i = 0; i < c; i++) {
+			struct mbuf *mb = mbv[off + i];
+
+			if (!resv[i] && err && pktv[i].ctr)
+				resv[i] = err;
+
+			if (!resv[i]) {
+				if (encrypt)
+					resv[i] = encrypt_finish(srtp, mb,
+								 &pktv[i]);
+				else
+					mb->pos = pktv[i].start;
+			}
+
+			if (errv)
+				errv[off + i] = resv[i];
+			if (!first)
+				first = resv[i];
+		}
 	}
 
-	if (hdr.seq > strm->s_l)
-		strm->s_l = hdr.seq;
+	return first;
+}
 
-	mb->pos = start;
 
-	return 0;
+/**
+ * Encrypt a batch of SRTP packets in place
+ *
+ * The packets are processed in order, as with srtp_encrypt(), but the
+ * AES-CTR keystream for all of them is generated in one pass.
+ *
+ * @param srtp SRTP Context
+ * @param mbv  Packets to encrypt
+ * @param errv Optional result of each packet
+ * @param n    Number of packets
+ *
+ * @return 0 if all packets were encrypted, otherwise the first error
+ */
+int srtp_encrypt_batch(struct srtp *srtp, struct mbuf *mbv[], int errv[],
+		       size_t n)
+{
+	return batch_run(srtp, mbv, errv, n, true);
+}
+
+
+/**
+ * Decrypt a batch of SRTP packets in place
+ *
+ * The error of each packet is returned in errv. Packets that fail
+ * authentication or replay protection must be dropped, their buffer
+ * may have been modified (the tag trimmed or the payload decrypted).
+ *
+ * @param srtp SRTP Context
+ * @param mbv  Packets to decrypt
+ * @param errv Optional result of each packet
+ * @param n    Number of packets
+ *
+ * @return 0 if all packets were decrypted, otherwise the first error
+ */
+int srtp_decrypt_batch(struct srtp *srtp, struct mbuf *mbv[], int errv[],
+		       size_t n)
+{
+	return batch_run(srtp, mbv, errv, n, false);
 }
@@ -6,7 +6,10 @@
 
 
 enum {
-	SRTP_SALT_SIZE = 14
+	SRTP_SALT_SIZE = 14,
+	GCM_SALT_SIZE  = 12,  /**< RFC 7714 master and session salt */
+	GCM_TAG_SIZE   = 16,  /**< RFC 7714 authentication tag      */
+	SRTP_BATCH_MAX = 32,  /**< Packets per batch keystream pass */
 };
 
 
@@ -18,15 +21,20 @@ union vect128 {
 	uint8_t   u8[16];
 };
 
+/** Replay window size in packets, a multiple of 64 (RFC 3711: >= 64) */
+#ifndef SRTP_REPLAY_WINDOW
+#define SRTP_REPLAY_WINDOW 128
+#endif
+
 /** Replay protection */
 struct replay {
-	uint64_t bitmap;   /**< Session state - must be 64 bits */
+	uint64_t bitmap[SRTP_REPLAY_WINDOW/64]; /**< Bit n: index lix-n seen */
 	uint64_t lix;      /**< Last received index             */
 };
 
 /** SRTP stream/context -- shared state between RTP/RTCP */
 struct srtp_stream {
-	struct le le;              /**< Linked-list element                */
+	uint64_t last_use;         /**< LRU stamp, from srtp->use_clock    */
 	struct replay replay_rtp;  /**< recv -- replay protection for RTP  */
 	struct replay replay_rtcp; /**< recv -- replay protection for RTCP */
 	uint32_t ssrc;             /**< SSRC -- lookup key                 */
@@ -40,18 +48,28 @@ struct srtp_stream {
 struct srtp {
 	struct comp {
 		struct aes *aes;    /**< AES Context                       */
-		struct hmac *hmac;  /**< HMAC Context                      */
-		union vect128 k_s;  /**< Derived salting key (14 bytes)    */
+		struct hmac *hmac;  /**< HMAC Context (not used for GCM)   */
+		union vect128 k_s;  /**< Derived salting key (14/12 bytes) */
 		size_t tag_len;     /**< Authentication tag length [bytes] */
+		enum aes_mode mode; /**< AES mode, CTR or GCM              */
 	} rtp, rtcp;
 
-	struct list streaml;        /**< SRTP-streams (struct srtp_stream) */
+	/** SRTP-streams, open-addressing hash table keyed on SSRC */
+	struct srtp_stream **streamv;
+	size_t stream_slots;        /**< Table size, a power of two        */
+	size_t streamc;             /**< Number of streams in the table    */
+	struct srtp_stream *last;   /**< Most recently used stream         */
+	uint64_t use_clock;         /**< LRU clock                         */
 };
 
 
 int stream_get(struct srtp_stream **strmp, struct srtp *srtp, uint32_t ssrc);
+void stream_flush(struct srtp *srtp);
 int stream_get_seq(struct srtp_stream **strmp, struct srtp *srtp,
 		   uint32_t ssrc, uint16_t seq);
+struct srtp_stream *stream_lookup(struct srtp *srtp, struct srtp_stream *tmp,
+				  uint32_t ssrc);
+int stream_add(struct srtp *srtp, const struct srtp_stream *tmp);
 
 
 int  srtp_derive(uint8_t *out, size_t out_len, uint8_t label,
@@ -59,6 +77,8 @@ int  srtp_derive(uint8_t *out, size_t out_len, uint8_t label,
 		 const uint8_t *master_salt, size_t salt_bytes);
 void srtp_iv_calc(union vect128 *iv, const union vect128 *k_s,
 		  uint32_t ssrc, uint64_t ix);
+void srtp_iv_calc_gcm(union vect128 *iv, const union vect128 *k_s,
+		      uint32_t ssrc, uint64_t ix);
 uint64_t srtp_get_index(uint32_t roc, uint16_t s_l, uint16_t seq);
 
 
@@ -3,53 +3,185 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_aes.h>
 #include <re_srtp.h>
 #include "srtp.h"
 
 
 /** SRTP protocol values */
 #ifndef SRTP_MAX_STREAMS
-#define SRTP_MAX_STREAMS  (8)  /**< Maximum number of SRTP streams */
+#define SRTP_MAX_STREAMS  (256)  /**< Maximum number of SRTP streams */
 #endif
 
 
-static void stream_destructor(void *arg)
+/*
+ * The streams of a session are kept in an open-addressing hash table
+ * with linear probing, keyed on SSRC and at most half full. When the
+ * session reaches SRTP_MAX_STREAMS, the least recently used stream is
+ * evicted to make room for a new SSRC.
+ *
+ * On the receive side a new SSRC is only added once one of its packets
+ * has been authenticated, so that forged packets can neither fill the
+ * table nor evict the streams of real senders.
+ */
+
+
+enum {
+	STREAM_SLOTS_MIN = 8,
+};
+
+
+static inline size_t stream_hash(uint32_t ssrc)
 {
-	struct srtp_stream *strm = arg;
+	uint32_t h = ssrc * 0x9e3779b1u;
 
-	list_unlink(&strm->le);
+	return h ^ (h >> 16);
 }
 
 
 static struct srtp_stream *stream_find(struct srtp *srtp, uint32_t ssrc)
 {
-	struct le *le;
+	const size_t mask = srtp->stream_slots - 1;
+	size_t i;
 
-	for (le = srtp->streaml.head; le; le = le->next) {
+	if (!srtp->streamc)
+		return NULL;
 
-		struct srtp_stream *strm = le->data;
+	for (i = stream_hash(ssrc) & mask; srtp->streamv[i];
+	     i = (i + 1) & mask) {
 
-		if (strm->ssrc == ssrc)
-			return strm;
+		if (srtp->streamv[i]->ssrc == ssrc)
+			return srtp->streamv[i];
 	}
 
 	return NULL;
 }
 
 
+static void slot_insert(struct srtp_stream **streamv, size_t slots,
+			struct srtp_stream *strm)
+{
+	const size_t mask = slots - 1;
+	size_t i = stream_hash(strm->ssrc) & mask;
+
+	while (streamv[i])
+		i = (i + 1) & mask;
+
+	streamv[i] = strm;
+}
+
+
+/* remove slot i and close the gap (backward-shift deletion) */
+static void slot_remove(struct srtp *srtp, size_t i)
+{
+	const size_t mask = srtp->stream_slots - 1;
+	size_t j = i;
+
+	srtp->streamv[i] = NULL;
+
+	for (;;) {
+		struct srtp_stream *strm;
+		size_t k;
+
+		j = (j + 1) & mask;
+
+		strm = srtp->streamv[j];
+		if (!strm)
+			break;
+
+		k = stream_hash(strm->ssrc) & mask;
+
+		/* leave it if its home slot is cyclically in (i, j] */
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		srtp->streamv[i] = strm;
+		srtp->streamv[j] = NULL;
+		i = j;
+	}
+
+	--srtp->streamc;
+}
+
+
+static void stream_evict_lru(struct srtp *srtp)
+{
+	struct srtp_stream *strm;
+	size_t i, lru = 0;
+	bool found = false;
+
+	for (i = 0; i < srtp->stream_slots; i++) {
+
+		strm = srtp->streamv[i];
+		if (!strm)
+			continue;
+
+		if (!found || strm->last_use < srtp->streamv[lru]->last_use) {
+			lru = i;
+			found = true;
+		}
+	}
+
+	if (!found)
+		return;
+
+	strm = srtp->streamv[lru];
+
+	slot_remove(srtp, lru);
+
+	if (srtp->last == strm)
+		srtp->last = NULL;
+
+	mem_deref(strm);
+}
+
+
+static int table_resize(struct srtp *srtp, size_t slots)
+{
+	struct srtp_stream **streamv;
+	size_t i;
+
+	streamv = mem_zalloc(slots * sizeof(*streamv), NULL);
+	if (!streamv)
+		return ENOMEM;
+
+	for (i = 0; i < srtp->stream_slots; i++) {
+
+		if (srtp->streamv[i])
+			slot_insert(streamv, slots, srtp->streamv[i]);
+	}
+
+	mem_deref(srtp->streamv);
+	srtp->streamv = streamv;
+	srtp->stream_slots = slots;
+
+	return 0;
+}
+
+
 static int stream_new(struct srtp_stream **strmp, struct srtp *srtp,
 		      uint32_t ssrc)
 {
 	struct srtp_stream *strm;
+	int err;
 
-	if (list_count(&srtp->streaml) >= SRTP_MAX_STREAMS)
-		return ENOSR;
+	if (srtp->streamc >= SRTP_MAX_STREAMS)
+		stream_evict_lru(srtp);
 
-	strm = mem_zalloc(sizeof(*strm), stream_destructor);
+	if ((srtp->streamc + 1) * 2 > srtp->stream_slots) {
+
+		err = table_resize(srtp, max(srtp->stream_slots * 2,
+					     (size_t)STREAM_SLOTS_MIN));
+		if (err)
+			return err;
+	}
+
+	strm = mem_zalloc(sizeof(*strm), NULL);
 	if (!strm)
 		return ENOMEM;
 
@@ -57,7 +189,8 @@ static int stream_new(struct srtp_stream **strmp, struct srtp *srtp,
 	srtp_replay_init(&strm->replay_rtp);
 	srtp_replay_init(&strm->replay_rtcp);
 
-	list_append(&srtp->streaml, &strm->le, strm);
+	slot_insert(srtp->streamv, srtp->stream_slots, strm);
+	++srtp->streamc;
 
 	if (strmp)
 		*strmp = strm;
@@ -69,17 +202,91 @@ static int stream_new(struct srtp_stream **strmp, struct srtp *srtp,
 int stream_get(struct srtp_stream **strmp, struct srtp *srtp, uint32_t ssrc)
 {
 	struct srtp_stream *strm;
+	int err;
 
 	if (!strmp || !srtp)
 		return EINVAL;
 
-	strm = stream_find(srtp, ssrc);
+	strm = srtp->last;
+	if (!strm || strm->ssrc != ssrc)
+		strm = stream_find(srtp, ssrc);
+
+	if (!strm) {
+		err = stream_new(&strm, srtp, ssrc);
+		if (err)
+			return err;
+	}
+
+	strm->last_use = ++srtp->use_clock;
+	srtp->last = strm;
+
+	*strmp = strm;
+
+	return 0;
+}
+
+
+/*
+ * Find the stream of a received packet. An unknown SSRC is set up in
+ * tmp instead, which the caller passes to stream_add() once the packet
+ * has been authenticated.
+ */
+struct srtp_stream *stream_lookup(struct srtp *srtp, struct srtp_stream *tmp,
+				  uint32_t ssrc)
+{
+	struct srtp_stream *strm;
+
+	strm = srtp->last;
+	if (!strm || strm->ssrc != ssrc)
+		strm = stream_find(srtp, ssrc);
+
 	if (strm) {
-		*strmp = strm;
-		return 0;
+		strm->last_use = ++srtp->use_clock;
+		srtp->last = strm;
+		return strm;
 	}
 
-	return stream_new(strmp, srtp, ssrc);
+	memset(tmp, 0, sizeof(*tmp));
+	tmp->ssrc = ssrc;
+	srtp_replay_init(&tmp->replay_rtp);
+	srtp_replay_init(&tmp->replay_rtcp);
+
+	return tmp;
+}
+
+
+/* Add a stream set up by stream_lookup(), evicting one if needed */
+int stream_add(struct srtp *srtp, const struct srtp_stream *tmp)
+{
+	struct srtp_stream *strm;
+	int err;
+
+	err = stream_new(&strm, srtp, tmp->ssrc);
+	if (err)
+		return err;
+
+	*strm = *tmp;
+	strm->last_use = ++srtp->use_clock;
+	srtp->last = strm;
+
+	return 0;
+}
+
+
+void stream_flush(struct srtp *srtp)
+{
+	size_t i;
+
+	if (!srtp)
+		return;
+
+	for (i = 0; i < srtp->stream_slots; i++)
+		mem_deref(srtp->streamv[i]);
+
+	srtp->streamv = mem_deref(srtp->streamv);
+	srtp->stream_slots = 0;
+	srtp->streamc = 0;
+	srtp->last = NULL;
 }
 
 
@@ -9,4 +9,5 @@ struct tls {
 	SSL_CTX *ctx;
 	X509 *cert;
 	char *pass;  /* password for private key */
+	struct dtls_pool *pool;  /* DTLS handshake workers */
 };
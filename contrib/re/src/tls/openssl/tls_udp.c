@@ -4,6 +4,9 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #define OPENSSL_NO_KRB5 1
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <re_types.h>
@@ -16,6 +19,7 @@
 #include <re_srtp.h>
 #include <re_udp.h>
 #include <re_tmr.h>
+#include <re_mqueue.h>
 #include <re_tls.h>
 #include "tls.h"
 
@@ -31,6 +35,15 @@ enum {
 };
 
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define BIO_get_data(b)     ((b)->ptr)
+#define BIO_set_data(b, p)  ((b)->ptr = (p))
+#define BIO_set_init(b, i)  ((b)->init = (i))
+#endif
+
+
+struct dtls_job;
+
 struct dtls_sock {
 	struct sa peer;
 	struct udp_helper *uh;
@@ -38,6 +51,7 @@ struct dtls_sock {
 	struct hash *ht;
 	struct mbuf *mb;
 	dtls_conn_h *connh;
+	BIO_METHOD *method;
 	void *arg;
 	size_t mtu;
 };
@@ -56,17 +70,23 @@ struct tls_conn {
 	dtls_recv_h *recvh;
 	dtls_close_h *closeh;
 	void *arg;
+	struct dtls_pool *pool;  /* handshake workers (optional) */
+	struct dtls_job *job;    /* handshake step running on a worker */
+	struct mbuf *pend;       /* records received meanwhile */
 	bool active;
 	bool up;
 };
 
 
+static void pool_recv(struct tls_conn *tc, const struct mbuf *mb);
+static int  pool_submit(struct tls_conn *tc, const uint8_t *p, size_t len);
+static int  job_output(struct dtls_job *job, const char *buf, int len);
+
+
 static int bio_create(BIO *b)
 {
-	b->init  = 1;
-	b->num   = 0;
-	b->ptr   = NULL;
-	b->flags = 0;
+	BIO_set_init(b, 1);
+	BIO_set_data(b, NULL);
 
 	return 1;
 }
@@ -77,9 +97,8 @@ static int bio_destroy(BIO *b)
 	if (!b)
 		return 0;
 
-	b->ptr   = NULL;
-	b->init  = 0;
-	b->flags = 0;
+	BIO_set_data(b, NULL);
+	BIO_set_init(b, 0);
 
 	return 1;
 }
@@ -87,11 +106,15 @@ static int bio_destroy(BIO *b)
 
 static int bio_write(BIO *b, const char *buf, int len)
 {
-	struct tls_conn *tc = b->ptr;
+	struct tls_conn *tc = BIO_get_data(b);
 	struct mbuf *mb;
 	enum {SPACE = 4};
 	int err;
 
+	/* on a worker, the records are sent when the step is done */
+	if (tc->job)
+		return job_output(tc->job, buf, len);
+
 	mb = mbuf_alloc(SPACE + len);
 	if (!mb)
 		return -1;
@@ -110,7 +133,7 @@ static int bio_write(BIO *b, const char *buf, int len)
 
 static long bio_ctrl(BIO *b, int cmd, long num, void *ptr)
 {
-	struct tls_conn *tc = b->ptr;
+	struct tls_conn *tc = BIO_get_data(b);
 	(void)num;
 	(void)ptr;
 
@@ -135,6 +158,7 @@ static long bio_ctrl(BIO *b, int cmd, long num, void *ptr)
 }
 
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
 static struct bio_method_st bio_udp_send = {
 	BIO_TYPE_SOURCE_SINK,
 	"udp_send",
@@ -149,6 +173,42 @@ static struct bio_method_st bio_udp_send = {
 };
 
 
+static BIO_METHOD *bio_method_alloc(void)
+{
+	return &bio_udp_send;
+}
+
+
+static void bio_method_free(BIO_METHOD *method)
+{
+	(void)method;
+}
+#else
+/* BIO_METHOD is opaque since OpenSSL 1.1 */
+static BIO_METHOD *bio_method_alloc(void)
+{
+	BIO_METHOD *method;
+
+	method = BIO_meth_new(BIO_TYPE_SOURCE_SINK, "udp_send");
+	if (!method)
+		return NULL;
+
+	BIO_meth_set_write(method, bio_write);
+	BIO_meth_set_ctrl(method, bio_ctrl);
+	BIO_meth_set_create(method, bio_create);
+	BIO_meth_set_destroy(method, bio_destroy);
+
+	return method;
+}
+
+
+static void bio_method_free(BIO_METHOD *method)
+{
+	BIO_meth_free(method);
+}
+#endif
+
+
 static void tls_close(struct tls_conn *tc)
 {
 	int r;
@@ -172,6 +232,8 @@ static void conn_destructor(void *arg)
 	hash_unlink(&tc->he);
 	tmr_cancel(&tc->tmr);
 	tls_close(tc);
+	mem_deref(tc->pend);
+	mem_deref(tc->pool);
 	mem_deref(tc->sock);
 }
 
@@ -198,6 +260,10 @@ static void timeout(void *arg)
 
 	DEBUG_INFO("timeout\n");
 
+	/* the timer is checked again when the worker is done */
+	if (tc->job)
+		return;
+
 	if (0 <= DTLSv1_handle_timeout(tc->ssl)) {
 
 		check_timer(tc);
@@ -233,13 +299,14 @@ static void check_timer(struct tls_conn *tc)
 #endif
 
 
-static int tls_connect(struct tls_conn *tc)
+/* One step of the handshake, without timers so that it can run anywhere */
+static int handshake(struct tls_conn *tc)
 {
 	int r;
 
 	ERR_clear_error();
 
-	r = SSL_connect(tc->ssl);
+	r = tc->active ? SSL_connect(tc->ssl) : SSL_accept(tc->ssl);
 	if (r <= 0) {
 		const int ssl_err = SSL_get_error(tc->ssl, r);
 
@@ -251,39 +318,24 @@ static int tls_connect(struct tls_conn *tc)
 			break;
 
 		default:
-			DEBUG_WARNING("connect error: %i\n", ssl_err);
+			DEBUG_WARNING("%s error: %i\n",
+				      tc->active ? "connect" : "accept",
+				      ssl_err);
 			return EPROTO;
 		}
 	}
 
-	check_timer(tc);
-
 	return 0;
 }
 
 
-static int tls_accept(struct tls_conn *tc)
+static int tls_handshake(struct tls_conn *tc)
 {
-	int r;
-
-	ERR_clear_error();
-
-	r = SSL_accept(tc->ssl);
-	if (r <= 0) {
-		const int ssl_err = SSL_get_error(tc->ssl, r);
-
-		ERR_clear_error();
-
-		switch (ssl_err) {
-
-		case SSL_ERROR_WANT_READ:
-			break;
+	int err;
 
-		default:
-			DEBUG_WARNING("accept error: %i\n", ssl_err);
-			return EPROTO;
-		}
-	}
+	err = handshake(tc);
+	if (err)
+		return err;
 
 	check_timer(tc);
 
@@ -291,66 +343,30 @@ static int tls_accept(struct tls_conn *tc)
 }
 
 
-static void conn_recv(struct tls_conn *tc, struct mbuf *mb)
+/* returns true if the connection was deref'd from the handler */
+static bool conn_estab(struct tls_conn *tc)
 {
-	int err, r;
-
-	if (!tc->ssl)
-		return;
-
-	/* feed SSL data to the BIO */
-	r = BIO_write(tc->sbio_in, mbuf_buf(mb), (int)mbuf_get_left(mb));
-	if (r <= 0) {
-		DEBUG_WARNING("receive bio write error: %i\n", r);
-		ERR_clear_error();
-		conn_close(tc, ENOMEM);
-		return;
-	}
-
-	if (SSL_state(tc->ssl) != SSL_ST_OK) {
-
-		if (tc->up) {
-			conn_close(tc, EPROTO);
-			return;
-		}
-
-		if (tc->active) {
-			err = tls_connect(tc);
-		}
-		else {
-			err = tls_accept(tc);
-		}
-
-		if (err) {
-			conn_close(tc, err);
-			return;
-		}
+	uint32_t nrefs;
 
-		DEBUG_INFO("%s: state=0x%04x\n",
-			   tc->active ? "client" : "server",
-			   SSL_state(tc->ssl));
+	tc->up = true;
 
-		/* TLS connection is established */
-		if (SSL_state(tc->ssl) != SSL_ST_OK)
-			return;
+	if (!tc->estabh)
+		return false;
 
-		tc->up = true;
+	mem_ref(tc);
 
-		if (tc->estabh) {
-			uint32_t nrefs;
+	tc->estabh(tc->arg);
 
-			mem_ref(tc);
+	nrefs = mem_nrefs(tc);
+	mem_deref(tc);
 
-			tc->estabh(tc->arg);
+	return nrefs == 1;
+}
 
-                        nrefs = mem_nrefs(tc);
-                        mem_deref(tc);
 
-                        /* check if connection was deref'd from handler */
-                        if (nrefs == 1)
-                                return;
-		}
-	}
+static void conn_read(struct tls_conn *tc, struct mbuf *mb)
+{
+	int err;
 
 	mbuf_set_pos(mb, 0);
 
@@ -399,8 +415,58 @@ static void conn_recv(struct tls_conn *tc, struct mbuf *mb)
 
 	if (tc->recvh && mbuf_get_left(mb) > 0)
 		tc->recvh(mb, tc->arg);
+}
+
 
-	return;
+static void conn_recv(struct tls_conn *tc, struct mbuf *mb)
+{
+	int err, r;
+
+	if (!tc->ssl)
+		return;
+
+	/* the handshake runs on the workers, one step at a time */
+	if (tc->pool && (tc->job || !tc->up)) {
+		pool_recv(tc, mb);
+		return;
+	}
+
+	/* feed SSL data to the BIO */
+	r = BIO_write(tc->sbio_in, mbuf_buf(mb), (int)mbuf_get_left(mb));
+	if (r <= 0) {
+		DEBUG_WARNING("receive bio write error: %i\n", r);
+		ERR_clear_error();
+		conn_close(tc, ENOMEM);
+		return;
+	}
+
+	if (!SSL_is_init_finished(tc->ssl)) {
+
+		if (tc->up) {
+			conn_close(tc, EPROTO);
+			return;
+		}
+
+		err = tls_handshake(tc);
+		if (err) {
+			conn_close(tc, err);
+			return;
+		}
+
+		DEBUG_INFO("%s: state=%s\n",
+			   tc->active ? "client" : "server",
+			   SSL_state_string(tc->ssl));
+
+		/* TLS connection is established */
+		if (!SSL_is_init_finished(tc->ssl))
+			return;
+
+		/* check if connection was deref'd from handler */
+		if (conn_estab(tc))
+			return;
+	}
+
+	conn_read(tc, mb);
 }
 
 
@@ -424,6 +490,7 @@ static int conn_alloc(struct tls_conn **ptc, struct tls *tls,
 	tc->recvh  = recvh;
 	tc->closeh = closeh;
 	tc->arg    = arg;
+	tc->pool   = mem_ref(tls->pool);
 
 	/* Connect the SSL socket */
 	tc->ssl = SSL_new(tls->ctx);
@@ -442,7 +509,7 @@ static int conn_alloc(struct tls_conn **ptc, struct tls *tls,
 		goto out;
 	}
 
-	tc->sbio_out = BIO_new(&bio_udp_send);
+	tc->sbio_out = BIO_new(sock->method);
 	if (!tc->sbio_out) {
 		ERR_clear_error();
 		BIO_free(tc->sbio_in);
@@ -450,7 +517,7 @@ static int conn_alloc(struct tls_conn **ptc, struct tls *tls,
 		goto out;
 	}
 
-	tc->sbio_out->ptr = tc;
+	BIO_set_data(tc->sbio_out, tc);
 
 	SSL_set_bio(tc->ssl, tc->sbio_in, tc->sbio_out);
 
@@ -497,7 +564,10 @@ int dtls_connect(struct tls_conn **ptc, struct tls *tls,
 
 	tc->active = true;
 
-	err = tls_connect(tc);
+	if (tc->pool)
+		err = pool_submit(tc, NULL, 0);
+	else
+		err = tls_handshake(tc);
 	if (err)
 		goto out;
 
@@ -542,18 +612,26 @@ int dtls_accept(struct tls_conn **ptc, struct tls *tls,
 
 	tc->active = false;
 
-	r = BIO_write(tc->sbio_in, mbuf_buf(sock->mb),
-		      (int)mbuf_get_left(sock->mb));
-	if (r <= 0) {
-		DEBUG_WARNING("accept bio write error: %i\n", r);
-		ERR_clear_error();
-		err = ENOMEM;
-		goto out;
+	if (tc->pool) {
+		err = pool_submit(tc, mbuf_buf(sock->mb),
+				  mbuf_get_left(sock->mb));
+		if (err)
+			goto out;
 	}
+	else {
+		r = BIO_write(tc->sbio_in, mbuf_buf(sock->mb),
+			      (int)mbuf_get_left(sock->mb));
+		if (r <= 0) {
+			DEBUG_WARNING("accept bio write error: %i\n", r);
+			ERR_clear_error();
+			err = ENOMEM;
+			goto out;
+		}
 
-	err = tls_accept(tc);
-	if (err)
-		goto out;
+		err = tls_handshake(tc);
+		if (err)
+			goto out;
+	}
 
 	sock->mb = mem_deref(sock->mb);
 
@@ -629,6 +707,9 @@ static void sock_destructor(void *arg)
 	mem_deref(sock->us);
 	mem_deref(sock->ht);
 	mem_deref(sock->mb);
+
+	if (sock->method)
+		bio_method_free(sock->method);
 }
 
 
@@ -725,6 +806,13 @@ int dtls_listen(struct dtls_sock **sockp, const struct sa *laddr,
 	if (err)
 		goto out;
 
+	sock->method = bio_method_alloc();
+	if (!sock->method) {
+		ERR_clear_error();
+		err = ENOMEM;
+		goto out;
+	}
+
 	sock->mtu   = MTU_DEFAULT;
 	sock->connh = connh;
 	sock->arg   = arg;
@@ -779,3 +867,478 @@ void dtls_recv_packet(struct dtls_sock *sock, const struct sa *src,
 
 	recv_handler(&addr, mb, sock);
 }
+
+
+/*
+ * Handshake workers
+ *
+ * The public key operations of a handshake take milliseconds, so with
+ * a pool the handshake steps of a connection run on worker threads.
+ * A step is one received flight: it is fed to the SSL object, which
+ * is only touched by that worker until the step is done. The records
+ * it produces and the result come back to the thread that created the
+ * pool via an mqueue, which sends the records, restarts the timer and
+ * calls the handlers. Records received while a step is running are
+ * kept until it is done. Once established, everything runs on the
+ * main thread again.
+ */
+
+struct dtls_job {
+	struct tls_conn *tc;
+	struct mbuf *in;         /* received record (optional) */
+	struct mbuf *out;        /* records to send, length prefixed */
+	struct le le;
+	int err;
+	bool estab;
+};
+
+enum {
+	POOL_REAP_INTERVAL = 100,  /* [ms] */
+};
+
+struct dtls_pool {
+	struct mqueue *mq;
+	struct list jobl;        /* struct dtls_job, protected by mutex */
+	struct list faill;       /* jobs not handed back, protected by mutex */
+	struct tmr tmr;          /* fails the jobs on faill */
+	unsigned njobs;          /* jobs not handed back yet */
+#ifdef HAVE_PTHREAD
+	pthread_t *tidv;
+	unsigned tidc;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+#endif
+	bool run;
+};
+
+
+static void job_destructor(void *arg)
+{
+	struct dtls_job *job = arg;
+
+	mem_deref(job->in);
+	mem_deref(job->out);
+	mem_deref(job->tc);
+}
+
+
+static int job_output(struct dtls_job *job, const char *buf, int len)
+{
+	int err;
+
+	if (len < 0 || len > 0xffff)
+		return -1;
+
+	if (!job->out) {
+		job->out = mbuf_alloc(512);
+		if (!job->out)
+			return -1;
+	}
+
+	err  = mbuf_write_u16(job->out, (uint16_t)len);
+	err |= mbuf_write_mem(job->out, (const uint8_t *)buf, len);
+
+	return err ? -1 : len;
+}
+
+
+/* runs on a worker */
+static void job_run(struct dtls_job *job)
+{
+	struct tls_conn *tc = job->tc;
+
+	if (job->in) {
+		int r = BIO_write(tc->sbio_in, mbuf_buf(job->in),
+				  (int)mbuf_get_left(job->in));
+		if (r <= 0) {
+			ERR_clear_error();
+			job->err = ENOMEM;
+			return;
+		}
+	}
+
+	job->err = handshake(tc);
+	if (job->err)
+		return;
+
+	job->estab = SSL_is_init_finished(tc->ssl);
+}
+
+
+static void job_send(struct tls_conn *tc, struct mbuf *out)
+{
+	enum {SPACE = 4};
+
+	out->pos = 0;
+
+	while (mbuf_get_left(out) >= 2) {
+		const size_t len = mbuf_read_u16(out);
+		struct mbuf *mb;
+		int err;
+
+		if (len > mbuf_get_left(out))
+			break;
+
+		mb = mbuf_alloc(SPACE + len);
+		if (!mb)
+			return;
+
+		mb->pos = SPACE;
+		(void)mbuf_write_mem(mb, mbuf_buf(out), len);
+		mb->pos = SPACE;
+
+		err = udp_send_helper(tc->sock->us, &tc->peer, mb,
+				      tc->sock->uh);
+		if (err) {
+			DEBUG_NOTICE("send %zu bytes failed (%m)\n",
+				     len, err);
+		}
+
+		mem_deref(mb);
+		mbuf_advance(out, len);
+	}
+}
+
+
+/* the next record that arrived during the last step */
+static struct mbuf *pend_pop(struct tls_conn *tc)
+{
+	struct mbuf *mb;
+	size_t len;
+
+	if (!tc->pend || mbuf_get_left(tc->pend) < 2)
+		return NULL;
+
+	len = mbuf_read_u16(tc->pend);
+	if (len > mbuf_get_left(tc->pend)) {
+		tc->pend = mem_deref(tc->pend);
+		return NULL;
+	}
+
+	mb = mbuf_alloc(len);
+	if (mb) {
+		(void)mbuf_write_mem(mb, mbuf_buf(tc->pend), len);
+		mb->pos = 0;
+	}
+
+	mbuf_advance(tc->pend, len);
+
+	if (!mbuf_get_left(tc->pend))
+		tc->pend = mem_deref(tc->pend);
+
+	return mb;
+}
+
+
+/* a handshake step is done, back on the main thread */
+static void pool_mqueue_handler(int id, void *data, void *arg)
+{
+	struct dtls_job *job = data;
+	struct tls_conn *tc = job->tc;
+	struct dtls_pool *pool = arg;
+	struct mbuf *mb;
+	(void)id;
+
+	--pool->njobs;
+	tc->job = NULL;
+
+	/* the connection was deref'd while the worker had it */
+	if (mem_nrefs(tc) == 1)
+		goto out;
+
+	if (job->out)
+		job_send(tc, job->out);
+
+	if (job->err) {
+		conn_close(tc, job->err);
+		goto out;
+	}
+
+	check_timer(tc);
+
+	if (job->estab && !tc->up) {
+
+		DEBUG_INFO("%s: established on worker\n",
+			   tc->active ? "client" : "server");
+
+		if (conn_estab(tc))
+			goto out;
+
+		/* application data in the last flight */
+		mb = mbuf_alloc(8192);
+		if (mb) {
+			conn_read(tc, mb);
+			mem_deref(mb);
+		}
+	}
+
+	/* a record may start the next step */
+	while (tc->ssl && !tc->job && (mb = pend_pop(tc))) {
+
+		mem_ref(tc);
+		conn_recv(tc, mb);
+		mem_deref(mb);
+
+		if (mem_nrefs(tc) == 1) {
+			mem_deref(tc);
+			break;
+		}
+		mem_deref(tc);
+	}
+
+ out:
+	mem_deref(job);
+}
+
+
+static void pool_recv(struct tls_conn *tc, const struct mbuf *mb)
+{
+	const size_t len = mbuf_get_left(mb);
+	size_t pos;
+	int err = 0;
+
+	if (!tc->job) {
+		err = pool_submit(tc, mbuf_buf(mb), len);
+		if (err)
+			conn_close(tc, err);
+		return;
+	}
+
+	if (len > 0xffff)
+		return;
+
+	if (!tc->pend) {
+		tc->pend = mbuf_alloc(len + 2);
+		if (!tc->pend)
+			return;
+	}
+
+	/* append after the records that are not read yet */
+	pos = tc->pend->pos;
+	tc->pend->pos = tc->pend->end;
+	err  = mbuf_write_u16(tc->pend, (uint16_t)len);
+	err |= mbuf_write_mem(tc->pend, mbuf_buf(mb), len);
+	tc->pend->pos = pos;
+	if (err)
+		DEBUG_WARNING("pending record dropped (%m)\n", err);
+}
+
+
+#ifdef HAVE_PTHREAD
+static void *pool_thread(void *arg)
+{
+	struct dtls_pool *pool = arg;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	for (;;) {
+		struct dtls_job *job;
+		int err;
+
+		while (pool->run && !pool->jobl.head)
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+
+		if (!pool->run)
+			break;
+
+		job = pool->jobl.head->data;
+		list_unlink(&job->le);
+
+		pthread_mutex_unlock(&pool->mutex);
+
+		job_run(job);
+
+		err = mqueue_push(pool->mq, 0, job);
+
+		pthread_mutex_lock(&pool->mutex);
+
+		/* the main thread fails the connection from its timer */
+		if (err) {
+			DEBUG_WARNING("worker: mqueue push failed (%m)\n",
+				      err);
+			if (!job->err)
+				job->err = err;
+			list_append(&pool->faill, &job->le, job);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+
+/* hand back the jobs that the workers could not queue, as failed */
+static void pool_reap(void *arg)
+{
+	struct dtls_pool *pool = arg;
+
+	/* the last connection may take the pool with it */
+	mem_ref(pool);
+
+	for (;;) {
+		struct le *le;
+
+		pthread_mutex_lock(&pool->mutex);
+		le = pool->faill.head;
+		list_unlink(le);
+		pthread_mutex_unlock(&pool->mutex);
+
+		if (!le)
+			break;
+
+		pool_mqueue_handler(0, le->data, pool);
+	}
+
+	if (pool->njobs)
+		tmr_start(&pool->tmr, POOL_REAP_INTERVAL, pool_reap, pool);
+
+	mem_deref(pool);
+}
+#endif
+
+
+static int pool_submit(struct tls_conn *tc, const uint8_t *p, size_t len)
+{
+	struct dtls_pool *pool = tc->pool;
+	struct dtls_job *job;
+	int err = 0;
+
+	job = mem_zalloc(sizeof(*job), job_destructor);
+	if (!job)
+		return ENOMEM;
+
+	if (p && len) {
+		job->in = mbuf_alloc(len);
+		if (!job->in) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		(void)mbuf_write_mem(job->in, p, len);
+		job->in->pos = 0;
+	}
+
+	/* the job keeps the connection while the worker has it */
+	job->tc = mem_ref(tc);
+	tc->job = job;
+	++pool->njobs;
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&pool->mutex);
+	list_append(&pool->jobl, &job->le, job);
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!tmr_isrunning(&pool->tmr))
+		tmr_start(&pool->tmr, POOL_REAP_INTERVAL, pool_reap, pool);
+#else
+	job_run(job);
+	err = mqueue_push(pool->mq, 0, job);
+	if (err) {
+		--pool->njobs;
+		tc->job = NULL;
+		goto out;
+	}
+#endif
+
+ out:
+	if (err)
+		mem_deref(job);
+
+	return err;
+}
+
+
+static void pool_destructor(void *arg)
+{
+	struct dtls_pool *pool = arg;
+#ifdef HAVE_PTHREAD
+	unsigned i;
+
+	tmr_cancel(&pool->tmr);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->run = false;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->tidc; i++)
+		pthread_join(pool->tidv[i], NULL);
+
+	mem_deref(pool->tidv);
+
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->cond);
+#endif
+
+	/* connections hold a reference, so no jobs are left */
+	mem_deref(pool->mq);
+}
+
+
+/**
+ * Run the DTLS handshakes of a TLS context on worker threads
+ *
+ * Must be called from the thread that runs the connections, before
+ * they are created. The handlers are still called on that thread.
+ *
+ * @param tls      TLS Context
+ * @param nthreads Number of worker threads, 0 to use none
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dtls_set_workers(struct tls *tls, unsigned nthreads)
+{
+#ifdef HAVE_PTHREAD
+	struct dtls_pool *pool;
+	int err;
+#endif
+
+	if (!tls)
+		return EINVAL;
+
+	tls->pool = mem_deref(tls->pool);
+
+	if (!nthreads)
+		return 0;
+
+#ifndef HAVE_PTHREAD
+	return ENOSYS;
+#else
+	pool = mem_zalloc(sizeof(*pool), pool_destructor);
+	if (!pool)
+		return ENOMEM;
+
+	err = mqueue_alloc(&pool->mq, pool_mqueue_handler, pool);
+	if (err) {
+		mem_deref(pool);
+		return err;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->run = true;
+
+	pool->tidv = mem_zalloc(nthreads * sizeof(*pool->tidv), NULL);
+	if (!pool->tidv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (; pool->tidc < nthreads; pool->tidc++) {
+		err = pthread_create(&pool->tidv[pool->tidc], NULL,
+				     pool_thread, pool);
+		if (err)
+			goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(pool);
+	else
+		tls->pool = pool;
+
+	return err;
+#endif
+}
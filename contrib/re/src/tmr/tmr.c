@@ -12,8 +12,10 @@
 #else
 #include <time.h>
 #endif
-#ifdef HAVE_PTHREAD
+#if defined (HAVE_PTHREAD) || defined (USE_TMR_WHEEL)
 #include <stdlib.h>
+#endif
+#ifdef HAVE_PTHREAD
 #include <pthread.h>
 #endif
 #include <re_types.h>
@@ -40,6 +42,7 @@ enum {
 extern struct list *tmrl_get(void);
 
 
+#ifndef USE_TMR_WHEEL
 static bool inspos_handler(struct le *le, void *arg)
 {
 	struct tmr *tmr = le->data;
@@ -56,6 +59,7 @@ static bool inspos_handler_0(struct le *le, void *arg)
 
 	return tmr->jfs > now;
 }
+#endif
 
 
 #if TMR_DEBUG
@@ -77,6 +81,297 @@ static void call_handler(tmr_h *th, void *arg)
 #endif
 
 
+#ifdef USE_TMR_WHEEL
+/*
+ * Hierarchical timer wheel
+ *
+ * Level 0 has 256 slots of 1 [ms], levels 1-4 have 64 slots each, with
+ * every slot of a level covering a full turn of the level below it. This
+ * gives a range of 2^32 [ms]; timers further away are parked in the last
+ * slot and re-inserted when it is cascaded. A level-0 slot only ever
+ * holds timers with the same expiry, so timers fire in expiry order.
+ * Unlike the sorted list, timers with the same expiry are not always
+ * fired in the order they were started: a timer cascaded down from a
+ * higher level is appended behind the ones added to the slot directly.
+ * The occupancy bitmap lets tmr_poll() skip idle time and
+ * tmr_next_timeout() find the next event without walking the slots.
+ */
+enum {
+	TMRW_L0_BITS = 8,
+	TMRW_LN_BITS = 6,
+	TMRW_LEVELS  = 5,
+	TMRW_L0_SIZE = 1 << TMRW_L0_BITS,
+	TMRW_LN_SIZE = 1 << TMRW_LN_BITS,
+	TMRW_SLOTS   = TMRW_L0_SIZE + (TMRW_LEVELS - 1) * TMRW_LN_SIZE,
+};
+
+#define TMRW_RANGE (1ULL << (TMRW_L0_BITS + \
+			     (TMRW_LEVELS - 1) * TMRW_LN_BITS))
+
+struct tmrw {
+	struct list slotv[TMRW_SLOTS];  /**< Level 0 followed by levels 1-4 */
+	uint64_t bitmap[TMRW_SLOTS/64]; /**< Slot occupancy, one bit each   */
+	uint64_t clk;                   /**< Next tick to be processed [ms] */
+	uint32_t n;                     /**< Number of active timers        */
+};
+
+extern struct tmrw **tmrw_get(void);
+void tmrw_free(struct tmrw *tmrw);
+
+
+static inline unsigned level_shift(unsigned lvl)
+{
+	return lvl ? TMRW_L0_BITS + (lvl - 1) * TMRW_LN_BITS : 0;
+}
+
+
+static inline unsigned level_base(unsigned lvl)
+{
+	return lvl ? TMRW_L0_SIZE + (lvl - 1) * TMRW_LN_SIZE : 0;
+}
+
+
+static inline unsigned first_bit(uint64_t v)
+{
+#if defined (__GNUC__)
+	return (unsigned)__builtin_ctzll(v);
+#else
+	unsigned i = 0;
+
+	while (!(v & 1)) {
+		v >>= 1;
+		++i;
+	}
+
+	return i;
+#endif
+}
+
+
+static struct tmrw *tmrw_lookup(bool create)
+{
+	struct tmrw **wp = tmrw_get();
+
+	if (!*wp && create) {
+
+		*wp = calloc(1, sizeof(**wp));
+		if (!*wp) {
+			DEBUG_WARNING("wheel: out of memory\n");
+			return NULL;
+		}
+
+		(*wp)->clk = tmr_jiffies();
+	}
+
+	return *wp;
+}
+
+
+void tmrw_free(struct tmrw *tmrw)
+{
+	unsigned i;
+
+	if (!tmrw)
+		return;
+
+	if (tmrw->n)
+		DEBUG_INFO("wheel: %u timers still running\n", tmrw->n);
+
+	/* a later tmr_cancel() must not touch the freed slots */
+	for (i = 0; i < TMRW_SLOTS; i++) {
+		struct le *le;
+
+		for (le = tmrw->slotv[i].head; le; le = le->next) {
+			struct tmr *tmr = le->data;
+
+			tmr->th = NULL;
+		}
+
+		list_clear(&tmrw->slotv[i]);
+	}
+
+	free(tmrw);
+}
+
+
+static void tmrw_add(struct tmrw *w, struct tmr *tmr)
+{
+	uint64_t jfs = tmr->jfs;
+	uint64_t delta;
+	unsigned idx, lvl;
+
+	if (jfs < w->clk)
+		jfs = w->clk;
+
+	delta = jfs - w->clk;
+	if (delta >= TMRW_RANGE) {
+		jfs = w->clk + TMRW_RANGE - 1;
+		delta = TMRW_RANGE - 1;
+	}
+
+	if (delta < TMRW_L0_SIZE) {
+		idx = (unsigned)(jfs & (TMRW_L0_SIZE - 1));
+	}
+	else {
+		for (lvl = 1; lvl < TMRW_LEVELS - 1; lvl++) {
+			if (delta < (1ULL << level_shift(lvl + 1)))
+				break;
+		}
+
+		idx = level_base(lvl) +
+			(unsigned)((jfs >> level_shift(lvl)) &
+				   (TMRW_LN_SIZE - 1));
+	}
+
+	list_append(&w->slotv[idx], &tmr->le, tmr);
+	w->bitmap[idx / 64] |= 1ULL << (idx % 64);
+	++w->n;
+}
+
+
+static void tmrw_del(struct tmrw *w, struct tmr *tmr)
+{
+	struct list *slot = tmr->le.list;
+
+	if (!slot)
+		return;
+
+	list_unlink(&tmr->le);
+
+	if (list_isempty(slot)) {
+		const unsigned idx = (unsigned)(slot - w->slotv);
+
+		w->bitmap[idx / 64] &= ~(1ULL << (idx % 64));
+	}
+
+	--w->n;
+}
+
+
+/* Re-insert all timers of the current slot on a level, returns its index */
+static unsigned tmrw_cascade(struct tmrw *w, unsigned lvl)
+{
+	const unsigned j = (unsigned)((w->clk >> level_shift(lvl)) &
+				      (TMRW_LN_SIZE - 1));
+	struct list *slot = &w->slotv[level_base(lvl) + j];
+
+	while (slot->head) {
+		struct tmr *tmr = slot->head->data;
+
+		tmrw_del(w, tmr);
+		tmrw_add(w, tmr);
+	}
+
+	return j;
+}
+
+
+/* Earliest tick at or after clk that has work: an expiry or a cascade */
+static uint64_t tmrw_next(const struct tmrw *w)
+{
+	const unsigned p = (unsigned)(w->clk & (TMRW_L0_SIZE - 1));
+	uint64_t next = UINT64_MAX;
+	unsigned lvl, i;
+
+	if (!w->n)
+		return next;
+
+	for (i = 0; i <= TMRW_L0_SIZE / 64; i++) {
+		const unsigned wi = ((p / 64) + i) % (TMRW_L0_SIZE / 64);
+		uint64_t v = w->bitmap[wi];
+
+		if (i == 0)
+			v &= ~0ULL << (p % 64);
+		else if (i == TMRW_L0_SIZE / 64)
+			v &= (1ULL << (p % 64)) - 1;
+
+		if (v) {
+			const unsigned idx = wi * 64 + first_bit(v);
+
+			next = w->clk + ((idx - p) & (TMRW_L0_SIZE - 1));
+			break;
+		}
+	}
+
+	for (lvl = 1; lvl < TMRW_LEVELS; lvl++) {
+		const unsigned shift = level_shift(lvl);
+		const uint64_t c = w->clk >> shift;
+		const unsigned cur = (unsigned)(c & (TMRW_LN_SIZE - 1));
+		uint64_t v = w->bitmap[level_base(lvl) / 64];
+		uint64_t d, t;
+
+		if (!v)
+			continue;
+
+		/* rotate so that bit 0 is the current slot */
+		if (cur)
+			v = (v >> cur) | (v << (TMRW_LN_SIZE - cur));
+
+		d = first_bit(v);
+
+		/* current slot was cascaded already, next turn */
+		if (d == 0 && (w->clk & ((1ULL << shift) - 1)))
+			d = TMRW_LN_SIZE;
+
+		t = (c + d) << shift;
+		if (t < next)
+			next = t;
+	}
+
+	return next;
+}
+
+
+static void tmrw_poll(struct tmrw *w)
+{
+	const uint64_t jfs = tmr_jiffies();
+
+	while (w->clk <= jfs) {
+		struct list *slot;
+		uint64_t next;
+
+		next = tmrw_next(w);
+		if (next > jfs) {
+			w->clk = jfs + 1;
+			break;
+		}
+
+		w->clk = next;
+
+		if (!(w->clk & (TMRW_L0_SIZE - 1))) {
+			unsigned lvl = 1;
+
+			while (lvl < TMRW_LEVELS && !tmrw_cascade(w, lvl))
+				++lvl;
+		}
+
+		slot = &w->slotv[w->clk & (TMRW_L0_SIZE - 1)];
+
+		/* handlers may add more expired timers to this slot */
+		while (slot->head) {
+			struct tmr *tmr = slot->head->data;
+			tmr_h *th = tmr->th;
+			void *th_arg = tmr->arg;
+
+			tmrw_del(w, tmr);
+			tmr->th = NULL;
+
+			if (!th)
+				continue;
+
+#if TMR_DEBUG
+			call_handler(th, th_arg);
+#else
+			th(th_arg);
+#endif
+		}
+
+		++w->clk;
+	}
+}
+#endif
+
+
 /**
  * Poll all timers in the current thread
  *
@@ -84,6 +379,14 @@ static void call_handler(tmr_h *th, void *arg)
  */
 void tmr_poll(struct list *tmrl)
 {
+#ifdef USE_TMR_WHEEL
+	struct tmrw *w = tmrw_lookup(false);
+
+	(void)tmrl;
+
+	if (w)
+		tmrw_poll(w);
+#else
 	const uint64_t jfs = tmr_jiffies();
 
 	for (;;) {
@@ -113,6 +416,7 @@ void tmr_poll(struct list *tmrl)
 		th(th_arg);
 #endif
 	}
+#endif
 }
 
 
@@ -158,6 +462,23 @@ uint64_t tmr_jiffies(void)
 uint64_t tmr_next_timeout(struct list *tmrl)
 {
 	const uint64_t jif = tmr_jiffies();
+#ifdef USE_TMR_WHEEL
+	const struct tmrw *w = tmrw_lookup(false);
+	uint64_t next;
+
+	(void)tmrl;
+
+	if (!w || !w->n)
+		return 0;
+
+	/* may be a cascade point rather than an expiry, which is harmless */
+	next = tmrw_next(w);
+
+	if (next <= jif)
+		return 1;
+	else
+		return next - jif;
+#else
 	const struct tmr *tmr;
 
 	tmr = list_ledata(tmrl->head);
@@ -168,31 +489,56 @@ uint64_t tmr_next_timeout(struct list *tmrl)
 		return 1;
 	else
 		return tmr->jfs - jif;
+#endif
+}
+
+
+static int list_status(struct re_printf *pf, const struct list *tmrl)
+{
+	struct le *le;
+	int err = 0;
+
+	for (le = tmrl->head; le; le = le->next) {
+		const struct tmr *tmr = le->data;
+
+		err |= re_hprintf(pf, "  %p: th=%p expire=%llums\n",
+				  tmr, tmr->th,
+				  (unsigned long long)tmr_get_expire(tmr));
+	}
+
+	return err;
 }
 
 
 int tmr_status(struct re_printf *pf, void *unused)
 {
+#ifdef USE_TMR_WHEEL
+	const struct tmrw *w = tmrw_lookup(false);
+	unsigned i;
+#else
 	struct list *tmrl = tmrl_get();
-	struct le *le;
+#endif
 	uint32_t n;
 	int err;
 
 	(void)unused;
 
+#ifdef USE_TMR_WHEEL
+	n = w ? w->n : 0;
+#else
 	n = list_count(tmrl);
+#endif
 	if (!n)
 		return 0;
 
 	err = re_hprintf(pf, "Timers (%u):\n", n);
 
-	for (le = tmrl->head; le; le = le->next) {
-		const struct tmr *tmr = le->data;
-
-		err |= re_hprintf(pf, "  %p: th=%p expire=%llums\n",
-				  tmr, tmr->th,
-				  (unsigned long long)tmr_get_expire(tmr));
-	}
+#ifdef USE_TMR_WHEEL
+	for (i = 0; i < TMRW_SLOTS; i++)
+		err |= list_status(pf, &w->slotv[i]);
+#else
+	err |= list_status(pf, tmrl);
+#endif
 
 	if (n > 100)
 		err |= re_hprintf(pf, "    (Dumped Timers: %u)\n", n);
@@ -206,8 +552,15 @@ int tmr_status(struct re_printf *pf, void *unused)
  */
 void tmr_debug(void)
 {
+#ifdef USE_TMR_WHEEL
+	const struct tmrw *w = tmrw_lookup(false);
+
+	if (w && w->n)
+		(void)re_fprintf(stderr, "%H", tmr_status, NULL);
+#else
 	if (!list_isempty(tmrl_get()))
 		(void)re_fprintf(stderr, "%H", tmr_status, NULL);
+#endif
 }
 
 
@@ -235,15 +588,27 @@ void tmr_init(struct tmr *tmr)
  */
 void tmr_start(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg)
 {
+#ifdef USE_TMR_WHEEL
+	struct tmrw *w;
+#else
 	struct list *tmrl = tmrl_get();
 	struct le *le;
+#endif
 
 	if (!tmr)
 		return;
 
+#ifdef USE_TMR_WHEEL
+	w = tmrw_lookup(th != NULL);
+
+	if (tmr->th && w) {
+		tmrw_del(w, tmr);
+	}
+#else
 	if (tmr->th) {
 		list_unlink(&tmr->le);
 	}
+#endif
 
 	tmr->th  = th;
 	tmr->arg = arg;
@@ -253,6 +618,14 @@ void tmr_start(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg)
 
 	tmr->jfs = delay + tmr_jiffies();
 
+#ifdef USE_TMR_WHEEL
+	if (!w) {
+		tmr->th = NULL;
+		return;
+	}
+
+	tmrw_add(w, tmr);
+#else
 	if (delay == 0) {
 		le = list_apply(tmrl, true, inspos_handler_0, &tmr->jfs);
 		if (le) {
@@ -271,6 +644,7 @@ void tmr_start(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg)
 			list_prepend(tmrl, &tmr->le, tmr);
 		}
 	}
+#endif
 
 #ifdef HAVE_ACTSCHED
 	/* TODO: this is a hack. when a new timer is started we must reset
@@ -3,6 +3,9 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#ifdef HAVE_MMSG
+#define _GNU_SOURCE 1
+#endif
 #include <stdlib.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -16,6 +19,12 @@
 #include <netdb.h>
 #endif
 #include <string.h>
+#ifdef HAVE_MMSG
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_UDP_GSO
+#include <netinet/udp.h>
+#endif
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
 #endif
@@ -56,8 +65,27 @@
 
 
 enum {
-	UDP_RXSZ_DEFAULT = 8192
+	UDP_RXSZ_DEFAULT = 8192,
+	UDP_RX_BATCH = 8,      /**< Datagrams per recvmmsg() call */
+	UDP_TX_BATCH = 32,     /**< Datagrams per sendmmsg() call */
+	UDP_GSO_MAXSZ = 60000, /**< Max bytes in one UDP_SEGMENT send */
+};
+
+#ifdef HAVE_UDP_GSO
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+/** UDP Generic Segmentation Offload state */
+enum udp_gso {
+	UDP_GSO_UNKNOWN = 0,
+	UDP_GSO_ON,
+	UDP_GSO_OFF,
 };
+#endif
 
 
 /** Defines a UDP socket */
@@ -68,9 +96,16 @@ struct udp_sock {
 	void *arg;           /**< Handler argument            */
 	int fd;              /**< Socket file descriptor      */
 	int fd6;             /**< IPv6 socket file descriptor */
+	struct udp_sock *parent; /**< Socket owning the fds if shared */
 	bool conn;           /**< Connected socket flag       */
 	size_t rxsz;         /**< Maximum receive chunk size  */
 	size_t rx_presz;     /**< Preallocated rx buffer size */
+#ifdef HAVE_MMSG
+	struct mbuf *rxv[UDP_RX_BATCH]; /**< Reusable rx buffers  */
+#endif
+#ifdef HAVE_UDP_GSO
+	enum udp_gso gso;    /**< Segmentation offload state  */
+#endif
 };
 
 /** Defines a UDP helper */
@@ -116,6 +151,9 @@ static bool helper_recv_handler(struct sa *src,
 static void udp_destructor(void *data)
 {
 	struct udp_sock *us = data;
+#ifdef HAVE_MMSG
+	size_t i;
+#endif
 
 	list_flush(&us->helpers);
 
@@ -128,14 +166,42 @@ static void udp_destructor(void *data)
 		fd_close(us->fd6);
 		(void)close(us->fd6);
 	}
+
+#ifdef HAVE_MMSG
+	for (i = 0; i < UDP_RX_BATCH; i++)
+		mem_deref(us->rxv[i]);
+#endif
+
+	mem_deref(us->parent);
+}
+
+
+static void udp_deliver(struct udp_sock *us, struct sa *src, struct mbuf *mb)
+{
+	struct le *le;
+
+	/* call helpers */
+	le = us->helpers.head;
+	while (le) {
+		struct udp_helper *uh = le->data;
+		bool hdld;
+
+		le = le->next;
+
+		hdld = uh->recvh(src, mb, uh->arg);
+		if (hdld)
+			return;
+	}
+
+	us->rh(src, mb, us->arg);
 }
 
 
+#ifndef HAVE_MMSG
 static void udp_read(struct udp_sock *us, int fd)
 {
 	struct mbuf *mb = mbuf_alloc(us->rxsz);
 	struct sa src;
-	struct le *le;
 	int err = 0;
 	ssize_t n;
 
@@ -207,24 +273,93 @@ static void udp_read(struct udp_sock *us, int fd)
 
 	(void)mbuf_resize(mb, mb->end);
 
-	/* call helpers */
-	le = us->helpers.head;
-	while (le) {
-		struct udp_helper *uh = le->data;
-		bool hdld;
+	udp_deliver(us, &src, mb);
 
-		le = le->next;
+ out:
+	mem_deref(mb);
+}
+#else
 
-		hdld = uh->recvh(&src, mb, uh->arg);
-		if (hdld)
-			goto out;
+
+/*
+ * Receive up to UDP_RX_BATCH datagrams with one recvmmsg() call.
+ * Buffers that the handlers did not keep a reference to are reused.
+ */
+static void udp_read_batch(struct udp_sock *us, int fd)
+{
+	struct mmsghdr msgv[UDP_RX_BATCH];
+	struct iovec iov[UDP_RX_BATCH];
+	struct sa srcv[UDP_RX_BATCH];
+	unsigned i, vlen;
+	int n, err;
+
+	for (vlen = 0; vlen < UDP_RX_BATCH; vlen++) {
+		struct mbuf *mb = us->rxv[vlen];
+
+		if (!mb) {
+			mb = us->rxv[vlen] = mbuf_alloc(us->rxsz);
+			if (!mb)
+				break;
+		}
+		else if (mb->size < us->rxsz) {
+			if (mbuf_resize(mb, us->rxsz))
+				break;
+		}
+
+		iov[vlen].iov_base = mb->buf + us->rx_presz;
+		iov[vlen].iov_len  = us->rxsz - us->rx_presz;
+
+		memset(&msgv[vlen], 0, sizeof(msgv[vlen]));
+		msgv[vlen].msg_hdr.msg_name    = &srcv[vlen].u.sa;
+		msgv[vlen].msg_hdr.msg_namelen = sizeof(srcv[vlen].u);
+		msgv[vlen].msg_hdr.msg_iov     = &iov[vlen];
+		msgv[vlen].msg_hdr.msg_iovlen  = 1;
 	}
 
-	us->rh(&src, mb, us->arg);
+	if (!vlen)
+		return;
 
- out:
-	mem_deref(mb);
+	n = recvmmsg(fd, msgv, vlen, 0, NULL);
+	if (n < 0) {
+		err = errno;
+
+		if (EAGAIN == err)
+			return;
+
+#ifdef EWOULDBLOCK
+		if (EWOULDBLOCK == err)
+			return;
+#endif
+
+		if (us->eh)
+			us->eh(err, us->arg);
+
+		return;
+	}
+
+	/* a handler may drop the last reference to the socket */
+	mem_ref(us);
+
+	for (i = 0; i < (unsigned)n; i++) {
+		struct mbuf *mb = us->rxv[i];
+
+		srcv[i].len = msgv[i].msg_hdr.msg_namelen;
+
+		mb->pos = us->rx_presz;
+		mb->end = msgv[i].msg_len + us->rx_presz;
+
+		udp_deliver(us, &srcv[i], mb);
+
+		if (mem_nrefs(mb) > 1)
+			us->rxv[i] = mem_deref(mb);
+
+		if (mem_nrefs(us) == 1)
+			break;
+	}
+
+	mem_deref(us);
 }
+#endif
 
 
 static void udp_read_handler(int flags, void *arg)
@@ -233,7 +368,11 @@ static void udp_read_handler(int flags, void *arg)
 
 	(void)flags;
 
+#ifdef HAVE_MMSG
+	udp_read_batch(us, us->fd);
+#else
 	udp_read(us, us->fd);
+#endif
 }
 
 
@@ -243,7 +382,11 @@ static void udp_read_handler6(int flags, void *arg)
 
 	(void)flags;
 
+#ifdef HAVE_MMSG
+	udp_read_batch(us, us->fd6);
+#else
 	udp_read(us, us->fd6);
+#endif
 }
 
 
@@ -411,6 +554,10 @@ int udp_connect(struct udp_sock *us, const struct sa *peer)
 	if (!us || !peer)
 		return EINVAL;
 
+	/* the fds belong to the parent */
+	if (us->parent)
+		return ENOTSUP;
+
 	/* choose a socket */
 	if (AF_INET6 == sa_af(peer) && -1 != us->fd6)
 		fd = us->fd6;
@@ -426,35 +573,64 @@ int udp_connect(struct udp_sock *us, const struct sa *peer)
 }
 
 
-static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
-			     struct mbuf *mb, struct le *le)
+/* the socket that owns the file descriptors */
+static inline struct udp_sock *udp_fd_sock(struct udp_sock *us)
 {
-	struct sa hdst;
-	int err = 0, fd;
+	return us->parent ? us->parent : us;
+}
+
+
+static inline int udp_send_fd(const struct udp_sock *us, const struct sa *dst)
+{
+	if (us->parent)
+		us = us->parent;
 
-	/* choose a socket */
 	if (AF_INET6 == sa_af(dst) && -1 != us->fd6)
-		fd = us->fd6;
+		return us->fd6;
 	else
-		fd = us->fd;
+		return us->fd;
+}
+
 
-	/* call helpers in reverse order */
+/*
+ * Call send helpers in reverse order. Returns true if a helper consumed
+ * the packet or failed, otherwise *dstp is the address to send to.
+ */
+static bool udp_send_helpers(int *err, const struct sa **dstp,
+			     struct sa *hdst, struct mbuf *mb, struct le *le)
+{
 	while (le) {
 		struct udp_helper *uh = le->data;
 
 		le = le->prev;
 
-		if (dst != &hdst) {
-			sa_cpy(&hdst, dst);
-			dst = &hdst;
+		if (*dstp != hdst) {
+			sa_cpy(hdst, *dstp);
+			*dstp = hdst;
 		}
 
-		if (uh->sendh(&err, &hdst, mb, uh->arg) || err)
-			return err;
+		if (uh->sendh(err, hdst, mb, uh->arg) || *err)
+			return true;
 	}
 
+	return false;
+}
+
+
+static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
+			     struct mbuf *mb, struct le *le)
+{
+	struct sa hdst;
+	int err = 0, fd;
+
+	/* choose a socket */
+	fd = udp_send_fd(us, dst);
+
+	if (udp_send_helpers(&err, &dst, &hdst, mb, le))
+		return err;
+
 	/* Connected socket? */
-	if (us->conn) {
+	if (udp_fd_sock(us)->conn) {
 		if (send(fd, BUF_CAST mb->buf + mb->pos, mb->end - mb->pos,
 			 0) < 0)
 			return errno;
@@ -487,6 +663,280 @@ int udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb)
 }
 
 
+#ifdef HAVE_MMSG
+/*
+ * sendmmsg() fails only when the first message could not be sent,
+ * so skip that one and carry on with the rest.
+ */
+static int udp_send_mmsg(int fd, struct mmsghdr *msgv, unsigned vlen)
+{
+	unsigned sent = 0;
+	int err = 0;
+
+	while (sent < vlen) {
+		int n = sendmmsg(fd, msgv + sent, vlen - sent, 0);
+		if (n < 0) {
+			if (EINTR == errno)
+				continue;
+
+			if (!err)
+				err = errno;
+
+			++sent;
+			continue;
+		}
+
+		sent += n;
+	}
+
+	return err;
+}
+#endif
+
+
+#ifdef HAVE_UDP_GSO
+/*
+ * Kernels without UDP_SEGMENT silently ignore the control message and
+ * would send one large datagram, so ask the socket before using it.
+ */
+static bool udp_gso_supported(struct udp_sock *us, int fd)
+{
+	if (UDP_GSO_UNKNOWN == us->gso) {
+		int val = 0;
+		socklen_t len = sizeof(val);
+
+		if (0 == getsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, &len))
+			us->gso = UDP_GSO_ON;
+		else
+			us->gso = UDP_GSO_OFF;
+	}
+
+	return UDP_GSO_ON == us->gso;
+}
+
+
+static bool msg_same_dst(const struct msghdr *a, const struct msghdr *b)
+{
+	if (a->msg_namelen != b->msg_namelen)
+		return false;
+
+	return !a->msg_namelen ||
+		0 == memcmp(a->msg_name, b->msg_name, a->msg_namelen);
+}
+
+
+/* Number of messages from msgv that can go in one segmented send */
+static unsigned gso_run(const struct mmsghdr *msgv, unsigned vlen)
+{
+	const size_t seg = msgv[0].msg_hdr.msg_iov->iov_len;
+	size_t total = seg;
+	unsigned n = 1;
+
+	while (n < vlen) {
+		const size_t len = msgv[n].msg_hdr.msg_iov->iov_len;
+
+		if (len > seg || total + len > UDP_GSO_MAXSZ)
+			break;
+
+		if (!msg_same_dst(&msgv[0].msg_hdr, &msgv[n].msg_hdr))
+			break;
+
+		total += len;
+		++n;
+
+		/* only the last segment may be shorter */
+		if (len < seg)
+			break;
+	}
+
+	return n;
+}
+
+
+static int udp_send_gso(int fd, const struct mmsghdr *msg, unsigned n)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr align;
+	} ctrl;
+	struct msghdr mh = msg->msg_hdr;
+	struct cmsghdr *cm;
+	uint16_t seg = (uint16_t)msg->msg_hdr.msg_iov->iov_len;
+
+	memset(&ctrl, 0, sizeof(ctrl));
+
+	/* the iovecs of consecutive messages are adjacent */
+	mh.msg_iovlen     = n;
+	mh.msg_control    = ctrl.buf;
+	mh.msg_controllen = sizeof(ctrl.buf);
+
+	cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_UDP;
+	cm->cmsg_type  = UDP_SEGMENT;
+	cm->cmsg_len   = CMSG_LEN(sizeof(seg));
+	memcpy(CMSG_DATA(cm), &seg, sizeof(seg));
+
+	while (sendmsg(fd, &mh, 0) < 0) {
+		if (EINTR != errno)
+			return errno;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Send runs of equally sized datagrams to the same destination as one
+ * UDP_SEGMENT send each, everything else with sendmmsg().
+ */
+static int udp_send_vec(struct udp_sock *us, int fd,
+			struct mmsghdr *msgv, unsigned vlen)
+{
+	unsigned i = 0, p = 0;
+	int err = 0, lerr;
+
+	if (!udp_gso_supported(us, fd))
+		return udp_send_mmsg(fd, msgv, vlen);
+
+	while (i < vlen) {
+		const unsigned n = gso_run(msgv + i, vlen - i);
+
+		if (n < 2) {
+			++i;
+			continue;
+		}
+
+		lerr = udp_send_mmsg(fd, msgv + p, i - p);
+		if (lerr && !err)
+			err = lerr;
+
+		lerr = udp_send_gso(fd, &msgv[i], n);
+		switch (lerr) {
+
+		case 0:
+			break;
+
+		case EIO:          /* no checksum offload on the device */
+		case ENOPROTOOPT:
+		case EOPNOTSUPP:
+			us->gso = UDP_GSO_OFF;
+			/*@fallthrough@*/
+		case EINVAL:       /* e.g. segment larger than the MTU */
+			lerr = udp_send_mmsg(fd, msgv + i, n);
+			/*@fallthrough@*/
+		default:
+			if (lerr && !err)
+				err = lerr;
+			break;
+		}
+
+		i += n;
+		p = i;
+
+		if (UDP_GSO_OFF == us->gso)
+			break;
+	}
+
+	lerr = udp_send_mmsg(fd, msgv + p, vlen - p);
+
+	return err ? err : lerr;
+}
+#endif
+
+
+/**
+ * Send a batch of UDP Datagrams to a peer
+ *
+ * The send helpers are called for every datagram, as with udp_send().
+ * Where supported the remaining datagrams are passed to the kernel with
+ * one system call per UDP_TX_BATCH datagrams, and runs of equally sized
+ * datagrams are sent as one buffer with UDP segmentation offload.
+ * A datagram the kernel refuses is skipped and the rest are still sent.
+ *
+ * @param us  UDP Socket
+ * @param dst Destination network address
+ * @param mbv Buffers to send
+ * @param mbc Number of buffers
+ *
+ * @return 0 if success, otherwise errorcode of the first failure
+ */
+int udp_send_batch(struct udp_sock *us, const struct sa *dst,
+		   struct mbuf * const *mbv, size_t mbc)
+{
+#ifdef HAVE_MMSG
+	struct mmsghdr msgv[UDP_TX_BATCH];
+	struct iovec iov[UDP_TX_BATCH];
+	struct sa hdstv[UDP_TX_BATCH];
+	size_t i = 0;
+	int fd, err = 0, serr = 0;
+
+	if (!us || !dst || (mbc && !mbv))
+		return EINVAL;
+
+	fd = udp_send_fd(us, dst);
+
+	while (i < mbc && !err) {
+		unsigned vlen = 0;
+		int lerr;
+
+		for (; i < mbc && vlen < UDP_TX_BATCH; i++) {
+			struct mbuf *mb = mbv[i];
+			const struct sa *pdst = dst;
+
+			if (udp_send_helpers(&err, &pdst, &hdstv[vlen], mb,
+					     us->helpers.tail)) {
+				if (err) {
+					++i;
+					break;
+				}
+
+				continue;
+			}
+
+			iov[vlen].iov_base = mb->buf + mb->pos;
+			iov[vlen].iov_len  = mb->end - mb->pos;
+
+			memset(&msgv[vlen], 0, sizeof(msgv[vlen]));
+			if (!udp_fd_sock(us)->conn) {
+				msgv[vlen].msg_hdr.msg_name = (void *)&pdst->u.sa;
+				msgv[vlen].msg_hdr.msg_namelen = pdst->len;
+			}
+			msgv[vlen].msg_hdr.msg_iov    = &iov[vlen];
+			msgv[vlen].msg_hdr.msg_iovlen = 1;
+
+			++vlen;
+		}
+
+		/* flush what was collected, also when a helper failed */
+#ifdef HAVE_UDP_GSO
+		lerr = udp_send_vec(udp_fd_sock(us), fd, msgv, vlen);
+#else
+		lerr = udp_send_mmsg(fd, msgv, vlen);
+#endif
+		if (lerr && !serr)
+			serr = lerr;
+	}
+
+	return serr ? serr : err;
+#else
+	size_t i;
+	int err = 0;
+
+	if (!us || !dst || (mbc && !mbv))
+		return EINVAL;
+
+	for (i = 0; i < mbc; i++) {
+		int lerr = udp_send_internal(us, dst, mbv[i],
+					     us->helpers.tail);
+		if (lerr && !err)
+			err = lerr;
+	}
+
+	return err;
+#endif
+}
+
+
 /**
  * Send an anonymous UDP Datagram to a peer
  *
@@ -529,6 +979,9 @@ int udp_local_get(const struct udp_sock *us, struct sa *local)
 	if (!us || !local)
 		return EINVAL;
 
+	if (us->parent)
+		us = us->parent;
+
 	local->len = sizeof(local->u);
 
 	if (0 == getsockname(us->fd, &local->u.sa, &local->len))
@@ -673,6 +1126,9 @@ int udp_sock_fd(const struct udp_sock *us, int af)
 	if (!us)
 		return -1;
 
+	if (us->parent)
+		us = us->parent;
+
 	switch (af) {
 
 	default:
@@ -734,6 +1190,73 @@ void udp_thread_detach(struct udp_sock *us)
 }
 
 
+/**
+ * Allocate a UDP Socket that shares the file descriptors of another one
+ *
+ * The new socket has its own helpers and receive handler. Datagrams
+ * sent on it go out on the parent socket without passing the helpers
+ * of the parent. Nothing is received on it directly, the owner of the
+ * parent socket passes datagrams on with udp_recv_packet().
+ *
+ * @param usp    Pointer to returned UDP Socket
+ * @param parent UDP Socket with the file descriptors
+ * @param rh     Receive handler
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_alloc_shared(struct udp_sock **usp, struct udp_sock *parent,
+		     udp_recv_h *rh, void *arg)
+{
+	struct udp_sock *us;
+
+	if (!usp || !parent)
+		return EINVAL;
+
+	us = mem_zalloc(sizeof(*us), udp_destructor);
+	if (!us)
+		return ENOMEM;
+
+	list_init(&us->helpers);
+
+	us->fd     = -1;
+	us->fd6    = -1;
+	us->parent = mem_ref(udp_fd_sock(parent));
+	us->rh     = rh ? rh : dummy_udp_recv_handler;
+	us->arg    = arg;
+	us->rxsz   = UDP_RXSZ_DEFAULT;
+
+	*usp = us;
+
+	return 0;
+}
+
+
+/**
+ * Receive a UDP Datagram on a socket, passing it through its helpers
+ *
+ * @param us  UDP Socket
+ * @param src Source network address
+ * @param mb  Datagram buffer
+ */
+void udp_recv_packet(struct udp_sock *us, const struct sa *src,
+		     struct mbuf *mb)
+{
+	struct sa hsrc;
+
+	if (!us || !src || !mb)
+		return;
+
+	/* the helpers may modify the source address */
+	hsrc = *src;
+
+	/* a handler may drop the last reference to the socket */
+	mem_ref(us);
+	udp_deliver(us, &hsrc, mb);
+	mem_deref(us);
+}
+
+
 static void helper_destructor(void *data)
 {
 	struct udp_helper *uh = data;
@@ -40,6 +40,7 @@ extern "C" {
 #include "avs_turn.h"
 #include "avs_vidcodec.h"
 #include "avs_uuid.h"
+#include "avs_watchdog.h"
 #include "avs_zapi.h"
 #include "avs_ztime.h"
 
@@ -49,6 +50,7 @@ extern "C" {
 #include "avs_engine.h"
 #include "avs_netprobe.h"
 #include "avs_audummy.h"
+#include "avs_sfu.h"
 
 #include "avs_mediamgr.h"
 
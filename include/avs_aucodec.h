@@ -52,6 +52,14 @@ typedef void (auenc_err_h)(int err, const char *msg, void *arg);
 typedef int  (auenc_rtp_h)(const uint8_t *pkt, size_t len, void *arg);
 typedef int  (auenc_rtcp_h)(const uint8_t *pkt, size_t len, void *arg);
 
+/*
+ * Zero-copy send (optional). txbufh returns a buffer with the transport
+ * headroom reserved, the encoder writes its RTP/RTCP packet at mb->pos
+ * and passes it to txh, which modifies it in place (SRTP, TURN).
+ */
+typedef struct mbuf *(auenc_txbuf_h)(size_t size, void *arg);
+typedef int  (auenc_tx_h)(struct mbuf *mb, void *arg);
+
 typedef int  (auenc_alloc_h)(struct auenc_state **aesp,
 			     struct media_ctx **mctxp,
 			     const struct aucodec *ac, const char *fmtp,
@@ -66,6 +74,8 @@ typedef int  (auenc_encode_h)(struct auenc_state *aes,
 			      const int16_t *sampv, size_t sampc);
 typedef int  (auenc_start_h)(struct auenc_state *aes);
 typedef void (auenc_stop_h)(struct auenc_state *aes);
+typedef void (auenc_settx_h)(struct auenc_state *aes,
+			     auenc_txbuf_h *txbufh, auenc_tx_h *txh);
 
 typedef void (audec_err_h)(int err, const char *msg, void *arg);
 
@@ -102,6 +112,7 @@ struct aucodec {
 	auenc_encode_h *ench;
 	auenc_start_h *enc_start;
 	auenc_stop_h *enc_stop;
+	auenc_settx_h *enc_settx;
 
 	audec_alloc_h *dec_alloc;
 	audec_decode_h *dech;
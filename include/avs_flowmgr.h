@@ -63,6 +63,8 @@ typedef int (flowmgr_req_h)(struct rr_resp *ctx,
 
 typedef void (flowmgr_log_append_h)(const char *msg, void *arg);
 typedef void (flowmgr_log_upload_h)(void *arg);
+typedef void (flowmgr_log_append_bin_h)(const uint8_t *buf, size_t len,
+					void *arg);
 
 typedef const char *(flowmgr_username_h)(const char *userid, void *arg);
 
@@ -229,6 +231,14 @@ void flowmgr_set_log_handlers(struct flowmgr *fm,
 			      flowmgr_log_upload_h *uploadh,
 			      void *arg);
 
+/**
+ * Set a handler for binary log records, decoded by toys/avslog-decode.
+ * It also gets the records below the text log level, down to the
+ * level set with log_set_bin_min_level(). Pass NULL to stop.
+ */
+void flowmgr_set_log_bin_handler(struct flowmgr *fm,
+				 flowmgr_log_append_bin_h *binh, void *arg);
+
 void flowmgr_set_media_estab_handler(struct flowmgr *fm,
 				     flowmgr_media_estab_h *mestabh,
 				     void *arg);
@@ -550,6 +560,53 @@ int marshal_flowmgr_is_sending_video(struct flowmgr *fm,
 void marshal_flowmgr_set_video_send_state(struct flowmgr *fm, const char *convid, enum flowmgr_video_send_state state);
 
 
+/* Asynchronous marshalled functions
+ *
+ * These return as soon as the call is queued for the re thread. The
+ * arguments are copied. When the call has been executed, doneh is
+ * called on the re thread with its result; doneh may be NULL.
+ *
+ * marshal_flowmgr_has_media() and marshal_flowmgr_is_sending_video()
+ * first consult a snapshot of the flowmgr state that the re thread
+ * publishes, and only block when the snapshot cannot answer the query.
+ * marshal_flowmgr_get_mute() reads the mute state of voe, which is the
+ * same for all flowmgrs.
+ */
+typedef void (flowmgr_marshal_h)(int err, void *arg);
+
+int marshal_flowmgr_process_event_async(struct flowmgr *fm,
+					const char *ctype,
+					const char *content, size_t clen,
+					flowmgr_marshal_h *doneh, void *arg);
+int marshal_flowmgr_acquire_flows_async(struct flowmgr *fm,
+					const char *convid,
+					const char *sessid,
+					flowmgr_netq_h *qh, void *qarg,
+					flowmgr_marshal_h *doneh, void *arg);
+int marshal_flowmgr_release_flows_async(struct flowmgr *fm,
+					const char *convid,
+					flowmgr_marshal_h *doneh, void *arg);
+int marshal_flowmgr_set_active_async(struct flowmgr *fm, const char *convid,
+				     bool active,
+				     flowmgr_marshal_h *doneh, void *arg);
+int marshal_flowmgr_user_add_async(struct flowmgr *fm, const char *convid,
+				   const char *userid, const char *name,
+				   flowmgr_marshal_h *doneh, void *arg);
+int marshal_flowmgr_mcat_changed_async(struct flowmgr *fm,
+				       const char *convid,
+				       enum flowmgr_mcat cat,
+				       flowmgr_marshal_h *doneh, void *arg);
+int marshal_flowmgr_set_mute_async(struct flowmgr *fm, bool mute,
+				   flowmgr_marshal_h *doneh, void *arg);
+int marshal_flowmgr_interruption_async(struct flowmgr *fm,
+				       const char *convid, bool interrupted,
+				       flowmgr_marshal_h *doneh, void *arg);
+int marshal_flowmgr_set_video_send_state_async(struct flowmgr *fm,
+				const char *convid,
+				enum flowmgr_video_send_state state,
+				flowmgr_marshal_h *doneh, void *arg);
+
+
 /* Wrap flow manager calls into these macros if you want to call them
  * from outside the re thread.
  */
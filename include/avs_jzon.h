@@ -74,6 +74,53 @@ void jzon_dump(struct json_object *jobj);
 struct odict *jzon_get_odict(struct json_object *jobj);
 
 
+/*
+ * Pull parser
+ *
+ * Reads JSON text token by token, without allocating. The tokens point
+ * into the text; strings and keys are given without the quotes and
+ * still escaped. After jzon_skip() the token of an object or array
+ * covers all of it, so a DOM can be built for just that value with
+ * jzon_decode().
+ */
+
+enum {
+	JZON_MAX_DEPTH = 32,
+};
+
+enum jzon_tok_type {
+	JZON_OBJECT_BEGIN,
+	JZON_OBJECT_END,
+	JZON_ARRAY_BEGIN,
+	JZON_ARRAY_END,
+	JZON_KEY,
+	JZON_STRING,
+	JZON_NUMBER,
+	JZON_TRUE,
+	JZON_FALSE,
+	JZON_NULL,
+};
+
+struct jzon_tok {
+	enum jzon_tok_type type;
+	struct pl pl;
+	unsigned depth;      /* containers around the token */
+};
+
+struct jzon_reader {
+	const char *p;
+	const char *end;
+	uint32_t stack;      /* one bit per level, set for objects */
+	unsigned depth;
+	int state;
+};
+
+void jzon_reader_init(struct jzon_reader *r, const char *buf, size_t len);
+int  jzon_next(struct jzon_reader *r, struct jzon_tok *tok);
+int  jzon_skip(struct jzon_reader *r, struct jzon_tok *tok);
+int  jzon_tok_strcpy(char *buf, size_t size, const struct jzon_tok *tok);
+
+
 /*
  * emulation of JSON-C api
  */
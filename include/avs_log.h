@@ -32,10 +32,16 @@ enum log_level {
 };
 
 typedef void (log_h)(uint32_t level, const char *msg);
+typedef void (log_bin_h)(const uint8_t *buf, size_t len, void *arg);
 
+/* A handler with binh gets binary records instead of text */
 struct log {
 	struct le le;
 	log_h *h;
+	log_bin_h *binh;
+	void *arg;           /* for binh */
+	uint16_t ndef;       /* formats sent to binh */
+	bool head;           /* stream header sent to binh */
 };
 
 void log_register_handler(struct log *log);
@@ -43,6 +49,9 @@ void log_unregister_handler(struct log *log);
 void log_set_min_level(enum log_level level);
 enum log_level log_get_min_level(void);
 void log_enable_stderr(bool enable);
+int  log_enable_async(bool enable);
+void log_flush(void);
+uint64_t log_dropped(void);
 void vlog(enum log_level level, const char *fmt, va_list ap);
 void loglv(enum log_level level, const char *fmt, ...);
 void vloglv(enum log_level level, const char *fmt, va_list ap);
@@ -51,4 +60,41 @@ void info(const char *fmt, ...);
 void warning(const char *fmt, ...);
 void error(const char *fmt, ...);
 
+
+/*
+ * Binary log
+ *
+ * LOG_BIN() logs with a static format. The arguments are copied into
+ * a binary record, which binary handlers get as is; the text is only
+ * formatted when it is written to stderr or a text handler. The
+ * records are decoded offline with toys/avslog-decode.
+ *
+ * %H and %v are still formatted at the call site.
+ */
+
+enum log_bin_type {
+	LOG_BIN_HEAD = 0,
+	LOG_BIN_FMT  = 1,
+	LOG_BIN_MSG  = 2,
+	LOG_BIN_TEXT = 3,
+};
+
+struct log_fmt {
+	const char *fmt;
+	enum log_level level;
+	uint16_t id;         /* set on first use */
+	uint8_t argc;
+	uint8_t argv[16];
+};
+
+#define LOG_BIN(level, fmt, ...)					\
+	do {								\
+		static struct log_fmt log_fmt_ =			\
+			{(fmt), (level), 0, 0, {0}};			\
+		log_bin(&log_fmt_, ##__VA_ARGS__);			\
+	} while (0)
+
+void log_bin(struct log_fmt *lf, ...);
+void log_set_bin_min_level(enum log_level level);
+
 #endif //#ifndef AVS_LOG_H
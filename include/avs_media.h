@@ -22,6 +22,7 @@
  */
 
 struct mediaflow;
+struct mediaflow_mux;
 struct zapi_candidate;
 struct aucodec_stats;
 struct rtp_stats;
@@ -95,6 +96,8 @@ typedef void (mediaflow_rtp_h)(const struct sa *src,
 typedef void (mediaflow_rtcp_h)(struct rtp_sock *rtp,
 				struct rtcp_msg *msg, void *arg);
 typedef void (mediaflow_close_h)(int err, void *arg);
+typedef bool (mediaflow_packet_h)(const struct sa *src, struct mbuf *mb,
+				  bool rtcp, void *arg);
 
 typedef void (mediaflow_rtp_state_h)(bool started, bool video_started,
 				     void *arg);
@@ -111,6 +114,17 @@ int mediaflow_alloc(struct mediaflow **mfp, struct tls *dtls,
 		    mediaflow_estab_h *estabh,
 		    mediaflow_close_h *closeh,
 		    void *arg);
+int mediaflow_alloc_mux(struct mediaflow **mfp, struct mediaflow_mux *mux,
+			struct tls *dtls,
+			const struct list *aucodecl,
+			const struct sa *laddr,
+			enum mediaflow_nat nat,
+			enum media_crypto cryptos,
+			bool external_rtp,
+			mediaflow_localcand_h *lcandh,
+			mediaflow_estab_h *estabh,
+			mediaflow_close_h *closeh,
+			void *arg);
 
 int mediaflow_set_setup(struct mediaflow *mf, enum media_setup setup);
 enum media_setup mediaflow_local_setup(const struct mediaflow *mf);
@@ -123,6 +137,8 @@ void mediaflow_set_rtp_handler(struct mediaflow *mf,
 			       mediaflow_audio_h *audioh,
 			       mediaflow_rtp_h *rtph,
 			       mediaflow_rtcp_h *rtcph);
+void mediaflow_set_packet_handler(struct mediaflow *mf,
+				  mediaflow_packet_h *pkth, void *arg);
 int mediaflow_add_video(struct mediaflow *mf, struct list *vidcodecl);
 void mediaflow_set_gather_handler(struct mediaflow *mf,
 				  mediaflow_gather_h *gatherh);
@@ -158,6 +174,9 @@ int mediaflow_send_raw_rtp(struct mediaflow *mf,
 			   const uint8_t *buf, size_t len);
 int mediaflow_send_raw_rtcp(struct mediaflow *mf,
 			    const uint8_t *buf, size_t len);
+struct mbuf *mediaflow_txbuf_alloc(struct mediaflow *mf, size_t size);
+int mediaflow_send_rtp_mbuf(struct mediaflow *mf, struct mbuf *mb);
+int mediaflow_send_rtcp_mbuf(struct mediaflow *mf, struct mbuf *mb);
 bool mediaflow_is_ready(const struct mediaflow *mf);
 int mediaflow_get_rtcpstats(struct mediaflow *mf, struct rtcp_stats *stats);
 int mediaflow_gather_stun(struct mediaflow *mf, const struct sa *stun_srv);
@@ -225,3 +244,11 @@ void mediaflow_enable_privacy(struct mediaflow *mf, bool enabled);
 const char *mediaflow_lcand_name(const struct mediaflow *mf);
 const char *mediaflow_rcand_name(const struct mediaflow *mf);
 bool mediaflow_dtls_peer_isset(const struct mediaflow *mf);
+
+
+/*
+ * Shared UDP socket for many mediaflows
+ */
+
+int mediaflow_mux_alloc(struct mediaflow_mux **muxp, const struct sa *laddr);
+const struct sa *mediaflow_mux_laddr(const struct mediaflow_mux *mux);
@@ -22,7 +22,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
-typedef struct locked_queue_t packet_queue_t;
+typedef struct packet_queue_t packet_queue_t;
 
 
 #ifdef __cplusplus
@@ -43,6 +43,37 @@ struct packet_queue_item_t {
 
 int packet_queue_alloc(packet_queue_t **pqp, bool blocking);
 
+/*
+ * Ring mode: a bounded, preallocated queue of nslots (power of two)
+ * slots of slot_size bytes each. Any number of threads may push, but
+ * only a single thread may pop. Pushing never allocates and never
+ * blocks; when all slots are in use ENOSPC is returned.
+ */
+int packet_queue_alloc_ring(packet_queue_t **pqp, bool blocking,
+			    size_t nslots, size_t slot_size);
+
+/*
+ * Zero-copy access to the slots of a ring mode queue.
+ *
+ * A producer reserves a slot, writes at most slot_size bytes to
+ * packet_data, sets packet_type and packet_size and then commits it.
+ * Every reserved slot must be committed.
+ *
+ * The consumer borrows the oldest committed slot and hands it back
+ * with packet_queue_release() once it is done with the data.
+ */
+struct packet_queue_slot {
+	packet_type_t packet_type;
+	uint8_t *packet_data;
+	size_t packet_size;
+	size_t slot_size;
+};
+
+int packet_queue_reserve(packet_queue_t *q, struct packet_queue_slot **slotp);
+int packet_queue_commit(packet_queue_t *q, struct packet_queue_slot *slot);
+int packet_queue_borrow(packet_queue_t *q, struct packet_queue_slot **slotp);
+int packet_queue_release(packet_queue_t *q, struct packet_queue_slot *slot);
+
 int packet_queue_push(packet_queue_t *q, packet_type_t packet_type,
 		      const uint8_t *packet_data, size_t packet_size);
 
@@ -0,0 +1,59 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Selective Forwarding Unit
+ *
+ * Terminates one mediaflow per participant and forwards the decrypted
+ * RTP of every participant to all the others, re-encrypted with the
+ * SRTP context of each outgoing flow. Media is never decoded.
+ */
+
+
+struct sfu;
+struct sfu_part;
+struct mediaflow;
+
+/* Minimum interval between keyframe requests sent to one source */
+#define SFU_KEYFRAME_INTERVAL 500  /* ms */
+
+/* Minimum interval between higher REMB estimates sent to one source */
+#define SFU_REMB_INTERVAL 1000     /* ms */
+
+/* Sources per participant, and when a quiet one may be replaced */
+#define SFU_MAX_SRCS      16
+#define SFU_SRC_TIMEOUT   30000    /* ms */
+
+struct sfu_stats {
+	size_t n_rtp_recv;
+	size_t n_rtp_sent;
+	size_t n_rtcp_recv;
+	size_t n_rtcp_dropped;   /* terminated in the SFU */
+	size_t n_kfreq_recv;     /* PLI/FIR from receivers */
+	size_t n_kfreq_sent;     /* PLI to sources, after aggregation */
+	size_t n_nack_recv;
+	size_t n_nack_sent;
+	size_t n_remb_recv;
+	size_t n_remb_sent;      /* to sources, after aggregation */
+	size_t n_rtp_dropped;    /* from sources over SFU_MAX_SRCS */
+};
+
+int  sfu_alloc(struct sfu **sfup);
+int  sfu_add(struct sfu_part **partp, struct sfu *sfu,
+	     struct mediaflow *mf);
+uint32_t sfu_part_ssrc(const struct sfu_part *part, uint32_t ssrc);
+const struct sfu_stats *sfu_stats(const struct sfu *sfu);
@@ -48,6 +48,10 @@ typedef void (videnc_err_h)(int err, const char *msg, void *arg);
 typedef int  (videnc_rtp_h)(const uint8_t *pkt, size_t len, void *arg);
 typedef int  (videnc_rtcp_h)(const uint8_t *pkt, size_t len, void *arg);
 
+/* Zero-copy send (optional), see auenc_txbuf_h */
+typedef struct mbuf *(videnc_txbuf_h)(size_t size, void *arg);
+typedef int  (videnc_tx_h)(struct mbuf *mb, void *arg);
+
 typedef int (videnc_alloc_h)(struct videnc_state **vesp,
 			     struct media_ctx **mctxp,
 			     const struct vidcodec *vc,
@@ -69,6 +73,8 @@ typedef int (videnc_encode_h)(struct videnc_state *ves, bool update,
 typedef int  (videnc_start_h)(struct videnc_state *ves);
 typedef void (videnc_stop_h)(struct videnc_state *ves);
 typedef void (videnc_hold_h)(struct videnc_state *ves, bool hold);
+typedef void (videnc_settx_h)(struct videnc_state *ves,
+			      videnc_txbuf_h *txbufh, videnc_tx_h *txh);
 
 
 typedef void (viddec_err_h)(int err, const char *msg, void *arg);
@@ -109,6 +115,7 @@ struct vidcodec {
 	videnc_start_h *enc_starth;
 	videnc_stop_h *enc_stoph;
 	videnc_hold_h *enc_holdh;
+	videnc_settx_h *enc_settxh;
 
 	viddec_alloc_h *dec_alloch;
 	viddec_decode_h *dech;
@@ -107,6 +107,7 @@ int voe_set_auplay(const char *dev);
 
 int voe_set_mute(bool mute);
 int voe_get_mute(bool *muted);
+int voe_get_mute_state(bool *muted);
 
 int voe_start_silencing();
 int voe_stop_silencing();
@@ -123,6 +124,7 @@ void voe_stop_recording_playout_PCM_file();
 
 int voe_enable_fec(bool enable);
 int voe_enable_aec(bool enable);
+int voe_enable_shared_encoder(bool enable);
 int voe_enable_rcv_ns(bool enable);
     
 int voe_set_bitrate(int rate_bps);
@@ -0,0 +1,76 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_WATCHDOG_H
+#define AVS_WATCHDOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Watchdog -- receive timeouts without a timer per packet
+ *
+ * Hot paths only call watchdog_touch(), which stores the current time
+ * in the deadline. A single periodic sweeper on the re thread calls the
+ * expiry handler of every deadline that has not been touched within its
+ * timeout. A deadline expires at most once until it is touched again;
+ * that touch returns true, so the caller can report recovery.
+ *
+ * Deadlines are added and removed on the re thread, touches can come
+ * from any thread.
+ */
+
+typedef void (watchdog_h)(void *arg);
+
+struct watchdog;
+
+struct watchdog_deadline {
+	struct le le;
+	uint64_t touched;      /* jiffies of last touch, 0 if never      */
+	bool expired;          /* set by sweeper, cleared by next touch  */
+	uint64_t timeout;
+	watchdog_h *expiredh;
+	void *arg;
+};
+
+
+int  watchdog_alloc(struct watchdog **wdp, uint64_t interval);
+void watchdog_add(struct watchdog *wd, struct watchdog_deadline *dl,
+		  uint64_t timeout, watchdog_h *expiredh, void *arg);
+void watchdog_remove(struct watchdog_deadline *dl);
+
+
+/* Returns true if the deadline had expired since the previous touch */
+static inline bool watchdog_touch(struct watchdog_deadline *dl)
+{
+	__atomic_store_n(&dl->touched, tmr_jiffies(), __ATOMIC_RELEASE);
+
+	if (!__atomic_load_n(&dl->expired, __ATOMIC_ACQUIRE))
+		return false;
+
+	return __atomic_exchange_n(&dl->expired, false, __ATOMIC_ACQ_REL);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -50,6 +50,7 @@ endif
 AVS_MODULES += queue
 AVS_MODULES += rest
 AVS_MODULES += sem
+AVS_MODULES += sfu
 AVS_MODULES += store
 AVS_MODULES += string
 AVS_MODULES += trace
@@ -59,6 +60,7 @@ AVS_MODULES += version
 AVS_MODULES += vidcodec
 AVS_MODULES += voe
 AVS_MODULES += vie
+AVS_MODULES += watchdog
 AVS_MODULES += audio_io
 AVS_MODULES += audio_effect
 AVS_MODULES += audummy
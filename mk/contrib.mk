@@ -230,6 +230,9 @@ CONTRIB_LIBRE_OS_OPTIONS_android := \
 	HAVE_INET_PTON=1 \
 	PEDANTIC= \
 	OS=linux \
+	HAVE_MMSG= \
+	HAVE_UDP_GSO= \
+	HAVE_IO_URING= \
 	USE_OPENSSL_AES=1 \
 	USE_OPENSSL_HMAC=1
 
@@ -245,6 +248,8 @@ CONTRIB_LIBRE_OS_OPTIONS_osx := \
 
 CONTRIB_LIBRE_OS_OPTIONS_linux := \
 	HAVE_EPOLL=1 \
+	USE_TMR_WHEEL=1 \
+	USE_MEM_POOL=1 \
 	USE_OPENSSL_AES=1 \
 	USE_OPENSSL_HMAC=1
 
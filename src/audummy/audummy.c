@@ -24,6 +24,7 @@
 
 
 #define NUM_CODECS 1
+#define PLD_SIZE 100
 
 
 static struct {
@@ -35,12 +36,16 @@ struct auenc_state {
 	const struct aucodec *ac;  /* inheritance */
 
 	struct tmr tmr_tx;
+	uint32_t ssrc;
 	uint32_t ts;
+	uint16_t seq;
 	int pt;
 
 	auenc_rtp_h *rtph;
 	auenc_rtcp_h *rtcph;
 	auenc_packet_h *pkth;
+	auenc_txbuf_h *txbufh;
+	auenc_tx_h *txh;
 	auenc_err_h *errh;
 	void *arg;
 };
@@ -55,14 +60,52 @@ struct audec_state {
 };
 
 
+/* write the packet straight into the send buffer of the media flow */
+static int send_packet(struct auenc_state *aes)
+{
+	struct rtp_header hdr;
+	struct mbuf *mb;
+	size_t pos;
+	int err;
+
+	mb = aes->txbufh(RTP_HEADER_SIZE + PLD_SIZE, aes->arg);
+	if (!mb)
+		return ENOMEM;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.pt   = aes->pt;
+	hdr.seq  = aes->seq++;
+	hdr.ts   = aes->ts;
+	hdr.ssrc = aes->ssrc;
+
+	pos = mb->pos;
+	err  = rtp_hdr_encode(mb, &hdr);
+	err |= mbuf_fill(mb, 0x00, PLD_SIZE);
+	if (err)
+		goto out;
+
+	mb->pos = pos;
+
+	err = aes->txh(mb, aes->arg);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
 static void timeout(void *arg)
 {
 	struct auenc_state *aes = arg;
-	static uint8_t pld[100];
+	static uint8_t pld[PLD_SIZE];
 
 	tmr_start(&aes->tmr_tx, 20, timeout, aes);
 
-	if (aes->pkth)
+	if (aes->txh)
+		(void)send_packet(aes);
+	else if (aes->pkth)
 		aes->pkth(aes->pt, aes->ts, pld, sizeof(pld), aes->arg);
 
 	aes->ts += 1920; /* opus in 48000Hz/2ch */
@@ -104,6 +147,8 @@ static int enc_alloc(struct auenc_state **aesp,
 
 	aes->ac = ac;
 	aes->pt = prm->pt;
+	aes->ssrc = prm->local_ssrc;
+	aes->seq = rand_u16();
 	aes->rtph = rtph;
 	aes->rtcph = rtcph;
 	aes->pkth = pkth;
@@ -119,6 +164,17 @@ static int enc_alloc(struct auenc_state **aesp,
 }
 
 
+static void audummy_settx(struct auenc_state *aes,
+			  auenc_txbuf_h *txbufh, auenc_tx_h *txh)
+{
+	if (!aes)
+		return;
+
+	aes->txbufh = txbufh;
+	aes->txh = txh;
+}
+
+
 static int audummy_start(struct auenc_state *aes)
 {
 	if (!aes)
@@ -206,6 +262,7 @@ static struct aucodec audummy_aucodecv[NUM_CODECS] = {
 		.ench      = NULL,
 		.enc_start = audummy_start,
 		.enc_stop  = audummy_stop,
+		.enc_settx = audummy_settx,
 
 		.dec_alloc = dec_alloc,
 		.dec_rtph  = audec_rtp_handler,
@@ -15,91 +15,232 @@
 * You should have received a copy of the GNU General Public License
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
+#include <string.h>
 #include <re.h>
 
 #include "avs_log.h"
 #include "avs_dict.h"
 
 
-struct dict {
-	struct hash *hmap;
-	bool flushing;      /* XXX: workaround to avoid double-free */
+/*
+ * Open addressing with linear probing.
+ *
+ * The slots hold the full hash of the key and the index of the entry.
+ * The entries are kept in the order they were added; a removed entry
+ * leaves a hole and its slot is marked as deleted. Both are cleaned up
+ * when the table is rebuilt to grow or shrink. The holes are kept while
+ * dict_apply() or dict_flush() are walking the entries, so that the
+ * handlers and destructors they call may add and remove entries.
+ */
+
+
+#define SLOT_FREE UINT32_MAX
+#define SLOT_DEL  (UINT32_MAX - 1)
+
+enum {
+	DICT_MIN_SIZE = 8,
+};
+
+
+struct dict_slot {
+	uint32_t hash;
+	uint32_t idx;        /* in entv, or SLOT_FREE or SLOT_DEL */
 };
 
 struct dict_entry {
-	struct le le;
-	char *key;
+	char *key;           /* NULL if removed */
 	void *value;
+	uint32_t hash;
 };
 
+struct dict {
+	struct dict_slot *slotv;
+	uint32_t nslot;      /* power of two */
+	uint32_t nused;      /* slots that are not free */
+
+	struct dict_entry *entv;
+	uint32_t nent;       /* entries in use, with the holes */
+	uint32_t maxent;
 
-static bool hmap_handler(struct le *le, void *arg)
+	uint32_t count;
+	uint32_t napply;     /* dict_apply() is running */
+	bool flushing;       /* XXX: workaround to avoid double-free */
+};
+
+
+static bool walking(const struct dict *dict)
 {
-	struct dict_entry *entry = le->data;
-	const char *key = arg;
+	return dict->napply || dict->flushing;
+}
 
-	return entry != NULL && str_cmp(entry->key, key) == 0;
+
+static uint32_t slots_for(uint32_t count)
+{
+	uint32_t n = DICT_MIN_SIZE;
+
+	/* half full at most */
+	while (n < count * 2)
+		n *= 2;
+
+	return n;
 }
 
 
-static void destructor(void *arg)
+static bool slot_find(const struct dict *dict, const char *key,
+		      uint32_t hash, uint32_t *posp)
 {
-	struct dict *dict = arg;
+	const uint32_t mask = dict->nslot - 1;
+	uint32_t i;
 
-	dict_flush(dict);
-	mem_deref(dict->hmap);
+	/* there is always a free slot */
+	for (i = hash & mask; ; i = (i + 1) & mask) {
+
+		const struct dict_slot *slot = &dict->slotv[i];
+
+		if (slot->idx == SLOT_FREE)
+			return false;
+
+		if (slot->idx == SLOT_DEL || slot->hash != hash)
+			continue;
+
+		if (0 == str_cmp(dict->entv[slot->idx].key, key)) {
+			*posp = i;
+			return true;
+		}
+	}
 }
 
 
-static void entry_destructor(void *arg)
+static void slot_insert(struct dict *dict, uint32_t hash, uint32_t idx)
 {
-	struct dict_entry *e = arg;
+	const uint32_t mask = dict->nslot - 1;
+	uint32_t i = hash & mask;
+
+	while (dict->slotv[i].idx != SLOT_FREE &&
+	       dict->slotv[i].idx != SLOT_DEL)
+		i = (i + 1) & mask;
 
-	hash_unlink(&e->le);
-	mem_deref(e->key);
+	if (dict->slotv[i].idx == SLOT_FREE)
+		++dict->nused;
 
-	// todo: should not be called if called from destr.
-	if (mem_nrefs(e->value) > 0)
-		mem_deref(e->value);
+	dict->slotv[i].hash = hash;
+	dict->slotv[i].idx = idx;
 }
 
 
-static struct dict_entry *entry_lookup(const struct dict *dict,
-				       const char *key)
+static int rebuild(struct dict *dict, uint32_t nslot)
 {
-	struct le *le;
-	uint32_t hkey;
+	struct dict_slot *slotv;
+	uint32_t i, n = 0;
 
-	if (!dict || !key) {
-		return NULL;
+	slotv = mem_alloc(nslot * sizeof(*slotv), NULL);
+	if (!slotv)
+		return ENOMEM;
+
+	memset(slotv, 0xff, nslot * sizeof(*slotv));
+
+	if (!walking(dict)) {
+		for (i = 0; i < dict->nent; i++) {
+			if (dict->entv[i].key)
+				dict->entv[n++] = dict->entv[i];
+		}
+		dict->nent = n;
 	}
 
-	hkey = hash_joaat_str_ci(key);
+	mem_deref(dict->slotv);
+	dict->slotv = slotv;
+	dict->nslot = nslot;
+	dict->nused = 0;
 
-	le = hash_lookup(dict->hmap, hkey, hmap_handler, (void *)key);
-	if (le) {
-		return (struct dict_entry *)le->data;
+	for (i = 0; i < dict->nent; i++) {
+		if (dict->entv[i].key)
+			slot_insert(dict, dict->entv[i].hash, i);
 	}
-	else {
-		return NULL;
+
+	return 0;
+}
+
+
+static int entries_reserve(struct dict *dict)
+{
+	struct dict_entry *entv;
+	uint32_t maxent;
+
+	if (dict->nent < dict->maxent)
+		return 0;
+
+	/* closing the holes is enough */
+	if (!walking(dict) && dict->count <= dict->nent / 2)
+		return rebuild(dict, dict->nslot);
+
+	maxent = dict->maxent * 2;
+
+	entv = mem_realloc(dict->entv, maxent * sizeof(*entv));
+	if (!entv)
+		return ENOMEM;
+
+	dict->entv = entv;
+	dict->maxent = maxent;
+
+	return 0;
+}
+
+
+static void shrink(struct dict *dict)
+{
+	const uint32_t nslot = slots_for(dict->count);
+	struct dict_entry *entv;
+
+	if (walking(dict))
+		return;
+
+	if (dict->nslot <= DICT_MIN_SIZE || dict->count * 8 > dict->nslot)
+		return;
+
+	if (rebuild(dict, nslot))
+		return;
+
+	/* the holes are closed, so the entries fit */
+	if (dict->maxent > nslot) {
+		entv = mem_realloc(dict->entv, nslot * sizeof(*entv));
+		if (entv) {
+			dict->entv = entv;
+			dict->maxent = nslot;
+		}
 	}
 }
 
 
+static void destructor(void *arg)
+{
+	struct dict *dict = arg;
+
+	dict_flush(dict);
+	mem_deref(dict->entv);
+	mem_deref(dict->slotv);
+}
+
+
 int dict_alloc(struct dict **dictp)
 {
 	struct dict *dict = mem_zalloc(sizeof(*dict), destructor);
-	int err;
+	int err = 0;
 
 	if (dict == NULL) {
 		return ENOMEM;
 	}
 
-	err = hash_alloc(&dict->hmap, 32);
-	if (err) {
+	dict->slotv = mem_alloc(DICT_MIN_SIZE * sizeof(*dict->slotv), NULL);
+	dict->entv = mem_alloc(DICT_MIN_SIZE * sizeof(*dict->entv), NULL);
+	if (!dict->slotv || !dict->entv) {
+		err = ENOMEM;
 		goto out;
 	}
 
+	memset(dict->slotv, 0xff, DICT_MIN_SIZE * sizeof(*dict->slotv));
+	dict->nslot = DICT_MIN_SIZE;
+	dict->maxent = DICT_MIN_SIZE;
+
 out:
 	if (err) {
 		mem_deref(dict);
@@ -114,43 +255,59 @@ out:
 
 void *dict_lookup(const struct dict *dict, const char *key)
 {
-	struct dict_entry *entry;
+	uint32_t pos;
 
 	if (!dict || !key) {
 		return NULL;
 	}
 
-	entry = entry_lookup(dict, key);
+	if (!slot_find(dict, key, hash_joaat_str_ci(key), &pos))
+		return NULL;
 
-	return entry ? entry->value : NULL;
+	return dict->entv[dict->slotv[pos].idx].value;
 }
 
 
 int dict_add(struct dict *dict, const char *key, void *val)
 {
 	struct dict_entry *entry;
-	uint32_t hkey;
+	uint32_t hash, pos;
+	char *k;
+	int err;
 
 	if (!dict || !key) {
 		return EINVAL;
 	}
 
-	entry = entry_lookup(dict, key);
-	if (entry) {
+	hash = hash_joaat_str_ci(key);
+
+	if (slot_find(dict, key, hash, &pos)) {
 		return EADDRINUSE;
 	}
 
-	hkey = hash_joaat_str_ci(key);
+	err = entries_reserve(dict);
+	if (err)
+		return err;
 
-	entry = mem_zalloc(sizeof(*entry), entry_destructor);
-	if (entry == NULL) {
-		return ENOMEM;
+	/* the deleted slots count, they make the probes longer */
+	if ((dict->nused + 1) * 4 > dict->nslot * 3) {
+		err = rebuild(dict, slots_for(dict->count + 1));
+		if (err)
+			return err;
 	}
 
-	str_dup(&entry->key, key);
+	err = str_dup(&k, key);
+	if (err)
+		return err;
+
+	entry = &dict->entv[dict->nent];
+	entry->key = k;
 	entry->value = mem_ref(val);
+	entry->hash = hash;
 
-	hash_append(dict->hmap, hkey, &entry->le, entry);
+	slot_insert(dict, hash, dict->nent);
+	++dict->nent;
+	++dict->count;
 
 	return 0;
 }
@@ -158,9 +315,13 @@ int dict_add(struct dict *dict, const char *key, void *val)
 
 void dict_remove(struct dict *dict, const char *key)
 {
+	struct dict_slot *slot;
 	struct dict_entry *entry;
+	uint32_t pos;
+	char *k;
+	void *val;
 
-	if (!dict)
+	if (!dict || !key)
 		return;
 
 	/* entry is already being flushed, no need to remote it */
@@ -168,25 +329,29 @@ void dict_remove(struct dict *dict, const char *key)
 		return;
 	}
 
-	entry = entry_lookup(dict, key);
-	if (entry) {
-		mem_deref(entry);
-	}
-}
+	if (!slot_find(dict, key, hash_joaat_str_ci(key), &pos))
+		return;
 
+	slot = &dict->slotv[pos];
+	entry = &dict->entv[slot->idx];
 
-struct dict_apply_data {
-	dict_apply_h *h;
-	void *arg;
-};
+	k = entry->key;
+	val = entry->value;
 
+	entry->key = NULL;
+	entry->value = NULL;
+	slot->idx = SLOT_DEL;
+	--dict->count;
 
-static bool hash_apply_handler(struct le *le, void *arg)
-{
-	struct dict_apply_data *data = arg;
-	struct dict_entry *entry = le->data;
+	while (dict->nent && !dict->entv[dict->nent - 1].key)
+		--dict->nent;
+
+	/* the value may remove other entries */
+	mem_deref(k);
+	if (mem_nrefs(val) > 0)
+		mem_deref(val);
 
-	return data->h(entry->key, entry->value, data->arg);
+	shrink(dict);
 }
 
 
@@ -194,61 +359,88 @@ static bool hash_apply_handler(struct le *le, void *arg)
  */
 void *dict_apply(const struct dict *dict, dict_apply_h *h, void *arg)
 {
-	struct dict_apply_data data;
-	struct le *le;
+	struct dict *d = (struct dict *)dict;
+	void *val = NULL;
+	uint32_t i;
 
 	if (!dict || !h)
 		return NULL;
 
-	data.h = h;
-	data.arg = arg;
+	++d->napply;
 
-	le = hash_apply(dict->hmap, hash_apply_handler, &data);
-	if (le)
-		return ((struct dict_entry *) le->data)->value;
-	else
-		return NULL;
+	/* the handler may add or remove entries, read them every time */
+	for (i = 0; i < d->nent; i++) {
+
+		struct dict_entry *entry = &d->entv[i];
+		void *v = entry->value;
+
+		if (!entry->key)
+			continue;
+
+		/* entv may be reallocated by the handler */
+		if (h(entry->key, v, arg)) {
+			val = v;
+			break;
+		}
+	}
+
+	--d->napply;
+
+	return val;
 }
 
 
 void dict_flush(struct dict *dict)
 {
+	uint32_t i;
+
 	if (!dict)
 		return;
 
 	dict->flushing = true;
-	hash_flush(dict->hmap);
-	dict->flushing = false;
-}
 
+	for (i = 0; i < dict->nent; i++) {
 
-uint32_t dict_count(const struct dict *dict)
-{
-	uint32_t i, count = 0;
+		struct dict_entry *entry = &dict->entv[i];
+		char *k = entry->key;
+		void *val = entry->value;
 
-	if (!dict)
-		return 0;
+		if (!k)
+			continue;
 
-	for (i=0; i<hash_bsize(dict->hmap); i++) {
-		count += list_count(hash_list(dict->hmap, i));
+		entry->key = NULL;
+		entry->value = NULL;
+		--dict->count;
+
+		mem_deref(k);
+		if (mem_nrefs(val) > 0)
+			mem_deref(val);
 	}
 
-	return count;
+	memset(dict->slotv, 0xff, dict->nslot * sizeof(*dict->slotv));
+	dict->nused = 0;
+	dict->nent = 0;
+
+	dict->flushing = false;
+
+	shrink(dict);
 }
 
 
-void dict_dump(const struct dict *dict)
+uint32_t dict_count(const struct dict *dict)
 {
-	uint32_t i;
+	return dict ? dict->count : 0;
+}
+
 
+void dict_dump(const struct dict *dict)
+{
 	if (!dict)
 		return;
 
 	re_printf("dictionary at %p:\n", dict);
-
-	for (i=0; i<hash_bsize(dict->hmap); i++) {
-		struct list *lst = hash_list(dict->hmap, i);
-
-		re_printf("%02u:  %u entries\n", i, list_count(lst));
-	}
+	re_printf("  %u entries (%u with holes, room for %u)\n",
+		  dict->count, dict->nent, dict->maxent);
+	re_printf("  %u slots, %u used, %u deleted\n",
+		  dict->nslot, dict->nused, dict->nused - dict->count);
 }
@@ -51,11 +51,8 @@ static void get_clients_handler(int err, const struct http_msg *msg,
 	for (i=0; i<count; i++) {
 		const struct odict_entry *ae, *e;
 		const char *clientid, *model;
-		char key[16];
 
-		re_snprintf(key, sizeof(key), "%zu", i);
-
-		ae = odict_lookup(dict, key);
+		ae = odict_at(dict, i);
 		if (!ae)
 			continue;
 
@@ -137,11 +134,8 @@ static void get_prekeys_handler(int err, const struct http_msg *msg,
 		const struct odict_entry *prekey, *clientid, *key, *id;
 		uint8_t *buf = NULL;
 		size_t buf_len;
-		char num[16];
-
-		re_snprintf(num, sizeof(num), "%zu", i);
 
-		ae = odict_lookup(clients->u.odict, num);
+		ae = odict_at(clients->u.odict, i);
 		if (!ae)
 			continue;
 
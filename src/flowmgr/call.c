@@ -900,6 +900,8 @@ void call_rtp_started(struct call *call, bool started)
 		     "total setup time is %llu ms\n",
 		     fm, call, t);
 	}
+
+	snapshot_update(fm);
 }
 
 
@@ -919,9 +921,11 @@ bool call_has_media(struct call *call)
 static bool stats_has_video(struct mediaflow *mf)
 {
 	struct rtp_stats* rtps = mediaflow_snd_video_rtp_stats(mf);
+	struct rtp_stats_snap snap;
 	bool has_video = false;
 	if(rtps){
-		if(rtps->bit_rate_stats.max != -1){
+		rtp_stats_snapshot(rtps, &snap);
+		if(snap.bit_rate_stats.max != -1){
 			has_video = true;
 		}
 	}
@@ -989,21 +993,28 @@ bool call_stats_prepare(struct call *call, struct json_object *jobj)
 			err |= jzon_add_int(jobj, "max_loss_u", voe_stats->loss_u.max);
 		}
 		struct rtp_stats* rtps = mediaflow_rcv_audio_rtp_stats(userflow_mediaflow(flow->userflow));
+		struct rtp_stats_snap rs;
 		if (rtps) {
-			err |= jzon_add_int(jobj, "avg_loss_d", (int)rtps->pkt_loss_stats.avg);
-			err |= jzon_add_int(jobj, "max_loss_d", (int)rtps->pkt_loss_stats.max);
-			err |= jzon_add_int(jobj, "avg_rate_d", (int)rtps->bit_rate_stats.avg);
-			err |= jzon_add_int(jobj, "min_rate_d", (int)rtps->bit_rate_stats.min);
-			err |= jzon_add_int(jobj, "avg_pkt_rate_d", (int)rtps->pkt_rate_stats.avg);
-			err |= jzon_add_int(jobj, "min_pkt_rate_d", (int)rtps->pkt_rate_stats.min);
-			err |= jzon_add_int(jobj, "a_dropouts", rtps->dropouts);
+			rtp_stats_snapshot(rtps, &rs);
+			err |= jzon_add_int(jobj, "avg_loss_d", (int)rs.pkt_loss_stats.avg);
+			err |= jzon_add_int(jobj, "max_loss_d", (int)rs.pkt_loss_stats.max);
+			err |= jzon_add_int(jobj, "avg_rate_d", (int)rs.bit_rate_stats.avg);
+			err |= jzon_add_int(jobj, "min_rate_d", (int)rs.bit_rate_stats.min);
+			err |= jzon_add_int(jobj, "avg_pkt_rate_d", (int)rs.pkt_rate_stats.avg);
+			err |= jzon_add_int(jobj, "min_pkt_rate_d", (int)rs.pkt_rate_stats.min);
+			err |= jzon_add_int(jobj, "a_dropouts", rs.dropouts);
+			err |= jzon_add_int(jobj, "p50_jitter_d", (int)rs.pctv[RTP_HIST_JITTER].p50);
+			err |= jzon_add_int(jobj, "p95_jitter_d", (int)rs.pctv[RTP_HIST_JITTER].p95);
+			err |= jzon_add_int(jobj, "p99_jitter_d", (int)rs.pctv[RTP_HIST_JITTER].p99);
+			err |= jzon_add_int(jobj, "p95_loss_d", (int)rs.pctv[RTP_HIST_LOSS].p95);
 		}
 		rtps = mediaflow_snd_audio_rtp_stats(userflow_mediaflow(flow->userflow));
 		if (rtps) {
-			err |= jzon_add_int(jobj, "avg_rate_u", (int)rtps->bit_rate_stats.avg);
-			err |= jzon_add_int(jobj, "min_rate_u", (int)rtps->bit_rate_stats.min);
-			err |= jzon_add_int(jobj, "avg_pkt_rate_u", (int)rtps->pkt_rate_stats.avg);
-			err |= jzon_add_int(jobj, "min_pkt_rate_u", (int)rtps->pkt_rate_stats.min);
+			rtp_stats_snapshot(rtps, &rs);
+			err |= jzon_add_int(jobj, "avg_rate_u", (int)rs.bit_rate_stats.avg);
+			err |= jzon_add_int(jobj, "min_rate_u", (int)rs.bit_rate_stats.min);
+			err |= jzon_add_int(jobj, "avg_pkt_rate_u", (int)rs.pkt_rate_stats.avg);
+			err |= jzon_add_int(jobj, "min_pkt_rate_u", (int)rs.pkt_rate_stats.min);
 		}
 		if (voe_stats) {
 			struct json_object *jsess;
@@ -1013,22 +1024,26 @@ bool call_stats_prepare(struct call *call, struct json_object *jobj)
 		}
 		rtps = mediaflow_rcv_video_rtp_stats(userflow_mediaflow(flow->userflow));
 		if (rtps) {
-			err |= jzon_add_int(jobj, "v_avg_rate_d", (int)rtps->bit_rate_stats.avg);
-			err |= jzon_add_int(jobj, "v_min_rate_d", (int)rtps->bit_rate_stats.min);
-			err |= jzon_add_int(jobj, "v_max_rate_d", (int)rtps->bit_rate_stats.max);
-			err |= jzon_add_int(jobj, "v_avg_frame_rate_d", (int)rtps->frame_rate_stats.avg);
-			err |= jzon_add_int(jobj, "v_min_frame_rate_d", (int)rtps->frame_rate_stats.min);
-			err |= jzon_add_int(jobj, "v_max_frame_rate_d", (int)rtps->frame_rate_stats.max);
-			err |= jzon_add_int(jobj, "v_dropouts", rtps->dropouts);
+			rtp_stats_snapshot(rtps, &rs);
+			err |= jzon_add_int(jobj, "v_avg_rate_d", (int)rs.bit_rate_stats.avg);
+			err |= jzon_add_int(jobj, "v_min_rate_d", (int)rs.bit_rate_stats.min);
+			err |= jzon_add_int(jobj, "v_max_rate_d", (int)rs.bit_rate_stats.max);
+			err |= jzon_add_int(jobj, "v_avg_frame_rate_d", (int)rs.frame_rate_stats.avg);
+			err |= jzon_add_int(jobj, "v_min_frame_rate_d", (int)rs.frame_rate_stats.min);
+			err |= jzon_add_int(jobj, "v_max_frame_rate_d", (int)rs.frame_rate_stats.max);
+			err |= jzon_add_int(jobj, "v_dropouts", rs.dropouts);
+			err |= jzon_add_int(jobj, "v_p95_jitter_d", (int)rs.pctv[RTP_HIST_JITTER].p95);
+			err |= jzon_add_int(jobj, "v_p95_loss_d", (int)rs.pctv[RTP_HIST_LOSS].p95);
 		}
 		rtps = mediaflow_snd_video_rtp_stats(userflow_mediaflow(flow->userflow));
 		if (rtps) {
-			err |= jzon_add_int(jobj, "v_avg_rate_u", (int)rtps->bit_rate_stats.avg);
-			err |= jzon_add_int(jobj, "v_min_rate_u", (int)rtps->bit_rate_stats.min);
-			err |= jzon_add_int(jobj, "v_max_rate_u", (int)rtps->bit_rate_stats.max);
-			err |= jzon_add_int(jobj, "v_avg_frame_rate_u", (int)rtps->frame_rate_stats.avg);
-			err |= jzon_add_int(jobj, "v_min_frame_rate_u", (int)rtps->frame_rate_stats.min);
-			err |= jzon_add_int(jobj, "v_max_frame_rate_u", (int)rtps->frame_rate_stats.max);
+			rtp_stats_snapshot(rtps, &rs);
+			err |= jzon_add_int(jobj, "v_avg_rate_u", (int)rs.bit_rate_stats.avg);
+			err |= jzon_add_int(jobj, "v_min_rate_u", (int)rs.bit_rate_stats.min);
+			err |= jzon_add_int(jobj, "v_max_rate_u", (int)rs.bit_rate_stats.max);
+			err |= jzon_add_int(jobj, "v_avg_frame_rate_u", (int)rs.frame_rate_stats.avg);
+			err |= jzon_add_int(jobj, "v_min_frame_rate_u", (int)rs.frame_rate_stats.min);
+			err |= jzon_add_int(jobj, "v_max_frame_rate_u", (int)rs.frame_rate_stats.max);
 		}
 		if (err)
 			return NULL;
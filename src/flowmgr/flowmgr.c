@@ -37,6 +37,7 @@
 /* Call signalling URL bases */
 
 #define VOLUME_TIMEOUT 100 /* ms between volume updates */
+#define DTLS_WORKERS 2     /* threads for DTLS handshakes */
 
 
 static const char *events[FLOWMGR_EVENT_MAX] = {
@@ -199,6 +200,27 @@ static const char *cipherv[] = {
 };
 
 
+/* The CommonCrypto and stub AES backends have no GCM */
+static bool aes_gcm_supported(void)
+{
+	static const uint8_t key[32];
+	static const size_t bitsv[] = {128, 256};
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(bitsv); i++) {
+		struct aes *aes = NULL;
+		int err;
+
+		err = aes_alloc(&aes, AES_MODE_GCM, key, bitsv[i], NULL);
+		mem_deref(aes);
+		if (err)
+			return false;
+	}
+
+	return true;
+}
+
+
 static int msystem_init(const char *msysname,
 			enum cert_type cert_type)
 {
@@ -273,13 +295,31 @@ static int msystem_init(const char *msysname,
 
 	tls_set_verify_client(msys.dtls);
 
-	err = tls_set_srtp(msys.dtls, "SRTP_AES128_CM_SHA1_80");
+	/* prefer the single-pass AEAD profiles (RFC 7714) where the AES
+	 * backend can do GCM, older OpenSSL versions only know AES-CM
+	 * with HMAC-SHA1
+	 */
+	err = ENOTSUP;
+	if (aes_gcm_supported()) {
+		err = tls_set_srtp(msys.dtls,
+				   "SRTP_AEAD_AES_128_GCM:"
+				   "SRTP_AEAD_AES_256_GCM:"
+				   "SRTP_AES128_CM_SHA1_80");
+	}
+	if (err)
+		err = tls_set_srtp(msys.dtls, "SRTP_AES128_CM_SHA1_80");
 	if (err) {
 		warning("flowmgr: failed to enable SRTP profile (%m)\n",
 			err);
 		return err;
 	}
 
+	/* keep the handshakes of many flows off the main thread */
+	err = dtls_set_workers(msys.dtls, DTLS_WORKERS);
+	if (err) {
+		warning("flowmgr: no DTLS workers (%m)\n", err);
+	}
+
 	tmr_init(&msys.vol_tmr);
 
 	err = str_dup(&msys.name, msysname);
@@ -1242,6 +1282,8 @@ void flowmgr_release_flows(struct flowmgr *fm, const char *convid)
 	call_cancel(call);
 
 	dict_remove(fm->calls, call_convid(call));
+
+	snapshot_update(fm);
 }
 
 
@@ -1300,6 +1342,9 @@ static void fm_destructor(void *arg)
 	list_flush(&fm->eventq);
 	list_flush(&fm->postl);
 
+	if (fm->log.bin.binh)
+		log_unregister_handler(&fm->log.bin);
+
 	list_unlink(&fm->le);
 }
 
@@ -1332,6 +1377,8 @@ int flowmgr_alloc(struct flowmgr **fmp, flowmgr_req_h *reqh,
 	/* Set these elsewhere, for more control... */
 	flowmgr_enable_metrics(fm, false);
 
+	snapshot_update(fm);
+
 	list_append(&msys.flowmgrl, &fm->le, fm);
 	if (msys.started) {
 		fm->config.pending = true;
@@ -1401,6 +1448,26 @@ void flowmgr_set_log_handlers(struct flowmgr *fm,
 }
 
 
+void flowmgr_set_log_bin_handler(struct flowmgr *fm,
+				 flowmgr_log_append_bin_h *binh, void *arg)
+{
+	if (!fm)
+		return;
+
+	if (fm->log.bin.binh)
+		log_unregister_handler(&fm->log.bin);
+
+	memset(&fm->log.bin, 0, sizeof(fm->log.bin));
+
+	if (!binh)
+		return;
+
+	fm->log.bin.binh = binh;
+	fm->log.bin.arg = arg;
+	log_register_handler(&fm->log.bin);
+}
+
+
 void flowmgr_set_conf_pos_handler(struct flowmgr *fm,
 				  flowmgr_conf_pos_h *conf_posh,
 				  void *arg)
@@ -1537,7 +1604,279 @@ static void event_enqueue(struct flowmgr *fm,
 int flowmgr_process_event(bool *hp, struct flowmgr *fm,
 			  const char *ctype, const char *content, size_t clen)
 {
-	return process_event(hp, fm, ctype, content, clen, false);
+	int err;
+
+	err = process_event(hp, fm, ctype, content, clen, false);
+
+	snapshot_update(fm);
+
+	return err;
+}
+
+
+/* The values the event handlers read, see event_body() */
+enum {
+	BODY_FLOWS = 0,
+	BODY_CANDIDATES,
+	BODY_ACTIVE,
+	BODY_SDP,
+	BODY_STATE,
+	BODY_MAX
+};
+
+static const char *body_keys[BODY_MAX] = {
+	"flows",
+	"candidates",
+	"active",
+	"sdp",
+	"state",
+};
+
+
+/* The fields that the dispatch needs, read without a DOM */
+struct event_head {
+	char type[32];
+	char convid[128];
+	char flowid[128];
+	const char *ev;      /* NULL if missing */
+	const char *conv;
+	const char *flow;
+
+	struct jzon_tok bodyv[BODY_MAX];  /* slices of the event */
+	unsigned bodym;                   /* one bit per bodyv[] set */
+};
+
+
+/* A field that does not fit fails, so the DOM decoder gets to read it */
+static int event_head_field(struct event_head *eh, const struct pl *key,
+			    const struct jzon_tok *val)
+{
+	int err;
+	const char **fieldp;
+	char *buf;
+	size_t size;
+
+	if (0 == pl_strcmp(key, "type")) {
+		fieldp = &eh->ev;
+		buf = eh->type;
+		size = sizeof(eh->type);
+	}
+	else if (0 == pl_strcmp(key, "conversation")) {
+		fieldp = &eh->conv;
+		buf = eh->convid;
+		size = sizeof(eh->convid);
+	}
+	else if (0 == pl_strcmp(key, "flow")) {
+		fieldp = &eh->flow;
+		buf = eh->flowid;
+		size = sizeof(eh->flowid);
+	}
+	else {
+		return 0;
+	}
+
+	/* the first one counts, like in the DOM */
+	if (*fieldp)
+		return 0;
+
+	err = jzon_tok_strcpy(buf, size, val);
+	if (err)
+		return err;
+
+	*fieldp = buf;
+
+	return 0;
+}
+
+
+static void event_body_field(struct event_head *eh, const struct pl *key,
+			     const struct jzon_tok *val)
+{
+	int i;
+
+	for (i = 0; i < BODY_MAX; i++) {
+
+		if (pl_strcmp(key, body_keys[i]))
+			continue;
+
+		/* the first one counts, like in the DOM */
+		if (!(eh->bodym & (1u << i))) {
+			eh->bodyv[i] = *val;
+			eh->bodym |= 1u << i;
+		}
+		break;
+	}
+}
+
+
+static int event_head_read(struct event_head *eh,
+			   const char *buf, size_t len)
+{
+	struct jzon_reader r;
+	struct jzon_tok key, tok;
+	int err;
+
+	memset(eh, 0, sizeof(*eh));
+
+	jzon_reader_init(&r, buf, len);
+
+	err = jzon_next(&r, &tok);
+	if (err)
+		return EBADMSG;
+
+	if (tok.type == JZON_ARRAY_BEGIN) {
+		err = jzon_skip(&r, &tok);
+		goto out;
+	}
+	else if (tok.type != JZON_OBJECT_BEGIN) {
+		return EBADMSG;
+	}
+
+	for (;;) {
+		err = jzon_next(&r, &key);
+		if (err)
+			return err;
+
+		if (key.type == JZON_OBJECT_END)
+			break;
+
+		err = jzon_next(&r, &tok);
+		if (err)
+			return err;
+
+		if (tok.type == JZON_STRING) {
+			err = event_head_field(eh, &key.pl, &tok);
+			if (err)
+				return err;
+		}
+
+		err = jzon_skip(&r, &tok);
+		if (err)
+			return err;
+
+		event_body_field(eh, &key.pl, &tok);
+	}
+
+ out:
+	if (err)
+		return err;
+
+	/* nothing after the object */
+	err = jzon_next(&r, &tok);
+
+	return err == ENOENT ? 0 : EBADMSG;
+}
+
+
+static int body_add(struct json_object *jobj, const char *key,
+		    const struct jzon_tok *tok)
+{
+	struct json_object *val = NULL;
+	char *str;
+	int err = 0;
+
+	switch (tok->type) {
+
+	case JZON_OBJECT_BEGIN:
+	case JZON_ARRAY_BEGIN:
+		err = jzon_decode(&val, tok->pl.p, tok->pl.l);
+		break;
+
+	case JZON_STRING:
+		/* the escapes never make a string longer */
+		str = mem_alloc(tok->pl.l + 1, NULL);
+		if (!str)
+			return ENOMEM;
+
+		err = jzon_tok_strcpy(str, tok->pl.l + 1, tok);
+		if (!err) {
+			val = json_object_new_string(str);
+			if (!val)
+				err = ENOMEM;
+		}
+
+		mem_deref(str);
+		break;
+
+	case JZON_TRUE:
+	case JZON_FALSE:
+		val = json_object_new_boolean(tok->type == JZON_TRUE);
+		if (!val)
+			err = ENOMEM;
+		break;
+
+	case JZON_NULL:
+		break;
+
+	default:
+		/* numbers are left to the DOM decoder */
+		return ENOTSUP;
+	}
+
+	if (err)
+		return err;
+
+	json_object_object_add(jobj, key, val);
+
+	return 0;
+}
+
+
+/*
+ * Decode only the values that the handler of an event reads, from the
+ * slices that event_head_read() found, instead of the whole event.
+ */
+static int event_body(struct json_object **jobjp,
+		      const struct event_head *eh, enum flowmgr_event event)
+{
+	struct json_object *jobj;
+	unsigned keym;
+	int i, err = 0;
+
+	switch (event) {
+
+	case FLOWMGR_EVENT_FLOW_ADD:
+		keym = 1u << BODY_FLOWS;
+		break;
+
+	case FLOWMGR_EVENT_FLOW_ACT:
+		keym = 1u << BODY_ACTIVE;
+		break;
+
+	case FLOWMGR_EVENT_CAND_ADD:
+	case FLOWMGR_EVENT_CAND_UPD:
+		keym = 1u << BODY_CANDIDATES;
+		break;
+
+	case FLOWMGR_EVENT_SDP:
+		keym = 1u << BODY_SDP | 1u << BODY_STATE;
+		break;
+
+	default:
+		keym = 0;
+		break;
+	}
+
+	jobj = json_object_new_object();
+	if (!jobj)
+		return ENOMEM;
+
+	for (i = 0; i < BODY_MAX; i++) {
+
+		if (!(keym & eh->bodym & (1u << i)))
+			continue;
+
+		err = body_add(jobj, body_keys[i], &eh->bodyv[i]);
+		if (err)
+			break;
+	}
+
+	if (err)
+		mem_deref(jobj);
+	else
+		*jobjp = jobj;
+
+	return err;
 }
 
 
@@ -1546,6 +1885,7 @@ static int process_event(bool *hp, struct flowmgr *fm,
 			 bool replayed)
 {
 	struct json_object *jobj = NULL;
+	struct event_head eh;
 	const char *ev;
 	const char *convid;
 	const char *flowid;
@@ -1564,17 +1904,25 @@ static int process_event(bool *hp, struct flowmgr *fm,
 		return EPROTO;
 	}
 
-	err = jzon_decode(&jobj, content, clen);
+	err = event_head_read(&eh, content, clen);
 	if (err) {
-		warning("flowmgr(%p): process_event: JSON parse error"
-			" [%zu bytes]\n", fm, clen);
-		goto out;
+		/* not strict JSON, the DOM decoder is more lenient */
+		err = jzon_decode(&jobj, content, clen);
+		if (err) {
+			warning("flowmgr(%p): process_event: JSON parse error"
+				" [%zu bytes]\n", fm, clen);
+			goto out;
+		}
+
+		eh.ev   = jzon_str(jobj, "type");
+		eh.conv = jzon_str(jobj, "conversation");
+		eh.flow = jzon_str(jobj, "flow");
 	}
 
-	ev = jzon_str(jobj, "type");
+	ev = eh.ev;
 
-	convid = jzon_str(jobj, "conversation");
-	flowid = jzon_str(jobj, "flow");
+	convid = eh.conv;
+	flowid = eh.flow;
 
 	if (!convid) {
 		err = EPROTO;
@@ -1629,6 +1977,25 @@ static int process_event(bool *hp, struct flowmgr *fm,
 		}
 	}
 
+	/* the event handler and the trace get the whole event */
+	if (!jobj && !fm->evh && fm->trace < 2 &&
+	    event != FLOWMGR_EVENT_FLOW_DEL) {
+
+		if (event_body(&jobj, &eh, event))
+			jobj = NULL;
+	}
+
+	if (!jobj &&
+	    (fm->evh || fm->trace >= 2 || event != FLOWMGR_EVENT_FLOW_DEL)) {
+
+		err = jzon_decode(&jobj, content, clen);
+		if (err) {
+			warning("flowmgr(%p): process_event: JSON parse error"
+				" [%zu bytes]\n", fm, clen);
+			goto out;
+		}
+	}
+
 	if (handled) {
 
 		if (fm->evh) {
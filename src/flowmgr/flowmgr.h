@@ -170,6 +170,31 @@ struct flow_elem {
 	struct le le;
 };
 
+/* State that other threads may read without marshalling.
+ * Written by the re thread only, guarded by a sequence counter.
+ */
+#define SNAPSHOT_MAX_CALLS 8
+#define SNAPSHOT_MAX_FLOWS 16
+
+struct flowmgr_snapshot {
+	uint32_t seq;   /* odd while an update is in progress */
+
+	bool complete;  /* false if not all calls and flows fit */
+	unsigned callc;
+	struct {
+		char convid[64];
+		bool active;
+		bool has_media;
+	} callv[SNAPSHOT_MAX_CALLS];
+
+	unsigned flowc;
+	struct {
+		unsigned call;  /* index into callv */
+		char partid[64];
+		bool sending_video;
+	} flowv[SNAPSHOT_MAX_FLOWS];
+};
+
 struct flowmgr {
 	struct dict *calls;  /* struct call */
 
@@ -202,6 +227,7 @@ struct flowmgr {
 		flowmgr_log_append_h *appendh;
 		flowmgr_log_upload_h *uploadh;
 		void *arg;
+		struct log bin;
 	} log;
 
 	/* username handlers */
@@ -244,6 +270,8 @@ struct flowmgr {
 		struct rest_cli *cli;
 		struct login_token token;
 	} rest;
+
+	struct flowmgr_snapshot snap;
 };
 
 
@@ -420,6 +448,13 @@ const char *msystem_get_interface(void);
 int  marshal_init(void);
 void marshal_close(void);
 
+/* snapshot */
+void snapshot_update(struct flowmgr *fm);
+int  snapshot_has_media(const struct flowmgr *fm, const char *convid,
+			bool *has_media);
+int  snapshot_is_sending_video(const struct flowmgr *fm, const char *convid,
+			       const char *partid, bool *sending);
+
 
 bool flowmgr_is_using_voe(void);
 
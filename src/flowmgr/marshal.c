@@ -17,6 +17,7 @@
 */
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include <re/re.h>
 #include <avs.h>
@@ -70,11 +71,28 @@ enum marshal_id {
 	MARSHAL_SET_AUDIO_STATE_HANDLER,
 };
 
+/* Every thread that marshals calls gets one waiter, which it keeps
+ * and reuses for all its calls until it exits.
+ */
+struct marshal_waiter {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
 struct marshal_elem {
 	int id;
 	struct flowmgr *fm;
+	struct marshal_waiter *waiter;
 	bool handled;
 	int ret;
+
+	/* Asynchronous calls: the element is heap allocated, owns
+	 * copies of its arguments and reports through doneh.
+	 */
+	bool async;
+	flowmgr_marshal_h *doneh;
+	void *arg;
+	void *ownv[3];
 };
 
 struct marshal_alloc_elem {
@@ -130,6 +148,7 @@ struct marshal_resp_elem {
 struct marshal_event_elem {
 	struct marshal_elem a;
 
+	bool handled;  /* hp points here for asynchronous calls */
 	bool *hp;
 	const char *ctype;
 	const char *content;
@@ -587,18 +606,91 @@ static void mqueue_handler(int id, void *data, void *arg)
             
 	}
 
+	if (me->fm && id != MARSHAL_FREE)
+		snapshot_update(me->fm);
+
+	if (me->async) {
+		if (me->doneh)
+			me->doneh(me->ret, me->arg);
+
+		mem_deref(me);
+		return;
+	}
+
+	/* The element lives on the stack of the waiting thread,
+	 * it must not be touched once the mutex is released.
+	 */
+	pthread_mutex_lock(&me->waiter->mutex);
 	me->handled = true;
+	pthread_cond_signal(&me->waiter->cond);
+	pthread_mutex_unlock(&me->waiter->mutex);
+}
+
+
+static pthread_key_t waiter_key;
+static pthread_once_t waiter_once = PTHREAD_ONCE_INIT;
+
+
+static void waiter_destructor(void *arg)
+{
+	struct marshal_waiter *w = arg;
+
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->mutex);
+}
+
+
+static void waiter_key_destructor(void *arg)
+{
+	mem_deref(arg);
+}
+
+
+static void waiter_key_create(void)
+{
+	pthread_key_create(&waiter_key, waiter_key_destructor);
+}
+
+
+/* Darwin semaphores are not suitable for short-lived use, so
+ * instead of one semaphore per call we keep a condition variable
+ * per calling thread.
+ */
+static struct marshal_waiter *marshal_waiter(void)
+{
+	struct marshal_waiter *w;
+
+	pthread_once(&waiter_once, waiter_key_create);
+
+	w = pthread_getspecific(waiter_key);
+	if (w)
+		return w;
+
+	w = mem_zalloc(sizeof(*w), waiter_destructor);
+	if (!w)
+		return NULL;
+
+	if (pthread_mutex_init(&w->mutex, NULL) != 0
+	    || pthread_cond_init(&w->cond, NULL) != 0) {
+		mem_deref(w);
+		return NULL;
+	}
+
+	if (pthread_setspecific(waiter_key, w) != 0) {
+		mem_deref(w);
+		return NULL;
+	}
+
+	return w;
 }
 
 
 static void marshal_wait(struct marshal_elem *me)
 {
-	/* Using a semaphore would be more efficient,
-	 * but the Darwin implementation of it is really
-	 * not suitable for short-lived semaphores
-	 */
-	while(!me->handled)
-		usleep(40000);
+	pthread_mutex_lock(&me->waiter->mutex);
+	while (!me->handled)
+		pthread_cond_wait(&me->waiter->cond, &me->waiter->mutex);
+	pthread_mutex_unlock(&me->waiter->mutex);
 }
 
 
@@ -624,18 +716,127 @@ void marshal_close(void)
 static void marshal_send(void *arg)
 {
 	struct marshal_elem *me = arg;
+	int err;
 
 	if (!marshal.mq) {
 		warning("flowmgr: marshal_send: no mq\n");
+		me->ret = ENOSYS;
 		return;
 	}
 
+	me->waiter = marshal_waiter();
+	if (!me->waiter) {
+		warning("flowmgr: marshal_send: no waiter\n");
+		me->ret = ENOMEM;
+		return;
+	}
+
+	/* the callers only set id, fm and the arguments */
 	me->handled = false;
-	mqueue_push(marshal.mq, me->id, me);
+	me->async = false;
+	me->doneh = NULL;
+	me->arg = NULL;
+	me->ret = 0;
+
+	err = mqueue_push(marshal.mq, me->id, me);
+	if (err) {
+		warning("flowmgr: marshal_send: mqueue_push failed (%m)\n",
+			err);
+		me->ret = err;
+		return;
+	}
+
 	marshal_wait(me);
 }
 
 
+static void async_destructor(void *arg)
+{
+	struct marshal_elem *me = arg;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(me->ownv); i++)
+		mem_deref(me->ownv[i]);
+}
+
+
+static void *async_alloc(size_t sz, int id, struct flowmgr *fm,
+			 flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_elem *me;
+
+	me = mem_zalloc(sz, async_destructor);
+	if (!me)
+		return NULL;
+
+	me->id = id;
+	me->fm = fm;
+	me->async = true;
+	me->doneh = doneh;
+	me->arg = arg;
+
+	return me;
+}
+
+
+/* Copy an argument into the element, zero-terminated */
+static int async_dup(struct marshal_elem *me, const char **dstp,
+		     const void *src, size_t len)
+{
+	char *dst;
+	size_t i;
+
+	*dstp = NULL;
+
+	if (!src)
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(me->ownv); i++) {
+		if (!me->ownv[i])
+			break;
+	}
+	if (i >= ARRAY_SIZE(me->ownv))
+		return EOVERFLOW;
+
+	dst = mem_alloc(len + 1, NULL);
+	if (!dst)
+		return ENOMEM;
+
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+
+	me->ownv[i] = dst;
+	*dstp = dst;
+
+	return 0;
+}
+
+
+static int async_str(struct marshal_elem *me, const char **dstp,
+		     const char *src)
+{
+	return async_dup(me, dstp, src, str_len(src));
+}
+
+
+/* Queue an asynchronous call; the element is consumed either way */
+static int marshal_post(struct marshal_elem *me, int err)
+{
+	if (!err && !marshal.mq) {
+		warning("flowmgr: marshal_post: no mq\n");
+		err = ENOSYS;
+	}
+
+	if (!err)
+		err = mqueue_push(marshal.mq, me->id, me);
+
+	if (err)
+		mem_deref(me);
+
+	return err;
+}
+
+
 int marshal_flowmgr_alloc(struct flowmgr **fmp, flowmgr_req_h *reqh,
 			  flowmgr_err_h *errh, void *arg)
 {
@@ -906,6 +1107,9 @@ bool marshal_flowmgr_has_media(struct flowmgr *fm, const char *convid,
 {
 	struct marshal_has_media me;
 
+	if (0 == snapshot_has_media(fm, convid, has_media))
+		return 0;
+
 	me.a.id = MARSHAL_HAS_MEDIA;
 	me.a.fm = fm;
 
@@ -968,6 +1172,10 @@ int marshal_flowmgr_get_mute(struct flowmgr *fm, bool *muted)
 {
 	struct marshal_mute_elem me;
 
+	/* the mute state is global in voe, not per flowmgr */
+	if (0 == voe_get_mute_state(muted))
+		return 0;
+
 	me.a.id = MARSHAL_GET_MUTE;
 	me.a.fm = fm;
 
@@ -1150,6 +1358,10 @@ int marshal_flowmgr_is_sending_video(struct flowmgr *fm,
 				     const char *convid, const char *partid)
 {
 	struct marshal_video_is_sending_elem me;
+	bool sending;
+
+	if (0 == snapshot_is_sending_video(fm, convid, partid, &sending))
+		return sending;
 
 	me.a.id = MARSHAL_IS_SENDING_VIDEO;
 	me.a.fm = fm;
@@ -1196,3 +1408,176 @@ void marshal_flowmgr_set_audio_state_handler(struct flowmgr *fm,
     
 	marshal_send(&me);
 }
+
+
+int marshal_flowmgr_process_event_async(struct flowmgr *fm,
+					const char *ctype,
+					const char *content, size_t clen,
+					flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_event_elem *me;
+	int err;
+
+	me = async_alloc(sizeof(*me), MARSHAL_EVENT, fm, doneh, arg);
+	if (!me)
+		return ENOMEM;
+
+	me->hp = &me->handled;
+	me->clen = clen;
+	err  = async_str(&me->a, &me->ctype, ctype);
+	err |= async_dup(&me->a, &me->content, content, clen);
+
+	return marshal_post(&me->a, err);
+}
+
+
+int marshal_flowmgr_acquire_flows_async(struct flowmgr *fm,
+					const char *convid,
+					const char *sessid,
+					flowmgr_netq_h *qh, void *qarg,
+					flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_acquire_elem *me;
+	int err;
+
+	me = async_alloc(sizeof(*me), MARSHAL_ACQUIRE, fm, doneh, arg);
+	if (!me)
+		return ENOMEM;
+
+	me->qh = qh;
+	me->arg = qarg;
+	err  = async_str(&me->a, &me->convid, convid);
+	err |= async_str(&me->a, &me->sessid, sessid);
+
+	return marshal_post(&me->a, err);
+}
+
+
+int marshal_flowmgr_release_flows_async(struct flowmgr *fm,
+					const char *convid,
+					flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_release_elem *me;
+	int err;
+
+	me = async_alloc(sizeof(*me), MARSHAL_RELEASE, fm, doneh, arg);
+	if (!me)
+		return ENOMEM;
+
+	err = async_str(&me->a, &me->convid, convid);
+
+	return marshal_post(&me->a, err);
+}
+
+
+int marshal_flowmgr_set_active_async(struct flowmgr *fm, const char *convid,
+				     bool active,
+				     flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_setactive_elem *me;
+	int err;
+
+	me = async_alloc(sizeof(*me), MARSHAL_SET_ACTIVE, fm, doneh, arg);
+	if (!me)
+		return ENOMEM;
+
+	me->active = active;
+	err = async_str(&me->a, &me->convid, convid);
+
+	return marshal_post(&me->a, err);
+}
+
+
+int marshal_flowmgr_user_add_async(struct flowmgr *fm, const char *convid,
+				   const char *userid, const char *name,
+				   flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_useradd_elem *me;
+	int err;
+
+	me = async_alloc(sizeof(*me), MARSHAL_USER_ADD, fm, doneh, arg);
+	if (!me)
+		return ENOMEM;
+
+	err  = async_str(&me->a, &me->convid, convid);
+	err |= async_str(&me->a, &me->userid, userid);
+	err |= async_str(&me->a, &me->name, name);
+
+	return marshal_post(&me->a, err);
+}
+
+
+int marshal_flowmgr_mcat_changed_async(struct flowmgr *fm,
+				       const char *convid,
+				       enum flowmgr_mcat cat,
+				       flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_mcat_elem *me;
+	int err;
+
+	me = async_alloc(sizeof(*me), MARSHAL_MCAT, fm, doneh, arg);
+	if (!me)
+		return ENOMEM;
+
+	me->cat = cat;
+	err = async_str(&me->a, &me->convid, convid);
+
+	return marshal_post(&me->a, err);
+}
+
+
+int marshal_flowmgr_set_mute_async(struct flowmgr *fm, bool mute,
+				   flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_mute_elem *me;
+	bool *mutep;
+
+	me = async_alloc(sizeof(*me) + sizeof(*mutep), MARSHAL_SET_MUTE,
+			 fm, doneh, arg);
+	if (!me)
+		return ENOMEM;
+
+	mutep = (bool *)(me + 1);
+	*mutep = mute;
+	me->mute = mutep;
+
+	return marshal_post(&me->a, 0);
+}
+
+
+int marshal_flowmgr_interruption_async(struct flowmgr *fm,
+				       const char *convid, bool interrupted,
+				       flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_interruption_elem *me;
+	int err;
+
+	me = async_alloc(sizeof(*me), MARSHAL_INTERRUPTION, fm, doneh, arg);
+	if (!me)
+		return ENOMEM;
+
+	me->interrupted = interrupted;
+	err = async_str(&me->a, &me->convid, convid);
+
+	return marshal_post(&me->a, err);
+}
+
+
+int marshal_flowmgr_set_video_send_state_async(struct flowmgr *fm,
+				const char *convid,
+				enum flowmgr_video_send_state state,
+				flowmgr_marshal_h *doneh, void *arg)
+{
+	struct marshal_video_state_elem *me;
+	int err;
+
+	me = async_alloc(sizeof(*me), MARSHAL_SET_VIDEO_SEND_STATE, fm,
+			 doneh, arg);
+	if (!me)
+		return ENOMEM;
+
+	me->state = state;
+	err = async_str(&me->a, &me->convid, convid);
+
+	return marshal_post(&me->a, err);
+}
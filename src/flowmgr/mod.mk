@@ -11,5 +11,6 @@ AVS_SRCS += \
 	flowmgr/flowmgr.c \
 	flowmgr/marshal.c \
 	flowmgr/rr.c \
+	flowmgr/snapshot.c \
 	flowmgr/userflow.c \
 	flowmgr/voice_message.c
@@ -0,0 +1,249 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Snapshot of flowmgr state for read-only queries from other threads.
+ *
+ * The re thread rewrites the snapshot in place whenever the state may
+ * have changed. It bumps the sequence counter to an odd value before
+ * and to an even value after writing. Readers never block: they retry
+ * when the counter was odd or changed while they were reading.
+ *
+ * If the snapshot cannot answer a query, the reader gets ENOENT and
+ * has to fall back to a marshalled call.
+ */
+
+#include <string.h>
+#include <re/re.h>
+#include "avs_aucodec.h"
+#include "avs_dict.h"
+#include "avs_log.h"
+#include "avs_uuid.h"
+#include "avs_zapi.h"
+#include "avs_rest.h"
+#include "avs_conf_pos.h"
+#include "avs_media.h"
+#include "avs_flowmgr.h"
+#include "flowmgr.h"
+
+
+static void write_begin(struct flowmgr_snapshot *snap)
+{
+	__atomic_store_n(&snap->seq, snap->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void write_end(struct flowmgr_snapshot *snap)
+{
+	__atomic_store_n(&snap->seq, snap->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+static uint32_t read_begin(const struct flowmgr_snapshot *snap)
+{
+	uint32_t seq;
+
+	while ((seq = __atomic_load_n(&snap->seq, __ATOMIC_ACQUIRE)) & 1)
+		;
+
+	return seq;
+}
+
+
+static bool read_retry(const struct flowmgr_snapshot *snap, uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&snap->seq, __ATOMIC_RELAXED) != seq;
+}
+
+
+static bool flow_handler(char *key, void *val, void *arg)
+{
+	struct flow *flow = val;
+	struct flowmgr_snapshot *snap = arg;
+	unsigned i = snap->flowc;
+
+	(void)key;
+
+	if (i >= ARRAY_SIZE(snap->flowv)
+	    || str_len(flow->remoteid) >= sizeof(snap->flowv[i].partid)) {
+		snap->complete = false;
+		return false;
+	}
+
+	snap->flowv[i].call = snap->callc;
+	snap->flowv[i].partid[0] = '\0';
+	str_ncpy(snap->flowv[i].partid, flow->remoteid,
+		 sizeof(snap->flowv[i].partid));
+	snap->flowv[i].sending_video = flow_is_sending_video(flow);
+	++snap->flowc;
+
+	return false;
+}
+
+
+static bool call_handler(char *key, void *val, void *arg)
+{
+	struct call *call = val;
+	struct flowmgr_snapshot *snap = arg;
+	unsigned i = snap->callc;
+
+	(void)key;
+
+	if (i >= ARRAY_SIZE(snap->callv)
+	    || str_len(call->convid) >= sizeof(snap->callv[i].convid)) {
+		snap->complete = false;
+		return true;
+	}
+
+	str_ncpy(snap->callv[i].convid, call->convid,
+		 sizeof(snap->callv[i].convid));
+	snap->callv[i].active = call_active_handler(NULL, call, NULL);
+	snap->callv[i].has_media = call->rtp_started;
+
+	dict_apply(call->flows, flow_handler, snap);
+	++snap->callc;
+
+	return false;
+}
+
+
+void snapshot_update(struct flowmgr *fm)
+{
+	struct flowmgr_snapshot *snap;
+
+	if (!fm)
+		return;
+
+	snap = &fm->snap;
+
+	write_begin(snap);
+
+	snap->complete = true;
+	snap->callc = 0;
+	snap->flowc = 0;
+	dict_apply(fm->calls, call_handler, snap);
+
+	write_end(snap);
+}
+
+
+/* Must be called between read_begin() and read_retry() */
+static int find_call(const struct flowmgr_snapshot *snap,
+		     const char *convid)
+{
+	unsigned i, n;
+
+	n = min(snap->callc, ARRAY_SIZE(snap->callv));
+
+	for (i = 0; i < n; i++) {
+
+		if (convid) {
+			if (0 == strncmp(snap->callv[i].convid, convid,
+					 sizeof(snap->callv[i].convid)))
+				return i;
+		}
+		else if (snap->callv[i].active) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+
+int snapshot_has_media(const struct flowmgr *fm, const char *convid,
+		       bool *has_media)
+{
+	const struct flowmgr_snapshot *snap;
+	uint32_t seq;
+	bool complete, hm;
+	int ix;
+
+	if (!fm || !has_media)
+		return EINVAL;
+
+	/* flowmgr_has_media() finds no call without a convid */
+	if (!convid) {
+		*has_media = false;
+		return 0;
+	}
+
+	snap = &fm->snap;
+
+	do {
+		seq = read_begin(snap);
+		complete = snap->complete;
+		ix = find_call(snap, convid);
+		hm = ix >= 0 ? snap->callv[ix].has_media : false;
+	} while (read_retry(snap, seq));
+
+	if (ix < 0 && !complete)
+		return ENOENT;
+
+	*has_media = hm;
+
+	return 0;
+}
+
+
+int snapshot_is_sending_video(const struct flowmgr *fm, const char *convid,
+			      const char *partid, bool *sending)
+{
+	const struct flowmgr_snapshot *snap;
+	uint32_t seq;
+	bool complete, found, sv;
+	unsigned i, n;
+	int ix;
+
+	if (!fm || !sending)
+		return EINVAL;
+
+	snap = &fm->snap;
+
+	do {
+		seq = read_begin(snap);
+		complete = snap->complete;
+		found = false;
+		sv = false;
+
+		ix = find_call(snap, convid);
+		n = min(snap->flowc, ARRAY_SIZE(snap->flowv));
+
+		for (i = 0; ix >= 0 && partid && i < n; i++) {
+
+			if (snap->flowv[i].call != (unsigned)ix)
+				continue;
+
+			if (0 == strncmp(snap->flowv[i].partid, partid,
+					 sizeof(snap->flowv[i].partid))) {
+				found = true;
+				sv = snap->flowv[i].sending_video;
+				break;
+			}
+		}
+	} while (read_retry(snap, seq));
+
+	if (!found && !complete)
+		return ENOENT;
+
+	*sending = sv;
+
+	return 0;
+}
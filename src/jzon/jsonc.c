@@ -285,10 +285,27 @@ int json_object_put(struct json_object *obj)
 #endif
 
 
+/* the key of an array element is its index, in decimal */
+static const char *index_key(char *buf, size_t sz, size_t idx)
+{
+	char *p = &buf[sz - 1];
+
+	*p = '\0';
+
+	do {
+		*--p = '0' + idx % 10;
+		idx /= 10;
+	} while (idx && p > buf);
+
+	return p;
+}
+
+
 /* return 0 for success, -1 for errors */
 int json_object_array_add(struct json_object *jobj, struct json_object *val)
 {
-	char key[16];
+	const char *key;
+	char buf[24];
 	int err;
 
 	if (!jobj)
@@ -299,9 +316,7 @@ int json_object_array_add(struct json_object *jobj, struct json_object *val)
 		return -1;
 	}
 
-	if (re_snprintf(key, sizeof(key), "%zu",
-			odict_count(jzon_odict(jobj), false)) < 0)
-		return -1;
+	key = index_key(buf, sizeof(buf), odict_count(jzon_odict(jobj), false));
 
 	if (val) {
 		err = add_entry(jobj, key, val);
@@ -344,8 +359,6 @@ int json_object_array_length(struct json_object *jobj)
 
 struct json_object *json_object_array_get_idx(struct json_object *obj, int idx)
 {
-	char key[16];
-
 	if (!obj || idx<0)
 		return NULL;
 
@@ -354,10 +367,7 @@ struct json_object *json_object_array_get_idx(struct json_object *obj, int idx)
 		return 0;
 	}
 
-	if (re_snprintf(key, sizeof(key), "%d", idx) < 0)
-		return NULL;
-
-	return (struct json_object *)odict_lookup(jzon_odict(obj), key);
+	return (struct json_object *)odict_at(jzon_odict(obj), idx);
 }
 
 
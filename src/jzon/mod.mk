@@ -5,4 +5,5 @@
 AVS_SRCS += \
 	jzon/jsonc.c \
 	jzon/jzon.c \
-	jzon/pretty.c
+	jzon/pretty.c \
+	jzon/pull.c
@@ -0,0 +1,420 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <re.h>
+#include "avs_jzon.h"
+
+
+/*
+ * Pull parser
+ *
+ * The reader keeps one bit per open container, so it needs no memory
+ * of its own. Subtrees that are not needed are still tokenized by
+ * jzon_skip(), so a text that is read to the end has been checked.
+ */
+
+
+enum state {
+	ST_VALUE = 0,
+	ST_FIRST_VALUE,  /* value or ']' */
+	ST_KEY,
+	ST_FIRST_KEY,    /* key or '}' */
+	ST_NEXT,         /* ',' or the end of the container */
+	ST_DONE,
+	ST_ERROR,
+};
+
+
+static void skip_ws(struct jzon_reader *r)
+{
+	while (r->p < r->end &&
+	       (*r->p == ' ' || *r->p == '\t' ||
+		*r->p == '\r' || *r->p == '\n'))
+		++r->p;
+}
+
+
+static void after_value(struct jzon_reader *r)
+{
+	r->state = r->depth ? ST_NEXT : ST_DONE;
+}
+
+
+static int read_string(struct jzon_reader *r, struct pl *pl)
+{
+	const char *p;
+
+	for (p = r->p + 1; p < r->end; p++) {
+
+		if (*p == '\\') {
+			if (++p == r->end)
+				break;
+		}
+		else if (*p == '"') {
+			pl->p = r->p + 1;
+			pl->l = p - pl->p;
+			r->p = p + 1;
+			return 0;
+		}
+		else if ((unsigned char)*p < 0x20) {
+			break;
+		}
+	}
+
+	return EBADMSG;
+}
+
+
+static int open_container(struct jzon_reader *r, struct jzon_tok *tok,
+			  bool object)
+{
+	if (r->depth >= JZON_MAX_DEPTH)
+		return EOVERFLOW;
+
+	if (object)
+		r->stack |= 1u << r->depth;
+	else
+		r->stack &= ~(1u << r->depth);
+
+	tok->type  = object ? JZON_OBJECT_BEGIN : JZON_ARRAY_BEGIN;
+	tok->depth = r->depth++;
+	tok->pl.p  = r->p++;
+	tok->pl.l  = 1;
+
+	r->state = object ? ST_FIRST_KEY : ST_FIRST_VALUE;
+
+	return 0;
+}
+
+
+static int close_container(struct jzon_reader *r, struct jzon_tok *tok)
+{
+	const bool object = *r->p == '}';
+
+	if (!r->depth || object != !!(r->stack & (1u << (r->depth - 1))))
+		return EBADMSG;
+
+	tok->type  = object ? JZON_OBJECT_END : JZON_ARRAY_END;
+	tok->depth = --r->depth;
+	tok->pl.p  = r->p++;
+	tok->pl.l  = 1;
+
+	after_value(r);
+
+	return 0;
+}
+
+
+static int read_literal(struct jzon_reader *r, struct jzon_tok *tok,
+			const char *lit, enum jzon_tok_type type)
+{
+	const size_t n = strlen(lit);
+
+	if ((size_t)(r->end - r->p) < n || memcmp(r->p, lit, n))
+		return EBADMSG;
+
+	tok->type = type;
+	tok->pl.p = r->p;
+	tok->pl.l = n;
+	r->p += n;
+
+	return 0;
+}
+
+
+static const char *skip_digits(const char *p, const char *end)
+{
+	while (p < end && *p >= '0' && *p <= '9')
+		++p;
+
+	return p;
+}
+
+
+/* -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+static int read_number(struct jzon_reader *r, struct jzon_tok *tok)
+{
+	const char *p = r->p, *q;
+
+	if (p < r->end && *p == '-')
+		++p;
+
+	if (p < r->end && *p == '0')
+		++p;
+	else if (p == (q = skip_digits(p, r->end)))
+		return EBADMSG;
+	else
+		p = q;
+
+	if (p < r->end && *p == '.') {
+		q = skip_digits(p + 1, r->end);
+		if (q == p + 1)
+			return EBADMSG;
+		p = q;
+	}
+
+	if (p < r->end && (*p == 'e' || *p == 'E')) {
+		++p;
+		if (p < r->end && (*p == '+' || *p == '-'))
+			++p;
+		q = skip_digits(p, r->end);
+		if (q == p)
+			return EBADMSG;
+		p = q;
+	}
+
+	/* like "01" or "1.2.3" */
+	if (p < r->end && *p && strchr("0123456789+-.eE", *p))
+		return EBADMSG;
+
+	tok->type = JZON_NUMBER;
+	tok->pl.p = r->p;
+	tok->pl.l = p - r->p;
+	r->p = p;
+
+	return 0;
+}
+
+
+static int read_value(struct jzon_reader *r, struct jzon_tok *tok)
+{
+	int err;
+
+	tok->depth = r->depth;
+
+	switch (*r->p) {
+
+	case '{':
+		return open_container(r, tok, true);
+
+	case '[':
+		return open_container(r, tok, false);
+
+	case '"':
+		tok->type = JZON_STRING;
+		err = read_string(r, &tok->pl);
+		break;
+
+	case 't':
+		err = read_literal(r, tok, "true", JZON_TRUE);
+		break;
+
+	case 'f':
+		err = read_literal(r, tok, "false", JZON_FALSE);
+		break;
+
+	case 'n':
+		err = read_literal(r, tok, "null", JZON_NULL);
+		break;
+
+	case '-':
+	case '0': case '1': case '2': case '3': case '4':
+	case '5': case '6': case '7': case '8': case '9':
+		err = read_number(r, tok);
+		break;
+
+	default:
+		err = EBADMSG;
+		break;
+	}
+
+	if (!err)
+		after_value(r);
+
+	return err;
+}
+
+
+static int read_key(struct jzon_reader *r, struct jzon_tok *tok)
+{
+	int err;
+
+	if (*r->p != '"')
+		return EBADMSG;
+
+	err = read_string(r, &tok->pl);
+	if (err)
+		return err;
+
+	skip_ws(r);
+	if (r->p == r->end || *r->p != ':')
+		return EBADMSG;
+
+	++r->p;
+
+	tok->type = JZON_KEY;
+	tok->depth = r->depth;
+	r->state = ST_VALUE;
+
+	return 0;
+}
+
+
+static int next(struct jzon_reader *r, struct jzon_tok *tok)
+{
+	bool object;
+
+	skip_ws(r);
+
+	if (r->state == ST_DONE)
+		return r->p == r->end ? ENOENT : EBADMSG;
+
+	if (r->p == r->end)
+		return EBADMSG;
+
+	switch (r->state) {
+
+	case ST_VALUE:
+		return read_value(r, tok);
+
+	case ST_FIRST_VALUE:
+		if (*r->p == ']')
+			return close_container(r, tok);
+		return read_value(r, tok);
+
+	case ST_FIRST_KEY:
+		if (*r->p == '}')
+			return close_container(r, tok);
+		return read_key(r, tok);
+
+	case ST_KEY:
+		return read_key(r, tok);
+
+	case ST_NEXT:
+		if (*r->p == '}' || *r->p == ']')
+			return close_container(r, tok);
+
+		if (*r->p != ',')
+			return EBADMSG;
+
+		++r->p;
+		skip_ws(r);
+		if (r->p == r->end)
+			return EBADMSG;
+
+		object = !!(r->stack & (1u << (r->depth - 1)));
+		if (object)
+			return read_key(r, tok);
+
+		return read_value(r, tok);
+
+	default:
+		return EBADMSG;
+	}
+}
+
+
+void jzon_reader_init(struct jzon_reader *r, const char *buf, size_t len)
+{
+	if (!r)
+		return;
+
+	memset(r, 0, sizeof(*r));
+
+	r->p = buf;
+	r->end = buf ? buf + len : buf;
+}
+
+
+/**
+ * Read the next token
+ *
+ * @param r   Reader
+ * @param tok Returns the token
+ *
+ * @return 0 if a token was read, ENOENT at the end of the text, or an
+ *         error if the text is not valid JSON
+ */
+int jzon_next(struct jzon_reader *r, struct jzon_tok *tok)
+{
+	int err;
+
+	if (!r || !tok)
+		return EINVAL;
+
+	if (r->state == ST_ERROR)
+		return EBADMSG;
+
+	err = next(r, tok);
+	if (err && err != ENOENT)
+		r->state = ST_ERROR;
+
+	return err;
+}
+
+
+/**
+ * Skip the value that starts with a token. For an object or array,
+ * the token is extended to the whole value, that can then be given to
+ * jzon_decode().
+ *
+ * @param r   Reader
+ * @param tok The last token that was read
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int jzon_skip(struct jzon_reader *r, struct jzon_tok *tok)
+{
+	struct jzon_tok t;
+	int err;
+
+	if (!r || !tok)
+		return EINVAL;
+
+	if (tok->type != JZON_OBJECT_BEGIN && tok->type != JZON_ARRAY_BEGIN)
+		return 0;
+
+	do {
+		err = jzon_next(r, &t);
+		if (err)
+			return err == ENOENT ? EBADMSG : err;
+
+	} while (t.depth != tok->depth ||
+		 (t.type != JZON_OBJECT_END && t.type != JZON_ARRAY_END));
+
+	tok->pl.l = t.pl.p + 1 - tok->pl.p;
+
+	return 0;
+}
+
+
+/**
+ * Copy a string or key token, with the escapes decoded like
+ * jzon_decode() does
+ *
+ * @param buf  Buffer for the string
+ * @param size Size of the buffer, with room for the terminating zero
+ * @param tok  String or key token
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int jzon_tok_strcpy(char *buf, size_t size, const struct jzon_tok *tok)
+{
+	if (!buf || !size || !tok)
+		return EINVAL;
+
+	if (tok->type != JZON_STRING && tok->type != JZON_KEY)
+		return EINVAL;
+
+	/* too long, or a bad escape */
+	if (re_snprintf(buf, size, "%H", utf8_decode, &tok->pl) < 0)
+		return EBADMSG;
+
+	return 0;
+}
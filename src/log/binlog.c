@@ -0,0 +1,750 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "log.h"
+
+
+/*
+ * Binary log records
+ *
+ * A record is a type byte, a 16-bit length and the payload. Fixed
+ * size numbers are in host byte order, the HEAD record says which
+ * one. Integers are varints (7 bits per byte, low bits first), signed
+ * ones zigzag encoded.
+ *
+ *   HEAD  "AVSL" version:u8 little_endian:u8
+ *   FMT   id:u16 level:u8 format
+ *   MSG   id:u16 level:u8 time_ms:varint arguments
+ *   TEXT  level:u8 time_ms:varint message
+ *
+ * The arguments of a MSG are those of the format, in order:
+ *
+ *   %d %i %m             signed varint
+ *   %u %x %X %p          varint
+ *   %f %F                double
+ *   %c                   8 bits
+ *   %j %J                ip:u8 port:u16, then 4 or 16 bytes address
+ *
+ * where ip is 4 or 6, or 0 for no address, as AF_INET6 is not the
+ * same number everywhere.
+ *   %s %r %b %H %v %w    len:u16 bytes (%H and %v are formatted here)
+ *
+ * See toys/avslog-decode for a decoder.
+ */
+
+
+enum {
+	BIN_VERSION = 1,
+	HDR_SIZE    = 3,
+	BIN_IPV4    = 4,
+	BIN_IPV6    = 6,
+};
+
+
+struct conv {
+	const char *lit;         /* literal text before the conversion */
+	size_t litl;
+	char spec[16];           /* '%', flags and width */
+	size_t specl;
+	int lenmod;              /* number of 'l', or -1 for 'z' */
+	char ch;                 /* conversion, 0 at the end */
+};
+
+struct writer {
+	uint8_t *p;
+	size_t size;
+	size_t len;
+	bool ovf;
+};
+
+
+/* the next conversion that takes arguments, like re_vhprintf() */
+static const char *next_conv(const char *p, struct conv *cv)
+{
+	memset(cv, 0, sizeof(*cv));
+
+	cv->lit = p;
+
+	for (;;) {
+		const char *q;
+
+		while (*p && *p != '%')
+			++p;
+
+		if (!*p) {
+			cv->litl = p - cv->lit;
+			return p;
+		}
+
+		q = p + 1;
+		cv->specl = 0;
+		cv->spec[cv->specl++] = '%';
+		cv->lenmod = 0;
+
+		for (; *q; q++) {
+			if (*q == '-' || *q == '.' || isdigit((unsigned char)*q)) {
+				if (cv->specl < sizeof(cv->spec) - 4)
+					cv->spec[cv->specl++] = *q;
+			}
+			else if (*q == 'l')
+				++cv->lenmod;
+			else if (*q == 'z')
+				cv->lenmod = -1;
+			else
+				break;
+		}
+
+		if (!*q) {
+			/* re_vhprintf() ignores a dangling '%' */
+			cv->litl = p - cv->lit;
+			return q;
+		}
+
+		if (*q == '%' || !strchr("bcdifFHmprsuvwWxXjJ", *q)) {
+			/* no argument, left in the literal text */
+			p = q + 1;
+			continue;
+		}
+
+		cv->litl = p - cv->lit;
+		cv->ch = *q;
+
+		return q + 1;
+	}
+}
+
+
+/* The argument types of a format, fails if it cannot be logged in binary */
+int log_fmt_compile(struct log_fmt *lf)
+{
+	const char *p = lf->fmt;
+	struct conv cv;
+	uint8_t a;
+
+	lf->argc = 0;
+
+	for (;;) {
+		p = next_conv(p, &cv);
+		if (!cv.ch)
+			break;
+
+		switch (cv.ch) {
+
+		case 'd':
+		case 'i':
+			a = cv.lenmod < 0 ? LOG_ARG_SSIZE
+			  : cv.lenmod == 0 ? LOG_ARG_INT
+			  : cv.lenmod == 1 ? LOG_ARG_LONG : LOG_ARG_LLONG;
+			break;
+
+		case 'u':
+		case 'x':
+		case 'X':
+			a = cv.lenmod < 0 ? LOG_ARG_SIZE
+			  : cv.lenmod == 0 ? LOG_ARG_UINT
+			  : cv.lenmod == 1 ? LOG_ARG_ULONG : LOG_ARG_ULLONG;
+			break;
+
+		case 'p': a = LOG_ARG_PTR;  break;
+		case 'f':
+		case 'F': a = LOG_ARG_DBL;  break;
+		case 'c': a = LOG_ARG_CHAR; break;
+		case 'm': a = LOG_ARG_ERR;  break;
+		case 's': a = LOG_ARG_STR;  break;
+		case 'r': a = LOG_ARG_PL;   break;
+		case 'b': a = LOG_ARG_BUF;  break;
+		case 'w':
+		case 'W': a = LOG_ARG_HEX;  break;
+		case 'j':
+		case 'J': a = LOG_ARG_SA;   break;
+		case 'H': a = LOG_ARG_PRINTH; break;
+		case 'v': a = LOG_ARG_VA;   break;
+		default:
+			return EINVAL;
+		}
+
+		if (lf->argc >= ARRAY_SIZE(lf->argv))
+			return E2BIG;
+
+		lf->argv[lf->argc++] = a;
+	}
+
+	return 0;
+}
+
+
+static void put(struct writer *w, const void *p, size_t len)
+{
+	if (w->len + len > w->size) {
+		w->ovf = true;
+		return;
+	}
+
+	memcpy(w->p + w->len, p, len);
+	w->len += len;
+}
+
+
+static void put_varint(struct writer *w, uint64_t n)
+{
+	uint8_t v[10];
+	size_t i = 0;
+
+	while (n >= 0x80) {
+		v[i++] = (uint8_t)(n | 0x80);
+		n >>= 7;
+	}
+	v[i++] = (uint8_t)n;
+
+	put(w, v, i);
+}
+
+
+static void put_svarint(struct writer *w, int64_t n)
+{
+	put_varint(w, ((uint64_t)n << 1) ^ (uint64_t)(n >> 63));
+}
+
+
+static void put_bytes(struct writer *w, const void *p, size_t len)
+{
+	uint16_t l = (uint16_t)min(len, 0xffff);
+
+	put(w, &l, sizeof(l));
+	if (l)
+		put(w, p, l);
+}
+
+
+static void put_hdr(struct writer *w, uint8_t type)
+{
+	w->len = 0;
+	w->ovf = false;
+
+	put(w, &type, 1);
+	w->len += 2;  /* length, set at the end */
+}
+
+
+static void put_end(struct writer *w)
+{
+	uint16_t len;
+
+	if (w->len - HDR_SIZE > 0xffff)
+		w->ovf = true;
+	if (w->ovf)
+		return;
+
+	len = (uint16_t)(w->len - HDR_SIZE);
+	memcpy(w->p + 1, &len, sizeof(len));
+}
+
+
+static void put_sa(struct writer *w, const struct sa *sa)
+{
+	uint8_t ip = 0;
+	uint16_t port = 0;
+
+	if (sa) {
+		switch (sa_af(sa)) {
+
+		case AF_INET:
+			ip = BIN_IPV4;
+			break;
+#ifdef HAVE_INET6
+		case AF_INET6:
+			ip = BIN_IPV6;
+			break;
+#endif
+		default:
+			break;
+		}
+
+		port = sa_port(sa);
+	}
+
+	put(w, &ip, 1);
+	put(w, &port, sizeof(port));
+
+	if (ip == BIN_IPV4)
+		put(w, &sa->u.in.sin_addr, 4);
+#ifdef HAVE_INET6
+	else if (ip == BIN_IPV6)
+		put(w, &sa->u.in6.sin6_addr, 16);
+#endif
+}
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	struct writer *w = arg;
+
+	put(w, p, size);
+
+	return w->ovf ? ENOMEM : 0;
+}
+
+
+/* %H and %v, formatted straight into the record */
+static void put_printf(struct writer *w, const char *fmt, ...)
+{
+	size_t pos = w->len;
+	uint16_t len;
+	va_list ap;
+
+	w->len += 2;
+
+	va_start(ap, fmt);
+	(void)re_vhprintf(fmt, ap, print_handler, w);
+	va_end(ap);
+
+	if (w->ovf)
+		return;
+
+	len = (uint16_t)min(w->len - pos - 2, 0xffff);
+	memcpy(w->p + pos, &len, sizeof(len));
+}
+
+
+/* Encode a MSG record, returns its length or 0 if it does not fit */
+size_t log_bin_encode(uint8_t *buf, size_t size, const struct log_fmt *lf,
+		      uint64_t ts, va_list ap)
+{
+	struct writer w = {buf, size, 0, false};
+	const uint8_t level = lf->level;
+	uint8_t i;
+
+	put_hdr(&w, LOG_BIN_MSG);
+	put(&w, &lf->id, sizeof(lf->id));
+	put(&w, &level, 1);
+	put_varint(&w, ts);
+
+	for (i = 0; i < lf->argc && !w.ovf; i++) {
+
+		int64_t sn;
+		uint64_t n;
+		double dbl;
+		int32_t e;
+		uint8_t c;
+		const char *str;
+		const struct pl *pl;
+		size_t len;
+
+		switch (lf->argv[i]) {
+
+		case LOG_ARG_INT:
+			sn = va_arg(ap, int);
+			put_svarint(&w, sn);
+			break;
+
+		case LOG_ARG_LONG:
+			sn = va_arg(ap, long);
+			put_svarint(&w, sn);
+			break;
+
+		case LOG_ARG_LLONG:
+			sn = va_arg(ap, long long);
+			put_svarint(&w, sn);
+			break;
+
+		case LOG_ARG_SSIZE:
+			sn = va_arg(ap, ssize_t);
+			put_svarint(&w, sn);
+			break;
+
+		case LOG_ARG_UINT:
+			n = va_arg(ap, unsigned);
+			put_varint(&w, n);
+			break;
+
+		case LOG_ARG_ULONG:
+			n = va_arg(ap, unsigned long);
+			put_varint(&w, n);
+			break;
+
+		case LOG_ARG_ULLONG:
+			n = va_arg(ap, unsigned long long);
+			put_varint(&w, n);
+			break;
+
+		case LOG_ARG_SIZE:
+			n = va_arg(ap, size_t);
+			put_varint(&w, n);
+			break;
+
+		case LOG_ARG_PTR:
+			n = (uintptr_t)va_arg(ap, void *);
+			put_varint(&w, n);
+			break;
+
+		case LOG_ARG_DBL:
+			dbl = va_arg(ap, double);
+			put(&w, &dbl, sizeof(dbl));
+			break;
+
+		case LOG_ARG_CHAR:
+			c = (uint8_t)va_arg(ap, int);
+			put(&w, &c, 1);
+			break;
+
+		case LOG_ARG_ERR:
+			e = va_arg(ap, int);
+			put_svarint(&w, e);
+			break;
+
+		case LOG_ARG_STR:
+			str = va_arg(ap, const char *);
+			put_bytes(&w, str, str_len(str));
+			break;
+
+		case LOG_ARG_PL:
+			pl = va_arg(ap, const struct pl *);
+			put_bytes(&w, pl ? pl->p : NULL,
+				  (pl && pl->p) ? pl->l : 0);
+			break;
+
+		case LOG_ARG_BUF:
+		case LOG_ARG_HEX:
+			str = va_arg(ap, const char *);
+			len = va_arg(ap, size_t);
+			put_bytes(&w, str, str ? len : 0);
+			break;
+
+		case LOG_ARG_SA:
+			put_sa(&w, va_arg(ap, const struct sa *));
+			break;
+
+		case LOG_ARG_PRINTH: {
+			re_printf_h *ph = va_arg(ap, re_printf_h *);
+			void *ph_arg = va_arg(ap, void *);
+
+			put_printf(&w, "%H", ph, ph_arg);
+			break;
+		}
+
+		case LOG_ARG_VA: {
+			const char *fmt = va_arg(ap, const char *);
+			va_list *apl = va_arg(ap, va_list *);
+
+			put_printf(&w, "%v", fmt, apl);
+			break;
+		}
+
+		default:
+			w.ovf = true;
+			break;
+		}
+	}
+
+	put_end(&w);
+
+	return w.ovf ? 0 : w.len;
+}
+
+
+size_t log_bin_encode_fmt(uint8_t *buf, size_t size,
+			  const struct log_fmt *lf)
+{
+	struct writer w = {buf, size, 0, false};
+	const uint8_t level = lf->level;
+
+	put_hdr(&w, LOG_BIN_FMT);
+	put(&w, &lf->id, sizeof(lf->id));
+	put(&w, &level, 1);
+	put(&w, lf->fmt, str_len(lf->fmt));
+	put_end(&w);
+
+	return w.ovf ? 0 : w.len;
+}
+
+
+size_t log_bin_encode_text(uint8_t *buf, size_t size, enum log_level level,
+			   uint64_t ts, const char *msg)
+{
+	struct writer w = {buf, size, 0, false};
+	const uint8_t lvl = level;
+	size_t len = str_len(msg);
+
+	put_hdr(&w, LOG_BIN_TEXT);
+	put(&w, &lvl, 1);
+	put_varint(&w, ts);
+
+	/* long messages are cut */
+	put(&w, msg, min(len, size - w.len));
+	put_end(&w);
+
+	return w.ovf ? 0 : w.len;
+}
+
+
+size_t log_bin_encode_head(uint8_t *buf, size_t size)
+{
+	struct writer w = {buf, size, 0, false};
+	const uint16_t one = 1;
+	uint8_t v[2];
+
+	v[0] = BIN_VERSION;
+	v[1] = *(const uint8_t *)&one;
+
+	put_hdr(&w, LOG_BIN_HEAD);
+	put(&w, "AVSL", 4);
+	put(&w, v, sizeof(v));
+	put_end(&w);
+
+	return w.ovf ? 0 : w.len;
+}
+
+
+struct reader {
+	const uint8_t *p;
+	size_t left;
+	bool err;
+};
+
+
+static const void *get(struct reader *r, size_t len)
+{
+	const uint8_t *p = r->p;
+
+	if (len > r->left) {
+		r->err = true;
+		return NULL;
+	}
+
+	r->p += len;
+	r->left -= len;
+
+	return p;
+}
+
+
+#define GET(r, v)					\
+	do {						\
+		const void *p_ = get((r), sizeof(v));	\
+		if (p_)					\
+			memcpy(&(v), p_, sizeof(v));	\
+	} while (0)
+
+
+static uint64_t get_varint(struct reader *r)
+{
+	uint64_t n = 0;
+	unsigned shift = 0;
+	uint8_t b;
+
+	do {
+		const uint8_t *p = get(r, 1);
+
+		if (!p || shift > 63) {
+			r->err = true;
+			return 0;
+		}
+
+		b = *p;
+		n |= (uint64_t)(b & 0x7f) << shift;
+		shift += 7;
+	} while (b & 0x80);
+
+	return n;
+}
+
+
+static int64_t get_svarint(struct reader *r)
+{
+	const uint64_t n = get_varint(r);
+
+	return (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+}
+
+
+static int print_spec(struct re_printf *pf, const struct conv *cv,
+		      const char *mod, const char *conv, ...)
+{
+	char spec[32];
+	va_list ap;
+	int err;
+
+	if (re_snprintf(spec, sizeof(spec), "%b%s%s",
+			cv->spec, cv->specl, mod, conv) < 0)
+		return EINVAL;
+
+	va_start(ap, conv);
+	err = re_vhprintf(spec, ap, pf->vph, pf->arg);
+	va_end(ap);
+
+	return err;
+}
+
+
+static int print_arg(struct re_printf *pf, const struct conv *cv,
+		     struct reader *r)
+{
+	char ch[2] = {cv->ch, 0};
+	const uint8_t *v;
+	uint64_t n;
+	int64_t sn;
+	double dbl = 0;
+	uint16_t len = 0;
+	uint8_t af = 0;
+	struct sa sa;
+
+	switch (cv->ch) {
+
+	case 'd':
+	case 'i':
+		sn = get_svarint(r);
+		return r->err ? EBADMSG : print_spec(pf, cv, "ll", ch,
+						     (long long)sn);
+
+	case 'm':
+		sn = get_svarint(r);
+		return r->err ? EBADMSG : print_spec(pf, cv, "", ch, (int)sn);
+
+	case 'u':
+	case 'x':
+	case 'X':
+		n = get_varint(r);
+		return r->err ? EBADMSG : print_spec(pf, cv, "ll", ch,
+						     (unsigned long long)n);
+
+	case 'p':
+		n = get_varint(r);
+		return r->err ? EBADMSG : print_spec(pf, cv, "", ch,
+						     (void *)(uintptr_t)n);
+
+	case 'f':
+	case 'F':
+		GET(r, dbl);
+		return r->err ? EBADMSG : print_spec(pf, cv, "", ch, dbl);
+
+	case 'c':
+		GET(r, af);
+		return r->err ? EBADMSG : print_spec(pf, cv, "", ch, (int)af);
+
+	case 'j':
+	case 'J':
+		GET(r, af);
+		GET(r, len);
+
+		sa_init(&sa, AF_UNSPEC);
+
+		if (af == BIN_IPV4) {
+			uint32_t a = 0;
+
+			GET(r, a);
+			sa_set_in(&sa, ntohl(a), len);
+		}
+#ifdef HAVE_INET6
+		else if (af == BIN_IPV6) {
+			v = get(r, 16);
+			if (v)
+				sa_set_in6(&sa, v, len);
+		}
+#endif
+		return r->err ? EBADMSG : print_spec(pf, cv, "", ch, &sa);
+
+	case 'w':
+	case 'W':
+	case 's':
+	case 'r':
+	case 'b':
+	case 'H':
+	case 'v':
+		GET(r, len);
+		v = get(r, len);
+		if (r->err)
+			return EBADMSG;
+
+		return print_spec(pf, cv, "", (cv->ch == 'w' || cv->ch == 'W')
+				  ? ch : "b", v, (size_t)len);
+
+	default:
+		return EINVAL;
+	}
+}
+
+
+/* Literal text, with the conversions that take no argument */
+static int print_lit(struct re_printf *pf, const char *p, size_t len)
+{
+	const char *end = p + len;
+	int err = 0;
+
+	while (p < end && !err) {
+		const char *q = p;
+
+		while (q < end && *q != '%')
+			++q;
+
+		if (q > p)
+			err |= pf->vph(p, q - p, pf->arg);
+
+		if (q == end)
+			break;
+
+		/* "%%" or a conversion re_vhprintf() does not know */
+		++q;
+		while (q < end && strchr("-.0123456789lz", *q))
+			++q;
+
+		if (q < end) {
+			err |= pf->vph(*q == '%' ? "%" : "?", 1, pf->arg);
+			++q;
+		}
+
+		p = q;
+	}
+
+	return err;
+}
+
+
+/* Render a MSG record as text, with its format */
+int log_bin_render(struct re_printf *pf, const char *fmt,
+		   const uint8_t *rec, size_t len)
+{
+	struct reader r = {rec, len, false};
+	const char *p = fmt;
+	struct conv cv;
+	int err = 0;
+
+	/* type, length, id, level and time */
+	(void)get(&r, HDR_SIZE + 3);
+	(void)get_varint(&r);
+	if (r.err)
+		return EBADMSG;
+
+	while (!err) {
+
+		p = next_conv(p, &cv);
+
+		if (cv.litl)
+			err = print_lit(pf, cv.lit, cv.litl);
+
+		if (!cv.ch || err)
+			break;
+
+		err = print_arg(pf, &cv, &r);
+	}
+
+	return err;
+}
@@ -16,27 +16,131 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include <re.h>
 #include "avs_log.h"
+#include "log.h"
+
+
+#define CACHE_LINE 64
+
+enum {
+	LOG_RING_SIZE   = 256,   /* records per thread, power of 2 */
+	LOG_REC_SIZE    = 240,   /* longer messages go to the heap */
+	LOG_PERIOD_MS   = 20,    /* max time a record waits */
+	LOG_BIN_MAX     = 1024,  /* binary record, else logged as text */
+	LOG_FMT_MAX     = 2048,  /* binary formats */
+	LOG_FMT_NONE    = 0xffff,
+};
+
+
+/*
+ * Async mode
+ *
+ * Every thread that logs gets its own ring, so the caller only
+ * formats into a slot and bumps an index. One writer thread takes
+ * the records of all rings in the order of their sequence numbers
+ * and writes them to stderr and the handlers. A full ring drops the
+ * record and counts it, the writer reports the count.
+ *
+ * A record gets its number just before it is published, so the
+ * writer may see a record before an older one of another thread.
+ * It then waits for the missing one, as the records are written
+ * strictly in order and lg.async.done is the watermark that
+ * log_flush() waits on.
+ *
+ * A new ring is pushed onto a lock-free list that the writer takes
+ * over, as the writer holds the lock while it runs the handlers.
+ */
+
+struct log_rec {
+	uint64_t seq;
+	uint64_t ts;
+	enum log_level level;
+	const struct log_fmt *lf;  /* binary record of len bytes */
+	size_t len;
+	char *heap;              /* message that did not fit in text */
+	char text[LOG_REC_SIZE];
+};
+
+struct log_ring {
+	size_t head;             /* written by the owner thread */
+	uint8_t pad1[CACHE_LINE - sizeof(size_t)];
+	size_t tail;             /* written by the writer thread */
+	uint8_t pad2[CACHE_LINE - sizeof(size_t)];
+
+	uint64_t ndrop;
+	bool dead;               /* owner thread has exited */
+	struct log_ring *next;   /* lg.async.newl */
+	struct le le;            /* lg.async.ringl */
+	struct log_rec recv[LOG_RING_SIZE];
+};
 
 
 static struct {
 	struct list logl;
 	enum log_level min_level;
+	enum log_level bin_level;
+	uint32_t nbin;           /* handlers of binary records */
 	bool stder;
+
+	pthread_mutex_t mutex;   /* logl and async state */
+
+	struct {
+		bool run;
+		pthread_t tid;
+		pthread_cond_t cond;       /* wakes up the writer */
+		pthread_cond_t cond_done;  /* a pass is done */
+		struct list ringl;         /* struct log_ring */
+		struct log_ring *newl;     /* rings not on ringl yet */
+		uint32_t nbusy;      /* threads writing to a ring */
+		uint64_t seq;        /* next record number */
+		uint64_t done;       /* records before this seq written */
+		uint64_t ndrop;      /* no ring, or ring freed */
+		uint64_t nreported;
+	} async;
+
+	/* binary formats by id, only ever added */
+	struct {
+		pthread_mutex_t mutex;
+		const struct log_fmt *fmtv[LOG_FMT_MAX + 1];
+		uint16_t n;
+	} bin;
 } lg = {
 	.logl  = LIST_INIT,
 	.min_level = LOG_LEVEL_WARN,
-	.stder = true
+	.bin_level = LOG_LEVEL_INFO,
+	.stder = true,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.async = {
+		.cond      = PTHREAD_COND_INITIALIZER,
+		.cond_done = PTHREAD_COND_INITIALIZER,
+		.ringl     = LIST_INIT,
+	},
+	.bin = {
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+	},
 };
 
 
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+
 void log_register_handler(struct log *log)
 {
 	if (!log)
 		return;
 
+	pthread_mutex_lock(&lg.mutex);
 	list_append(&lg.logl, &log->le, log);
+	if (log->binh)
+		__atomic_add_fetch(&lg.nbin, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&lg.mutex);
 }
 
 
@@ -45,7 +149,11 @@ void log_unregister_handler(struct log *log)
 	if (!log)
 		return;
 
+	pthread_mutex_lock(&lg.mutex);
+	if (log->binh && log->le.list)
+		__atomic_sub_fetch(&lg.nbin, 1, __ATOMIC_RELAXED);
 	list_unlink(&log->le);
+	pthread_mutex_unlock(&lg.mutex);
 }
 
 
@@ -67,37 +175,146 @@ void log_enable_stderr(bool enable)
 }
 
 
+/**
+ * Set the minimum level of the messages for binary log handlers
+ *
+ * They get these messages even if they are below the minimum level
+ * for text.
+ *
+ * @param level Minimum log level
+ */
+void log_set_bin_min_level(enum log_level level)
+{
+	lg.bin_level = level;
+}
+
+
+/* wanted as text, or by a binary handler */
+static inline bool wanted(enum log_level level)
+{
+	if (level >= lg.min_level)
+		return true;
+
+	return level >= lg.bin_level
+		&& __atomic_load_n(&lg.nbin, __ATOMIC_RELAXED);
+}
+
+
 void vloglv(enum log_level level, const char *fmt, va_list ap)
 {
-	if (lg.min_level > level)
+	if (!wanted(level))
 		return;
 
 	vlog(level, fmt, ap);
 }
 
 
-void vlog(enum log_level level, const char *fmt, va_list ap)
+static void print_stderr(enum log_level level, const char *msg)
 {
+	bool color = level == LOG_LEVEL_WARN
+		  || level == LOG_LEVEL_ERROR;
+
+	if (color)
+		(void)re_fprintf(stderr, "\x1b[31m"); /* Red */
+
+	(void)re_fprintf(stderr, "%s", msg);
+
+	if (color)
+		(void)re_fprintf(stderr, "\x1b[;m");
+}
+
+
+/* The stream header and the formats up to id, before a record */
+static void bin_sync(struct log *log, uint16_t id)
+{
+	uint8_t buf[LOG_BIN_MAX];
+	uint16_t ndef, i;
+	size_t len;
+
+	if (!__atomic_exchange_n(&log->head, true, __ATOMIC_ACQ_REL)) {
+		len = log_bin_encode_head(buf, sizeof(buf));
+		log->binh(buf, len, log->arg);
+	}
+
+	ndef = __atomic_load_n(&log->ndef, __ATOMIC_ACQUIRE);
+
+	/* a format may be sent twice if two threads get here */
+	for (i = ndef + 1; i <= id; i++) {
+
+		len = log_bin_encode_fmt(buf, sizeof(buf), lg.bin.fmtv[i]);
+		if (len)
+			log->binh(buf, len, log->arg);
+	}
+
+	while (ndef < id &&
+	       !__atomic_compare_exchange_n(&log->ndef, &ndef, id, false,
+					    __ATOMIC_ACQ_REL,
+					    __ATOMIC_ACQUIRE))
+		;
+}
+
+
+static void emit(enum log_level level, uint64_t ts, const char *msg)
+{
+	bool text = level >= lg.min_level;
 	struct le *le;
-	char *msg;
-	int err;
 
-	err = re_vsdprintf(&msg, fmt, ap);
-	if (err)
-		return;
+	if (text && lg.stder)
+		print_stderr(level, msg);
+
+	le = lg.logl.head;
+
+	while (le) {
+
+		struct log *log = le->data;
+		le = le->next;
+
+		if (log->binh) {
+			uint8_t buf[LOG_BIN_MAX];
+			size_t len;
 
-	if (lg.stder) {
+			if (level < lg.bin_level)
+				continue;
 
-		bool color = level == LOG_LEVEL_WARN
-			  || level == LOG_LEVEL_ERROR;
+			len = log_bin_encode_text(buf, sizeof(buf),
+						  level, ts, msg);
+			bin_sync(log, 0);
+			log->binh(buf, len, log->arg);
+		}
+		else if (text && log->h)
+			log->h(level, msg);
+	}
+}
 
-		if (color)
-			(void)re_fprintf(stderr, "\x1b[31m"); /* Red */
 
-		(void)re_fprintf(stderr, "%s", msg);
+struct bin_msg {
+	const struct log_fmt *lf;
+	const uint8_t *rec;
+	size_t len;
+};
+
+
+static int bin_msg_print(struct re_printf *pf, void *arg)
+{
+	const struct bin_msg *bm = arg;
 
-		if (color)
-			(void)re_fprintf(stderr, "\x1b[;m");
+	return log_bin_render(pf, bm->lf->fmt, bm->rec, bm->len);
+}
+
+
+/* A binary record, formatted only if someone wants the text */
+static void emit_bin(const struct log_fmt *lf, const uint8_t *rec,
+		     size_t len)
+{
+	const enum log_level level = lf->level;
+	bool text = level >= lg.min_level;
+	struct bin_msg bm = {lf, rec, len};
+	char *msg = NULL;
+	struct le *le;
+
+	if (text && lg.stder) {
+		if (0 == re_sdprintf(&msg, "%H", bin_msg_print, &bm))
+			print_stderr(level, msg);
 	}
 
 	le = lg.logl.head;
@@ -107,19 +324,470 @@ void vlog(enum log_level level, const char *fmt, va_list ap)
 		struct log *log = le->data;
 		le = le->next;
 
-		if (log->h)
+		if (log->binh) {
+			if (level < lg.bin_level)
+				continue;
+
+			bin_sync(log, lf->id);
+			log->binh(rec, len, log->arg);
+		}
+		else if (text && log->h) {
+			if (!msg && re_sdprintf(&msg, "%H",
+						bin_msg_print, &bm))
+				continue;
+
 			log->h(level, msg);
+		}
 	}
 
 	mem_deref(msg);
 }
 
 
+static void ring_key_destructor(void *arg)
+{
+	struct log_ring *r = arg;
+
+	/* the writer frees it when it is empty */
+	__atomic_store_n(&r->dead, true, __ATOMIC_RELEASE);
+}
+
+
+static void ring_key_create(void)
+{
+	pthread_key_create(&ring_key, ring_key_destructor);
+}
+
+
+static struct log_ring *log_ring(void)
+{
+	struct log_ring *r;
+
+	pthread_once(&ring_once, ring_key_create);
+
+	r = pthread_getspecific(ring_key);
+	if (r)
+		return r;
+
+	/* not from the mem pool, the ring lives as long as the thread */
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	if (pthread_setspecific(ring_key, r) != 0) {
+		free(r);
+		return NULL;
+	}
+
+	r->next = __atomic_load_n(&lg.async.newl, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&lg.async.newl, &r->next, r,
+					    true, __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED))
+		;
+
+	return r;
+}
+
+
+/* Move the new rings to ringl, called with lg.mutex held */
+static void adopt_rings(void)
+{
+	struct log_ring *r;
+
+	r = __atomic_exchange_n(&lg.async.newl, NULL, __ATOMIC_ACQUIRE);
+
+	while (r) {
+		list_append(&lg.async.ringl, &r->le, r);
+		r = r->next;
+	}
+}
+
+
+/*
+ * Start writing to a ring, if the writer still runs. Disabling waits
+ * for the threads that got in, so their records are not left behind.
+ */
+static bool async_enter(void)
+{
+	if (!__atomic_load_n(&lg.async.run, __ATOMIC_RELAXED))
+		return false;
+
+	__atomic_add_fetch(&lg.async.nbusy, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&lg.async.run, __ATOMIC_SEQ_CST))
+		return true;
+
+	__atomic_sub_fetch(&lg.async.nbusy, 1, __ATOMIC_RELEASE);
+
+	return false;
+}
+
+
+static void async_leave(void)
+{
+	__atomic_sub_fetch(&lg.async.nbusy, 1, __ATOMIC_RELEASE);
+}
+
+
+/* A free record in the ring of this thread, or NULL if full */
+static struct log_rec *ring_reserve(struct log_ring **rp, size_t *usedp)
+{
+	struct log_ring *r;
+	size_t used;
+
+	r = log_ring();
+	if (!r) {
+		__atomic_add_fetch(&lg.async.ndrop, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	used = r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	if (used >= LOG_RING_SIZE) {
+		__atomic_add_fetch(&r->ndrop, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	*rp = r;
+	*usedp = used;
+
+	return &r->recv[r->head & (LOG_RING_SIZE - 1)];
+}
+
+
+static void ring_commit(struct log_ring *r, struct log_rec *rec,
+			size_t used)
+{
+	rec->seq = __atomic_fetch_add(&lg.async.seq, 1, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+
+	/* the writer wakes up by itself, unless the ring fills up */
+	if (used + 1 == LOG_RING_SIZE / 2)
+		pthread_cond_signal(&lg.async.cond);
+}
+
+
+static void async_vlog(enum log_level level, const char *fmt, va_list ap)
+{
+	struct log_ring *r;
+	struct log_rec *rec;
+	size_t used;
+	va_list aq;
+	int n;
+
+	rec = ring_reserve(&r, &used);
+	if (!rec)
+		return;
+
+	va_copy(aq, ap);
+	n = re_vsnprintf(rec->text, sizeof(rec->text), fmt, aq);
+	va_end(aq);
+
+	rec->heap = NULL;
+	if (n < 0 && re_vsdprintf(&rec->heap, fmt, ap))
+		rec->heap = NULL;
+
+	rec->level = level;
+	rec->ts = tmr_jiffies();
+	rec->lf = NULL;
+
+	ring_commit(r, rec, used);
+}
+
+
+static void async_bin(const struct log_fmt *lf, const uint8_t *buf,
+		      size_t len)
+{
+	struct log_ring *r;
+	struct log_rec *rec;
+	size_t used;
+
+	rec = ring_reserve(&r, &used);
+	if (!rec)
+		return;
+
+	rec->heap = NULL;
+
+	if (len > sizeof(rec->text)) {
+		rec->heap = mem_alloc(len, NULL);
+		if (!rec->heap) {
+			__atomic_add_fetch(&r->ndrop, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	memcpy(rec->heap ? rec->heap : rec->text, buf, len);
+
+	rec->level = lf->level;
+	rec->lf = lf;
+	rec->len = len;
+
+	ring_commit(r, rec, used);
+}
+
+
+static uint64_t ndropped(void)
+{
+	uint64_t n = __atomic_load_n(&lg.async.ndrop, __ATOMIC_RELAXED);
+	struct le *le;
+
+	LIST_FOREACH(&lg.async.ringl, le) {
+		const struct log_ring *r = le->data;
+
+		n += __atomic_load_n(&r->ndrop, __ATOMIC_RELAXED);
+	}
+
+	return n;
+}
+
+
+/* the oldest record of all rings, or NULL */
+static struct log_ring *oldest_ring(void)
+{
+	struct log_ring *oldest = NULL;
+	uint64_t seq = 0;
+	struct le *le;
+
+	LIST_FOREACH(&lg.async.ringl, le) {
+		struct log_ring *r = le->data;
+		const struct log_rec *rec;
+
+		if (r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+			continue;
+
+		rec = &r->recv[r->tail & (LOG_RING_SIZE - 1)];
+
+		if (!oldest || rec->seq < seq) {
+			oldest = r;
+			seq = rec->seq;
+		}
+	}
+
+	return oldest;
+}
+
+
+/* Write all records, called with lg.mutex held */
+static size_t drain(void)
+{
+	struct log_ring *r;
+	uint64_t ndrop;
+	struct le *le;
+	size_t n = 0;
+
+	adopt_rings();
+
+	for (;;) {
+		struct log_rec *rec = NULL;
+		const char *p;
+
+		r = oldest_ring();
+		if (r)
+			rec = &r->recv[r->tail & (LOG_RING_SIZE - 1)];
+
+		if (!rec || rec->seq != lg.async.done) {
+
+			if (lg.async.done == __atomic_load_n(&lg.async.seq,
+							     __ATOMIC_ACQUIRE))
+				break;
+
+			/* numbered, but not published yet */
+			sched_yield();
+			adopt_rings();
+			continue;
+		}
+
+		p = rec->heap ? rec->heap : rec->text;
+
+		if (rec->lf)
+			emit_bin(rec->lf, (const uint8_t *)p, rec->len);
+		else
+			emit(rec->level, rec->ts, p);
+
+		rec->heap = mem_deref(rec->heap);
+
+		__atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+		++lg.async.done;
+		++n;
+	}
+
+	/* free the rings of threads that are gone */
+	le = lg.async.ringl.head;
+	while (le) {
+		r = le->data;
+		le = le->next;
+
+		if (!__atomic_load_n(&r->dead, __ATOMIC_ACQUIRE))
+			continue;
+		if (r->tail != __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+			continue;
+
+		__atomic_add_fetch(&lg.async.ndrop, r->ndrop,
+				   __ATOMIC_RELAXED);
+		list_unlink(&r->le);
+		free(r);
+	}
+
+	ndrop = ndropped();
+	if (ndrop > lg.async.nreported) {
+		char msg[64];
+
+		re_snprintf(msg, sizeof(msg),
+			    "log: %llu messages dropped (%llu total)\n",
+			    (unsigned long long)(ndrop - lg.async.nreported),
+			    (unsigned long long)ndrop);
+		emit(LOG_LEVEL_WARN, tmr_jiffies(), msg);
+
+		lg.async.nreported = ndrop;
+	}
+
+	pthread_cond_broadcast(&lg.async.cond_done);
+
+	return n;
+}
+
+
+static void *async_thread(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&lg.mutex);
+
+	while (lg.async.run) {
+
+		struct timespec ts;
+
+		if (drain())
+			continue;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LOG_PERIOD_MS * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec  += 1;
+			ts.tv_nsec -= 1000000000;
+		}
+
+		pthread_cond_timedwait(&lg.async.cond, &lg.mutex, &ts);
+	}
+
+	pthread_mutex_unlock(&lg.mutex);
+
+	return NULL;
+}
+
+
+/**
+ * Write log messages from a background thread
+ *
+ * The handlers are then called on that thread. Disabling writes all
+ * messages that are still queued.
+ *
+ * @param enable True to enable, false to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int log_enable_async(bool enable)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&lg.mutex);
+
+	if (enable == lg.async.run)
+		goto out;
+
+	if (enable) {
+		err = pthread_create(&lg.async.tid, NULL, async_thread, NULL);
+		if (err)
+			goto out;
+
+		__atomic_store_n(&lg.async.run, true, __ATOMIC_RELEASE);
+	}
+	else {
+		__atomic_store_n(&lg.async.run, false, __ATOMIC_SEQ_CST);
+		pthread_cond_signal(&lg.async.cond);
+		pthread_mutex_unlock(&lg.mutex);
+
+		pthread_join(lg.async.tid, NULL);
+
+		/* new messages are written directly, wait for the others */
+		while (__atomic_load_n(&lg.async.nbusy, __ATOMIC_ACQUIRE))
+			sched_yield();
+
+		pthread_mutex_lock(&lg.mutex);
+		(void)drain();
+	}
+
+ out:
+	pthread_mutex_unlock(&lg.mutex);
+
+	return err;
+}
+
+
+/**
+ * Wait until the messages logged so far by any thread are written
+ */
+void log_flush(void)
+{
+	uint64_t seq;
+
+	seq = __atomic_load_n(&lg.async.seq, __ATOMIC_ACQUIRE);
+
+	pthread_mutex_lock(&lg.mutex);
+
+	while (lg.async.run && lg.async.done < seq) {
+		pthread_cond_signal(&lg.async.cond);
+		pthread_cond_wait(&lg.async.cond_done, &lg.mutex);
+	}
+
+	pthread_mutex_unlock(&lg.mutex);
+}
+
+
+/**
+ * Get the number of messages dropped because a ring was full
+ *
+ * @return Number of dropped messages
+ */
+uint64_t log_dropped(void)
+{
+	uint64_t n;
+
+	pthread_mutex_lock(&lg.mutex);
+	adopt_rings();
+	n = ndropped();
+	pthread_mutex_unlock(&lg.mutex);
+
+	return n;
+}
+
+
+void vlog(enum log_level level, const char *fmt, va_list ap)
+{
+	char *msg;
+	int err;
+
+	if (async_enter()) {
+		async_vlog(level, fmt, ap);
+		async_leave();
+		return;
+	}
+
+	err = re_vsdprintf(&msg, fmt, ap);
+	if (err)
+		return;
+
+	emit(level, tmr_jiffies(), msg);
+
+	mem_deref(msg);
+}
+
+
 void loglv(enum log_level level, const char *fmt, ...)
 {
 	va_list ap;
 
-	if (level < lg.min_level)
+	if (!wanted(level))
 		return;
 
 	va_start(ap, fmt);
@@ -132,7 +800,7 @@ void debug(const char *fmt, ...)
 {
 	va_list ap;
 
-	if (lg.min_level > LOG_LEVEL_DEBUG)
+	if (!wanted(LOG_LEVEL_DEBUG))
 		return;
 
 	va_start(ap, fmt);
@@ -145,7 +813,7 @@ void info(const char *fmt, ...)
 {
 	va_list ap;
 
-	if (lg.min_level > LOG_LEVEL_INFO)
+	if (!wanted(LOG_LEVEL_INFO))
 		return;
 
 	va_start(ap, fmt);
@@ -158,7 +826,7 @@ void warning(const char *fmt, ...)
 {
 	va_list ap;
 
-	if (lg.min_level > LOG_LEVEL_WARN)
+	if (!wanted(LOG_LEVEL_WARN))
 		return;
 
 	va_start(ap, fmt);
@@ -175,3 +843,74 @@ void error(const char *fmt, ...)
 	vlog(LOG_LEVEL_ERROR, fmt, ap);
 	va_end(ap);
 }
+
+
+/* id of a binary format, registered on first use */
+static uint16_t fmt_id(struct log_fmt *lf)
+{
+	uint16_t id;
+
+	id = __atomic_load_n(&lf->id, __ATOMIC_ACQUIRE);
+	if (id)
+		return id;
+
+	pthread_mutex_lock(&lg.bin.mutex);
+
+	id = lf->id;
+	if (!id) {
+		if (lg.bin.n >= LOG_FMT_MAX
+		    || str_len(lf->fmt) > LOG_BIN_MAX / 2
+		    || log_fmt_compile(lf)) {
+			id = LOG_FMT_NONE;
+		}
+		else {
+			id = ++lg.bin.n;
+			lg.bin.fmtv[id] = lf;
+		}
+
+		__atomic_store_n(&lf->id, id, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&lg.bin.mutex);
+
+	return id;
+}
+
+
+/**
+ * Log a message with a static format, see LOG_BIN()
+ *
+ * The arguments are copied into a binary record, the text is only
+ * formatted for stderr and the text handlers. Formats the binary
+ * log cannot take are logged as text.
+ *
+ * @param lf  Static format
+ */
+void log_bin(struct log_fmt *lf, ...)
+{
+	uint8_t buf[LOG_BIN_MAX];
+	size_t len = 0;
+	va_list ap;
+
+	if (!lf || !wanted(lf->level))
+		return;
+
+	va_start(ap, lf);
+	if (fmt_id(lf) != LOG_FMT_NONE)
+		len = log_bin_encode(buf, sizeof(buf), lf, tmr_jiffies(), ap);
+	va_end(ap);
+
+	if (!len) {
+		va_start(ap, lf);
+		vlog(lf->level, lf->fmt, ap);
+		va_end(ap);
+		return;
+	}
+
+	if (async_enter()) {
+		async_bin(lf, buf, len);
+		async_leave();
+	}
+	else
+		emit_bin(lf, buf, len);
+}
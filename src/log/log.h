@@ -0,0 +1,53 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Internal interface for the log module */
+
+
+/* argument types of a binary log format */
+enum log_arg {
+	LOG_ARG_INT = 1,
+	LOG_ARG_LONG,
+	LOG_ARG_LLONG,
+	LOG_ARG_SSIZE,
+	LOG_ARG_UINT,
+	LOG_ARG_ULONG,
+	LOG_ARG_ULLONG,
+	LOG_ARG_SIZE,
+	LOG_ARG_PTR,
+	LOG_ARG_DBL,
+	LOG_ARG_CHAR,
+	LOG_ARG_ERR,
+	LOG_ARG_STR,
+	LOG_ARG_PL,
+	LOG_ARG_BUF,
+	LOG_ARG_HEX,
+	LOG_ARG_SA,
+	LOG_ARG_PRINTH,
+	LOG_ARG_VA,
+};
+
+int    log_fmt_compile(struct log_fmt *lf);
+size_t log_bin_encode(uint8_t *buf, size_t size, const struct log_fmt *lf,
+		      uint64_t ts, va_list ap);
+size_t log_bin_encode_fmt(uint8_t *buf, size_t size,
+			  const struct log_fmt *lf);
+size_t log_bin_encode_text(uint8_t *buf, size_t size, enum log_level level,
+			   uint64_t ts, const char *msg);
+size_t log_bin_encode_head(uint8_t *buf, size_t size);
+int    log_bin_render(struct re_printf *pf, const char *fmt,
+		      const uint8_t *rec, size_t len);
@@ -3,5 +3,5 @@
 #
 
 AVS_SRCS += \
+	log/binlog.c \
 	log/log.c
-
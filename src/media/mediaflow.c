@@ -68,6 +68,31 @@ enum sdp_state {
 enum {
 	MQ_ERR = 0,
 	MQ_RTP_START = 1,
+	MQ_VIDEO_FLUSH = 2,
+};
+
+enum {
+	VIDEO_TX_BATCH = 32,  /* max packets of one frame sent together */
+	VIDEO_TX_HOLD  = 2,   /* max time a packet is held back [ms] */
+	TX_TAILROOM    = 32,  /* SRTCP index and SRTP authentication tag */
+};
+
+/* where an incoming RTP/RTCP packet goes to */
+enum rtp_route {
+	ROUTE_NONE = 0,
+	ROUTE_AUDIO,
+	ROUTE_VIDEO,
+	ROUTE_RTX,
+};
+
+enum {
+	ROUTE_PT_MAX   = 128,
+	ROUTE_SSRC_MAX = 8,   /* remote SSRCs, 1 audio and up to 4 video */
+};
+
+struct route_pt {
+	enum rtp_route route;
+	void *data;          /* aucodec or vidcodec */
 };
 
 struct interface {
@@ -93,6 +118,7 @@ struct mediaflow {
 
 	/* RTP/RTCP */
 	struct rtp_sock *rtp;
+	struct mux_sock *mux_sock;   /* on a shared UDP socket (optional) */
 	struct rtcp_stats stats;
 	struct rtp_stats audio_stats_rcv;
 	struct rtp_stats audio_stats_snd;
@@ -195,8 +221,29 @@ struct mediaflow {
 		bool started;
 		char *label;
 		bool has_rtp;
+
+		/* packets of the frame being sent, protected by mutex_enc */
+		struct mbuf *txv[VIDEO_TX_BATCH];
+		size_t txc;
+		uint32_t tx_ts;
+		uint16_t tx_seq;     /* next new sequence number */
+		bool tx_seqok;
+		bool tx_armed;       /* flush timer requested */
+		struct tmr tmr_tx;   /* main thread only */
 	} video;
 
+	/* Incoming packet dispatch, rebuilt in post_sdp_decode() */
+	struct {
+		struct route_pt audio[ROUTE_PT_MAX];  /* per m-line */
+		struct route_pt video[ROUTE_PT_MAX];
+
+		struct {
+			uint32_t ssrc;
+			enum rtp_route route;
+		} ssrcv[ROUTE_SSRC_MAX];
+		size_t ssrcc;
+	} route;
+
 	/* User callbacks */
 	mediaflow_localcand_h *lcandh;
 	mediaflow_estab_h *estabh;
@@ -208,6 +255,10 @@ struct mediaflow {
 	mediaflow_gather_h *gatherh;
 	void *arg;
 
+	/* Decrypted RTP/RTCP packets, before any codec routing */
+	mediaflow_packet_h *pkth;
+	void *pkth_arg;
+
 	struct {
 		size_t total_lost;
 
@@ -243,6 +294,18 @@ struct mediaflow {
 #define info(...)    mf_log(mf, LOG_LEVEL_INFO,  __VA_ARGS__);
 #define warning(...) mf_log(mf, LOG_LEVEL_WARN,  __VA_ARGS__);
 
+/* per-packet logs, as binary records with the tag as an argument */
+#define mf_log_bin(level, fmt, ...)					\
+	do {								\
+		if (mf->tag[0])						\
+			LOG_BIN(level, "[%s] " fmt, mf->tag,		\
+				##__VA_ARGS__);				\
+		else							\
+			LOG_BIN(level, fmt, ##__VA_ARGS__);		\
+	} while (0)
+#define debug_bin(...) mf_log_bin(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define info_bin(...)  mf_log_bin(LOG_LEVEL_INFO,  __VA_ARGS__)
+
 
 #if TARGET_OS_IPHONE
 #undef OS
@@ -474,6 +537,61 @@ static size_t get_headroom(const struct mediaflow *mf)
 }
 
 
+/*
+ * Send buffers have the transport headroom (TURN) reserved in front of
+ * mb->pos and room for the SRTP trailer behind the packet, so that the
+ * SRTP and TURN send helpers work in place without another copy.
+ */
+struct mbuf *mediaflow_txbuf_alloc(struct mediaflow *mf, size_t size)
+{
+	struct mbuf *mb;
+	size_t headroom;
+
+	if (!mf)
+		return NULL;
+
+	headroom = get_headroom(mf);
+
+	mb = mbuf_alloc(headroom + size + TX_TAILROOM);
+	if (!mb)
+		return NULL;
+
+	mb->pos = headroom;
+	mb->end = headroom;
+
+	return mb;
+}
+
+
+/* the selected candidate may have changed since the buffer was allocated */
+static int txbuf_headroom(const struct mediaflow *mf, struct mbuf *mb)
+{
+	size_t headroom = get_headroom(mf);
+
+	if (mb->pos >= headroom)
+		return 0;
+
+	return mbuf_shift(mb, headroom - mb->pos);
+}
+
+
+/* Copy a packet into a send buffer, for encoders without enc_settx */
+static struct mbuf *txbuf_dup(struct mediaflow *mf, const uint8_t *pkt,
+			      size_t len)
+{
+	struct mbuf *mb;
+
+	mb = mediaflow_txbuf_alloc(mf, len);
+	if (!mb)
+		return NULL;
+
+	(void)mbuf_write_mem(mb, pkt, len);
+	mb->pos -= len;
+
+	return mb;
+}
+
+
 static bool lite_candidate_handler(const char *name, const char *val,
 				   void *arg)
 {
@@ -587,41 +705,188 @@ static inline int lostcalc(struct mediaflow *mf, uint16_t seq)
 }
 
 
+static void route_add_formats(struct route_pt *ptv,
+			      const struct sdp_media *sdpm,
+			      enum rtp_route route)
+{
+	struct le *le;
+
+	LIST_FOREACH(sdp_media_format_lst(sdpm, true), le) {
+		const struct sdp_format *fmt = le->data;
+
+		if (fmt->pt < 0 || fmt->pt >= ROUTE_PT_MAX)
+			continue;
+
+		/* the first format wins, as with sdp_media_lformat() */
+		if (ptv[fmt->pt].route != ROUTE_NONE)
+			continue;
+
+		if (route == ROUTE_VIDEO && 0 == str_casecmp(fmt->name, "rtx"))
+			ptv[fmt->pt].route = ROUTE_RTX;
+		else
+			ptv[fmt->pt].route = route;
+
+		ptv[fmt->pt].data = fmt->data;
+	}
+}
+
+
+struct route_ssrc {
+	struct mediaflow *mf;
+	enum rtp_route route;
+};
+
+
+static bool route_ssrc_handler(const char *name, const char *value,
+			       void *arg)
+{
+	struct route_ssrc *rs = arg;
+	struct mediaflow *mf = rs->mf;
+	struct pl pl;
+	uint32_t ssrc;
+	size_t i;
+	(void)name;
+
+	if (re_regex(value, strlen(value), "[0-9]+", &pl))
+		return false;
+
+	ssrc = pl_u32(&pl);
+
+	/* there is one attribute line per SSRC and source attribute */
+	for (i = 0; i < mf->route.ssrcc; i++) {
+		if (mf->route.ssrcv[i].ssrc == ssrc)
+			return false;
+	}
+
+	if (mf->route.ssrcc >= ROUTE_SSRC_MAX)
+		return true;
+
+	mf->route.ssrcv[mf->route.ssrcc].ssrc = ssrc;
+	mf->route.ssrcv[mf->route.ssrcc].route = rs->route;
+	++mf->route.ssrcc;
+
+	return false;
+}
+
+
+/*
+ * Build the payload type and SSRC tables for incoming packets from the
+ * negotiated SDP, so that each packet is routed with a table lookup
+ * instead of a search through the SDP formats.
+ */
+static void route_build(struct mediaflow *mf)
+{
+	struct route_ssrc rs = {mf, ROUTE_AUDIO};
+	int pt;
+
+	memset(&mf->route, 0, sizeof(mf->route));
+
+	route_add_formats(mf->route.audio, mf->sdpm, ROUTE_AUDIO);
+	(void)sdp_media_rattr_apply(mf->sdpm, "ssrc", route_ssrc_handler, &rs);
+
+	if (mf->video.sdpm) {
+		route_add_formats(mf->route.video, mf->video.sdpm,
+				  ROUTE_VIDEO);
+
+		rs.route = ROUTE_VIDEO;
+		if (sdp_media_rattr_apply(mf->video.sdpm, "ssrc",
+					  route_ssrc_handler, &rs)) {
+			warning("mediaflow: too many remote SSRCs\n");
+		}
+	}
+
+	for (pt = 0; pt < ROUTE_PT_MAX; pt++) {
+
+		if (mf->route.audio[pt].route == ROUTE_NONE ||
+		    mf->route.video[pt].route == ROUTE_NONE)
+			continue;
+
+		warning("mediaflow: payload type %d is used for audio"
+			" and video, routing it by SSRC\n", pt);
+	}
+}
+
+
+static enum rtp_route route_ssrc(const struct mediaflow *mf, uint32_t ssrc)
+{
+	size_t i;
+
+	for (i = 0; i < mf->route.ssrcc; i++) {
+		if (mf->route.ssrcv[i].ssrc == ssrc)
+			return mf->route.ssrcv[i].route;
+	}
+
+	return ROUTE_NONE;
+}
+
+
+/*
+ * Look up the route of an incoming RTP packet. A payload type that is
+ * on both m-lines is resolved with the sender SSRC, and a packet from
+ * an unknown SSRC is not routed at all.
+ */
+static const struct route_pt *route_lookup(const struct mediaflow *mf,
+					   uint8_t pt, uint32_t ssrc)
+{
+	const struct route_pt *a, *v;
+
+	if (pt >= ROUTE_PT_MAX)
+		return NULL;
+
+	a = &mf->route.audio[pt];
+	v = &mf->route.video[pt];
+
+	if (v->route == ROUTE_NONE)
+		return a->route != ROUTE_NONE ? a : NULL;
+	if (a->route == ROUTE_NONE)
+		return v;
+
+	switch (route_ssrc(mf, ssrc)) {
+
+	case ROUTE_AUDIO:
+		return a;
+
+	case ROUTE_VIDEO:
+		return v;
+
+	default:
+		return NULL;
+	}
+}
+
+
 static void rtp_recv_handler(const struct sa *src,
 			     const struct rtp_header *hdr,
 			     struct mbuf *mb, void *arg)
 {
 	struct mediaflow *mf = arg;
-	const struct sdp_format *fmt;
+	const struct route_pt *rpt;
 	const struct aucodec *ac;
 	int lost;
 	int err;
 
-	
-
-	
 	lost = lostcalc(mf, hdr->seq);
 	if (lost > 0) {
-		info("mediaflow[%u]: %d rtp packets lost\n",
-		     sa_port(rtp_local(mf->rtp)), lost);
+		info_bin("mediaflow[%u]: %d rtp packets lost\n",
+			 sa_port(rtp_local(mf->rtp)), lost);
 		mf->stat.total_lost += lost;
 	}
 
 	if (mf->rtph)
 		mf->rtph(src, hdr, mb, mf->arg);
 
-	fmt = sdp_media_lformat(mf->sdpm, hdr->pt);
-	if (!fmt) {
+	rpt = route_lookup(mf, hdr->pt, hdr->ssrc);
+	if (!rpt || rpt->route != ROUTE_AUDIO) {
 		warning("mediaflow: payload type: %d not found"
 			" in sdp (%zu bytes)\n",
 			hdr->pt, mbuf_get_left(mb));
 		return;
 	}
 
-	ac = fmt->data;
+	ac = rpt->data;
 	if (!ac) {
-		warning("mediaflow: decoder: %s/%d/%d not found\n",
-			fmt->name, fmt->srate, fmt->ch);
+		warning("mediaflow: decoder: payload type %d not found\n",
+			hdr->pt);
 		return;
 	}
 
@@ -680,12 +945,18 @@ static int auenc_packet_handler(uint8_t pt, uint32_t ts,
 				void *arg)
 {
 	struct mediaflow *mf = arg;
-	struct mbuf *mb = mbuf_alloc(256);
+	struct mbuf *mb;
 	int err;
 
-	mb->pos = RTP_HEADER_SIZE;
-	mbuf_write_mem(mb, pld, pld_len);
-	mb->pos = RTP_HEADER_SIZE;
+	mb = mediaflow_txbuf_alloc(mf, RTP_HEADER_SIZE + pld_len);
+	if (!mb)
+		return ENOMEM;
+
+	/* rtp_send() encodes the header in front of the payload */
+	mb->pos += RTP_HEADER_SIZE;
+	mb->end = mb->pos;
+	(void)mbuf_write_mem(mb, pld, pld_len);
+	mb->pos -= pld_len;
 
 	update_tx_stats(mf, pld_len);
 
@@ -744,29 +1015,70 @@ static void audec_error_handler(int err, const char *msg, void *arg)
 }
 
 
-static int voenc_rtp_handler(const uint8_t *pkt, size_t len, void *arg)
+static struct mbuf *txbuf_handler(size_t size, void *arg)
 {
 	struct mediaflow *mf = arg;
+
+	return mediaflow_txbuf_alloc(mf, size);
+}
+
+
+static int voenc_tx_handler(struct mbuf *mb, void *arg)
+{
+	struct mediaflow *mf = arg;
+	size_t pos, len;
 	int err;
 
-	if (!mf)
+	if (!mf || !mb)
 		return EINVAL;
 
+	if (packet_is_rtcp_packet(mb))
+		return mediaflow_send_rtcp_mbuf(mf, mb);
+
 	if (!mf->sent_rtp) {
 		info("mediaflow: first RTP packet sent\n");
 		mf->sent_rtp = true;
 		mqueue_push(mf->mq, MQ_RTP_START, NULL);
 	}
 
-	err = mediaflow_send_raw_rtp(mf, pkt, len);
+	/* the packet is encrypted and framed in place, but not moved */
+	err = txbuf_headroom(mf, mb);
+	if (err)
+		return err;
+
+	pos = mb->pos;
+	len = mbuf_get_left(mb);
+
+	err = mediaflow_send_rtp_mbuf(mf, mb);
 	if (err == 0){
-		rtp_stats_update(&mf->audio_stats_snd, pkt, len);
+		rtp_stats_update(&mf->audio_stats_snd, mb->buf + pos, len);
 	}
 
 	return err;
 }
 
 
+static int voenc_rtp_handler(const uint8_t *pkt, size_t len, void *arg)
+{
+	struct mediaflow *mf = arg;
+	struct mbuf *mb;
+	int err;
+
+	if (!mf || !pkt)
+		return EINVAL;
+
+	mb = txbuf_dup(mf, pkt, len);
+	if (!mb)
+		return ENOMEM;
+
+	err = voenc_tx_handler(mb, mf);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
 static int voenc_rtcp_handler(const uint8_t *pkt, size_t len, void *arg)
 {
 	struct mediaflow *mf = arg;
@@ -825,11 +1137,16 @@ static int start_codecs(struct mediaflow *mf)
 			goto out;
 		}
 
+		if (ac->enc_settx) {
+			ac->enc_settx(mf->aes, txbuf_handler,
+				      voenc_tx_handler);
+		}
+
 		if (mf->started && ac->enc_start) {
 			ac->enc_start(mf->aes);
 		}
 	}
-	rtp_stats_init(&mf->audio_stats_snd, fmt->pt, 2000);
+	rtp_stats_init(&mf->audio_stats_snd, fmt->pt, fmt->srate, 2000);
 
 	if (ac->dec_alloc && !mf->ads){
 		err = ac->dec_alloc(&mf->ads, &mf->mctx, ac, NULL,
@@ -846,7 +1163,7 @@ static int start_codecs(struct mediaflow *mf)
 			ac->dec_start(mf->ads);
 		}
 	}
-	rtp_stats_init(&mf->audio_stats_rcv, fmt->pt, 2000);
+	rtp_stats_init(&mf->audio_stats_rcv, fmt->pt, fmt->srate, 2000);
 
 	rtcp_set_srate(mf->rtp, ac->srate, ac->srate);
 
@@ -857,19 +1174,169 @@ static int start_codecs(struct mediaflow *mf)
 }
 
 
-static int videnc_rtp_handler(const uint8_t *pkt, size_t len, void *arg)
+static int video_tx_flush(struct mediaflow *mf)
+{
+	size_t i;
+	int err;
+
+	if (!mf->video.txc)
+		return 0;
+
+	err = udp_send_batch(rtp_sock(mf->rtp), &mf->rcand.addr,
+			     mf->video.txv, mf->video.txc);
+
+	for (i = 0; i < mf->video.txc; i++)
+		mf->video.txv[i] = mem_deref(mf->video.txv[i]);
+	mf->video.txc = 0;
+
+	return err;
+}
+
+
+static void video_tx_timeout(void *arg)
+{
+	struct mediaflow *mf = arg;
+
+	pthread_mutex_lock(&mf->mutex_enc);
+
+	mf->video.tx_armed = false;
+	(void)video_tx_flush(mf);
+
+	pthread_mutex_unlock(&mf->mutex_enc);
+}
+
+
+/*
+ * New video RTP packets of a frame are held back until the last packet
+ * of the frame (marker bit) and then sent with one udp_send_batch()
+ * call, which on Linux sends the equally sized SRTP packets as one
+ * UDP_SEGMENT buffer. The pacer may split a frame over several bursts,
+ * so a timer on the main thread flushes whatever is still held after
+ * VIDEO_TX_HOLD ms. Retransmissions (RTX or an old sequence number),
+ * padding and other SSRCs are never held.
+ */
+static int send_video_rtp(struct mediaflow *mf, struct mbuf *mb)
+{
+	const uint8_t *buf = mbuf_buf(mb);
+	size_t len = mbuf_get_left(mb);
+	uint32_t ts, ssrc;
+	uint16_t seq;
+	bool marker, padding;
+	bool hold = false;
+	int err = 0;
+
+	if (len < RTP_HEADER_SIZE)
+		return mediaflow_send_rtp_mbuf(mf, mb);
+
+	MAGIC_CHECK(mf);
+
+	if (!mediaflow_is_ready(mf)) {
+		warning("mediaflow: send_video_rtp(%zu bytes): not ready"
+			" [ice=%d, crypto=%d]\n",
+			len, mf->ice_ready, mf->crypto_ready);
+		return EINTR;
+	}
+
+	padding = (buf[0] & 0x20) != 0;
+	marker  = (buf[1] & 0x80) != 0;
+	seq  = (uint16_t)(buf[2] << 8 | buf[3]);
+	ts   = (uint32_t)buf[4] << 24 | buf[5] << 16 | buf[6] << 8 | buf[7];
+	ssrc = (uint32_t)buf[8] << 24 | buf[9] << 16 | buf[10] << 8 | buf[11];
+
+	pthread_mutex_lock(&mf->mutex_enc);
+
+	if (ssrc == mf->lssrcv[MEDIA_VIDEO]) {
+
+		/* an older sequence number is a retransmission */
+		if (!mf->video.tx_seqok ||
+		    (int16_t)(seq - mf->video.tx_seq) >= 0) {
+
+			mf->video.tx_seq = seq + 1;
+			mf->video.tx_seqok = true;
+			hold = !padding;
+		}
+	}
+
+	/* keep the packet order on the wire */
+	if (mf->video.txc && (!hold || ts != mf->video.tx_ts)) {
+		err = video_tx_flush(mf);
+		if (err)
+			goto out;
+	}
+
+	err = txbuf_headroom(mf, mb);
+	if (err)
+		goto out;
+
+	update_tx_stats(mf, len - RTP_HEADER_SIZE);
+
+	mf->video.txv[mf->video.txc++] = mem_ref(mb);
+	mf->video.tx_ts = ts;
+
+	if (!hold || marker || mf->video.txc == VIDEO_TX_BATCH) {
+		err = video_tx_flush(mf);
+	}
+	else if (!mf->video.tx_armed) {
+		mf->video.tx_armed = true;
+		mqueue_push(mf->mq, MQ_VIDEO_FLUSH, NULL);
+	}
+
+ out:
+	pthread_mutex_unlock(&mf->mutex_enc);
+
+	return err;
+}
+
+
+static int videnc_tx_handler(struct mbuf *mb, void *arg)
 {
 	struct mediaflow *mf = arg;
+	size_t pos, len;
+	int err;
 
-	int err = mediaflow_send_raw_rtp(mf, pkt, len);
+	if (!mf || !mb)
+		return EINVAL;
+
+	if (packet_is_rtcp_packet(mb))
+		return mediaflow_send_rtcp_mbuf(mf, mb);
+
+	err = txbuf_headroom(mf, mb);
+	if (err)
+		return err;
+
+	pos = mb->pos;
+	len = mbuf_get_left(mb);
+
+	err = send_video_rtp(mf, mb);
 	if (err == 0) {
-		rtp_stats_update(&mf->video_stats_snd, pkt, len);
+		rtp_stats_update(&mf->video_stats_snd, mb->buf + pos, len);
 	}
 
 	return err;
 }
 
 
+static int videnc_rtp_handler(const uint8_t *pkt, size_t len, void *arg)
+{
+	struct mediaflow *mf = arg;
+	struct mbuf *mb;
+	int err;
+
+	if (!mf || !pkt)
+		return EINVAL;
+
+	mb = txbuf_dup(mf, pkt, len);
+	if (!mb)
+		return ENOMEM;
+
+	err = videnc_tx_handler(mb, mf);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
 static int videnc_rtcp_handler(const uint8_t *pkt, size_t len, void *arg)
 {
 	struct mediaflow *mf = arg;
@@ -982,6 +1449,11 @@ static int start_video_codecs(struct mediaflow *mf)
 			goto out;
 		}
 
+		if (vc->enc_settxh) {
+			vc->enc_settxh(mf->video.ves, txbuf_handler,
+				       videnc_tx_handler);
+		}
+
 		if (mf->started && vc->enc_starth) {
 			err = vc->enc_starth(mf->video.ves);
 			if (err) {
@@ -991,7 +1463,8 @@ static int start_video_codecs(struct mediaflow *mf)
 			}
 		}
 	}
-	rtp_stats_init(&mf->video_stats_snd, fmt->pt, 10000);
+	rtp_stats_init(&mf->video_stats_snd, fmt->pt, fmt->srate,
+		       10000);
 
 	if (vc->dec_alloch && !mf->video.vds){
 		err = vc->dec_alloch(&mf->video.vds, &mf->video.mctx, vc,
@@ -1013,7 +1486,8 @@ static int start_video_codecs(struct mediaflow *mf)
 			}
 		}
 	}
-	rtp_stats_init(&mf->video_stats_rcv, fmt->pt, 10000);
+	rtp_stats_init(&mf->video_stats_rcv, fmt->pt, fmt->srate,
+		       10000);
 
  out:
 	return err;
@@ -1125,24 +1599,37 @@ static int send_packet(struct mediaflow *mf, size_t headroom,
 {
 	struct mbuf *mb = NULL;
 	size_t len = mbuf_get_left(mb_pkt);
+	size_t room;
 	int err = 0;
 
 	if (!mf)
 		return EINVAL;
 
-	info("mediaflow: <%s> send_packet `%s' (%zu bytes) via %s to %J\n",
-	     mediaflow_nat_name(mf->nat),
-	     packet_classify_name(pkt),
-	     mbuf_get_left(mb_pkt),
-	     sock_prefix(headroom), raddr);
+	/* the selected candidate may need more than the DTLS peer */
+	room = max(headroom, get_headroom(mf));
 
-	mb = mbuf_alloc(headroom + len);
-	if (!mb)
-		return ENOMEM;
+	info_bin("mediaflow: <%s> send_packet `%s' (%zu bytes) via %s to %J\n",
+		 mediaflow_nat_name(mf->nat),
+		 packet_classify_name(pkt),
+		 mbuf_get_left(mb_pkt),
+		 sock_prefix(headroom), raddr);
 
-	mb->pos = headroom;
-	mbuf_write_mem(mb, mbuf_buf(mb_pkt), len);
-	mb->pos = headroom;
+	/* The transport headers are written in front of mb->pos. This is
+	 * only done in place if the buffer has room for them and nobody
+	 * else holds it, which is the case for the DTLS stack buffers.
+	 */
+	if (mb_pkt->pos >= room && mem_nrefs(mb_pkt) == 1) {
+		mb = mem_ref(mb_pkt);
+	}
+	else {
+		mb = mbuf_alloc(room + len);
+		if (!mb)
+			return ENOMEM;
+
+		mb->pos = room;
+		mbuf_write_mem(mb, mbuf_buf(mb_pkt), len);
+		mb->pos = room;
+	}
 
 	/* now invalid */
 	mb_pkt = NULL;
@@ -1235,10 +1722,10 @@ static bool send_dtls_handler(int *err, struct sa *dst_unused,
 
 	++mf->mf_stats.dtls_pkt_sent;
 
-	info("mediaflow: dtls_helper: send DTLS packet #%u (%zu bytes)"
-	     " \n",
-	     mf->mf_stats.dtls_pkt_sent,
-	     mbuf_get_left(mb_pkt));
+	info_bin("mediaflow: dtls_helper: send DTLS packet #%u (%zu bytes)"
+		 " \n",
+		 mf->mf_stats.dtls_pkt_sent,
+		 mbuf_get_left(mb_pkt));
 
 	/*
 	 * Early DTLS
@@ -1416,11 +1903,28 @@ static bool verify_fingerprint(struct mediaflow *mf,
 }
 
 
+/* length of the master key and master salt in bytes */
+static size_t srtp_master_keylen(enum srtp_suite suite)
+{
+	switch (suite) {
+
+	case SRTP_AES_CM_128_HMAC_SHA1_32: return 16 + 14;
+	case SRTP_AES_CM_128_HMAC_SHA1_80: return 16 + 14;
+	case SRTP_AES_256_CM_HMAC_SHA1_32: return 32 + 14;
+	case SRTP_AES_256_CM_HMAC_SHA1_80: return 32 + 14;
+	case SRTP_AES_128_GCM:             return 16 + 12;
+	case SRTP_AES_256_GCM:             return 32 + 12;
+	default:                           return 0;
+	}
+}
+
+
 static void dtls_estab_handler(void *arg)
 {
 	struct mediaflow *mf = arg;
 	enum srtp_suite suite;
-	uint8_t cli_key[30], srv_key[30];
+	uint8_t cli_key[46], srv_key[46];
+	size_t keylen;
 	int err;
 
 	if (mf->mf_stats.dtls_estab < 0 && mf->ts_dtls)
@@ -1452,10 +1956,12 @@ static void dtls_estab_handler(void *arg)
 
 	info("mediaflow: DTLS established (%s)\n", srtp_suite_name(suite));
 
+	keylen = srtp_master_keylen(suite);
+
 	mf->srtp_tx = mem_deref(mf->srtp_tx);
 	err = srtp_alloc(&mf->srtp_tx, suite,
 			 mf->setup_local == SETUP_ACTIVE ? cli_key : srv_key,
-			 sizeof(cli_key), 0);
+			 keylen, 0);
 	if (err) {
 		warning("mediaflow: failed to allocate SRTP for TX (%m)\n",
 			err);
@@ -1464,7 +1970,7 @@ static void dtls_estab_handler(void *arg)
 
 	err = srtp_alloc(&mf->srtp_rx, suite,
 			 mf->setup_local == SETUP_ACTIVE ? srv_key : cli_key,
-			 sizeof(srv_key), 0);
+			 keylen, 0);
 	if (err) {
 		warning("mediaflow: failed to allocate SRTP for RX (%m)\n",
 			err);
@@ -1645,6 +2151,14 @@ static void ice_established_handler(struct mediaflow *mf,
 		mf->mf_stats.nat_estab = tmr_jiffies() - mf->ts_nat_start;
 	}
 
+	if (mf->mux_sock) {
+		err = mux_sock_add_route(mf->mux_sock, peer);
+		if (err) {
+			warning("mediaflow: mux: add route for %J"
+				" failed (%m)\n", peer, err);
+		}
+	}
+
 	if (mf->crypto_ready) {
 		info("mediaflow: ice-estab: crypto already ready\n");
 		goto out;
@@ -1763,8 +2277,8 @@ static void handle_dtls_packet(struct mediaflow *mf, const struct sa *src,
 {
 	++mf->mf_stats.dtls_pkt_recv;
 
-	info("dtls: recv %zu bytes from %s|%J\n",
-	     mbuf_get_left(mb), sock_prefix(mb->pos), src);
+	info_bin("dtls: recv %zu bytes from %s|%J\n",
+		 mbuf_get_left(mb), sock_prefix(mb->pos), src);
 
 	set_dtls_peer(mf, mb->pos, src);
 
@@ -1778,6 +2292,7 @@ static bool udp_helper_recv_handler_srtp(struct sa *src, struct mbuf *mb,
 	struct mediaflow *mf = arg;
 	size_t len = mbuf_get_left(mb);
 	const enum packet pkt = packet_classify_packet_type(mb);
+	bool decrypted = false;
 	int err;
 
 	if (pkt == PACKET_DTLS) {
@@ -1817,11 +2332,32 @@ static bool udp_helper_recv_handler_srtp(struct sa *src, struct mbuf *mb,
 			}
 		}
 
+		decrypted = true;
 	}
 
  next:
 	if (packet_is_rtp_or_rtcp(mb)) {
 
+		/* the handler forwards it, so it must be authenticated,
+		 * unless we did not offer any crypto
+		 */
+		if (mf->pkth && !decrypted && mf->cryptos_local)
+			return true;
+
+		if (mf->pkth) {
+			const size_t pos = mb->pos;
+
+			len = mbuf_get_left(mb);
+
+			if (mf->pkth(src, mb, packet_is_rtcp_packet(mb),
+				     mf->pkth_arg)) {
+				update_rx_stats(mf, len);
+				return true; /* handled */
+			}
+
+			mb->pos = pos;
+		}
+
 		/* If external RTP is enabled, forward RTP/RTCP packets
 		 * to the relevant au/vid-codec.
 		 *
@@ -1851,8 +2387,9 @@ static void external_rtp_recv(struct mediaflow *mf,
 {
 	const struct aucodec *ac;
 	const struct vidcodec *vc;
+	const struct route_pt *rpt;
 	struct rtp_header hdr;
-	const struct sdp_format *fmt;
+	enum rtp_route route;
 	size_t start = mb->pos;
 	int err;
 
@@ -1867,14 +2404,22 @@ static void external_rtp_recv(struct mediaflow *mf,
 		update_rx_stats(mf, mbuf_get_left(mb));
 	}
 	else {
-		/* RTCP is sent to both audio+video */
+		const uint8_t *p = mbuf_buf(mb);
+
+		/* RTCP goes to the decoder of the sender SSRC,
+		   or to both audio+video if the sender is unknown */
+		route = ROUTE_NONE;
+		if (mbuf_get_left(mb) >= 8) {
+			route = route_ssrc(mf, (uint32_t)p[4] << 24 |
+					   p[5] << 16 | p[6] << 8 | p[7]);
+		}
 
-		if (ac && ac->dec_rtcph) {
+		if (route != ROUTE_VIDEO && ac && ac->dec_rtcph) {
 			mb->pos = start;
 			ac->dec_rtcph(mf->ads,
 				      mbuf_buf(mb), mbuf_get_left(mb));
 		}
-		if (vc && vc->dec_rtcph) {
+		if (route != ROUTE_AUDIO && vc && vc->dec_rtcph) {
 			mb->pos = start;
 			vc->dec_rtcph(mf->video.vds,
 				      mbuf_buf(mb), mbuf_get_left(mb));
@@ -1896,11 +2441,13 @@ static void external_rtp_recv(struct mediaflow *mf,
 		goto out;
 	}
 
-	fmt = sdp_media_lformat(mf->sdpm, hdr.pt);
-	if (fmt) {
+	/* now, pass on the raw RTP packet to the decoder */
 
-		/* now, pass on the raw RTP/RTCP packet to the decoder */
+	rpt = route_lookup(mf, hdr.pt, hdr.ssrc);
+	route = rpt ? rpt->route : ROUTE_NONE;
+	switch (route) {
 
+	case ROUTE_AUDIO:
 		if (ac && ac->dec_rtph) {
 			ac->dec_rtph(mf->ads,
 				     mbuf_buf(mb), mbuf_get_left(mb));
@@ -1908,12 +2455,10 @@ static void external_rtp_recv(struct mediaflow *mf,
 			rtp_stats_update(&mf->audio_stats_rcv,
 					 mbuf_buf(mb), mbuf_get_left(mb));
 		}
+		break;
 
-		goto out;
-	}
-
-	fmt = sdp_media_lformat(mf->video.sdpm, hdr.pt);
-	if (fmt) {
+	case ROUTE_VIDEO:
+	case ROUTE_RTX:
 		if (!mf->video.has_rtp) {
 			mf->video.has_rtp = true;
 			check_rtpstart(mf);
@@ -1922,16 +2467,21 @@ static void external_rtp_recv(struct mediaflow *mf,
 			vc->dec_rtph(mf->video.vds,
 				     mbuf_buf(mb), mbuf_get_left(mb));
 
-			rtp_stats_update(&mf->video_stats_rcv,
-					 mbuf_buf(mb),mbuf_get_left(mb));
+			/* retransmissions are not counted as received */
+			if (route == ROUTE_VIDEO) {
+				rtp_stats_update(&mf->video_stats_rcv,
+						 mbuf_buf(mb),
+						 mbuf_get_left(mb));
+			}
 		}
+		break;
 
-		goto out;
+	default:
+		info("mediaflow: recv: no SDP format found"
+		     " for payload type %d\n", hdr.pt);
+		break;
 	}
 
-	info("mediaflow: recv: no SDP format found"
-	     " for payload type %d\n", hdr.pt);
-
  out:
 	return;  /* stop packet here */
 }
@@ -2116,11 +2666,17 @@ int mediaflow_summary(struct re_printf *pf, const struct mediaflow *mf)
 int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf)
 {
 	struct aucodec_stats *voe_stats;
+	struct rtp_stats_snap as, ar, vs, vr;
 	int err = 0;
 
 	if (!mf)
 		return 0;
 
+	rtp_stats_snapshot(&mf->audio_stats_snd, &as);
+	rtp_stats_snapshot(&mf->audio_stats_rcv, &ar);
+	rtp_stats_snapshot(&mf->video_stats_snd, &vs);
+	rtp_stats_snapshot(&mf->video_stats_rcv, &vr);
+
 	err |= re_hprintf(pf,
 			  "----------- mediaflow RTP summary ------------\n");
 
@@ -2133,17 +2689,17 @@ int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf)
 				  voe_stats->in_vol.max);
 	}
 	err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
-			  mf->audio_stats_snd.bit_rate_stats.min,
-			  mf->audio_stats_snd.bit_rate_stats.avg,
-			  mf->audio_stats_snd.bit_rate_stats.max);
+			  as.bit_rate_stats.min,
+			  as.bit_rate_stats.avg,
+			  as.bit_rate_stats.max);
 	err |= re_hprintf(pf,"Packet rate (1/s) %.1f %.1f %.1f \n",
-			  mf->audio_stats_snd.pkt_rate_stats.min,
-			  mf->audio_stats_snd.pkt_rate_stats.avg,
-			  mf->audio_stats_snd.pkt_rate_stats.max);
+			  as.pkt_rate_stats.min,
+			  as.pkt_rate_stats.avg,
+			  as.pkt_rate_stats.max);
 	err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
-			  mf->audio_stats_snd.pkt_loss_stats.min,
-			  mf->audio_stats_snd.pkt_loss_stats.avg,
-			  mf->audio_stats_snd.pkt_loss_stats.max);
+			  as.pkt_loss_stats.min,
+			  as.pkt_loss_stats.avg,
+			  as.pkt_loss_stats.max);
 
 	err |= re_hprintf(pf,"Audio RX: \n");
 	if (voe_stats) {
@@ -2153,17 +2709,17 @@ int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf)
 				  voe_stats->out_vol.max);
 	}
 	err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
-			  mf->audio_stats_rcv.bit_rate_stats.min,
-			  mf->audio_stats_rcv.bit_rate_stats.avg,
-			  mf->audio_stats_rcv.bit_rate_stats.max);
+			  ar.bit_rate_stats.min,
+			  ar.bit_rate_stats.avg,
+			  ar.bit_rate_stats.max);
 	err |= re_hprintf(pf,"Packet rate (1/s) %.1f %.1f %.1f \n",
-			  mf->audio_stats_rcv.pkt_rate_stats.min,
-			  mf->audio_stats_rcv.pkt_rate_stats.avg,
-			  mf->audio_stats_rcv.pkt_rate_stats.max);
+			  ar.pkt_rate_stats.min,
+			  ar.pkt_rate_stats.avg,
+			  ar.pkt_rate_stats.max);
 	err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
-			  mf->audio_stats_rcv.pkt_loss_stats.min,
-			  mf->audio_stats_rcv.pkt_loss_stats.avg,
-			  mf->audio_stats_rcv.pkt_loss_stats.max);
+			  ar.pkt_loss_stats.min,
+			  ar.pkt_loss_stats.avg,
+			  ar.pkt_loss_stats.max);
 	if (voe_stats){
 		err |= re_hprintf(pf,"JB size (ms) %.1f %.1f %.1f \n",
 				  voe_stats->jb_size.min,
@@ -2175,38 +2731,38 @@ int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf)
 				  voe_stats->rtt.max);
 	}
 	err |= re_hprintf(pf,"Packet dropouts (#) %d \n",
-			  mf->audio_stats_rcv.dropouts);
+			  ar.dropouts);
 
 	if (mf->video.has_media){
 		err |= re_hprintf(pf,"Video TX: \n");
 		err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
-				  mf->video_stats_snd.bit_rate_stats.min,
-				  mf->video_stats_snd.bit_rate_stats.avg,
-				  mf->video_stats_snd.bit_rate_stats.max);
+				  vs.bit_rate_stats.min,
+				  vs.bit_rate_stats.avg,
+				  vs.bit_rate_stats.max);
 		err |= re_hprintf(pf,"Frame rate (1/s) %.1f %.1f %.1f \n",
-				  mf->video_stats_snd.frame_rate_stats.min,
-				  mf->video_stats_snd.frame_rate_stats.avg,
-				  mf->video_stats_snd.frame_rate_stats.max);
+				  vs.frame_rate_stats.min,
+				  vs.frame_rate_stats.avg,
+				  vs.frame_rate_stats.max);
 		err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
-				  mf->video_stats_snd.pkt_loss_stats.min,
-				  mf->video_stats_snd.pkt_loss_stats.avg,
-				  mf->video_stats_snd.pkt_loss_stats.max);
+				  vs.pkt_loss_stats.min,
+				  vs.pkt_loss_stats.avg,
+				  vs.pkt_loss_stats.max);
 
 		err |= re_hprintf(pf,"Video RX: \n");
 		err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
-				  mf->video_stats_rcv.bit_rate_stats.min,
-				  mf->video_stats_rcv.bit_rate_stats.avg,
-				  mf->video_stats_rcv.bit_rate_stats.max);
+				  vr.bit_rate_stats.min,
+				  vr.bit_rate_stats.avg,
+				  vr.bit_rate_stats.max);
 		err |= re_hprintf(pf,"Frame rate (1/s) %.1f %.1f %.1f \n",
-				  mf->video_stats_rcv.frame_rate_stats.min,
-				  mf->video_stats_rcv.frame_rate_stats.avg,
-				  mf->video_stats_rcv.frame_rate_stats.max);
+				  vr.frame_rate_stats.min,
+				  vr.frame_rate_stats.avg,
+				  vr.frame_rate_stats.max);
 		err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
-				  mf->video_stats_rcv.pkt_loss_stats.min,
-				  mf->video_stats_rcv.pkt_loss_stats.avg,
-				  mf->video_stats_rcv.pkt_loss_stats.max);
+				  vr.pkt_loss_stats.min,
+				  vr.pkt_loss_stats.avg,
+				  vr.pkt_loss_stats.max);
 		err |= re_hprintf(pf,"Packet dropouts (#) %d \n",
-				  mf->video_stats_rcv.dropouts);
+				  vr.dropouts);
 	}
 
 	err |= re_hprintf(pf,
@@ -2220,6 +2776,7 @@ int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf)
 static void destructor(void *arg)
 {
 	struct mediaflow *mf = arg;
+	size_t i;
 
 	if (MAGIC != mf->magic) {
 		warning("mediaflow: destructor: bad magic (0x%08x)\n",
@@ -2245,6 +2802,10 @@ static void destructor(void *arg)
 
 	tmr_cancel(&mf->tmr_rtp);
 	tmr_cancel(&mf->tmr_nat);
+	tmr_cancel(&mf->video.tmr_tx);
+
+	/* no more packets from the shared socket */
+	mf->mux_sock = mem_deref(mf->mux_sock);
 
 	/* XXX: voe is calling to mediaflow_xxx here */
 	/* deref the encoders/decodrs first, as they may be multithreaded,
@@ -2257,6 +2818,10 @@ static void destructor(void *arg)
 	mf->video.ves = mem_deref(mf->video.ves);
 	mf->video.vds = mem_deref(mf->video.vds);
 
+	for (i = 0; i < mf->video.txc; i++)
+		mem_deref(mf->video.txv[i]);
+	mf->video.txc = 0;
+
 	mem_deref(mf->tls_conn);
 
 	list_flush(&mf->interfacel);
@@ -2319,8 +2884,8 @@ static void stun_udp_recv_handler(const struct sa *src,
 	struct stun_unknown_attr ua;
 	struct stun_msg *msg = NULL;
 
-	debug("mediaflow: stun: receive %zu bytes from %J\n",
-	      mbuf_get_left(mb), src);
+	debug_bin("mediaflow: stun: receive %zu bytes from %J\n",
+		  mbuf_get_left(mb), src);
 
 	if (0 == stun_msg_decode(&msg, mb, &ua) &&
 	    stun_msg_method(msg) == STUN_METHOD_BINDING) {
@@ -2351,6 +2916,11 @@ static void mq_callback(int id, void *data, void *arg)
 	case MQ_RTP_START:
 		check_rtpstart(mf);
 		break;
+
+	case MQ_VIDEO_FLUSH:
+		tmr_start(&mf->video.tmr_tx, VIDEO_TX_HOLD,
+			  video_tx_timeout, mf);
+		break;
 	}
 }
 
@@ -2390,6 +2960,34 @@ int mediaflow_alloc(struct mediaflow **mfp,
 		    mediaflow_estab_h *estabh,
 		    mediaflow_close_h *closeh,
 		    void *arg)
+{
+	return mediaflow_alloc_mux(mfp, NULL, dtls, aucodecl, laddr_sdp,
+				   nat, cryptos, external_rtp,
+				   lcandh, estabh, closeh, arg);
+}
+
+
+/**
+ * Create a new mediaflow, optionally on a shared UDP socket.
+ *
+ * With a shared socket the mediaflow has no RTP/RTCP socket of its
+ * own, and the local port is the one of the shared socket. This is
+ * supported for ICE-lite and for no NAT traversal, trickle ICE has
+ * its own sockets per local candidate.
+ *
+ * @param mux  Shared UDP socket (optional)
+ */
+int mediaflow_alloc_mux(struct mediaflow **mfp, struct mediaflow_mux *mux,
+			struct tls *dtls,
+			const struct list *aucodecl,
+			const struct sa *laddr_sdp,
+			enum mediaflow_nat nat,
+			enum media_crypto cryptos,
+			bool external_rtp,
+			mediaflow_localcand_h *lcandh,
+			mediaflow_estab_h *estabh,
+			mediaflow_close_h *closeh,
+			void *arg)
 {
 	struct mediaflow *mf;
 	struct le *le;
@@ -2403,6 +3001,12 @@ int mediaflow_alloc(struct mediaflow **mfp,
 	if (!sa_isset(laddr_sdp, SA_ADDR))
 		return EINVAL;
 
+	if (mux && nat != MEDIAFLOW_ICELITE && nat != MEDIAFLOW_NAT_NONE) {
+		warning("mediaflow: shared socket not supported with %s\n",
+			mediaflow_nat_name(nat));
+		return ENOTSUP;
+	}
+
 	mf = mem_zalloc(sizeof(*mf), destructor);
 	if (!mf)
 		return ENOMEM;
@@ -2448,9 +3052,20 @@ int mediaflow_alloc(struct mediaflow **mfp,
 
 	mf->enable_rtcp = !external_rtp;
 
-	err = rtp_listen(&mf->rtp, IPPROTO_UDP, &laddr_rtp, 32768, 61000,
-			 mf->enable_rtcp,
-			 rtp_recv_handler, rtcp_recv_handler, mf);
+	if (mux) {
+		err = mux_sock_alloc(&mf->mux_sock, mux, mf->ice_ufrag);
+		if (err)
+			goto out;
+
+		err = rtp_listen_sock(&mf->rtp, mux_sock_udp(mf->mux_sock),
+				      mf->enable_rtcp,
+				      rtp_recv_handler, rtcp_recv_handler, mf);
+	}
+	else {
+		err = rtp_listen(&mf->rtp, IPPROTO_UDP, &laddr_rtp,
+				 32768, 61000, mf->enable_rtcp,
+				 rtp_recv_handler, rtcp_recv_handler, mf);
+	}
 	if (err) {
 		warning("mediaflow: rtp_listen failed (%m)\n", err);
 		goto out;
@@ -2660,6 +3275,7 @@ int mediaflow_alloc(struct mediaflow **mfp,
 
 	if (cryptos & CRYPTO_DTLS_SRTP) {
 
+		struct udp_sock *us_dtls = NULL;
 		struct sa laddr_dtls;
 
 		sa_set_str(&laddr_dtls, "0.0.0.0", 0);
@@ -2668,9 +3284,19 @@ int mediaflow_alloc(struct mediaflow **mfp,
 			warning("mediaflow: dtls context is missing\n");
 		}
 
+		/* the DTLS socket only redirects, it needs no fd */
+		if (mf->mux_sock) {
+			err = udp_alloc_shared(&us_dtls,
+					       mux_sock_udp(mf->mux_sock),
+					       NULL, NULL);
+			if (err)
+				goto out;
+		}
+
 		err = dtls_listen(&mf->dtls_sock, &laddr_dtls,
-				  NULL, 2, LAYER_DTLS,
+				  us_dtls, 2, LAYER_DTLS,
 				  dtls_conn_handler, mf);
+		mem_deref(us_dtls);
 		if (err) {
 			warning("mediaflow: dtls_listen failed (%m)\n", err);
 			goto out;
@@ -2816,6 +3442,22 @@ void mediaflow_set_rtp_handler(struct mediaflow *mf,
 }
 
 
+/*
+ * Install a handler that sees every decrypted RTP/RTCP packet before
+ * it is routed to the codecs or the RTP stack. Returning true from the
+ * handler consumes the packet.
+ */
+void mediaflow_set_packet_handler(struct mediaflow *mf,
+				  mediaflow_packet_h *pkth, void *arg)
+{
+	if (!mf)
+		return;
+
+	mf->pkth     = pkth;
+	mf->pkth_arg = arg;
+}
+
+
 int mediaflow_add_video(struct mediaflow *mf, struct list *vidcodecl)
 {
 	struct le *le;
@@ -3462,6 +4104,8 @@ static int post_sdp_decode(struct mediaflow *mf)
 
 	get_sdp_candidates(mf);
 
+	route_build(mf);
+
 
 	/*
 	 * Handle negotiation about a common crypto-type
@@ -3778,13 +4422,11 @@ int mediaflow_send_rtp(struct mediaflow *mf, const struct rtp_header *hdr,
 		return EINTR;
 	}
 
-	headroom = get_headroom(mf);
-
-	mb = mbuf_alloc(headroom + 256);
+	mb = mediaflow_txbuf_alloc(mf, RTP_HEADER_SIZE + pldlen);
 	if (!mb)
 		return ENOMEM;
 
-	mb->pos = headroom;
+	headroom = mb->pos;
 	err  = rtp_hdr_encode(mb, hdr);
 	err |= mbuf_write_mem(mb, pld, pldlen);
 	if (err)
@@ -3805,22 +4447,28 @@ int mediaflow_send_rtp(struct mediaflow *mf, const struct rtp_header *hdr,
 }
 
 
-/* NOTE: might be called from different threads */
-int mediaflow_send_raw_rtp(struct mediaflow *mf, const uint8_t *buf,
-			   size_t len)
+/*
+ * Send an RTP packet from a buffer allocated with mediaflow_txbuf_alloc().
+ * The buffer is encrypted and framed in place; the caller keeps its
+ * reference.
+ *
+ * NOTE: might be called from different threads
+ */
+int mediaflow_send_rtp_mbuf(struct mediaflow *mf, struct mbuf *mb)
 {
-	struct mbuf *mb;
-	size_t headroom;
+	size_t len;
 	int err;
 
-	if (!mf || !buf)
+	if (!mf || !mb)
 		return EINVAL;
 
 	MAGIC_CHECK(mf);
 
+	len = mbuf_get_left(mb);
+
 	/* check if media-stream is ready for sending */
 	if (!mediaflow_is_ready(mf)) {
-		warning("mediaflow: send_raw_rtp(%zu bytes): not ready"
+		warning("mediaflow: send_rtp_mbuf(%zu bytes): not ready"
 			" [ice=%d, crypto=%d]\n",
 			len, mf->ice_ready, mf->crypto_ready);
 		return EINTR;
@@ -3828,19 +4476,9 @@ int mediaflow_send_raw_rtp(struct mediaflow *mf, const uint8_t *buf,
 
 	pthread_mutex_lock(&mf->mutex_enc);
 
-	headroom = get_headroom(mf);
-
-	mb = mbuf_alloc(headroom + len);
-	if (!mb) {
-		err = ENOMEM;
-		goto out;
-	}
-
-	mb->pos = headroom;
-	err = mbuf_write_mem(mb, buf, len);
+	err = txbuf_headroom(mf, mb);
 	if (err)
 		goto out;
-	mb->pos = headroom;
 
 	if (len >= RTP_HEADER_SIZE)
 		update_tx_stats(mf, len - RTP_HEADER_SIZE);
@@ -3850,14 +4488,34 @@ int mediaflow_send_raw_rtp(struct mediaflow *mf, const uint8_t *buf,
 		goto out;
 
  out:
-	mem_deref(mb);
-
 	pthread_mutex_unlock(&mf->mutex_enc);
 
 	return err;
 }
 
 
+/* NOTE: might be called from different threads */
+int mediaflow_send_raw_rtp(struct mediaflow *mf, const uint8_t *buf,
+			   size_t len)
+{
+	struct mbuf *mb;
+	int err;
+
+	if (!mf || !buf)
+		return EINVAL;
+
+	mb = txbuf_dup(mf, buf, len);
+	if (!mb)
+		return ENOMEM;
+
+	err = mediaflow_send_rtp_mbuf(mf, mb);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
 void mediaflow_rtp_start_send(struct mediaflow *mf)
 {
 	if (!mf)
@@ -3871,55 +4529,62 @@ void mediaflow_rtp_start_send(struct mediaflow *mf)
 }
 
 
-int mediaflow_send_raw_rtcp(struct mediaflow *mf,
-			    const uint8_t *buf, size_t len)
+/* Send an RTCP packet, see mediaflow_send_rtp_mbuf() */
+int mediaflow_send_rtcp_mbuf(struct mediaflow *mf, struct mbuf *mb)
 {
-	struct mbuf *mb;
-	size_t headroom;
 	int err;
 
-	if (!mf || !buf || !len)
+	if (!mf || !mb || !mbuf_get_left(mb))
 		return EINVAL;
 
 	MAGIC_CHECK(mf);
 
 	/* check if media-stream is ready for sending */
 	if (!mediaflow_is_ready(mf)) {
-		warning("mediaflow: send_raw_rtcp(%zu bytes): not ready"
+		warning("mediaflow: send_rtcp_mbuf(%zu bytes): not ready"
 			" [ice=%d, crypto=%d]\n",
-			len, mf->ice_ready, mf->crypto_ready);
+			mbuf_get_left(mb), mf->ice_ready, mf->crypto_ready);
 		return EINTR;
 	}
 
 	pthread_mutex_lock(&mf->mutex_enc);
 
-	headroom = get_headroom(mf);
-
-	mb = mbuf_alloc(headroom + 256);
-	if (!mb) {
-		err = ENOMEM;
-		goto out;
-	}
-
-	mb->pos = headroom;
-	err = mbuf_write_mem(mb, buf, len);
+	err = txbuf_headroom(mf, mb);
 	if (err)
 		goto out;
-	mb->pos = headroom;
 
 	err = udp_send(rtp_sock(mf->rtp), &mf->rcand.addr, mb);
 	if (err)
 		goto out;
 
  out:
-	mem_deref(mb);
-
 	pthread_mutex_unlock(&mf->mutex_enc);
 
 	return err;
 }
 
 
+int mediaflow_send_raw_rtcp(struct mediaflow *mf,
+			    const uint8_t *buf, size_t len)
+{
+	struct mbuf *mb;
+	int err;
+
+	if (!mf || !buf || !len)
+		return EINVAL;
+
+	mb = txbuf_dup(mf, buf, len);
+	if (!mb)
+		return ENOMEM;
+
+	err = mediaflow_send_rtcp_mbuf(mf, mb);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
 int mediaflow_get_rtcpstats(struct mediaflow *mf, struct rtcp_stats *stats)
 {
 	if (!mf || !stats)
@@ -7,5 +7,6 @@ AVS_SRCS += \
 	media/dtls.c \
 	media/icelite.c \
 	media/mediaflow.c \
+	media/mux.c \
 	media/packet.c \
 	media/rtp_stats.c
@@ -0,0 +1,359 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_media.h"
+#include "priv_mediaflow.h"
+
+
+/*
+ * One UDP socket shared by many mediaflows.
+ *
+ * Every mediaflow gets its own UDP socket object on top of the shared
+ * file descriptor, so that its helpers (ICE, DTLS, SRTP) stay private
+ * to it. Incoming packets are passed to the right one:
+ *
+ *   - STUN requests by the local ICE ufrag in the USERNAME attribute
+ *   - everything else by the source address, which the mediaflow adds
+ *     when ICE (or the plain remote address) is established
+ *
+ * All of this runs in the re main thread.
+ */
+
+
+enum {
+	MUX_HASH_SIZE = 256,
+};
+
+
+struct mediaflow_mux {
+	struct udp_sock *us;
+	struct hash *ht_ufrag;   /* struct mux_sock */
+	struct hash *ht_addr;    /* struct mux_route */
+	struct sa laddr;
+	uint64_t n_drop;
+};
+
+struct mux_sock {
+	struct le he;            /* mux->ht_ufrag */
+	struct mediaflow_mux *mux;
+	struct udp_sock *us;
+	struct list routel;      /* struct mux_route */
+	char *ufrag;
+};
+
+struct mux_route {
+	struct le he;            /* mux->ht_addr */
+	struct le le;            /* ms->routel */
+	struct sa addr;
+	struct mux_sock *ms;
+};
+
+
+static void route_destructor(void *arg)
+{
+	struct mux_route *rt = arg;
+
+	hash_unlink(&rt->he);
+	list_unlink(&rt->le);
+}
+
+
+static bool route_cmp_handler(struct le *le, void *arg)
+{
+	const struct mux_route *rt = le->data;
+
+	return sa_cmp(&rt->addr, arg, SA_ALL);
+}
+
+
+static struct mux_route *route_find(const struct mediaflow_mux *mux,
+				    const struct sa *addr)
+{
+	return list_ledata(hash_lookup(mux->ht_addr,
+				       sa_hash(addr, SA_ALL),
+				       route_cmp_handler, (void *)addr));
+}
+
+
+static int route_add(struct mux_sock *ms, const struct sa *addr)
+{
+	struct mediaflow_mux *mux = ms->mux;
+	struct mux_route *rt;
+
+	rt = route_find(mux, addr);
+	if (rt) {
+		if (rt->ms == ms)
+			return 0;
+
+		/* the address has moved to another mediaflow */
+		info("mediaflow: mux: %J moves to ufrag %s\n",
+		     addr, ms->ufrag);
+
+		list_unlink(&rt->le);
+		list_append(&ms->routel, &rt->le, rt);
+		rt->ms = ms;
+
+		return 0;
+	}
+
+	rt = mem_zalloc(sizeof(*rt), route_destructor);
+	if (!rt)
+		return ENOMEM;
+
+	rt->addr = *addr;
+	rt->ms = ms;
+
+	hash_append(mux->ht_addr, sa_hash(addr, SA_ALL), &rt->he, rt);
+	list_append(&ms->routel, &rt->le, rt);
+
+	return 0;
+}
+
+
+static bool ufrag_cmp_handler(struct le *le, void *arg)
+{
+	const struct mux_sock *ms = le->data;
+	const struct pl *ufrag = arg;
+
+	return 0 == pl_strcmp(ufrag, ms->ufrag);
+}
+
+
+/*
+ * The local ufrag of a STUN Binding request, from the USERNAME
+ * attribute "local:remote". Nothing is decoded apart from that.
+ */
+static int stun_lufrag(struct pl *ufrag, const struct mbuf *mb)
+{
+	const uint8_t *p = mbuf_buf(mb);
+	size_t left = mbuf_get_left(mb);
+	size_t len;
+
+	if (left < STUN_HEADER_SIZE)
+		return EBADMSG;
+
+	/* Binding request */
+	if (p[0] != 0x00 || p[1] != 0x01)
+		return ENOENT;
+
+	len = (size_t)p[2] << 8 | p[3];
+	if (len > left - STUN_HEADER_SIZE)
+		return EBADMSG;
+
+	p += STUN_HEADER_SIZE;
+
+	while (len >= STUN_ATTR_HEADER_SIZE) {
+		const uint16_t type = p[0] << 8 | p[1];
+		const size_t alen = (size_t)p[2] << 8 | p[3];
+		const size_t plen = (alen + 3) & ~(size_t)3;
+
+		p   += STUN_ATTR_HEADER_SIZE;
+		len -= STUN_ATTR_HEADER_SIZE;
+
+		if (alen > len)
+			return EBADMSG;
+
+		if (type == STUN_ATTR_USERNAME) {
+			const char *sep = memchr(p, ':', alen);
+
+			ufrag->p = (const char *)p;
+			ufrag->l = sep ? (size_t)(sep - ufrag->p) : alen;
+
+			return 0;
+		}
+
+		if (plen > len)
+			break;
+
+		p   += plen;
+		len -= plen;
+	}
+
+	return ENOENT;
+}
+
+
+static void mux_recv_handler(const struct sa *src, struct mbuf *mb,
+			     void *arg)
+{
+	struct mediaflow_mux *mux = arg;
+	struct mux_sock *ms = NULL;
+	struct mux_route *rt;
+	struct pl ufrag;
+
+	if (PACKET_STUN == packet_classify_packet_type(mb) &&
+	    0 == stun_lufrag(&ufrag, mb)) {
+
+		ms = list_ledata(hash_lookup(mux->ht_ufrag,
+					     hash_joaat((const uint8_t *)ufrag.p,
+							ufrag.l),
+					     ufrag_cmp_handler, &ufrag));
+
+		/* the route is added by the mediaflow, once the ICE
+		   layer has checked the integrity of the request */
+		if (ms) {
+			udp_recv_packet(ms->us, src, mb);
+			return;
+		}
+	}
+
+	rt = route_find(mux, src);
+	if (!rt) {
+		if (!(mux->n_drop++ % 100)) {
+			debug("mediaflow: mux: no route for %J"
+			      " (%llu dropped)\n", src,
+			      (unsigned long long)mux->n_drop);
+		}
+		return;
+	}
+
+	udp_recv_packet(rt->ms->us, src, mb);
+}
+
+
+static void mux_destructor(void *arg)
+{
+	struct mediaflow_mux *mux = arg;
+
+	/* the mediaflows hold a reference, so the tables are empty */
+	mem_deref(mux->ht_addr);
+	mem_deref(mux->ht_ufrag);
+	mem_deref(mux->us);
+}
+
+
+/**
+ * Create a UDP socket that can be shared by many mediaflows
+ *
+ * Use one per local interface if the flows must be told apart by
+ * the local address.
+ *
+ * @param muxp   Pointer to the new shared socket
+ * @param laddr  Local address, the port may be zero
+ */
+int mediaflow_mux_alloc(struct mediaflow_mux **muxp, const struct sa *laddr)
+{
+	struct mediaflow_mux *mux;
+	int err;
+
+	if (!muxp || !laddr)
+		return EINVAL;
+
+	mux = mem_zalloc(sizeof(*mux), mux_destructor);
+	if (!mux)
+		return ENOMEM;
+
+	err  = hash_alloc(&mux->ht_ufrag, MUX_HASH_SIZE);
+	err |= hash_alloc(&mux->ht_addr, MUX_HASH_SIZE);
+	if (err)
+		goto out;
+
+	err = udp_listen(&mux->us, laddr, mux_recv_handler, mux);
+	if (err) {
+		warning("mediaflow: mux: listen on %J failed (%m)\n",
+			laddr, err);
+		goto out;
+	}
+
+	err = udp_local_get(mux->us, &mux->laddr);
+	if (err)
+		goto out;
+
+	info("mediaflow: mux: listening on %J\n", &mux->laddr);
+
+ out:
+	if (err)
+		mem_deref(mux);
+	else
+		*muxp = mux;
+
+	return err;
+}
+
+
+const struct sa *mediaflow_mux_laddr(const struct mediaflow_mux *mux)
+{
+	return mux ? &mux->laddr : NULL;
+}
+
+
+static void sock_destructor(void *arg)
+{
+	struct mux_sock *ms = arg;
+
+	hash_unlink(&ms->he);
+	list_flush(&ms->routel);
+
+	mem_deref(ms->us);
+	mem_deref(ms->ufrag);
+	mem_deref(ms->mux);
+}
+
+
+int mux_sock_alloc(struct mux_sock **msp, struct mediaflow_mux *mux,
+		   const char *ufrag)
+{
+	struct mux_sock *ms;
+	int err;
+
+	if (!msp || !mux || !str_isset(ufrag))
+		return EINVAL;
+
+	ms = mem_zalloc(sizeof(*ms), sock_destructor);
+	if (!ms)
+		return ENOMEM;
+
+	ms->mux = mem_ref(mux);
+
+	err = str_dup(&ms->ufrag, ufrag);
+	if (err)
+		goto out;
+
+	err = udp_alloc_shared(&ms->us, mux->us, NULL, NULL);
+	if (err)
+		goto out;
+
+	hash_append(mux->ht_ufrag, hash_joaat_str(ufrag), &ms->he, ms);
+
+ out:
+	if (err)
+		mem_deref(ms);
+	else
+		*msp = ms;
+
+	return err;
+}
+
+
+struct udp_sock *mux_sock_udp(const struct mux_sock *ms)
+{
+	return ms ? ms->us : NULL;
+}
+
+
+/* Route packets from this address to the mediaflow */
+int mux_sock_add_route(struct mux_sock *ms, const struct sa *addr)
+{
+	if (!ms || !sa_isset(addr, SA_ALL))
+		return EINVAL;
+
+	return route_add(ms, addr);
+}
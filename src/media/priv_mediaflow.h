@@ -80,6 +80,18 @@ int dtls_print_sha1_fingerprint(struct re_printf *pf, const struct tls *tls);
 int dtls_print_sha256_fingerprint(struct re_printf *pf, const struct tls *tls);
 
 
+/*
+ * Shared UDP socket
+ */
+
+struct mux_sock;
+
+int mux_sock_alloc(struct mux_sock **msp, struct mediaflow_mux *mux,
+		   const char *ufrag);
+struct udp_sock *mux_sock_udp(const struct mux_sock *ms);
+int mux_sock_add_route(struct mux_sock *ms, const struct sa *addr);
+
+
 /*
  * Packet
  */
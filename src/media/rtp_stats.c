@@ -16,133 +16,291 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "rtp_stats.h"
-#include <stdio.h>
+#include <stdbool.h>
 #include <string.h>
+#include <time.h>
+#include "rtp_stats.h"
+
+
+enum {
+	RTP_HDR_SIZE = 12,
+	JITTER_GAIN  = 16,    /* RFC 3550 section 6.4.1 */
+};
+
+enum {
+	SUM_BIT_RATE = 0,
+	SUM_PKT_RATE,
+	SUM_PKT_LOSS,
+	SUM_FRAME_RATE,
+};
+
 
+/* upper bucket edges, the last bucket is open */
+static const float hist_edgev[RTP_HIST_NUM][RTP_HIST_BUCKETS - 1] = {
+	/* jitter [ms] */
+	{1, 2, 3, 5, 7, 10, 15, 20, 30, 40, 60, 80, 120, 160, 250},
 
-static uint8_t get_pt(const uint8_t *pkt, size_t len)
+	/* bitrate [kbit/s] */
+	{8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 2048},
+
+	/* loss [%] */
+	{0, 1, 2, 3, 4, 5, 7, 10, 15, 20, 25, 30, 40, 50, 75},
+};
+
+
+/* monotonic, so that wall clock steps do not show up as jitter */
+static uint64_t time_us(void)
 {
-	uint16_t pt = pkt[1];
-	return pt;
+	struct timespec now;
+
+	if (0 != clock_gettime(CLOCK_MONOTONIC, &now))
+		return 0;
+
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
 }
 
 
-static uint16_t get_seqnr(const uint8_t *pkt, size_t len)
+static void hist_add(struct rtp_hist *hist, enum rtp_hist_type type,
+		     float v)
 {
-	uint16_t seq_nr = pkt[3] + (((uint16_t)pkt[2]) << 8);
-	return seq_nr;
+	const float *edgev = hist_edgev[type];
+	unsigned i;
+
+	for (i = 0; i < RTP_HIST_BUCKETS - 1; i++) {
+		if (v <= edgev[i])
+			break;
+	}
+
+	++hist->cntv[i];
+	++hist->n;
 }
 
 
-static void calc_max_min_avg(float buf[], int n, struct max_min_avg *out )
+/* upper edge of the bucket holding the p-quantile (0 < p <= 1) */
+float rtp_hist_percentile(const struct rtp_hist *hist,
+			  enum rtp_hist_type type, float p)
 {
-	float avg_ = 0.0f;
-	float max_ = -1e6;
-	float min_ = 1e6;
-	int i;
-	if (n > NBUF){
-		n = NBUF;
-	}
-	for ( i = 0; i < n; i++) {
-		avg_ += buf[i];
-		if (buf[i] > max_){
-			max_ = buf[i];
-		}
-		if (buf[i] < min_){
-			min_ = buf[i];
-		}
+	const float *edgev;
+	uint32_t target, cnt = 0;
+	unsigned i;
+
+	if (!hist || type >= RTP_HIST_NUM || !hist->n)
+		return -1;
+
+	edgev = hist_edgev[type];
+
+	target = (uint32_t)(p * hist->n);
+	if (target < p * hist->n || target == 0)
+		++target;
+
+	for (i = 0; i < RTP_HIST_BUCKETS - 1; i++) {
+		cnt += hist->cntv[i];
+		if (cnt >= target)
+			return edgev[i];
 	}
-	avg_ = avg_ / n;
-	out->max = max_;
-	out->min = min_;
-	out->avg = avg_;
+
+	return edgev[RTP_HIST_BUCKETS - 2];
 }
 
 
-void rtp_stats_init(struct rtp_stats* rs, int pt, int dropout_thres_ms)
+static void mma_add(struct max_min_avg *mma, float *sum, uint32_t n,
+		    float v)
 {
-	memset(rs,0,sizeof(struct rtp_stats));
-	rs->bit_rate_stats.min = -1;
-	rs->bit_rate_stats.max = -1;
-	rs->bit_rate_stats.avg = -1;
-	rs->pkt_rate_stats.min = -1;
-	rs->pkt_rate_stats.max = -1;
-	rs->pkt_rate_stats.avg = -1;
-	rs->pkt_loss_stats.min = -1;
-	rs->pkt_loss_stats.max = -1;
-	rs->pkt_loss_stats.avg = -1;
-	rs->frame_rate_stats.min = -1;
-	rs->frame_rate_stats.max = -1;
-	rs->frame_rate_stats.avg = -1;
-	rs->idx = 0;
-	rs->n = 0;
-	rs->dropouts = 0;
+	if (n == 0 || v > mma->max)
+		mma->max = v;
+	if (n == 0 || v < mma->min)
+		mma->min = v;
+
+	*sum += v;
+	mma->avg = *sum / (float)(n + 1);
+}
+
+
+static void write_begin(struct rtp_stats *rs)
+{
+	__atomic_store_n(&rs->seq, rs->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void write_end(struct rtp_stats *rs)
+{
+	__atomic_store_n(&rs->seq, rs->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+static uint32_t read_begin(const struct rtp_stats *rs)
+{
+	uint32_t seq;
+
+	while ((seq = __atomic_load_n(&rs->seq, __ATOMIC_ACQUIRE)) & 1)
+		;
+
+	return seq;
+}
+
+
+static bool read_retry(const struct rtp_stats *rs, uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&rs->seq, __ATOMIC_RELAXED) != seq;
+}
+
+
+static void publish(struct rtp_stats *rs)
+{
+	write_begin(rs);
+	rs->snap = rs->cur;
+	write_end(rs);
+}
+
+
+void rtp_stats_init(struct rtp_stats *rs, int pt, uint32_t srate,
+		    int dropout_thres_ms)
+{
+	struct max_min_avg none = {-1, -1, -1};
+	unsigned i;
+
+	if (!rs)
+		return;
+
+	memset(rs, 0, sizeof(*rs));
+
+	rs->cur.bit_rate_stats = none;
+	rs->cur.pkt_rate_stats = none;
+	rs->cur.pkt_loss_stats = none;
+	rs->cur.frame_rate_stats = none;
+	for (i = 0; i < RTP_HIST_NUM; i++) {
+		rs->cur.pctv[i].p50 = -1;
+		rs->cur.pctv[i].p95 = -1;
+		rs->cur.pctv[i].p99 = -1;
+	}
+
 	rs->pt = pt;
+	rs->srate = srate;
 	rs->dropout_thres_ms = dropout_thres_ms;
+
+	publish(rs);
 }
 
 
-void rtp_stats_update(struct rtp_stats* rs, const uint8_t *pkt, size_t len)
+static void interval_end(struct rtp_stats *rs, uint16_t seq, uint64_t now)
 {
-	// lock ??
-	if ((get_pt(pkt, len) & 0x7f) != rs->pt) {
-		return;
+	struct rtp_stats_snap *cur = &rs->cur;
+	float diff_ms = (float)(now - rs->start_time) / 1000.0f;
+	uint32_t expected = (uint16_t)(seq - rs->start_seq_nr) + 1;
+	float bit_rate = 8.0f * rs->byte_cnt / diff_ms;
+	float frame_rate = 1000.0f * rs->frame_cnt / diff_ms;
+	float packet_rate = 1000.0f * expected / diff_ms;
+	float loss_rate = 0;
+	unsigned i;
+
+	/* duplicates may make up for lost packets */
+	if (expected > rs->packet_cnt)
+		loss_rate = 100.0f * (expected - rs->packet_cnt) / expected;
+
+	mma_add(&cur->bit_rate_stats, &rs->sumv[SUM_BIT_RATE],
+		cur->intervals, bit_rate);
+	mma_add(&cur->pkt_rate_stats, &rs->sumv[SUM_PKT_RATE],
+		cur->intervals, packet_rate);
+	mma_add(&cur->pkt_loss_stats, &rs->sumv[SUM_PKT_LOSS],
+		cur->intervals, loss_rate);
+	mma_add(&cur->frame_rate_stats, &rs->sumv[SUM_FRAME_RATE],
+		cur->intervals, frame_rate);
+	++cur->intervals;
+
+	hist_add(&rs->histv[RTP_HIST_BITRATE], RTP_HIST_BITRATE, bit_rate);
+	hist_add(&rs->histv[RTP_HIST_LOSS], RTP_HIST_LOSS, loss_rate);
+
+	for (i = 0; i < RTP_HIST_NUM; i++) {
+		cur->pctv[i].p50 = rtp_hist_percentile(&rs->histv[i], i, .50f);
+		cur->pctv[i].p95 = rtp_hist_percentile(&rs->histv[i], i, .95f);
+		cur->pctv[i].p99 = rtp_hist_percentile(&rs->histv[i], i, .99f);
 	}
+	cur->jitter = rs->jitter / 1000.0f;
+
+	publish(rs);
+
+	rs->byte_cnt = 0;
+	rs->packet_cnt = 0;
+	rs->frame_cnt = 0;
+}
+
+
+/* as rtp_stats_update(), with the arrival time given in [us] */
+void rtp_stats_update_at(struct rtp_stats *rs, const uint8_t *pkt,
+			 size_t len, uint64_t now)
+{
+	uint32_t ts;
+	uint16_t seq;
+
+	if (!rs || !pkt || len < RTP_HDR_SIZE)
+		return;
+
+	if ((pkt[1] & 0x7f) != rs->pt)
+		return;
+
+	seq = pkt[2] << 8 | pkt[3];
+	ts  = (uint32_t)pkt[4] << 24 | pkt[5] << 16 | pkt[6] << 8 | pkt[7];
 
 	if (rs->packet_cnt == 0) {
-		ztime_get(&rs->start_time);
-		if (rs->n == 0){
-			memcpy(&rs->prev_time, &rs->start_time,
-			       sizeof(struct ztime));
-		}
-		rs->start_seq_nr = get_seqnr(pkt, len);
+		rs->start_time = now;
+		rs->start_seq_nr = seq;
+	}
+
+	if (rs->prev_time) {
+		int64_t d;
+
+		/* difference in relative transit time, RFC 3550 A.8 */
+		d  = (int64_t)(now - rs->prev_time);
+		d -= (int64_t)(int32_t)(ts - rs->prev_ts) * 1000000
+			/ (int64_t)(rs->srate ? rs->srate : 1000);
+		if (d < 0)
+			d = -d;
+
+		rs->jitter += ((float)d - rs->jitter) / JITTER_GAIN;
+		hist_add(&rs->histv[RTP_HIST_JITTER], RTP_HIST_JITTER,
+			 rs->jitter / 1000.0f);
+
+		if (now - rs->prev_time > rs->dropout_thres_ms * 1000ULL)
+			++rs->cur.dropouts;
 	}
+
 	rs->byte_cnt += len;
 	rs->packet_cnt++;
-	if ( get_pt(pkt, len) == (rs->pt + (1 << 7)) ) {
+	if (pkt[1] == (rs->pt | 0x80))
 		rs->frame_cnt++;
-	}
 
-	struct ztime now;
-	ztime_get(&now);
-	int64_t diff_ms = ztime_diff(&now, &rs->prev_time);
-	if (diff_ms > rs->dropout_thres_ms){
-		rs->dropouts++;
-	}
-	memcpy(&rs->prev_time, &now, sizeof(struct ztime));
-	diff_ms = ztime_diff(&now, &rs->start_time);
-	if (diff_ms > INTERVAL_MS) {
-		float bit_rate = (float)((8*rs->byte_cnt)/diff_ms);
-		float frame_rate = (float)((rs->frame_cnt*1000)/diff_ms);
-		int expected_packets = get_seqnr(pkt, len) - rs->start_seq_nr;
-		if (expected_packets < 0) {
-			expected_packets += 0xffff;
-		}
-		expected_packets += 1;
-		float packet_rate = (float)((expected_packets*1000)/diff_ms);
-
-		int lost = expected_packets - rs->packet_cnt;
-		float loss_rate = 100.0f*(float)lost/(float)expected_packets;
-
-		rs->bit_rate_buf[rs->idx] = bit_rate;
-		rs->pkt_rate_buf[rs->idx] = packet_rate;
-		rs->pkt_loss_buf[rs->idx] = loss_rate;
-		rs->frame_cnt_buf[rs->idx] = frame_rate;
-
-		rs->idx++;
-		rs->idx &= CNT_MASK;
-		rs->n++;
-
-		calc_max_min_avg(rs->bit_rate_buf, rs->n, &rs->bit_rate_stats);
-		calc_max_min_avg(rs->pkt_rate_buf, rs->n, &rs->pkt_rate_stats);
-		calc_max_min_avg(rs->pkt_loss_buf, rs->n, &rs->pkt_loss_stats);
-		calc_max_min_avg(rs->frame_cnt_buf, rs->n,
-				 &rs->frame_rate_stats);
-
-		rs->byte_cnt = 0;
-		rs->packet_cnt = 0;
-		rs->frame_cnt = 0;
-	}
-	//unlock
+	rs->prev_time = now;
+	rs->prev_ts = ts;
+
+	if (now - rs->start_time > INTERVAL_MS * 1000ULL)
+		interval_end(rs, seq, now);
+}
+
+
+/*
+ * Called for every packet of the stream, always from the same thread.
+ * The clock is read once per packet.
+ */
+void rtp_stats_update(struct rtp_stats *rs, const uint8_t *pkt, size_t len)
+{
+	rtp_stats_update_at(rs, pkt, len, time_us());
+}
+
+
+/* may be called from any thread */
+void rtp_stats_snapshot(const struct rtp_stats *rs,
+			struct rtp_stats_snap *snap)
+{
+	uint32_t seq;
+
+	if (!rs || !snap)
+		return;
+
+	do {
+		seq = read_begin(rs);
+		*snap = rs->snap;
+	} while (read_retry(rs, seq));
 }
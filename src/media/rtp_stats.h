@@ -17,38 +17,82 @@
 */
 
 #include <stdint.h>
-#include "avs_ztime.h"
+#include <stddef.h>
 #include "avs_voe_stats.h"
 
 #define INTERVAL_MS 10000
-#define LOG2_NBUF 5
-#define NBUF (1 << LOG2_NBUF)
-#define CNT_MASK (NBUF-1)
 
-// We calculate statistics for last 320 seconds ie ~ 5 minutes
+/*
+ * Statistics of one RTP stream, updated by one thread per packet.
+ *
+ * Rates and loss are measured per INTERVAL_MS and kept as running
+ * min/max/avg and as fixed-bucket histograms for the whole stream.
+ * At the end of each interval they are published to a snapshot, which
+ * any thread can read with rtp_stats_snapshot() without locking.
+ */
 
-struct rtp_stats {
-	int byte_cnt;
-	int packet_cnt;
-	int frame_cnt;
-	int idx;
-	int n;
-	int pt;
-	int dropout_thres_ms;
-	float bit_rate_buf[NBUF];
-	float pkt_rate_buf[NBUF];
-	float pkt_loss_buf[NBUF];
-	float frame_cnt_buf[NBUF];
+enum rtp_hist_type {
+	RTP_HIST_JITTER = 0,  /* RFC 3550 jitter per packet [ms]        */
+	RTP_HIST_BITRATE,     /* bitrate per interval [kbit/s]          */
+	RTP_HIST_LOSS,        /* packet loss per interval [%]           */
+
+	RTP_HIST_NUM
+};
+
+enum {
+	RTP_HIST_BUCKETS = 16,
+};
+
+struct rtp_hist {
+	uint32_t cntv[RTP_HIST_BUCKETS];
+	uint32_t n;
+};
+
+struct rtp_percentiles {
+	float p50;
+	float p95;
+	float p99;
+};
+
+struct rtp_stats_snap {
 	struct max_min_avg bit_rate_stats;
 	struct max_min_avg pkt_rate_stats;
 	struct max_min_avg pkt_loss_stats;
 	struct max_min_avg frame_rate_stats;
+	struct rtp_percentiles pctv[RTP_HIST_NUM];
+	float jitter;         /* RFC 3550 interarrival jitter [ms] */
 	int dropouts;
-	uint16_t start_seq_nr;
-	struct ztime start_time;
-	struct ztime prev_time;
+	uint32_t intervals;
 };
 
-void rtp_stats_init(struct rtp_stats* rs, int pt, int dropout_thres_ms);
+struct rtp_stats {
+	/* writer side */
+	int pt;
+	uint32_t srate;
+	uint32_t dropout_thres_ms;
+	uint32_t byte_cnt;
+	uint32_t packet_cnt;
+	uint32_t frame_cnt;
+	uint16_t start_seq_nr;
+	uint64_t start_time;  /* [us] */
+	uint64_t prev_time;   /* [us] */
+	uint32_t prev_ts;
+	float jitter;         /* [us] */
+	float sumv[4];
+	struct rtp_hist histv[RTP_HIST_NUM];
+	struct rtp_stats_snap cur;
+
+	/* reader side */
+	uint32_t seq;
+	struct rtp_stats_snap snap;
+};
 
-void rtp_stats_update(struct rtp_stats* rs, const uint8_t *pkt, size_t len);
\ No newline at end of file
+void rtp_stats_init(struct rtp_stats *rs, int pt, uint32_t srate,
+		    int dropout_thres_ms);
+void rtp_stats_update(struct rtp_stats *rs, const uint8_t *pkt, size_t len);
+void rtp_stats_update_at(struct rtp_stats *rs, const uint8_t *pkt,
+			 size_t len, uint64_t now);
+void rtp_stats_snapshot(const struct rtp_stats *rs,
+			struct rtp_stats_snap *snap);
+float rtp_hist_percentile(const struct rtp_hist *hist,
+			  enum rtp_hist_type type, float p);
@@ -93,6 +93,147 @@ static void send_to_listeners(struct nevent *ne, struct json_object *pld)
 }
 
 
+static bool lsnr_wants(const struct nevent_lsnr *lsnr, const char *type)
+{
+	return lsnr->eventh && (!lsnr->type || streq(type, lsnr->type));
+}
+
+
+/* Pass one payload item to the listeners, the DOM only if one wants it */
+static void dispatch_item(struct nevent *ne, const struct pl *item)
+{
+	struct json_object *jobj = NULL;
+	struct jzon_reader r;
+	struct jzon_tok key, tok;
+	char buf[64];
+	const char *type = NULL;
+	struct le *le;
+	bool wanted = false;
+
+	jzon_reader_init(&r, item->p, item->l);
+
+	/* the item is known to be a valid object */
+	(void)jzon_next(&r, &tok);
+
+	while (0 == jzon_next(&r, &key) && key.type == JZON_KEY) {
+
+		if (jzon_next(&r, &tok))
+			break;
+
+		if (tok.type == JZON_STRING && !pl_strcmp(&key.pl, "type")) {
+			if (0 == jzon_tok_strcpy(buf, sizeof(buf), &tok))
+				type = buf;
+			break;
+		}
+
+		if (jzon_skip(&r, &tok))
+			break;
+	}
+
+	LIST_FOREACH(&ne->lsnrl, le) {
+		wanted = lsnr_wants(le->data, type);
+		if (wanted)
+			break;
+	}
+
+	if (!wanted)
+		return;
+
+	if (jzon_decode(&jobj, item->p, item->l)) {
+		warning("nevent: failed to parse item (%zu bytes)\n",
+			item->l);
+		return;
+	}
+
+	LIST_FOREACH(&ne->lsnrl, le) {
+		struct nevent_lsnr *lsnr = le->data;
+
+		if (lsnr_wants(lsnr, type))
+			lsnr->eventh(type, jobj, lsnr->arg);
+	}
+
+	mem_deref(jobj);
+}
+
+
+/*
+ * Find the "payload" array, and check that all of the text is valid
+ * before any of it is passed on.
+ */
+static int find_payload(struct pl *payload, const char *buf, size_t len)
+{
+	struct jzon_reader r;
+	struct jzon_tok key, tok;
+	bool found = false;
+	int err;
+
+	jzon_reader_init(&r, buf, len);
+
+	err = jzon_next(&r, &tok);
+	if (err)
+		return EBADMSG;
+
+	if (tok.type != JZON_OBJECT_BEGIN)
+		return jzon_skip(&r, &tok) ? EBADMSG : ENOENT;
+
+	while (0 == (err = jzon_next(&r, &key)) && key.type == JZON_KEY) {
+
+		err = jzon_next(&r, &tok);
+		if (err)
+			return err;
+
+		err = jzon_skip(&r, &tok);
+		if (err)
+			return err;
+
+		if (!found && tok.type == JZON_ARRAY_BEGIN &&
+		    !pl_strcmp(&key.pl, "payload")) {
+			*payload = tok.pl;
+			found = true;
+		}
+	}
+	if (err)
+		return err;
+
+	err = jzon_next(&r, &tok);
+	if (err != ENOENT)
+		return EBADMSG;
+
+	return found ? 0 : ENOENT;
+}
+
+
+static int recv_payload(struct nevent *ne, const char *buf, size_t len)
+{
+	struct jzon_reader r;
+	struct jzon_tok tok;
+	struct pl payload;
+	int err;
+
+	err = find_payload(&payload, buf, len);
+	if (err)
+		return err;
+
+	debug("%b\n", buf, len);
+
+	jzon_reader_init(&r, payload.p, payload.l);
+	(void)jzon_next(&r, &tok);
+
+	while (0 == jzon_next(&r, &tok) && tok.type != JZON_ARRAY_END) {
+
+		const bool object = tok.type == JZON_OBJECT_BEGIN;
+
+		if (jzon_skip(&r, &tok))
+			break;
+
+		if (object)
+			dispatch_item(ne, &tok.pl);
+	}
+
+	return 0;
+}
+
+
 static void websock_estab_handler(void *arg)
 {
 	struct nevent *ne = arg;
@@ -118,6 +259,13 @@ static void websock_recv_handler(const struct websock_hdr *hdr,
 		return;
 	}
 
+	/* without a handler for the whole message, only the items that
+	   the listeners want are decoded */
+	if (!ne->recvh && 0 == recv_payload(ne, (char *)mbuf_buf(mb), len))
+		return;
+
+	/* the whole message is needed, or it is not strict JSON */
+
 	err = jzon_decode(&jobj, (char *)mbuf_buf(mb), len);
 	if (err) {
 		warning("nevent: failed to parse JSON (%zu bytes)\n", len);
@@ -16,15 +16,264 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stddef.h>
 #include <string.h>
+#include <sched.h>
 #include <re.h>
 #include "avs_packetqueue.h"
 #include "avs_lockedqueue.h"
+#include "avs_semaphore.h"
+
+
+#define CACHE_LINE 64
+
+
+struct ring_slot {
+	size_t seq;
+	size_t pos;
+	struct packet_queue_slot pub;
+};
+
+/*
+ * Bounded ring with a sequence number per slot. A slot at position
+ * pos is free for a producer when seq == pos and ready for the
+ * consumer when seq == pos + 1. Producers claim positions with a CAS
+ * on head, the single consumer owns tail.
+ */
+struct ring {
+	size_t head;
+	uint8_t pad1[CACHE_LINE - sizeof(size_t)];
+	size_t tail;
+	uint8_t pad2[CACHE_LINE - sizeof(size_t)];
+
+	struct ring_slot *slotv;
+	uint8_t *data;
+	size_t mask;
+	struct avs_sem *sem;
+};
+
+struct packet_queue_t {
+	struct locked_queue_t *lq;
+	struct ring *ring;
+};
+
+
+static void ring_destructor(void *arg)
+{
+	struct ring *r = arg;
+
+	mem_deref(r->slotv);
+	mem_deref(r->data);
+	mem_deref(r->sem);
+}
+
+
+static void packet_queue_destructor(void *arg)
+{
+	struct packet_queue_t *q = arg;
+
+	mem_deref(q->lq);
+	mem_deref(q->ring);
+}
 
 
 int packet_queue_alloc(packet_queue_t **pqp, bool blocking)
 {
-	return locked_queue_alloc(pqp, blocking);
+	struct packet_queue_t *q;
+	int err;
+
+	if (!pqp)
+		return EINVAL;
+
+	q = mem_zalloc(sizeof(*q), packet_queue_destructor);
+	if (!q)
+		return ENOMEM;
+
+	err = locked_queue_alloc(&q->lq, blocking);
+	if (err)
+		mem_deref(q);
+	else
+		*pqp = q;
+
+	return err;
+}
+
+
+int packet_queue_alloc_ring(packet_queue_t **pqp, bool blocking,
+			    size_t nslots, size_t slot_size)
+{
+	struct packet_queue_t *q;
+	struct ring *r;
+	size_t i;
+	int err = 0;
+
+	if (!pqp || nslots < 2 || (nslots & (nslots - 1)) || !slot_size)
+		return EINVAL;
+
+	q = mem_zalloc(sizeof(*q), packet_queue_destructor);
+	if (!q)
+		return ENOMEM;
+
+	r = mem_zalloc(sizeof(*r), ring_destructor);
+	if (!r) {
+		err = ENOMEM;
+		goto out;
+	}
+	q->ring = r;
+
+	r->mask = nslots - 1;
+	r->slotv = mem_zalloc(nslots * sizeof(*r->slotv), NULL);
+	r->data = mem_alloc(nslots * slot_size, NULL);
+	if (!r->slotv || !r->data) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nslots; i++) {
+		r->slotv[i].seq = i;
+		r->slotv[i].pub.packet_data = r->data + i * slot_size;
+		r->slotv[i].pub.slot_size = slot_size;
+	}
+
+	if (blocking) {
+		err = avs_sem_alloc(&r->sem, 0);
+		if (err)
+			goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(q);
+	else
+		*pqp = q;
+
+	return err;
+}
+
+
+static inline struct ring_slot *ring_slot(struct packet_queue_slot *slot)
+{
+	return (struct ring_slot *)(void *)
+		((uint8_t *)slot - offsetof(struct ring_slot, pub));
+}
+
+
+int packet_queue_reserve(packet_queue_t *q, struct packet_queue_slot **slotp)
+{
+	struct ring *r;
+	struct ring_slot *s;
+	size_t pos;
+	intptr_t dif;
+
+	if (!q || !slotp)
+		return EINVAL;
+
+	r = q->ring;
+	if (!r)
+		return ENOTSUP;
+
+	pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	for (;;) {
+		s = &r->slotv[pos & r->mask];
+		dif = (intptr_t)__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)
+			- (intptr_t)pos;
+
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&r->head, &pos,
+							pos + 1, true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		}
+		else if (dif < 0) {
+			return ENOSPC;
+		}
+		else {
+			pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	s->pos = pos;
+	s->pub.packet_size = 0;
+	*slotp = &s->pub;
+
+	return 0;
+}
+
+
+int packet_queue_commit(packet_queue_t *q, struct packet_queue_slot *slot)
+{
+	struct ring_slot *s;
+
+	if (!q || !q->ring || !slot || slot->packet_size > slot->slot_size)
+		return EINVAL;
+
+	s = ring_slot(slot);
+	__atomic_store_n(&s->seq, s->pos + 1, __ATOMIC_RELEASE);
+
+	if (q->ring->sem)
+		avs_sem_post(q->ring->sem);
+
+	return 0;
+}
+
+
+int packet_queue_borrow(packet_queue_t *q, struct packet_queue_slot **slotp)
+{
+	struct ring *r;
+	struct ring_slot *s;
+	size_t pos;
+
+	if (!q || !slotp)
+		return EINVAL;
+
+	r = q->ring;
+	if (!r)
+		return ENOTSUP;
+
+	if (r->sem)
+		avs_sem_wait(r->sem);
+
+	pos = r->tail;
+	s = &r->slotv[pos & r->mask];
+
+	while (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+
+		/* A later slot may have been committed before this one;
+		 * its producer is still writing, so wait for it.
+		 */
+		if (!r->sem)
+			return ENODATA;
+
+		sched_yield();
+	}
+
+	s->pos = pos;
+	*slotp = &s->pub;
+
+	return 0;
+}
+
+
+int packet_queue_release(packet_queue_t *q, struct packet_queue_slot *slot)
+{
+	struct ring *r;
+	struct ring_slot *s;
+	size_t pos;
+
+	if (!q || !q->ring || !slot)
+		return EINVAL;
+
+	r = q->ring;
+	s = ring_slot(slot);
+
+	/* a producer may take the slot as soon as seq is stored */
+	pos = s->pos;
+	r->tail = pos + 1;
+
+	__atomic_store_n(&s->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+
+	return 0;
 }
 
 
@@ -38,6 +287,27 @@ static void packet_queue_item_destructor(void *arg)
 }
 
 
+static int ring_push(packet_queue_t *q, packet_type_t packet_type,
+		     const uint8_t *packet_data, size_t packet_size)
+{
+	struct packet_queue_slot *slot;
+	int err;
+
+	if (packet_size > q->ring->slotv[0].pub.slot_size)
+		return EMSGSIZE;
+
+	err = packet_queue_reserve(q, &slot);
+	if (err)
+		return err;
+
+	memcpy(slot->packet_data, packet_data, packet_size);
+	slot->packet_type = packet_type;
+	slot->packet_size = packet_size;
+
+	return packet_queue_commit(q, slot);
+}
+
+
 int packet_queue_push(packet_queue_t* q, packet_type_t packet_type,
 		      const uint8_t *packet_data, size_t packet_size)
 {
@@ -46,6 +316,9 @@ int packet_queue_push(packet_queue_t* q, packet_type_t packet_type,
 	if (!q || !packet_data || !packet_size)
 		return EINVAL;
 
+	if (q->ring)
+		return ring_push(q, packet_type, packet_data, packet_size);
+
 	item = mem_zalloc(sizeof(*item), packet_queue_item_destructor);
 	if (!item)
 		return ENOMEM;
@@ -59,7 +332,35 @@ int packet_queue_push(packet_queue_t* q, packet_type_t packet_type,
 	item->packet_size = packet_size;
 	memcpy(item->packet_data, packet_data, packet_size);
 
-	return locked_queue_push(q, &item->list_elem, item);
+	return locked_queue_push(q->lq, &item->list_elem, item);
+}
+
+
+static int ring_pop(packet_queue_t *q, packet_type_t *packet_type,
+		    uint8_t **packet_data, size_t *packet_size)
+{
+	struct packet_queue_slot *slot;
+	uint8_t *data;
+	int err;
+
+	err = packet_queue_borrow(q, &slot);
+	if (err)
+		return err;
+
+	data = mem_alloc(slot->packet_size, NULL);
+	if (!data) {
+		err = ENOMEM;
+	}
+	else {
+		memcpy(data, slot->packet_data, slot->packet_size);
+		*packet_data = data;
+		*packet_size = slot->packet_size;
+		*packet_type = slot->packet_type;
+	}
+
+	packet_queue_release(q, slot);
+
+	return err;
 }
 
 
@@ -73,7 +374,10 @@ int packet_queue_pop(packet_queue_t* q, packet_type_t *packet_type,
 	if (!q)
 		return EINVAL;
 
-	err = locked_queue_pop(q, &list_elem);
+	if (q->ring)
+		return ring_pop(q, packet_type, packet_data, packet_size);
+
+	err = locked_queue_pop(q->lq, &list_elem);
 	if (err != 0) {
 		return err;
 	}
@@ -91,4 +395,3 @@ int packet_queue_pop(packet_queue_t* q, packet_type_t *packet_type,
 
 	return 0;
 }
-
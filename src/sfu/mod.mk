@@ -0,0 +1,5 @@
+#
+# mod.mk
+#
+
+AVS_SRCS += sfu/sfu.c
@@ -0,0 +1,600 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_media.h"
+#include "avs_sfu.h"
+
+
+/*
+ * Every RTP stream a participant sends is forwarded to all the other
+ * participants under an SSRC that is unique within the SFU, so that a
+ * receiver never sees two sources collide. Sequence numbers and
+ * timestamps are left alone -- each forwarded SSRC has exactly one
+ * source, so they stay consistent per stream.
+ *
+ * RTCP is terminated: reports, SDES and BYE only describe one hop.
+ * Feedback is mapped back to the source of the stream it is about:
+ *
+ *   - Keyframe requests (PLI and FIR) are sent on as a single PLI, at
+ *     most once per SFU_KEYFRAME_INTERVAL.
+ *   - NACKs are sent on as they are. The SFU keeps no packets, and the
+ *     sequence numbers it forwards are the source's own.
+ *   - REMB estimates of all receivers are combined into the lowest one.
+ *     A lower estimate is sent on at once, a higher one at most once
+ *     per SFU_REMB_INTERVAL.
+ *
+ * A participant has at most SFU_MAX_SRCS sources. Sources that have
+ * been quiet for SFU_SRC_TIMEOUT make room for new ones, packets of
+ * further SSRCs are dropped.
+ */
+
+
+enum {
+	RTP_MIN_SIZE  = 12,
+	RTCP_FB_SIZE  = 12,
+	PSFB_FIR      = 4,     /* RFC 5104 */
+	FIR_FCI_SIZE  = 8,
+	REMB_MIN_SIZE = 20,    /* draft-alvestrand-rmcat-remb, no SSRCs */
+	REMB_FCI_SIZE = 12,    /* with one SSRC */
+};
+
+
+/* writes the FCI of a feedback message, as for rtcp_encode() */
+typedef int (fci_encode_h)(struct mbuf *mb, void *arg);
+
+struct sfu {
+	struct list partl;     /* struct sfu_part */
+	uint32_t ssrc;         /* sender SSRC of SFU-originated RTCP */
+	struct sfu_stats stats;
+};
+
+struct sfu_part {
+	struct le le;
+	struct sfu *sfu;
+	struct mediaflow *mf;  /* pointer, owned by the application */
+	struct list srcl;      /* struct sfu_src, streams sent by this part */
+};
+
+struct sfu_src {
+	struct le le;
+	struct sfu_part *part;
+	uint32_t ssrc;         /* as sent by the participant */
+	uint32_t fwd_ssrc;     /* as forwarded to the others */
+	uint64_t ts_rtp;       /* last packet from the participant */
+	uint64_t ts_kfreq;     /* last keyframe request to the participant */
+	uint64_t ts_remb;      /* last REMB to the participant */
+	uint64_t remb_sent;    /* bitrate of that REMB [bit/s] */
+	uint64_t remb_min;     /* lowest estimate since then, 0 if none */
+};
+
+
+static struct sfu_src *src_find_fwd(const struct sfu *sfu, uint32_t ssrc)
+{
+	struct le *le, *lf;
+
+	LIST_FOREACH(&sfu->partl, le) {
+		const struct sfu_part *part = le->data;
+
+		LIST_FOREACH(&part->srcl, lf) {
+			struct sfu_src *src = lf->data;
+
+			if (src->fwd_ssrc == ssrc)
+				return src;
+		}
+	}
+
+	return NULL;
+}
+
+
+static struct sfu_src *src_find(const struct sfu_part *part, uint32_t ssrc)
+{
+	struct le *le;
+
+	LIST_FOREACH(&part->srcl, le) {
+		struct sfu_src *src = le->data;
+
+		if (src->ssrc == ssrc)
+			return src;
+	}
+
+	return NULL;
+}
+
+
+/* make room for a new source, false if the participant is at its limit */
+static bool src_prune(struct sfu_part *part, uint64_t now)
+{
+	struct le *le = part->srcl.head;
+
+	while (le) {
+		struct sfu_src *src = le->data;
+
+		le = le->next;
+
+		if (now <= src->ts_rtp + SFU_SRC_TIMEOUT)
+			continue;
+
+		info("sfu: source ssrc=%08x timed out\n", src->ssrc);
+
+		list_unlink(&src->le);
+		mem_deref(src);
+	}
+
+	return list_count(&part->srcl) < SFU_MAX_SRCS;
+}
+
+
+static int src_add(struct sfu_src **srcp, struct sfu_part *part,
+		   uint32_t ssrc)
+{
+	struct sfu_src *src;
+	uint32_t fwd_ssrc;
+
+	do {
+		fwd_ssrc = rand_u32();
+	} while (!fwd_ssrc || fwd_ssrc == part->sfu->ssrc ||
+		 src_find_fwd(part->sfu, fwd_ssrc));
+
+	src = mem_zalloc(sizeof(*src), NULL);
+	if (!src)
+		return ENOMEM;
+
+	src->part     = part;
+	src->ssrc     = ssrc;
+	src->fwd_ssrc = fwd_ssrc;
+
+	list_append(&part->srcl, &src->le, src);
+
+	info("sfu: new source ssrc=%08x forwarded as %08x\n",
+	     ssrc, fwd_ssrc);
+
+	*srcp = src;
+
+	return 0;
+}
+
+
+static void forward_rtp(struct sfu_part *from, const struct sfu_src *src,
+			const struct mbuf *mb)
+{
+	struct sfu *sfu = from->sfu;
+	const uint8_t *pkt = mbuf_buf(mb);
+	size_t len = mbuf_get_left(mb);
+	struct le *le;
+
+	LIST_FOREACH(&sfu->partl, le) {
+		struct sfu_part *part = le->data;
+		struct mbuf *mbo;
+		size_t pos;
+		int err;
+
+		if (part == from || !mediaflow_is_ready(part->mf))
+			continue;
+
+		/* a copy per receiver, SRTP encrypts it in place */
+		mbo = mediaflow_txbuf_alloc(part->mf, len);
+		if (!mbo)
+			return;
+
+		pos = mbo->pos;
+		(void)mbuf_write_mem(mbo, pkt, len);
+		mbo->pos = pos;
+
+		mbo->buf[pos + 8]  = src->fwd_ssrc >> 24;
+		mbo->buf[pos + 9]  = src->fwd_ssrc >> 16;
+		mbo->buf[pos + 10] = src->fwd_ssrc >> 8;
+		mbo->buf[pos + 11] = src->fwd_ssrc;
+
+		err = mediaflow_send_rtp_mbuf(part->mf, mbo);
+		if (err) {
+			warning("sfu: forward %zu bytes failed (%m)\n",
+				len, err);
+		}
+		else {
+			++sfu->stats.n_rtp_sent;
+		}
+
+		mem_deref(mbo);
+	}
+}
+
+
+static void handle_rtp(struct sfu_part *part, const struct mbuf *mb)
+{
+	const uint8_t *p = mbuf_buf(mb);
+	struct sfu_src *src;
+	uint64_t now;
+	uint32_t ssrc;
+
+	if (mbuf_get_left(mb) < RTP_MIN_SIZE || (p[0] >> 6) != RTP_VERSION)
+		return;
+
+	++part->sfu->stats.n_rtp_recv;
+
+	ssrc = (uint32_t)p[8] << 24 | p[9] << 16 | p[10] << 8 | p[11];
+	now = tmr_jiffies();
+
+	src = src_find(part, ssrc);
+	if (!src) {
+		if (!src_prune(part, now)) {
+			++part->sfu->stats.n_rtp_dropped;
+			return;
+		}
+
+		if (src_add(&src, part, ssrc))
+			return;
+	}
+
+	src->ts_rtp = now;
+
+	forward_rtp(part, src, mb);
+}
+
+
+/* send a feedback message from the SFU to the participant of src */
+static int send_fb(const struct sfu_src *src, enum rtcp_type type,
+		   uint32_t fmt, uint32_t media_ssrc, size_t fci_len,
+		   fci_encode_h *ench, void *arg)
+{
+	struct mediaflow *mf = src->part->mf;
+	struct mbuf *mb;
+	size_t pos;
+	int err;
+
+	if (!mediaflow_is_ready(mf))
+		return ENOTCONN;
+
+	mb = mediaflow_txbuf_alloc(mf, RTCP_FB_SIZE + fci_len);
+	if (!mb)
+		return ENOMEM;
+
+	pos = mb->pos;
+	err = rtcp_encode(mb, type, fmt, src->part->sfu->ssrc, media_ssrc,
+			  ench, arg);
+	if (err)
+		goto out;
+
+	mb->pos = pos;
+
+	err = mediaflow_send_rtcp_mbuf(mf, mb);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static void keyframe_request(struct sfu *sfu, uint32_t fwd_ssrc)
+{
+	struct sfu_src *src;
+	uint64_t now;
+	int err;
+
+	++sfu->stats.n_kfreq_recv;
+
+	src = src_find_fwd(sfu, fwd_ssrc);
+	if (!src)
+		return;
+
+	/* the first request is always sent on */
+	now = tmr_jiffies();
+	if (src->ts_kfreq && now < src->ts_kfreq + SFU_KEYFRAME_INTERVAL)
+		return;
+
+	err = send_fb(src, RTCP_PSFB, RTCP_PSFB_PLI, src->ssrc, 0,
+		      NULL, NULL);
+	if (err) {
+		warning("sfu: send PLI to ssrc=%08x failed (%m)\n",
+			src->ssrc, err);
+		return;
+	}
+
+	src->ts_kfreq = now;
+	++sfu->stats.n_kfreq_sent;
+}
+
+
+static uint32_t read_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+
+static int fci_encode(struct mbuf *mb, void *arg)
+{
+	const struct pl *fci = arg;
+
+	return mbuf_write_pl(mb, fci);
+}
+
+
+static void nack_forward(struct sfu *sfu, const uint8_t *p, size_t len)
+{
+	struct sfu_src *src;
+	struct pl fci;
+	int err;
+
+	++sfu->stats.n_nack_recv;
+
+	src = src_find_fwd(sfu, read_u32(p + 8));
+	if (!src)
+		return;
+
+	fci.p = (const char *)p + RTCP_FB_SIZE;
+	fci.l = len - RTCP_FB_SIZE;
+
+	err = send_fb(src, RTCP_RTPFB, RTCP_RTPFB_GNACK, src->ssrc, fci.l,
+		      fci_encode, &fci);
+	if (err) {
+		warning("sfu: send NACK to ssrc=%08x failed (%m)\n",
+			src->ssrc, err);
+		return;
+	}
+
+	++sfu->stats.n_nack_sent;
+}
+
+
+static int remb_encode(struct mbuf *mb, void *arg)
+{
+	const struct sfu_src *src = arg;
+	uint64_t mantissa = src->remb_min;
+	uint8_t exp = 0;
+	int err;
+
+	while (mantissa > 0x3ffff) {
+		mantissa >>= 1;
+		++exp;
+	}
+
+	err  = mbuf_write_str(mb, "REMB");
+	err |= mbuf_write_u8(mb, 1);
+	err |= mbuf_write_u8(mb, exp << 2 | (uint8_t)(mantissa >> 16));
+	err |= mbuf_write_u16(mb, htons((uint16_t)mantissa));
+	err |= mbuf_write_u32(mb, htonl(src->ssrc));
+
+	return err;
+}
+
+
+static void remb_update(struct sfu *sfu, uint32_t fwd_ssrc,
+			uint64_t bitrate, uint64_t now)
+{
+	struct sfu_src *src;
+	int err;
+
+	src = src_find_fwd(sfu, fwd_ssrc);
+	if (!src)
+		return;
+
+	if (!src->remb_min || bitrate < src->remb_min)
+		src->remb_min = bitrate;
+
+	if (src->ts_remb && src->remb_min >= src->remb_sent &&
+	    now < src->ts_remb + SFU_REMB_INTERVAL)
+		return;
+
+	err = send_fb(src, RTCP_PSFB, RTCP_PSFB_AFB, 0, REMB_FCI_SIZE,
+		      remb_encode, src);
+	if (err) {
+		warning("sfu: send REMB to ssrc=%08x failed (%m)\n",
+			src->ssrc, err);
+		return;
+	}
+
+	src->ts_remb   = now;
+	src->remb_sent = src->remb_min;
+	src->remb_min  = 0;
+	++sfu->stats.n_remb_sent;
+}
+
+
+static bool is_remb(const uint8_t *p, size_t len)
+{
+	return len >= REMB_MIN_SIZE && 0 == memcmp(p + 12, "REMB", 4) &&
+		len >= REMB_MIN_SIZE + 4 * (size_t)p[16];
+}
+
+
+static void remb_handler(struct sfu *sfu, const uint8_t *p)
+{
+	const uint8_t exp = p[17] >> 2;
+	const uint64_t mantissa = (uint64_t)(p[17] & 0x3) << 16 |
+		p[18] << 8 | p[19];
+	const uint64_t now = tmr_jiffies();
+	size_t i;
+
+	++sfu->stats.n_remb_recv;
+
+	for (i = 0; i < p[16]; i++) {
+		remb_update(sfu, read_u32(p + REMB_MIN_SIZE + 4 * i),
+			    mantissa << exp, now);
+	}
+}
+
+
+static void handle_rtcp(struct sfu_part *part, const struct mbuf *mb)
+{
+	struct sfu *sfu = part->sfu;
+	const uint8_t *p = mbuf_buf(mb);
+	size_t left = mbuf_get_left(mb);
+
+	++sfu->stats.n_rtcp_recv;
+
+	/* walk the compound packet */
+	while (left >= 4) {
+		uint8_t fmt = p[0] & 0x1f;
+		uint8_t pt  = p[1];
+		size_t len = 4 * ((size_t)(p[2] << 8 | p[3]) + 1);
+		size_t i;
+
+		if ((p[0] >> 6) != RTCP_VERSION || len > left)
+			break;
+
+		if (pt == RTCP_PSFB && fmt == RTCP_PSFB_PLI &&
+		    len >= RTCP_FB_SIZE) {
+
+			keyframe_request(sfu, read_u32(p + 8));
+		}
+		else if (pt == RTCP_PSFB && fmt == PSFB_FIR) {
+
+			for (i = RTCP_FB_SIZE;
+			     i + FIR_FCI_SIZE <= len;
+			     i += FIR_FCI_SIZE) {
+
+				keyframe_request(sfu, read_u32(p + i));
+			}
+		}
+		else if (pt == RTCP_RTPFB && fmt == RTCP_RTPFB_GNACK &&
+			 len > RTCP_FB_SIZE) {
+
+			nack_forward(sfu, p, len);
+		}
+		else if (pt == RTCP_PSFB && fmt == RTCP_PSFB_AFB &&
+			 is_remb(p, len)) {
+
+			remb_handler(sfu, p);
+		}
+		else {
+			++sfu->stats.n_rtcp_dropped;
+		}
+
+		p    += len;
+		left -= len;
+	}
+}
+
+
+static bool packet_handler(const struct sa *src, struct mbuf *mb,
+			   bool rtcp, void *arg)
+{
+	struct sfu_part *part = arg;
+	(void)src;
+
+	if (rtcp)
+		handle_rtcp(part, mb);
+	else
+		handle_rtp(part, mb);
+
+	return true;  /* never reaches the local codecs */
+}
+
+
+static void part_destructor(void *arg)
+{
+	struct sfu_part *part = arg;
+
+	mediaflow_set_packet_handler(part->mf, NULL, NULL);
+
+	list_flush(&part->srcl);
+	list_unlink(&part->le);
+}
+
+
+static void destructor(void *arg)
+{
+	struct sfu *sfu = arg;
+	struct le *le;
+
+	/* participants are owned by the application */
+	le = sfu->partl.head;
+	while (le) {
+		struct sfu_part *part = le->data;
+
+		le = le->next;
+
+		mediaflow_set_packet_handler(part->mf, NULL, NULL);
+		list_unlink(&part->le);
+		part->sfu = NULL;
+	}
+}
+
+
+int sfu_alloc(struct sfu **sfup)
+{
+	struct sfu *sfu;
+
+	if (!sfup)
+		return EINVAL;
+
+	sfu = mem_zalloc(sizeof(*sfu), destructor);
+	if (!sfu)
+		return ENOMEM;
+
+	list_init(&sfu->partl);
+	sfu->ssrc = rand_u32();
+
+	*sfup = sfu;
+
+	return 0;
+}
+
+
+/*
+ * Add a participant. The SFU takes over all incoming RTP/RTCP of the
+ * mediaflow; media must not be started on it. Dereference the
+ * participant before the mediaflow.
+ */
+int sfu_add(struct sfu_part **partp, struct sfu *sfu,
+	    struct mediaflow *mf)
+{
+	struct sfu_part *part;
+
+	if (!partp || !sfu || !mf)
+		return EINVAL;
+
+	part = mem_zalloc(sizeof(*part), part_destructor);
+	if (!part)
+		return ENOMEM;
+
+	part->sfu = sfu;
+	part->mf  = mf;
+	list_init(&part->srcl);
+
+	list_append(&sfu->partl, &part->le, part);
+
+	mediaflow_set_packet_handler(mf, packet_handler, part);
+
+	*partp = part;
+
+	return 0;
+}
+
+
+/* The SSRC under which a participant's stream is forwarded, or 0 */
+uint32_t sfu_part_ssrc(const struct sfu_part *part, uint32_t ssrc)
+{
+	const struct sfu_src *src;
+
+	if (!part)
+		return 0;
+
+	src = src_find(part, ssrc);
+
+	return src ? src->fwd_ssrc : 0;
+}
+
+
+const struct sfu_stats *sfu_stats(const struct sfu *sfu)
+{
+	return sfu ? &sfu->stats : NULL;
+}
@@ -362,6 +362,16 @@ void vie_capture_stop(struct videnc_state *ves)
 	_send_state = FLOWMGR_VIDEO_SEND_NONE;
 }
 
+void vie_enc_settx(struct videnc_state *ves,
+		   videnc_txbuf_h *txbufh, videnc_tx_h *txh)
+{
+	if (!ves)
+		return;
+
+	ves->txbufh = txbufh;
+	ves->txh = txh;
+}
+
 void vie_capture_hold(struct videnc_state *ves, bool hold)
 {
 #if 0
@@ -29,6 +29,27 @@
 #include "webrtc/video_encoder.h"
 #include "vie.h"
 
+/* the packet from the engine is copied once, into the send buffer */
+static int send_mbuf(struct videnc_state *ves,
+		     const uint8_t *packet, size_t length)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = ves->txbufh(length, ves->arg);
+	if (!mb)
+		return ENOMEM;
+
+	(void)mbuf_write_mem(mb, packet, length);
+	mb->pos -= length;
+
+	err = ves->txh(mb, ves->arg);
+
+	mem_deref(mb);
+
+	return err;
+}
+
 ViETransport::ViETransport(struct vie *vie_) : vie(vie_), active(true)
 {
 }
@@ -55,8 +76,11 @@ bool ViETransport::SendRtp(const uint8_t* packet, size_t length,
     
 	stats_rtp_add_packet(&vie->stats_tx, packet, length);
 
-	if (ves->rtph) {
-		err = ves->rtph(packet, length, ves->arg);
+	if (ves->txh || ves->rtph) {
+		if (ves->txh)
+			err = send_mbuf(ves, packet, length);
+		else
+			err = ves->rtph(packet, length, ves->arg);
 		if (err) {
 			warning("vie: rtp send failed (%m)\n", err);
 			return -1;
@@ -90,8 +114,11 @@ bool ViETransport::SendRtcp(const uint8_t* packet, size_t length)
 
 	stats_rtcp_add_packet(&vie->stats_tx, packet, length);
 
-	if (ves->rtcph) {
-		err = ves->rtcph(packet, length, ves->arg);
+	if (ves->txh || ves->rtcph) {
+		if (ves->txh)
+			err = send_mbuf(ves, packet, length);
+		else
+			err = ves->rtcph(packet, length, ves->arg);
 		if (err) {
 			warning("vie: rtcp send failed (%m)\n", err);
 			return -1;
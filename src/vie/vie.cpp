@@ -61,6 +61,7 @@ static struct vidcodec vie_vidcodecv[NUM_CODECS] = {
 		.enc_starth   = vie_capture_start,
 		.enc_stoph    = vie_capture_stop,
 		.enc_holdh    = vie_capture_hold,
+		.enc_settxh   = vie_enc_settx,
 
 		.dec_alloch   = vie_dec_alloc,
 		.dec_starth   = vie_render_start,
@@ -109,6 +110,8 @@ void vie_close(void)
 	}
 	vie_capture_router_deinit();
 
+	vid_eng.wd = (struct watchdog *)mem_deref(vid_eng.wd);
+
 	if (vid_eng.codecs) {
 		delete [] vid_eng.codecs;
 		vid_eng.codecs = NULL;
@@ -189,6 +192,10 @@ int vie_init(struct list *vidcodecl)
 
 	list_init(&vid_eng.chl);
 
+	err = watchdog_alloc(&vid_eng.wd, VIE_RENDERER_TIMEOUT_LIMIT / 10);
+	if (err)
+		goto out;
+
 	err = vie_capture_router_init();
 	if (err)
 		goto out;
@@ -103,6 +103,8 @@ struct videnc_state {
 
 	videnc_rtp_h *rtph;
 	videnc_rtcp_h *rtcph;
+	videnc_txbuf_h *txbufh;
+	videnc_tx_h *txh;
 	videnc_err_h *errh;
 	void *arg;
 
@@ -122,6 +124,8 @@ int  vie_enc_alloc(struct videnc_state **vesp,
 int  vie_capture_start(struct videnc_state *ves);
 void vie_capture_stop(struct videnc_state *ves);
 void vie_capture_hold(struct videnc_state *ves, bool hold);
+void vie_enc_settx(struct videnc_state *ves,
+		   videnc_txbuf_h *txbufh, videnc_tx_h *txh);
 
 void vie_frame_handler(webrtc::VideoFrame *frame, void *arg);
 
@@ -226,6 +230,8 @@ struct vid_eng {
 	bool renderer_reset;
 	bool capture_reset;
 
+	struct watchdog *wd;  /* renderer frame timeouts */
+
 	flowmgr_video_state_change_h *state_change_h;
 	flowmgr_render_frame_h *render_frame_h;
 	flowmgr_video_size_h *size_h;
@@ -38,12 +38,14 @@ ViERenderer::ViERenderer()
 	: _state(VIE_RENDERER_STATE_STOPPED)
 {
 	lock_alloc(&_lock);
-	tmr_init(&_timer);
+	memset(&_deadline, 0, sizeof(_deadline));
+	watchdog_add(vid_eng.wd, &_deadline, VIE_RENDERER_TIMEOUT_LIMIT,
+		     frame_timeout_timer, this);
 }
 
 ViERenderer::~ViERenderer()
 {
-	tmr_cancel(&_timer);
+	watchdog_remove(&_deadline);
 	if (_state == VIE_RENDERER_STATE_RUNNING) {
 		if (vid_eng.state_change_h) {
 			vid_eng.state_change_h(FLOWMGR_VIDEO_RECEIVE_STOPPED,
@@ -67,10 +69,11 @@ void ViERenderer::OnFrame(const webrtc::VideoFrame& video_frame)
 		_state = VIE_RENDERER_STATE_RUNNING;
 	}
 
-	tmr_cancel(&_timer);
-	tmr_start(&_timer, VIE_RENDERER_TIMEOUT_LIMIT, frame_timeout_timer, this);
 	lock_rel(_lock);
 
+	/* swept on the re thread, no timer restart per frame */
+	watchdog_touch(&_deadline);
+
 
 	if (!vid_eng.render_frame_h)
 		return;
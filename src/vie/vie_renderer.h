@@ -24,6 +24,7 @@
 #include "webrtc/media/base/videosinkinterface.h"
 //#include "webrtc/modules/video_render/include/video_render.h"
 #include <re.h>
+#include <avs_watchdog.h>
 
 enum ViERendererState {
 	VIE_RENDERER_STATE_STOPPED = 0,
@@ -44,7 +45,7 @@ public:
 private:
 	enum ViERendererState _state;
 	lock *_lock;
-	struct tmr _timer;
+	struct watchdog_deadline _deadline;
 };
 
 #endif
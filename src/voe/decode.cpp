@@ -52,7 +52,7 @@ static void ads_destructor(void *arg)
 	debug("voe: ads_destructor: %p ve=%p(%d)\n",
 	      ads, ads->ve, mem_nrefs(ads->ve));
 
-	tmr_cancel(&ads->tmr_rtp_timeout);
+	watchdog_remove(&ads->rtp_deadline);
     
 	voe_dec_stop(ads);
 
@@ -102,7 +102,8 @@ int voe_dec_alloc(struct audec_state **adsp,
 	ads->errh = errh;
 	ads->arg = arg;
     
-	tmr_init(&ads->tmr_rtp_timeout);
+	watchdog_add(gvoe.wd, &ads->rtp_deadline, RTP_TIMEOUT_MS,
+		     voe_rtp_timeout_handler, ads);
 
  out:
 	if (err) {
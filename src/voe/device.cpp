@@ -48,12 +48,30 @@ int voe_set_mute(bool mute)
 {
 	int err = 0;
     
-    gvoe.isMuted = mute;
+    __atomic_store_n(&gvoe.isMuted, mute, __ATOMIC_RELAXED);
     
     return voe_update_mute(&gvoe);
 }
 
 
+/*
+ * The mute state that voe applies to all channels, without asking the
+ * engine; unlike voe_get_mute() it may be called from any thread.
+ */
+int voe_get_mute_state(bool *muted)
+{
+	if (!muted)
+		return EINVAL;
+
+	if (!__atomic_load_n(&gvoe.volume, __ATOMIC_ACQUIRE))
+		return ENOSYS;
+
+	*muted = __atomic_load_n(&gvoe.isMuted, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+
 int voe_get_mute(bool *muted)
 {
 	int err;
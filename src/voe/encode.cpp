@@ -53,7 +53,12 @@ static void aes_destructor(void *arg)
 
 	voe_enc_stop(aes);
 
+	/* a fan-out on the engine thread may still be using it */
+	pthread_mutex_lock(&gvoe.enc.mutex);
 	list_unlink(&aes->le);
+	while (gvoe.enc.busy)
+		pthread_cond_wait(&gvoe.enc.cond, &gvoe.enc.mutex);
+	pthread_mutex_unlock(&gvoe.enc.mutex);
 
 	mem_deref(aes->ve);
 }
@@ -94,8 +99,6 @@ int voe_enc_alloc(struct auenc_state **aesp,
 		*mctxp = (struct media_ctx *)aes->ve;
 	}
 
-	list_append(&gvoe.encl, &aes->le, aes);
-
 	aes->ve->aes = aes;
 	aes->ac = ac;
 	aes->rtph = rtph;
@@ -103,6 +106,12 @@ int voe_enc_alloc(struct auenc_state **aesp,
 	aes->pkth = pkth;
 	aes->errh = errh;
 	aes->arg = arg;
+	aes->ssrc = prm->local_ssrc;
+	aes->seq = rand_u16();
+
+	pthread_mutex_lock(&gvoe.enc.mutex);
+	list_append(&gvoe.encl, &aes->le, aes);
+	pthread_mutex_unlock(&gvoe.enc.mutex);
 
 	if(gvoe.rtp_rtcp){
 		gvoe.rtp_rtcp->SetLocalSSRC(aes->ve->ch, prm->local_ssrc);
@@ -122,12 +131,28 @@ int voe_enc_alloc(struct auenc_state **aesp,
 
 int voe_enc_start(struct auenc_state *aes)
 {
+	int owner_ch = -1;
+
 	if (!aes)
 		return EINVAL;
 
-	info("voe: starting encoder -- StartSend ch %d \n", aes->ve->ch);
-
+	pthread_mutex_lock(&gvoe.enc.mutex);
 	aes->started = true;
+	if (gvoe.enc.enabled) {
+		if (gvoe.enc.owner)
+			owner_ch = gvoe.enc.owner->ve->ch;
+		else
+			gvoe.enc.owner = aes;
+	}
+	pthread_mutex_unlock(&gvoe.enc.mutex);
+
+	if (owner_ch >= 0) {
+		info("voe: starting encoder -- ch %d shares ch %d\n",
+		     aes->ve->ch, owner_ch);
+		return 0;
+	}
+
+	info("voe: starting encoder -- StartSend ch %d \n", aes->ve->ch);
 
 	if (gvoe.base){
 		gvoe.base->StartSend(aes->ve->ch);
@@ -139,15 +164,229 @@ int voe_enc_start(struct auenc_state *aes)
 
 void voe_enc_stop(struct auenc_state *aes)
 {
+	struct auenc_state *next = NULL;
+	struct le *le;
+
 	if (!aes)
 		return;
 
+	pthread_mutex_lock(&gvoe.enc.mutex);
 	aes->started = false;
+	if (gvoe.enc.owner == aes) {
+
+		/* hand the encoding over to another started channel */
+		LIST_FOREACH(&gvoe.encl, le) {
+			struct auenc_state *a = (struct auenc_state *)le->data;
+
+			if (!a->started)
+				continue;
+
+			a->resync = true;
+			if (!next)
+				next = a;
+		}
+
+		gvoe.enc.owner = next;
+	}
+	pthread_mutex_unlock(&gvoe.enc.mutex);
 
 	if (gvoe.base){
 		info("voe: stopping encoder -- StopSend ch %d \n",
 		     aes->ve->ch);
 
 		gvoe.base->StopSend(aes->ve->ch);
+
+		if (next) {
+			info("voe: shared encoder moves to ch %d\n",
+			     next->ve->ch);
+			gvoe.base->StartSend(next->ve->ch);
+		}
+	}
+}
+
+
+void voe_enc_settx(struct auenc_state *aes,
+		   auenc_txbuf_h *txbufh, auenc_tx_h *txh)
+{
+	if (!aes)
+		return;
+
+	aes->txbufh = txbufh;
+	aes->txh = txh;
+}
+
+
+/*
+ * Shared encoder
+ *
+ * In a group call every flow would otherwise run its own VoE channel
+ * and encode the same microphone signal. With the shared encoder only
+ * the owner's channel sends, and each packet it produces is copied to
+ * all started encoders with their own SSRC, sequence number and
+ * timestamp. SRTP is still done per flow, by the transmit handler.
+ */
+
+
+struct fanout_dst {
+	struct auenc_state *aes;
+	uint16_t seq;
+	uint32_t ts;
+	bool marker;
+};
+
+
+int voe_enable_shared_encoder(bool enable)
+{
+	struct le *le;
+	int err = 0;
+
+	pthread_mutex_lock(&gvoe.enc.mutex);
+
+	LIST_FOREACH(&gvoe.encl, le) {
+		const struct auenc_state *aes =
+			(struct auenc_state *)le->data;
+
+		if (aes->started) {
+			err = EBUSY;
+			goto out;
+		}
+	}
+
+	gvoe.enc.enabled = enable;
+
+ out:
+	pthread_mutex_unlock(&gvoe.enc.mutex);
+
+	if (err) {
+		warning("voe: shared encoder cannot be changed"
+			" while sending\n");
+	}
+
+	return err;
+}
+
+
+/* called with gvoe.enc.mutex held */
+static void fanout_header(struct fanout_dst *dst, uint32_t ts)
+{
+	struct auenc_state *aes = dst->aes;
+
+	dst->marker = false;
+
+	if (aes->resync) {
+		/* continue right after the last packet of the old owner */
+		if (aes->sent)
+			aes->ts_off = aes->ts_last + aes->ts_delta - ts;
+
+		aes->resync = false;
+		dst->marker = true;
+	}
+	else if (aes->sent) {
+		aes->ts_delta = ts + aes->ts_off - aes->ts_last;
 	}
+
+	dst->seq = aes->seq++;
+	dst->ts  = ts + aes->ts_off;
+
+	aes->ts_last = dst->ts;
+	aes->sent = true;
+}
+
+
+static int fanout_send(const struct fanout_dst *dst,
+		       const uint8_t *pkt, size_t len)
+{
+	struct auenc_state *aes = dst->aes;
+	struct mbuf *mb;
+	uint8_t *p;
+	size_t pos;
+	int err;
+
+	if (aes->txh)
+		mb = aes->txbufh(len, aes->arg);
+	else
+		mb = mbuf_alloc(len);
+	if (!mb)
+		return ENOMEM;
+
+	pos = mb->pos;
+	(void)mbuf_write_mem(mb, pkt, len);
+	mb->pos = pos;
+
+	p = mbuf_buf(mb);
+	if (dst->marker)
+		p[1] |= 0x80;
+	p[2]  = dst->seq >> 8;
+	p[3]  = dst->seq;
+	p[4]  = dst->ts >> 24;
+	p[5]  = dst->ts >> 16;
+	p[6]  = dst->ts >> 8;
+	p[7]  = dst->ts;
+	p[8]  = aes->ssrc >> 24;
+	p[9]  = aes->ssrc >> 16;
+	p[10] = aes->ssrc >> 8;
+	p[11] = aes->ssrc;
+
+	if (aes->txh)
+		err = aes->txh(mb, aes->arg);
+	else
+		err = aes->rtph(p, len, aes->arg);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/*
+ * Called on the engine thread with a packet from the owner's channel.
+ * The lock is not held while sending, the transmit handlers take the
+ * mediaflow lock, which is held around voe_enc_alloc().
+ */
+int voe_enc_fanout(const uint8_t *pkt, size_t len)
+{
+	std::vector<struct fanout_dst> dstv;
+	uint32_t ts;
+	struct le *le;
+	size_t i;
+	int err;
+
+	if (!pkt || len < RTP_HEADER_SIZE)
+		return EINVAL;
+
+	ts = (uint32_t)pkt[4] << 24 | pkt[5] << 16 | pkt[6] << 8 | pkt[7];
+
+	pthread_mutex_lock(&gvoe.enc.mutex);
+
+	dstv.reserve(list_count(&gvoe.encl));
+
+	LIST_FOREACH(&gvoe.encl, le) {
+		struct auenc_state *aes = (struct auenc_state *)le->data;
+		struct fanout_dst dst;
+
+		if (!aes->started || !(aes->txh || aes->rtph))
+			continue;
+
+		dst.aes = aes;
+		fanout_header(&dst, ts);
+		dstv.push_back(dst);
+	}
+
+	++gvoe.enc.busy;
+	pthread_mutex_unlock(&gvoe.enc.mutex);
+
+	for (i = 0; i < dstv.size(); i++) {
+		err = fanout_send(&dstv[i], pkt, len);
+		if (err) {
+			warning("voe: shared encoder: send to ch %d"
+				" failed (%m)\n", dstv[i].aes->ve->ch, err);
+		}
+	}
+
+	pthread_mutex_lock(&gvoe.enc.mutex);
+	--gvoe.enc.busy;
+	pthread_cond_broadcast(&gvoe.enc.cond);
+	pthread_mutex_unlock(&gvoe.enc.mutex);
+
+	return 0;
 }
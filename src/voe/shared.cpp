@@ -48,6 +48,28 @@ extern "C" {
 static void tmr_transport_handler(void *arg);
 
 
+/* the packet from the engine is copied once, into the send buffer */
+static int send_mbuf(struct auenc_state *aes,
+		     const uint8_t *packet, size_t length)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = aes->txbufh(length, aes->arg);
+	if (!mb)
+		return ENOMEM;
+
+	(void)mbuf_write_mem(mb, packet, length);
+	mb->pos -= length;
+
+	err = aes->txh(mb, aes->arg);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
 class VoETransport : public webrtc::Transport {
 public:
 	VoETransport(struct voe_channel *ve_) : ve(ve_), active(true),
@@ -71,8 +93,18 @@ public:
 		}
 		
 		aes = ve->aes;
-		if (aes->rtph) {
-			err = aes->rtph(packet, length, aes->arg);
+		if (gvoe.enc.enabled) {
+			err = voe_enc_fanout(packet, length);
+#if FORCE_AUDIO_RTP_RECORDING
+			if (!err)
+				ve->rtp_dump_out->DumpPacket(packet, length);
+#endif
+		}
+		else if (aes->txh || aes->rtph) {
+			if (aes->txh)
+				err = send_mbuf(aes, packet, length);
+			else
+				err = aes->rtph(packet, length, aes->arg);
 			if (err) {
 				warning("voe: rtp send failed (%m)\n", err);
 				return false;
@@ -104,8 +136,11 @@ public:
 		if (!aes->started)
 			return true;
 
-		if (aes->rtcph) {
-			err = aes->rtcph(packet, length, aes->arg);
+		if (aes->txh || aes->rtcph) {
+			if (aes->txh)
+				err = send_mbuf(aes, packet, length);
+			else
+				err = aes->rtcph(packet, length, aes->arg);
 			if (err) {
 				warning("voe: rtcp send failed (%m)\n", err);
 				return false;
@@ -297,6 +332,7 @@ int voe_ve_alloc(struct voe_channel **vep, const struct aucodec *ac,
 	int err = 0;
 	int bitrate_bps;
 	int packet_size_ms;
+	bool muted;
 
 	ve = (struct voe_channel *)mem_zalloc(sizeof(*ve), ve_destructor);
 	if (!ve)
@@ -330,7 +366,9 @@ int voe_ve_alloc(struct voe_channel **vep, const struct aucodec *ac,
 
 		voe_start_audio_proc(&gvoe);
 
-		voe_get_mute(&gvoe.isMuted);
+		if (0 == voe_get_mute(&muted))
+			__atomic_store_n(&gvoe.isMuted, muted,
+					 __ATOMIC_RELAXED);
 
 		voe_start_silencing();
         
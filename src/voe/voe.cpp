@@ -497,7 +497,7 @@ static void set_interrupted(int ch, bool interrupted)
 	}
 }
 
-static void tmr_rtp_timeout_handler(void *arg)
+void voe_rtp_timeout_handler(void *arg)
 {
 	struct audec_state *ads = (struct audec_state *)arg;
     
@@ -523,9 +523,8 @@ static int rtp_handler(struct audec_state *ads,
 	}
 	    
 	if (gvoe.nw){
-		set_interrupted(ads->ve->ch, false);
-		tmr_cancel(&ads->tmr_rtp_timeout);
-		tmr_start(&ads->tmr_rtp_timeout, 2*MILLISECONDS_PER_SECOND,tmr_rtp_timeout_handler, ads);
+		if (watchdog_touch(&ads->rtp_deadline))
+			set_interrupted(ads->ve->ch, false);
         
 		gvoe.nw->ReceivedRTPPacket(ads->ve->ch, pkt, len);
 
@@ -609,6 +608,7 @@ static struct aucodec voe_aucodecv[NUM_CODECS] = {
 		.ench      = NULL,
 		.enc_start = voe_enc_start,
 		.enc_stop  = voe_enc_stop,
+		.enc_settx = voe_enc_settx,
 
 		.dec_alloc = voe_dec_alloc,
 		.dec_rtph  = rtp_handler,
@@ -693,9 +693,14 @@ void voe_close(void)
 	webrtc::VoiceEngine::Delete(gvoe.ve);
 	gvoe.ve = NULL;
 
+	/* no more encoder callbacks once the engine is gone */
+	pthread_cond_destroy(&gvoe.enc.cond);
+	pthread_mutex_destroy(&gvoe.enc.mutex);
+
 	webrtc::Trace::ReturnTrace();
 
 	tmr_cancel(&gvoe.tmr_neteq_stats);
+	gvoe.wd = (struct watchdog *)mem_deref(gvoe.wd);
     
 	gvoe.mq = (struct mqueue *)mem_deref(gvoe.mq);
     
@@ -726,6 +731,10 @@ int voe_init(struct list *aucodecl)
     
 	memset(&gvoe, 0, sizeof(gvoe));
 
+	/* before any error path, voe_close() destroys them */
+	pthread_mutex_init(&gvoe.enc.mutex, NULL);
+	pthread_cond_init(&gvoe.enc.cond, NULL);
+
 	gvoe.ve = webrtc::VoiceEngine::Create();
 	if (!gvoe.ve) {
 		err = ENOMEM;
@@ -792,6 +801,10 @@ int voe_init(struct list *aucodecl)
 	if (err)
 		goto out;
 
+	err = watchdog_alloc(&gvoe.wd, RTP_TIMEOUT_MS / 8);
+	if (err)
+		goto out;
+
 	list_init(&gvoe.encl);
 	list_init(&gvoe.decl);
 
@@ -47,6 +47,7 @@
 /* common */
 
 #define MILLISECONDS_PER_SECOND 1000
+#define RTP_TIMEOUT_MS (2*MILLISECONDS_PER_SECOND)
 
 /* main file */
 void voe_multi_party_packet_rate_control(struct voe *voe);
@@ -55,6 +56,7 @@ void voe_stop_audio_proc(struct voe *voe);
 void voe_update_agc_settings(struct voe *voe);
 void voe_update_aec_settings(struct voe *voe);
 int voe_update_mute(struct voe *voe);
+void voe_rtp_timeout_handler(void *arg);
 
 /* encoder */
 
@@ -67,8 +69,19 @@ struct auenc_state {
 	auenc_rtp_h *rtph;
 	auenc_rtcp_h *rtcph;
 	auenc_packet_h *pkth;
+	auenc_txbuf_h *txbufh;
+	auenc_tx_h *txh;
 	auenc_err_h *errh;
 	void *arg;
+
+	/* shared encoder, protected by gvoe.enc.mutex */
+	uint32_t ssrc;
+	uint16_t seq;
+	uint32_t ts_off;     /* added to the timestamp of the encoder */
+	uint32_t ts_last;    /* last timestamp sent */
+	uint32_t ts_delta;   /* timestamp increment per packet */
+	bool sent;
+	bool resync;         /* encoder changed, realign the timestamps */
 };
 
 int voe_enc_alloc(struct auenc_state **aesp,
@@ -83,6 +96,9 @@ int voe_enc_alloc(struct auenc_state **aesp,
 
 int  voe_enc_start(struct auenc_state *aes);
 void voe_enc_stop(struct auenc_state *aes);
+void voe_enc_settx(struct auenc_state *aes,
+		   auenc_txbuf_h *txbufh, auenc_tx_h *txh);
+int  voe_enc_fanout(const uint8_t *pkt, size_t len);
 
 /* decoder */
 
@@ -95,7 +111,7 @@ struct audec_state {
 	audec_recv_h *recvh;
 	audec_err_h *errh;
     
-	struct tmr tmr_rtp_timeout;
+	struct watchdog_deadline rtp_deadline;
     
 	void *arg;
 };
@@ -262,6 +278,7 @@ struct voe {
 	std::string path_to_files;
     
 	struct tmr tmr_neteq_stats;
+	struct watchdog *wd;  /* RTP receive timeouts */
     
 	struct mqueue *mq;
 	struct list transportl;
@@ -282,6 +299,17 @@ struct voe {
 		flowmgr_audio_state_change_h *chgh;
 		void *arg;
 	} state;
+
+	/* Shared encoder: only the channel of the owner encodes, and
+	 * every started encoder gets a copy of its packets.
+	 */
+	struct {
+		bool enabled;
+		struct auenc_state *owner;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		int busy;            /* fan-outs in progress */
+	} enc;
 };
 
 extern struct voe gvoe;
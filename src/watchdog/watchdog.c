@@ -0,0 +1,121 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include "avs_watchdog.h"
+
+
+struct watchdog {
+	struct list deadl;
+	struct tmr tmr;
+	uint64_t interval;
+};
+
+
+static void destructor(void *arg)
+{
+	struct watchdog *wd = arg;
+
+	tmr_cancel(&wd->tmr);
+	list_clear(&wd->deadl);
+}
+
+
+static void sweep_handler(void *arg)
+{
+	struct watchdog *wd = arg;
+	const uint64_t now = tmr_jiffies();
+	struct le *le;
+
+	if (list_isempty(&wd->deadl))
+		return;
+
+	tmr_start(&wd->tmr, wd->interval, sweep_handler, wd);
+
+	le = wd->deadl.head;
+	while (le) {
+		struct watchdog_deadline *dl = le->data;
+		uint64_t touched;
+
+		le = le->next;
+
+		touched = __atomic_load_n(&dl->touched, __ATOMIC_ACQUIRE);
+		if (!touched || now < touched + dl->timeout)
+			continue;
+
+		if (__atomic_exchange_n(&dl->expired, true, __ATOMIC_ACQ_REL))
+			continue;
+
+		if (dl->expiredh)
+			dl->expiredh(dl->arg);
+	}
+}
+
+
+int watchdog_alloc(struct watchdog **wdp, uint64_t interval)
+{
+	struct watchdog *wd;
+
+	if (!wdp || !interval)
+		return EINVAL;
+
+	wd = mem_zalloc(sizeof(*wd), destructor);
+	if (!wd)
+		return ENOMEM;
+
+	list_init(&wd->deadl);
+	tmr_init(&wd->tmr);
+	wd->interval = interval;
+
+	*wdp = wd;
+
+	return 0;
+}
+
+
+/**
+ * Start watching a deadline. It is armed by the first watchdog_touch().
+ */
+void watchdog_add(struct watchdog *wd, struct watchdog_deadline *dl,
+		  uint64_t timeout, watchdog_h *expiredh, void *arg)
+{
+	if (!wd || !dl)
+		return;
+
+	watchdog_remove(dl);
+
+	dl->touched = 0;
+	dl->expired = false;
+	dl->timeout = timeout;
+	dl->expiredh = expiredh;
+	dl->arg = arg;
+
+	list_append(&wd->deadl, &dl->le, dl);
+
+	if (!tmr_isrunning(&wd->tmr))
+		tmr_start(&wd->tmr, wd->interval, sweep_handler, wd);
+}
+
+
+void watchdog_remove(struct watchdog_deadline *dl)
+{
+	if (!dl)
+		return;
+
+	list_unlink(&dl->le);
+}
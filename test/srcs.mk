@@ -23,6 +23,7 @@ TEST_SRCS	+= test_flowmgr_b2b.cpp
 TEST_SRCS	+= test_http.cpp
 TEST_SRCS	+= test_jzon.cpp
 TEST_SRCS	+= test_libre.cpp
+TEST_SRCS	+= test_log.cpp
 TEST_SRCS	+= test_login.cpp
 TEST_SRCS	+= test_media.cpp
 TEST_SRCS	+= test_media_b2b.cpp
@@ -34,7 +35,9 @@ TEST_SRCS	+= test_nevent.cpp
 TEST_SRCS	+= test_packetqueue.cpp
 TEST_SRCS	+= test_resampler.cpp
 TEST_SRCS	+= test_rest.cpp
+TEST_SRCS	+= test_rtp_stats.cpp
 TEST_SRCS	+= test_self.cpp
+TEST_SRCS	+= test_sfu.cpp
 TEST_SRCS	+= test_srtp.cpp
 TEST_SRCS	+= test_string.cpp
 TEST_SRCS	+= test_turn.cpp
@@ -42,6 +45,7 @@ TEST_SRCS	+= test_uuid.cpp
 TEST_SRCS	+= test_vidcodec.cpp
 TEST_SRCS	+= test_voe.cpp
 TEST_SRCS	+= test_vp8_impl.cpp
+TEST_SRCS	+= test_watchdog.cpp
 TEST_SRCS	+= test_zapi.cpp
 TEST_SRCS	+= test_ztime.cpp
 
@@ -15,6 +15,9 @@
 * You should have received a copy of the GNU General Public License
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
+#include <sys/time.h>
+#include <string>
+#include <vector>
 #include <re.h>
 #include <avs.h>
 #include <gtest/gtest.h>
@@ -206,3 +209,211 @@ TEST_F(DictTest, many_objects_in_two_containers)
 		mem_deref(objv[i]);
 	}
 }
+
+
+TEST_F(DictTest, grow_and_shrink)
+{
+	const unsigned n = 10000;
+	char *str;
+	char key[16];
+	unsigned i;
+
+	err = str_dup(&str, "value");
+	ASSERT_EQ(0, err);
+
+	for (i=0; i<n; i++) {
+		re_snprintf(key, sizeof(key), "key-%u", i);
+		err = dict_add(dict, key, str);
+		ASSERT_EQ(0, err);
+	}
+	ASSERT_EQ(n, dict_count(dict));
+	ASSERT_EQ(EADDRINUSE, dict_add(dict, "key-7", str));
+
+	for (i=0; i<n; i+=2) {
+		re_snprintf(key, sizeof(key), "key-%u", i);
+		dict_remove(dict, key);
+	}
+	ASSERT_EQ(n/2, dict_count(dict));
+
+	for (i=0; i<n; i++) {
+		re_snprintf(key, sizeof(key), "key-%u", i);
+		if (i % 2)
+			ASSERT_TRUE(str == dict_lookup(dict, key));
+		else
+			ASSERT_TRUE(NULL == dict_lookup(dict, key));
+	}
+
+	for (i=1; i<n; i+=2) {
+		re_snprintf(key, sizeof(key), "key-%u", i);
+		dict_remove(dict, key);
+	}
+	ASSERT_EQ(0, dict_count(dict));
+	ASSERT_TRUE(NULL == dict_lookup(dict, "key-1"));
+
+	/* one reference left */
+	ASSERT_EQ(1, mem_nrefs(str));
+	mem_deref(str);
+}
+
+
+static bool remove_apply_handler(char *key, void *val, void *arg)
+{
+	struct dict *dict = (struct dict *)arg;
+
+	dict_remove(dict, key);
+
+	return false;
+}
+
+
+static bool count_apply_handler(char *key, void *val, void *arg)
+{
+	++*(unsigned *)arg;
+
+	return false;
+}
+
+
+TEST_F(DictTest, remove_in_apply)
+{
+	char *str;
+	char key[16];
+	unsigned i, n = 0;
+
+	err = str_dup(&str, "value");
+	ASSERT_EQ(0, err);
+
+	for (i=0; i<100; i++) {
+		re_snprintf(key, sizeof(key), "%u", i);
+		err = dict_add(dict, key, str);
+		ASSERT_EQ(0, err);
+	}
+
+	dict_apply(dict, count_apply_handler, &n);
+	ASSERT_EQ(100, n);
+
+	ASSERT_TRUE(NULL == dict_apply(dict, remove_apply_handler, dict));
+	ASSERT_EQ(0, dict_count(dict));
+
+	n = 0;
+	dict_apply(dict, count_apply_handler, &n);
+	ASSERT_EQ(0, n);
+
+	mem_deref(str);
+}
+
+
+static bool grow_apply_handler(char *key, void *val, void *arg)
+{
+	struct dict *dict = (struct dict *)arg;
+	char k[16];
+	unsigned i;
+
+	/* enough to grow the entries, then stop on the first one */
+	for (i=0; i<64; i++) {
+		re_snprintf(k, sizeof(k), "new-%u", i);
+		dict_add(dict, k, val);
+	}
+
+	return true;
+}
+
+
+TEST_F(DictTest, add_in_apply)
+{
+	char *str;
+
+	err = str_dup(&str, "value");
+	ASSERT_EQ(0, err);
+
+	err = dict_add(dict, "first", str);
+	ASSERT_EQ(0, err);
+
+	ASSERT_TRUE(str == dict_apply(dict, grow_apply_handler, dict));
+	ASSERT_EQ(65, dict_count(dict));
+	ASSERT_TRUE(str == dict_lookup(dict, "new-63"));
+
+	mem_deref(str);
+}
+
+
+static uint64_t usec_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+TEST(dict, performance)
+{
+	static const unsigned sizev[] = {10, 1000, 100000};
+	const unsigned ops = 1000000;
+	char *str;
+	int err;
+
+	err = str_dup(&str, "value");
+	ASSERT_EQ(0, err);
+
+	re_printf("~~~ performance report ~~~\n");
+	re_printf("entries   add     lookup  count   remove  (ns per op)\n");
+
+	for (size_t s = 0; s < ARRAY_SIZE(sizev); s++) {
+		const unsigned n = sizev[s];
+		std::vector<std::string> keyv(n);
+		struct dict *dict;
+		uint64_t t1, t_add, t_lookup, t_count, t_remove;
+		unsigned i, found = 0;
+		uint64_t total = 0;
+
+		for (i=0; i<n; i++) {
+			char key[40];
+
+			re_snprintf(key, sizeof(key),
+				    "%08x-conversation-%u", rand_u32(), i);
+			keyv[i] = key;
+		}
+
+		err = dict_alloc(&dict);
+		ASSERT_EQ(0, err);
+
+		t1 = usec_now();
+		for (i=0; i<n; i++)
+			dict_add(dict, keyv[i].c_str(), str);
+		t_add = usec_now() - t1;
+
+		t1 = usec_now();
+		for (i=0; i<ops; i++) {
+			if (dict_lookup(dict, keyv[i % n].c_str()))
+				++found;
+		}
+		t_lookup = usec_now() - t1;
+
+		t1 = usec_now();
+		for (i=0; i<ops; i++)
+			total += dict_count(dict);
+		t_count = usec_now() - t1;
+
+		t1 = usec_now();
+		for (i=0; i<n; i++)
+			dict_remove(dict, keyv[i].c_str());
+		t_remove = usec_now() - t1;
+
+		ASSERT_EQ(ops, found);
+		ASSERT_EQ((uint64_t)ops * n, total);
+		ASSERT_EQ(0, dict_count(dict));
+
+		re_printf("%-9u %-7.1f %-7.1f %-7.1f %-7.1f\n", n,
+			  1000.0 * t_add / n, 1000.0 * t_lookup / ops,
+			  1000.0 * t_count / ops, 1000.0 * t_remove / n);
+
+		mem_deref(dict);
+	}
+
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+
+	mem_deref(str);
+}
@@ -203,7 +203,8 @@ static void agent_filter(struct agent *ag, unsigned seq_lost)
 }
 
 
-static void test_init(enum cert_type cert_type, unsigned seq_lost)
+static void test_init(enum cert_type cert_type, unsigned seq_lost,
+		      unsigned workers = 0)
 {
 	struct tls *tls = NULL;
 	struct agent *ag_a=0, *ag_b=0;
@@ -239,6 +240,9 @@ static void test_init(enum cert_type cert_type, unsigned seq_lost)
 		break;
 	}
 
+	err = dtls_set_workers(tls, workers);
+	ASSERT_EQ(0, err);
+
 	/* create both agents, then connect from A to B */
 	agent_alloc(&ag_a, tls, "A", true);
 	agent_alloc(&ag_b, tls, "B", false);
@@ -285,3 +289,15 @@ TEST(dtls, no_packet_loss_with_ecdsa)
 {
 	test_init(CERT_TYPE_ECDSA, 0);
 }
+
+
+TEST(dtls, no_packet_loss_on_workers)
+{
+	test_init(CERT_TYPE_RSA, 0, 2);
+}
+
+
+TEST(dtls, packet_loss_on_workers)
+{
+	test_init(CERT_TYPE_RSA, 5, 2);
+}
@@ -19,6 +19,7 @@
 #include <avs.h>
 #include <gtest/gtest.h>
 #include <string.h>
+#include <pthread.h>
 #include "fakes.hpp"
 #include "ztest.h"
 
@@ -455,3 +456,212 @@ TEST_F(FlowmgrTest, call_config)
 		     srvv[0].username);
 	ASSERT_STREQ("stun:54.155.57.143:3478", srvv[1].url);
 }
+
+
+#define MARSHAL_ROUNDS 200
+
+enum marshal_case {
+	CASE_GET_MUTE,
+	CASE_SET_MUTE,
+	CASE_HAS_MEDIA,
+	CASE_CAN_SEND_VIDEO,
+	CASE_IS_SENDING_VIDEO,
+	CASE_SET_ACTIVE,
+	CASE_MCAT,
+	CASE_ENABLE_METRICS,
+
+	CASE_MAX
+};
+
+static const char *marshal_case_name[CASE_MAX] = {
+	"MARSHAL_GET_MUTE",
+	"MARSHAL_SET_MUTE",
+	"MARSHAL_HAS_MEDIA",
+	"MARSHAL_CAN_SEND_VIDEO",
+	"MARSHAL_IS_SENDING_VIDEO",
+	"MARSHAL_SET_ACTIVE",
+	"MARSHAL_MCAT",
+	"MARSHAL_ENABLE_METRICS",
+};
+
+struct marshal_bench {
+	struct flowmgr *fm;
+	struct mqueue *mq;
+	const char *convid;
+	uint64_t usv[CASE_MAX];
+};
+
+
+static void marshal_bench_call(struct marshal_bench *mb, int c)
+{
+	bool muted, has_media;
+
+	switch (c) {
+
+	case CASE_GET_MUTE:
+		marshal_flowmgr_get_mute(mb->fm, &muted);
+		break;
+
+	case CASE_SET_MUTE:
+		marshal_flowmgr_set_mute(mb->fm, false);
+		break;
+
+	case CASE_HAS_MEDIA:
+		marshal_flowmgr_has_media(mb->fm, mb->convid, &has_media);
+		break;
+
+	case CASE_CAN_SEND_VIDEO:
+		marshal_flowmgr_can_send_video(mb->fm, mb->convid);
+		break;
+
+	case CASE_IS_SENDING_VIDEO:
+		marshal_flowmgr_is_sending_video(mb->fm, mb->convid, NULL);
+		break;
+
+	case CASE_SET_ACTIVE:
+		marshal_flowmgr_set_active(mb->fm, mb->convid, true);
+		break;
+
+	case CASE_MCAT:
+		marshal_flowmgr_mcat_changed(mb->fm, mb->convid,
+					     FLOWMGR_MCAT_NORMAL);
+		break;
+
+	case CASE_ENABLE_METRICS:
+		marshal_flowmgr_enable_metrics(mb->fm, false);
+		break;
+	}
+}
+
+
+static void *marshal_bench_thread(void *arg)
+{
+	struct marshal_bench *mb = (struct marshal_bench *)arg;
+
+	for (int c = 0; c < CASE_MAX; c++) {
+
+		uint64_t t1 = tmr_jiffies();
+
+		for (int i = 0; i < MARSHAL_ROUNDS; i++)
+			marshal_bench_call(mb, c);
+
+		mb->usv[c] = (tmr_jiffies() - t1) * 1000 / MARSHAL_ROUNDS;
+	}
+
+	mqueue_push(mb->mq, 0, NULL);
+
+	return NULL;
+}
+
+
+static void marshal_bench_done(int id, void *data, void *arg)
+{
+	(void)id;
+	(void)data;
+	(void)arg;
+
+	re_cancel();
+}
+
+
+TEST_F(FlowmgrTest, marshal_latency)
+{
+	struct marshal_bench mb;
+	pthread_t tid;
+
+	memset(&mb, 0, sizeof(mb));
+	mb.fm = fm;
+	mb.convid = convid;
+
+	err = mqueue_alloc(&mb.mq, marshal_bench_done, NULL);
+	ASSERT_EQ(0, err);
+
+	pthread_create(&tid, NULL, marshal_bench_thread, &mb);
+
+	err = re_main_wait(10000);
+	ASSERT_EQ(0, err);
+
+	pthread_join(tid, NULL);
+	mem_deref(mb.mq);
+
+	re_printf("~~~ marshal round trip ~~~\n");
+	for (int c = 0; c < CASE_MAX; c++) {
+		re_printf("%-26s %6llu us\n", marshal_case_name[c],
+			  (unsigned long long)mb.usv[c]);
+	}
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
+
+
+struct marshal_async {
+	struct flowmgr *fm;
+	const char *convid;
+	int ndone;
+	int last_err;
+	bool has_media;
+	int err_has_media;
+};
+
+
+static void marshal_async_done(int err, void *arg)
+{
+	struct marshal_async *ma = (struct marshal_async *)arg;
+
+	ma->last_err = err;
+
+	if (++ma->ndone == 3)
+		re_cancel();
+}
+
+
+static void *marshal_async_thread(void *arg)
+{
+	struct marshal_async *ma = (struct marshal_async *)arg;
+	char convid[64];
+
+	/* the arguments are copied, so a temporary is fine */
+	str_ncpy(convid, ma->convid, sizeof(convid));
+
+	marshal_flowmgr_set_active_async(ma->fm, convid, true,
+					 marshal_async_done, ma);
+	marshal_flowmgr_mcat_changed_async(ma->fm, convid,
+					   FLOWMGR_MCAT_NORMAL,
+					   marshal_async_done, ma);
+	memset(convid, 0, sizeof(convid));
+
+	/* answered from the snapshot, without the re thread */
+	ma->has_media = true;
+	ma->err_has_media = marshal_flowmgr_has_media(ma->fm, ma->convid,
+						      &ma->has_media);
+
+	marshal_flowmgr_release_flows_async(ma->fm, ma->convid,
+					    marshal_async_done, ma);
+
+	return NULL;
+}
+
+
+TEST_F(FlowmgrTest, marshal_async)
+{
+	struct marshal_async ma;
+	pthread_t tid;
+
+	memset(&ma, 0, sizeof(ma));
+	ma.fm = fm;
+	ma.convid = convid;
+
+	pthread_create(&tid, NULL, marshal_async_thread, &ma);
+	pthread_join(tid, NULL);
+
+	ASSERT_EQ(0, ma.err_has_media);
+	ASSERT_FALSE(ma.has_media);
+
+	/* nothing has been handled until the re thread runs */
+	ASSERT_EQ(0, ma.ndone);
+
+	err = re_main_wait(5000);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(3, ma.ndone);
+}
@@ -16,6 +16,7 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string>
 #include <re.h>
 #include <avs.h>
 #include <gtest/gtest.h>
@@ -354,3 +355,228 @@ TEST(jzon, add_base64)
 
 	mem_deref(jobj);
 }
+
+
+TEST(jzon, array_index)
+{
+	static const char json[] = "{\"a\":[1,\"two\",[3],{\"x\":4}]}";
+	struct json_object *arr, *jobj, *a;
+	char *str = NULL;
+	int i, err;
+
+	arr = json_object_new_array();
+	ASSERT_TRUE(arr != NULL);
+
+	for (i = 0; i < 1000; i++)
+		ASSERT_EQ(0, json_object_array_add(arr, json_object_new_int(i)));
+
+	ASSERT_EQ(1000, json_object_array_length(arr));
+
+	for (i = 0; i < 1000; i++) {
+		ASSERT_EQ(i, json_object_get_int(
+				     json_object_array_get_idx(arr, i)));
+	}
+	ASSERT_TRUE(NULL == json_object_array_get_idx(arr, 1000));
+	ASSERT_TRUE(NULL == json_object_array_get_idx(arr, -1));
+
+	/* the keys are still the index */
+	odict_entry_del(jzon_get_odict(arr), "500");
+	ASSERT_EQ(999, json_object_array_length(arr));
+	ASSERT_EQ(501, json_object_get_int(json_object_array_get_idx(arr,
+								      500)));
+
+	mem_deref(arr);
+
+	err = jzon_decode(&jobj, json, strlen(json));
+	ASSERT_EQ(0, err);
+
+	err = jzon_array(&a, jobj, "a");
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(4, json_object_array_length(a));
+	ASSERT_EQ(1, json_object_get_int(json_object_array_get_idx(a, 0)));
+	ASSERT_STREQ("two", json_object_get_string(
+			     json_object_array_get_idx(a, 1)));
+	ASSERT_EQ(1, json_object_array_length(json_object_array_get_idx(a,
+									 2)));
+	err = jzon_int(&i, json_object_array_get_idx(a, 3), "x");
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(4, i);
+
+	err = jzon_encode(&str, jobj);
+	ASSERT_EQ(0, err);
+	ASSERT_STREQ(json, str);
+
+	mem_deref(str);
+	mem_deref(jobj);
+}
+
+
+TEST(jzon, pull_tokens)
+{
+	static const char json[] =
+		" {\"a\": [1, -2.5e3, true, false, null],"
+		" \"b\\\"\": \"x\\ny\", \"c\": {}}";
+	static const enum jzon_tok_type typev[] = {
+		JZON_OBJECT_BEGIN,
+		JZON_KEY, JZON_ARRAY_BEGIN, JZON_NUMBER, JZON_NUMBER,
+		JZON_TRUE, JZON_FALSE, JZON_NULL, JZON_ARRAY_END,
+		JZON_KEY, JZON_STRING,
+		JZON_KEY, JZON_OBJECT_BEGIN, JZON_OBJECT_END,
+		JZON_OBJECT_END,
+	};
+	struct jzon_reader r;
+	struct jzon_tok tok;
+	char buf[16];
+	size_t i;
+
+	jzon_reader_init(&r, json, strlen(json));
+
+	for (i = 0; i < ARRAY_SIZE(typev); i++) {
+
+		ASSERT_EQ(0, jzon_next(&r, &tok));
+		ASSERT_EQ(typev[i], tok.type);
+
+		switch (i) {
+
+		case 4:
+			ASSERT_EQ(0, pl_strcmp(&tok.pl, "-2.5e3"));
+			ASSERT_EQ(2u, tok.depth);
+			break;
+
+		case 9:
+			ASSERT_EQ(0, pl_strcmp(&tok.pl, "b\\\""));
+			ASSERT_EQ(0, jzon_tok_strcpy(buf, sizeof(buf), &tok));
+			ASSERT_STREQ("b\"", buf);
+			break;
+
+		case 10:
+			ASSERT_EQ(0, jzon_tok_strcpy(buf, sizeof(buf), &tok));
+			ASSERT_STREQ("x\ny", buf);
+			ASSERT_NE(0, jzon_tok_strcpy(buf, 3, &tok));
+			break;
+
+		case 14:
+			ASSERT_EQ(0u, tok.depth);
+			break;
+		}
+	}
+
+	ASSERT_EQ(ENOENT, jzon_next(&r, &tok));
+}
+
+
+TEST(jzon, pull_skip_and_decode)
+{
+	static const char json[] =
+		"{\"type\":\"x\",\"obj\":{\"a\":[1,{\"b\":2}]},\"n\":3}";
+	struct json_object *jobj, *arr;
+	struct jzon_reader r;
+	struct jzon_tok tok;
+
+	jzon_reader_init(&r, json, strlen(json));
+
+	ASSERT_EQ(0, jzon_next(&r, &tok));
+	for (int i = 0; i < 4; i++)
+		ASSERT_EQ(0, jzon_next(&r, &tok));
+	ASSERT_EQ(JZON_OBJECT_BEGIN, tok.type);
+
+	ASSERT_EQ(0, jzon_skip(&r, &tok));
+	ASSERT_EQ(0, pl_strcmp(&tok.pl, "{\"a\":[1,{\"b\":2}]}"));
+
+	/* a DOM for the subtree only */
+	ASSERT_EQ(0, jzon_decode(&jobj, tok.pl.p, tok.pl.l));
+	ASSERT_EQ(0, jzon_array(&arr, jobj, "a"));
+	ASSERT_EQ(2, json_object_array_length(arr));
+	mem_deref(jobj);
+
+	/* skipping a plain value does nothing */
+	ASSERT_EQ(0, jzon_next(&r, &tok));
+	ASSERT_EQ(JZON_KEY, tok.type);
+	ASSERT_EQ(0, jzon_next(&r, &tok));
+	ASSERT_EQ(JZON_NUMBER, tok.type);
+	ASSERT_EQ(0, jzon_skip(&r, &tok));
+	ASSERT_EQ(3u, pl_u32(&tok.pl));
+
+	ASSERT_EQ(0, jzon_next(&r, &tok));
+	ASSERT_EQ(JZON_OBJECT_END, tok.type);
+	ASSERT_EQ(ENOENT, jzon_next(&r, &tok));
+}
+
+
+TEST(jzon, pull_errors)
+{
+	static const char *badv[] = {
+		"",
+		"{",
+		"{\"a\"}",
+		"{\"a\":1]",
+		"[1,]",
+		"{\"a\":1,}",
+		"[1 2]",
+		"{\"a\":tru}",
+		"{\"a\":\"x}",
+		"{} {}",
+		"{\"a\":1}x",
+		"[-]",
+		"[1-2]",
+		"[1.2.3]",
+		"[01]",
+		"[1.]",
+		"[1e]",
+		"[-01]",
+	};
+	struct jzon_reader r;
+	struct jzon_tok tok;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(badv); i++) {
+		int err;
+
+		jzon_reader_init(&r, badv[i], strlen(badv[i]));
+
+		do {
+			err = jzon_next(&r, &tok);
+		} while (!err);
+
+		ASSERT_EQ(EBADMSG, err) << badv[i];
+
+		/* and it stays that way */
+		ASSERT_EQ(EBADMSG, jzon_next(&r, &tok));
+	}
+
+	/* too deep */
+	std::string deep(JZON_MAX_DEPTH + 1, '[');
+	int err;
+
+	jzon_reader_init(&r, deep.c_str(), deep.size());
+	do {
+		err = jzon_next(&r, &tok);
+	} while (!err);
+	ASSERT_EQ(EOVERFLOW, err);
+}
+
+
+TEST(jzon, pull_numbers)
+{
+	static const char *numv[] = {
+		"0", "-0", "7", "120", "-3", "1.5", "0.25", "-2e10",
+		"3E+2", "4.25e-3",
+	};
+	struct jzon_reader r;
+	struct jzon_tok tok;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(numv); i++) {
+		std::string json = std::string("[") + numv[i] + "]";
+
+		jzon_reader_init(&r, json.c_str(), json.size());
+
+		ASSERT_EQ(0, jzon_next(&r, &tok));
+		ASSERT_EQ(0, jzon_next(&r, &tok)) << numv[i];
+		ASSERT_EQ(JZON_NUMBER, tok.type);
+		ASSERT_EQ(0, pl_strcmp(&tok.pl, numv[i]));
+		ASSERT_EQ(0, jzon_next(&r, &tok));
+		ASSERT_EQ(ENOENT, jzon_next(&r, &tok));
+	}
+}
@@ -15,6 +15,9 @@
 * You should have received a copy of the GNU General Public License
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
+#include <sys/time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "gtest/gtest.h"
 #include <re.h>
 
@@ -68,3 +71,846 @@ TEST(libre, verify_dtls_support)
 	ASSERT_TRUE(tls != NULL);
 	mem_deref(tls);
 }
+
+
+#define MQ_MESSAGES 200000
+#define MQ_PRODUCERS 4
+#define MQ_ROUNDS 2000
+
+
+struct mq_test {
+	struct mqueue *mq;
+	int pfd[2];
+	uint32_t next[MQ_PRODUCERS];
+	int received;
+	int expected;
+	bool ooo;
+	volatile int handled;
+};
+
+struct mq_producer {
+	struct mq_test *mt;
+	int id;
+};
+
+
+static void mq_handler(int id, void *data, void *arg)
+{
+	struct mq_test *mt = (struct mq_test *)arg;
+	uint32_t seq = (uint32_t)(uintptr_t)data;
+
+	if (id < MQ_PRODUCERS) {
+		if (mt->next[id] != seq)
+			mt->ooo = true;
+		mt->next[id] = seq + 1;
+	}
+
+	__atomic_add_fetch(&mt->handled, 1, __ATOMIC_RELEASE);
+
+	if (++mt->received == mt->expected)
+		re_cancel();
+}
+
+
+/* Baseline: one pipe write and one read per message */
+static void pipe_handler(int flags, void *arg)
+{
+	struct mq_test *mt = (struct mq_test *)arg;
+	void *msg[2];
+
+	(void)flags;
+
+	if (read(mt->pfd[0], msg, sizeof(msg)) != sizeof(msg))
+		return;
+
+	mq_handler((int)(intptr_t)msg[0], msg[1], mt);
+}
+
+
+static void mq_test_push(struct mq_test *mt, int id, uint32_t seq)
+{
+	if (mt->mq) {
+		mqueue_push(mt->mq, id, (void *)(uintptr_t)seq);
+	}
+	else {
+		void *msg[2] = {(void *)(intptr_t)id, (void *)(uintptr_t)seq};
+		ssize_t n;
+
+		n = write(mt->pfd[1], msg, sizeof(msg));
+		(void)n;
+	}
+}
+
+
+static void *mq_producer_thread(void *arg)
+{
+	struct mq_producer *p = (struct mq_producer *)arg;
+
+	for (uint32_t i = 0; i < MQ_MESSAGES; i++)
+		mq_test_push(p->mt, p->id, i);
+
+	return NULL;
+}
+
+
+static void *mq_pingpong_thread(void *arg)
+{
+	struct mq_test *mt = (struct mq_test *)arg;
+
+	for (int i = 0; i < MQ_ROUNDS; i++) {
+
+		mq_test_push(mt, MQ_PRODUCERS, 0);
+
+		while (__atomic_load_n(&mt->handled, __ATOMIC_ACQUIRE) <= i)
+			;
+	}
+
+	return NULL;
+}
+
+
+static int mq_test_init(struct mq_test *mt, bool use_pipe, int expected)
+{
+	int err;
+
+	memset(mt, 0, sizeof(*mt));
+	mt->expected = expected;
+	mt->pfd[0] = mt->pfd[1] = -1;
+
+	if (!use_pipe)
+		return mqueue_alloc(&mt->mq, mq_handler, mt);
+
+	if (pipe(mt->pfd) < 0)
+		return errno;
+
+	err = fd_listen(mt->pfd[0], FD_READ, pipe_handler, mt);
+
+	return err;
+}
+
+
+static void mq_test_close(struct mq_test *mt)
+{
+	mt->mq = (struct mqueue *)mem_deref(mt->mq);
+
+	if (mt->pfd[0] >= 0) {
+		fd_close(mt->pfd[0]);
+		close(mt->pfd[0]);
+		close(mt->pfd[1]);
+	}
+}
+
+
+static uint64_t usec_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+static int mq_run(bool use_pipe, int nprod, uint64_t *usp)
+{
+	struct mq_producer prodv[MQ_PRODUCERS];
+	pthread_t tidv[MQ_PRODUCERS];
+	struct mq_test mt;
+	uint64_t t1;
+	int err;
+
+	err = mq_test_init(&mt, use_pipe, nprod * MQ_MESSAGES);
+	if (err)
+		return err;
+
+	t1 = usec_now();
+
+	for (int i = 0; i < nprod; i++) {
+		prodv[i].mt = &mt;
+		prodv[i].id = i;
+		pthread_create(&tidv[i], NULL, mq_producer_thread, &prodv[i]);
+	}
+
+	err = re_main(NULL);
+
+	for (int i = 0; i < nprod; i++)
+		pthread_join(tidv[i], NULL);
+
+	*usp = usec_now() - t1;
+
+	mq_test_close(&mt);
+
+	if (mt.ooo || mt.received != mt.expected)
+		return EPROTO;
+
+	return err;
+}
+
+
+static int mq_pingpong(bool use_pipe, uint64_t *usp)
+{
+	struct mq_test mt;
+	pthread_t tid;
+	uint64_t t1;
+	int err;
+
+	err = mq_test_init(&mt, use_pipe, MQ_ROUNDS);
+	if (err)
+		return err;
+
+	t1 = usec_now();
+
+	pthread_create(&tid, NULL, mq_pingpong_thread, &mt);
+	err = re_main(NULL);
+	pthread_join(tid, NULL);
+
+	*usp = usec_now() - t1;
+
+	mq_test_close(&mt);
+
+	return err;
+}
+
+
+TEST(libre, mqueue)
+{
+	uint64_t us;
+	int err;
+
+	err = mq_run(false, MQ_PRODUCERS, &us);
+	ASSERT_EQ(0, err);
+}
+
+
+TEST(libre, mqueue_performance)
+{
+	uint64_t us_mq[2], us_pipe[2], lat_mq, lat_pipe;
+	int err;
+
+	for (int i = 0; i < 2; i++) {
+		int nprod = i ? MQ_PRODUCERS : 1;
+
+		err = mq_run(false, nprod, &us_mq[i]);
+		ASSERT_EQ(0, err);
+		err = mq_run(true, nprod, &us_pipe[i]);
+		ASSERT_EQ(0, err);
+	}
+
+	err = mq_pingpong(false, &lat_mq);
+	ASSERT_EQ(0, err);
+	err = mq_pingpong(true, &lat_pipe);
+	ASSERT_EQ(0, err);
+
+	re_printf("~~~ performance report ~~~\n");
+	re_printf("messages:          %d per producer\n", MQ_MESSAGES);
+	re_printf("mqueue 1/%d prod:   %llu / %llu ms\n", MQ_PRODUCERS,
+		  us_mq[0] / 1000, us_mq[1] / 1000);
+	re_printf("pipe   1/%d prod:   %llu / %llu ms\n", MQ_PRODUCERS,
+		  us_pipe[0] / 1000, us_pipe[1] / 1000);
+	re_printf("mqueue round trip: %.1f us\n", 1.0 * lat_mq / MQ_ROUNDS);
+	re_printf("pipe round trip:   %.1f us\n", 1.0 * lat_pipe / MQ_ROUNDS);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
+
+
+#define TMR_COUNT 16
+
+
+struct tmr_test {
+	struct tmr tmrv[TMR_COUNT];
+	struct tmr tmr_zero;
+	struct tmr tmr_long;
+	struct tmr tmr_cancel;
+	int order[TMR_COUNT];
+	int fired;
+	bool zero_fired;
+	bool cancel_fired;
+};
+
+struct tmr_entry {
+	struct tmr_test *tt;
+	int ix;
+};
+
+
+static void tmr_zero_handler(void *arg)
+{
+	struct tmr_test *tt = (struct tmr_test *)arg;
+
+	tt->zero_fired = true;
+}
+
+
+static void tmr_cancel_handler(void *arg)
+{
+	struct tmr_test *tt = (struct tmr_test *)arg;
+
+	tt->cancel_fired = true;
+}
+
+
+static void tmr_entry_handler(void *arg)
+{
+	struct tmr_entry *te = (struct tmr_entry *)arg;
+	struct tmr_test *tt = te->tt;
+
+	tt->order[tt->fired++] = te->ix;
+
+	/* a zero delay timer started from a handler must still fire */
+	if (te->ix == TMR_COUNT / 2)
+		tmr_start(&tt->tmr_zero, 0, tmr_zero_handler, tt);
+
+	if (tt->fired == TMR_COUNT)
+		re_cancel();
+}
+
+
+TEST(libre, tmr)
+{
+	struct tmr_entry entv[TMR_COUNT];
+	struct tmr_test tt;
+	uint64_t expire;
+	int err;
+
+	memset(&tt, 0, sizeof(tt));
+
+	/* start in reverse order, and spanning more than one wheel turn */
+	for (int i = TMR_COUNT - 1; i >= 0; i--) {
+		entv[i].tt = &tt;
+		entv[i].ix = i;
+		tmr_start(&tt.tmrv[i], 5 + i * 20, tmr_entry_handler, &entv[i]);
+	}
+
+	tmr_start(&tt.tmr_long, 3600 * 1000, tmr_cancel_handler, &tt);
+	tmr_start(&tt.tmr_cancel, 10, tmr_cancel_handler, &tt);
+	tmr_cancel(&tt.tmr_cancel);
+
+	/* restarting must move the timer, not add it twice */
+	tmr_start(&tt.tmrv[0], 1, tmr_entry_handler, &entv[0]);
+
+	ASSERT_FALSE(tmr_isrunning(&tt.tmr_cancel));
+	ASSERT_TRUE(tmr_isrunning(&tt.tmr_long));
+
+	expire = tmr_get_expire(&tt.tmr_long);
+	ASSERT_LE(expire, 3600 * 1000);
+	ASSERT_GE(expire, 3600 * 1000 - 1000);
+
+	err = re_main(NULL);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(TMR_COUNT, tt.fired);
+	for (int i = 0; i < TMR_COUNT; i++)
+		ASSERT_EQ(i, tt.order[i]);
+
+	ASSERT_TRUE(tt.zero_fired);
+	ASSERT_FALSE(tt.cancel_fired);
+	ASSERT_TRUE(tmr_isrunning(&tt.tmr_long));
+
+	tmr_cancel(&tt.tmr_long);
+	ASSERT_FALSE(tmr_isrunning(&tt.tmr_long));
+}
+
+
+static void tmr_dummy_handler(void *arg)
+{
+	(void)arg;
+}
+
+
+/* Start, restart and cancel n timers spread over one minute */
+static void tmr_run(int n, uint64_t *startp, uint64_t *restartp,
+		    uint64_t *cancelp)
+{
+	struct tmr *tmrv;
+	uint64_t t1;
+
+	tmrv = (struct tmr *)calloc(n, sizeof(*tmrv));
+	ASSERT_TRUE(tmrv != NULL);
+
+	t1 = usec_now();
+	for (int i = 0; i < n; i++)
+		tmr_start(&tmrv[i], 1000 + rand_u32() % 60000,
+			  tmr_dummy_handler, NULL);
+	*startp = usec_now() - t1;
+
+	t1 = usec_now();
+	for (int i = 0; i < n; i++)
+		tmr_start(&tmrv[i], 1000 + rand_u32() % 60000,
+			  tmr_dummy_handler, NULL);
+	*restartp = usec_now() - t1;
+
+	t1 = usec_now();
+	for (int i = 0; i < n; i++)
+		tmr_cancel(&tmrv[i]);
+	*cancelp = usec_now() - t1;
+
+	free(tmrv);
+}
+
+
+TEST(libre, tmr_performance)
+{
+	const int countv[] = {10000, 100000};
+	uint64_t start, restart, cancel;
+
+	re_printf("~~~ performance report ~~~\n");
+
+	for (size_t i = 0; i < ARRAY_SIZE(countv); i++) {
+
+		tmr_run(countv[i], &start, &restart, &cancel);
+
+		re_printf("%6d timers: start %llu ms, restart %llu ms,"
+			  " cancel %llu ms\n", countv[i],
+			  start / 1000, restart / 1000, cancel / 1000);
+
+		/* the sorted list is O(n) per start, do not wait for it */
+		if (start > 1000000) {
+			re_printf("(skipping larger counts)\n");
+			break;
+		}
+	}
+
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
+
+
+#define UDP_PACKETS 100000
+#define UDP_PKTSIZE 1200
+#define UDP_BURST 32
+#define UDP_WINDOW 2048  /* x ~2.3k truesize must fit the 4M rcvbuf */
+
+
+struct udp_test {
+	struct udp_sock *us_rx;
+	struct udp_sock *us_tx;
+	struct udp_helper *uh;
+	struct sa dst;
+	struct tmr tmr;
+	uint32_t next;
+	bool ooo;
+	bool batch;
+	bool mixed;
+	int helper_calls;
+	volatile int received;
+	int expected;
+};
+
+
+/* Mixed mode: runs of equal size, a short packet, and some odd sizes */
+static size_t udp_test_size(const struct udp_test *ut, uint32_t seq)
+{
+	if (!ut->mixed)
+		return UDP_PKTSIZE;
+
+	switch (seq % 11) {
+
+	case 5:  return 300;
+	case 8:  return UDP_PKTSIZE + 100;
+	case 9:  return 20 + seq % 7;
+	default: return UDP_PKTSIZE;
+	}
+}
+
+
+static void udp_test_recv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct udp_test *ut = (struct udp_test *)arg;
+	size_t len = mbuf_get_left(mb);
+	uint32_t seq;
+
+	(void)src;
+
+	seq = mbuf_read_u32(mb);
+	if (seq != ut->next || len != udp_test_size(ut, seq))
+		ut->ooo = true;
+	ut->next = seq + 1;
+
+	__atomic_add_fetch(&ut->received, 1, __ATOMIC_RELEASE);
+
+	if (ut->received == ut->expected)
+		re_cancel();
+}
+
+
+static bool udp_test_helper_send(int *err, struct sa *dst,
+				 struct mbuf *mb, void *arg)
+{
+	struct udp_test *ut = (struct udp_test *)arg;
+
+	(void)err;
+	(void)dst;
+	(void)mb;
+
+	++ut->helper_calls;
+
+	return false;
+}
+
+
+static void udp_test_timeout(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+static int udp_test_send(struct udp_test *ut, uint32_t seq, int n)
+{
+	struct mbuf *mbv[UDP_BURST];
+	int err = 0;
+
+	for (int i = 0; i < n; i++) {
+		size_t sz = udp_test_size(ut, seq + i);
+
+		mbv[i] = mbuf_alloc(sz);
+		mbuf_write_u32(mbv[i], seq + i);
+		mbuf_fill(mbv[i], 0xa5, sz - 4);
+		mbv[i]->pos = 0;
+	}
+
+	if (ut->batch) {
+		err = udp_send_batch(ut->us_tx, &ut->dst, mbv, n);
+	}
+	else {
+		for (int i = 0; i < n && !err; i++)
+			err = udp_send(ut->us_tx, &ut->dst, mbv[i]);
+	}
+
+	for (int i = 0; i < n; i++)
+		mem_deref(mbv[i]);
+
+	return err;
+}
+
+
+static void *udp_sender_thread(void *arg)
+{
+	struct udp_test *ut = (struct udp_test *)arg;
+	uint32_t seq = 0;
+
+	while ((int)seq < ut->expected) {
+		int n = std::min(UDP_BURST, ut->expected - (int)seq);
+
+		/* stay within the socket buffer to avoid loss */
+		while ((int)seq - __atomic_load_n(&ut->received,
+						  __ATOMIC_ACQUIRE)
+		       > UDP_WINDOW)
+			usleep(50);
+
+		if (udp_test_send(ut, seq, n))
+			break;
+
+		seq += n;
+	}
+
+	return NULL;
+}
+
+
+static int udp_test_init(struct udp_test *ut, bool batch, bool mixed,
+			 int expected)
+{
+	int err;
+
+	memset(ut, 0, sizeof(*ut));
+	ut->batch = batch;
+	ut->mixed = mixed;
+	ut->expected = expected;
+
+	sa_set_str(&ut->dst, "127.0.0.1", 0);
+
+	err = udp_listen(&ut->us_rx, &ut->dst, udp_test_recv, ut);
+	if (err)
+		return err;
+	err = udp_local_get(ut->us_rx, &ut->dst);
+	if (err)
+		return err;
+
+	err = udp_listen(&ut->us_tx, NULL, NULL, NULL);
+	if (err)
+		return err;
+
+	err = udp_register_helper(&ut->uh, ut->us_tx, 0,
+				  udp_test_helper_send, NULL, ut);
+	if (err)
+		return err;
+
+	udp_sockbuf_set(ut->us_rx, 1 << 22);
+	udp_sockbuf_set(ut->us_tx, 1 << 22);
+
+	return 0;
+}
+
+
+static void udp_test_close(struct udp_test *ut)
+{
+	tmr_cancel(&ut->tmr);
+	mem_deref(ut->uh);
+	mem_deref(ut->us_tx);
+	mem_deref(ut->us_rx);
+}
+
+
+static int udp_run(bool batch, bool mixed, int npkt, uint64_t *usp)
+{
+	struct udp_test ut;
+	pthread_t tid;
+	uint64_t t1;
+	int err;
+
+	err = udp_test_init(&ut, batch, mixed, npkt);
+	if (err)
+		goto out;
+
+	tmr_start(&ut.tmr, 10000, udp_test_timeout, &ut);
+
+	t1 = usec_now();
+
+	pthread_create(&tid, NULL, udp_sender_thread, &ut);
+	err = re_main(NULL);
+	pthread_join(tid, NULL);
+
+	*usp = usec_now() - t1;
+
+	if (ut.ooo || ut.received != ut.expected ||
+	    ut.helper_calls != ut.expected)
+		err = EPROTO;
+
+ out:
+	udp_test_close(&ut);
+
+	return err;
+}
+
+
+TEST(libre, udp_send_batch)
+{
+	uint64_t us;
+	int err;
+
+	err = udp_run(true, false, 1000, &us);
+	ASSERT_EQ(0, err);
+
+	err = udp_run(false, false, 1000, &us);
+	ASSERT_EQ(0, err);
+
+	/* datagram boundaries must survive segmentation offload */
+	err = udp_run(true, true, 1000, &us);
+	ASSERT_EQ(0, err);
+}
+
+
+TEST(libre, udp_performance)
+{
+	uint64_t us_single, us_batch;
+	int err;
+
+	err = udp_run(false, false, UDP_PACKETS, &us_single);
+	ASSERT_EQ(0, err);
+	err = udp_run(true, false, UDP_PACKETS, &us_batch);
+	ASSERT_EQ(0, err);
+
+	re_printf("~~~ performance report ~~~\n");
+	re_printf("packets:        %d x %d bytes over loopback\n",
+		  UDP_PACKETS, UDP_PKTSIZE);
+	re_printf("udp_send:       %llu pps\n",
+		  1000000ULL * UDP_PACKETS / us_single);
+	re_printf("udp_send_batch: %llu pps\n",
+		  1000000ULL * UDP_PACKETS / us_batch);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
+
+
+TEST(libre, poll_method_iouring)
+{
+	uint64_t us;
+	int err;
+
+	err = poll_method_set(METHOD_IOURING);
+	if (err) {
+		re_printf("io_uring not available, skipping\n");
+		return;
+	}
+
+	/* the pipe handler reads one message per event, so pending
+	 * messages must keep the fd readable (level-triggered) */
+	err = mq_run(true, MQ_PRODUCERS, &us);
+	EXPECT_EQ(0, err);
+
+	err = mq_run(false, MQ_PRODUCERS, &us);
+	EXPECT_EQ(0, err);
+
+	err = udp_run(true, true, 1000, &us);
+	EXPECT_EQ(0, err);
+
+	err = udp_run(false, false, 1000, &us);
+	EXPECT_EQ(0, err);
+
+	err = poll_method_set(poll_method_best());
+	ASSERT_EQ(0, err);
+}
+
+
+TEST(libre, poll_method_performance)
+{
+	uint64_t us_epoll, us_uring, lat_epoll, lat_uring;
+	int err;
+
+	err = poll_method_set(METHOD_EPOLL);
+	if (err) {
+		re_printf("epoll not available, skipping\n");
+		return;
+	}
+
+	err = udp_run(false, false, UDP_PACKETS, &us_epoll);
+	ASSERT_EQ(0, err);
+	err = mq_pingpong(true, &lat_epoll);
+	ASSERT_EQ(0, err);
+
+	err = poll_method_set(METHOD_IOURING);
+	if (err) {
+		re_printf("io_uring not available, skipping\n");
+		poll_method_set(poll_method_best());
+		return;
+	}
+
+	err = udp_run(false, false, UDP_PACKETS, &us_uring);
+	ASSERT_EQ(0, err);
+	err = mq_pingpong(true, &lat_uring);
+	ASSERT_EQ(0, err);
+
+	err = poll_method_set(poll_method_best());
+	ASSERT_EQ(0, err);
+
+	re_printf("~~~ performance report ~~~\n");
+	re_printf("udp receive:    epoll %llu pps, io_uring %llu pps\n",
+		  1000000ULL * UDP_PACKETS / us_epoll,
+		  1000000ULL * UDP_PACKETS / us_uring);
+	re_printf("pipe roundtrip: epoll %.2f us, io_uring %.2f us\n",
+		  (double)lat_epoll / MQ_ROUNDS,
+		  (double)lat_uring / MQ_ROUNDS);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
+
+
+static int mem_test_destroyed;
+
+static void mem_test_destructor(void *arg)
+{
+	(void)arg;
+	++mem_test_destroyed;
+}
+
+
+static void *mem_deref_thread(void *arg)
+{
+	mem_deref(arg);
+	return NULL;
+}
+
+
+static size_t mem_pool_hits(void)
+{
+	struct mempool_stat statv[16];
+	size_t i, n = 16, hits = 0;
+
+	if (mem_pool_stat(statv, &n))
+		return 0;
+
+	for (i = 0; i < n; i++)
+		hits += statv[i].hits;
+
+	return hits;
+}
+
+
+TEST(libre, mem_pool)
+{
+	struct mbuf *mb;
+	uint8_t *p;
+	pthread_t tid;
+	size_t hits;
+
+	/* reference counting and destructors are unchanged */
+	mem_test_destroyed = 0;
+	p = (uint8_t *)mem_pool_alloc(100, mem_test_destructor);
+	ASSERT_TRUE(p != NULL);
+	mem_ref(p);
+	mem_deref(p);
+	ASSERT_EQ(0, mem_test_destroyed);
+	mem_deref(p);
+	ASSERT_EQ(1, mem_test_destroyed);
+
+	/* contents survive growing within, across and out of classes */
+	p = (uint8_t *)mem_pool_alloc(100, NULL);
+	ASSERT_TRUE(p != NULL);
+	for (int i = 0; i < 100; i++)
+		p[i] = (uint8_t)i;
+
+	p = (uint8_t *)mem_realloc(p, 120);
+	ASSERT_TRUE(p != NULL);
+	p = (uint8_t *)mem_realloc(p, 3000);
+	ASSERT_TRUE(p != NULL);
+	p = (uint8_t *)mem_realloc(p, 10000);
+	ASSERT_TRUE(p != NULL);
+	p = (uint8_t *)mem_realloc(p, 50);
+	ASSERT_TRUE(p != NULL);
+	for (int i = 0; i < 50; i++)
+		ASSERT_EQ((uint8_t)i, p[i]);
+	mem_deref(p);
+
+	/* blocks may be released on a different thread */
+	p = (uint8_t *)mem_pool_alloc(1500, NULL);
+	pthread_create(&tid, NULL, mem_deref_thread, p);
+	pthread_join(tid, NULL);
+
+	hits = mem_pool_hits();
+
+	for (int i = 0; i < 1000; i++) {
+		mb = mbuf_alloc(1500);
+		ASSERT_TRUE(mb != NULL);
+		ASSERT_EQ(0, mbuf_fill(mb, 0x5a, 1500));
+		mem_deref(mb);
+	}
+
+	/* steady state is served from the pool, if it is enabled */
+	if (mem_pool_stat(NULL, NULL) != ENOSYS)
+		ASSERT_GE(mem_pool_hits() - hits, (size_t)1998);
+}
+
+
+TEST(libre, mem_pool_performance)
+{
+	const int rounds = 1000000;
+	struct mbuf *mbv[8];
+	uint64_t t1, us;
+
+	t1 = usec_now();
+
+	for (int i = 0; i < rounds; i++) {
+		struct mbuf *mb = mbuf_alloc(1200);
+
+		mbuf_fill(mb, 0, 1200);
+		mbv[i % 8] = mb;
+
+		/* keep a few in flight, like a send queue */
+		if (i % 8 == 7) {
+			for (int j = 0; j < 8; j++)
+				mem_deref(mbv[j]);
+		}
+	}
+
+	us = usec_now() - t1;
+
+	re_printf("~~~ performance report ~~~\n");
+	re_printf("mbuf_alloc/deref: %.1f ns per packet\n",
+		  1000.0 * us / rounds);
+	re_printf("%H", mem_status, NULL);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
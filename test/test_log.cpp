@@ -0,0 +1,445 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <vector>
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+/* the handler runs on the log thread, read the results after a flush */
+static std::vector<std::string> logged;
+static bool block_handler;
+static bool handler_blocked;
+static int drop_reports;
+static int nraced;       /* any thread, async or not */
+static int nflushed[4];  /* per thread */
+
+
+static void log_handler(uint32_t level, const char *msg)
+{
+	if (level == LOG_LEVEL_WARN && strstr(msg, "messages dropped"))
+		++drop_reports;
+
+	if (0 == strncmp(msg, "lograce:", 8)) {
+		__atomic_add_fetch(&nraced, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	if (0 == strncmp(msg, "logflush:", 9)) {
+		int id = msg[9] - '0';
+
+		__atomic_add_fetch(&nflushed[id], 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	if (0 != strncmp(msg, "logtest:", 8))
+		return;
+
+	logged.push_back(msg);
+
+	if (__atomic_load_n(&block_handler, __ATOMIC_ACQUIRE)) {
+
+		__atomic_store_n(&handler_blocked, true, __ATOMIC_RELEASE);
+
+		while (__atomic_load_n(&block_handler, __ATOMIC_ACQUIRE))
+			sched_yield();
+	}
+}
+
+
+static struct log lg_test;
+
+
+class Log : public ::testing::Test {
+
+public:
+	virtual void SetUp()
+	{
+		logged.clear();
+		block_handler = false;
+		handler_blocked = false;
+		drop_reports = 0;
+		nraced = 0;
+		memset(nflushed, 0, sizeof(nflushed));
+
+		lg_test.h = log_handler;
+		log_register_handler(&lg_test);
+
+		log_set_min_level(LOG_LEVEL_INFO);
+		log_enable_stderr(false);
+
+		ASSERT_EQ(0, log_enable_async(true));
+	}
+
+	virtual void TearDown()
+	{
+		log_enable_async(false);
+		log_unregister_handler(&lg_test);
+		log_set_min_level(LOG_LEVEL_WARN);
+		log_enable_stderr(true);
+	}
+};
+
+
+static int count_prefix(const char *prefix)
+{
+	int n = 0;
+
+	for (size_t i = 0; i < logged.size(); i++) {
+		if (0 == logged[i].compare(0, strlen(prefix), prefix))
+			++n;
+	}
+
+	return n;
+}
+
+
+TEST_F(Log, async_in_order)
+{
+	const int N = 200;
+	int i;
+
+	for (i = 0; i < N; i++)
+		info("logtest: n=%d\n", i);
+
+	log_flush();
+
+	ASSERT_EQ(N, (int)logged.size());
+	for (i = 0; i < N; i++) {
+		char buf[64];
+
+		re_snprintf(buf, sizeof(buf), "logtest: n=%d\n", i);
+		ASSERT_STREQ(buf, logged[i].c_str());
+	}
+}
+
+
+TEST_F(Log, async_below_min_level)
+{
+	debug("logtest: not logged\n");
+	warning("logtest: logged\n");
+
+	log_flush();
+
+	ASSERT_EQ(1, (int)logged.size());
+	ASSERT_STREQ("logtest: logged\n", logged[0].c_str());
+}
+
+
+TEST_F(Log, async_long_message)
+{
+	std::string s(1000, 'x');
+
+	info("logtest: %s\n", s.c_str());
+
+	log_flush();
+
+	ASSERT_EQ(1, (int)logged.size());
+	ASSERT_EQ(std::string("logtest: ") + s + "\n", logged[0]);
+}
+
+
+static void *log_thread(void *arg)
+{
+	const int id = (int)(intptr_t)arg;
+
+	for (int i = 0; i < 100; i++)
+		info("logtest:%d n=%d\n", id, i);
+
+	return NULL;
+}
+
+
+TEST_F(Log, async_many_threads)
+{
+	enum { NTHREADS = 4 };
+	pthread_t tidv[NTHREADS];
+	int i, t;
+
+	for (t = 0; t < NTHREADS; t++) {
+		ASSERT_EQ(0, pthread_create(&tidv[t], NULL, log_thread,
+					    (void *)(intptr_t)t));
+	}
+	for (t = 0; t < NTHREADS; t++)
+		pthread_join(tidv[t], NULL);
+
+	log_flush();
+
+	ASSERT_EQ(NTHREADS * 100, (int)logged.size());
+
+	/* every thread is in order */
+	for (t = 0; t < NTHREADS; t++) {
+		int next = 0;
+
+		for (i = 0; i < (int)logged.size(); i++) {
+			int id, n;
+
+			if (2 != sscanf(logged[i].c_str(),
+					"logtest:%d n=%d", &id, &n))
+				continue;
+			if (id != t)
+				continue;
+
+			ASSERT_EQ(next, n);
+			++next;
+		}
+
+		ASSERT_EQ(100, next);
+	}
+}
+
+
+static void *race_thread(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < 100; i++)
+		info("lograce: n=%d\n", i);
+
+	return NULL;
+}
+
+
+TEST_F(Log, async_disable_while_logging)
+{
+	enum { NTHREADS = 4 };
+	pthread_t tidv[NTHREADS];
+	int t;
+
+	for (t = 0; t < NTHREADS; t++) {
+		ASSERT_EQ(0, pthread_create(&tidv[t], NULL, race_thread,
+					    NULL));
+	}
+
+	/* nothing queued may be left behind */
+	ASSERT_EQ(0, log_enable_async(false));
+
+	for (t = 0; t < NTHREADS; t++)
+		pthread_join(tidv[t], NULL);
+
+	ASSERT_EQ(NTHREADS * 100,
+		  __atomic_load_n(&nraced, __ATOMIC_RELAXED));
+	ASSERT_EQ(0, drop_reports);
+}
+
+
+struct flush_thread {
+	pthread_t tid;
+	int id;
+	int nlogged;
+};
+
+
+static void *flush_thread(void *arg)
+{
+	struct flush_thread *ft = (struct flush_thread *)arg;
+
+	/* less than a ring at a time, nothing is dropped */
+	for (int i = 0; i < 2000; i++) {
+		info("logflush:%d n=%d\n", ft->id, i);
+		__atomic_add_fetch(&ft->nlogged, 1, __ATOMIC_RELEASE);
+
+		if (i % 100 == 99)
+			log_flush();
+	}
+
+	return NULL;
+}
+
+
+TEST_F(Log, async_flush_waits_for_all_threads)
+{
+	enum { NTHREADS = 4 };
+	struct flush_thread ftv[NTHREADS];
+	int seen[NTHREADS];
+	bool running = true;
+	int t;
+
+	for (t = 0; t < NTHREADS; t++) {
+		ftv[t].id = t;
+		ftv[t].nlogged = 0;
+		ASSERT_EQ(0, pthread_create(&ftv[t].tid, NULL, flush_thread,
+					    &ftv[t]));
+	}
+
+	/* what any thread logged before the flush is written after it */
+	while (running) {
+
+		running = false;
+		for (t = 0; t < NTHREADS; t++) {
+			seen[t] = __atomic_load_n(&ftv[t].nlogged,
+						  __ATOMIC_ACQUIRE);
+			if (seen[t] < 2000)
+				running = true;
+		}
+
+		log_flush();
+
+		for (t = 0; t < NTHREADS; t++) {
+			ASSERT_LE(seen[t], __atomic_load_n(&nflushed[t],
+							   __ATOMIC_RELAXED));
+		}
+	}
+
+	for (t = 0; t < NTHREADS; t++)
+		pthread_join(ftv[t].tid, NULL);
+}
+
+
+TEST_F(Log, async_overflow_drops_and_reports)
+{
+	const int N = 1000;
+	uint64_t ndrop = log_dropped();
+	int i;
+
+	/* stall the log thread in the handler */
+	__atomic_store_n(&block_handler, true, __ATOMIC_RELEASE);
+	info("logtest: first\n");
+
+	while (!__atomic_load_n(&handler_blocked, __ATOMIC_ACQUIRE))
+		sched_yield();
+
+	/* must not block */
+	for (i = 0; i < N; i++)
+		info("logtest: n=%d\n", i);
+
+	__atomic_store_n(&block_handler, false, __ATOMIC_RELEASE);
+
+	log_flush();
+
+	ndrop = log_dropped() - ndrop;
+
+	ASSERT_GT(ndrop, 0u);
+	ASSERT_EQ(N + 1, (int)logged.size() + (int)ndrop);
+	ASSERT_EQ(N - (int)ndrop, count_prefix("logtest: n="));
+	ASSERT_EQ(1, drop_reports);
+}
+
+
+static const char bin_fmt[] =
+	"logtest: %d %u %zu %llx %-4s|%J %m %c %r %f %w\n";
+
+
+static void log_bin_example(const struct sa *sa, const struct pl *pl)
+{
+	static const uint8_t v[3] = {0xde, 0xad, 0x01};
+
+	LOG_BIN(LOG_LEVEL_INFO, bin_fmt,
+		-5, 7u, (size_t)9, 0xabcULL, "ab", sa, EINVAL, 'q', pl,
+		1.5, v, sizeof(v));
+}
+
+
+static std::string bin_example_text(const struct sa *sa,
+				    const struct pl *pl)
+{
+	static const uint8_t v[3] = {0xde, 0xad, 0x01};
+	char buf[256];
+
+	re_snprintf(buf, sizeof(buf), bin_fmt,
+		    -5, 7u, (size_t)9, 0xabcULL, "ab", sa, EINVAL, 'q', pl,
+		    1.5, v, sizeof(v));
+
+	return buf;
+}
+
+
+TEST_F(Log, bin_text_is_the_same)
+{
+	struct pl pl = PL("pl");
+	struct sa sa;
+
+	ASSERT_EQ(0, sa_set_str(&sa, "10.0.0.1", 3478));
+
+	log_bin_example(&sa, &pl);
+
+	log_flush();
+
+	ASSERT_EQ(1, (int)logged.size());
+	ASSERT_EQ(bin_example_text(&sa, &pl), logged[0]);
+
+	/* and without the log thread */
+	log_enable_async(false);
+	logged.clear();
+
+	ASSERT_EQ(0, sa_set_str(&sa, "::1", 80));
+
+	log_bin_example(&sa, &pl);
+
+	ASSERT_EQ(1, (int)logged.size());
+	ASSERT_EQ(bin_example_text(&sa, &pl), logged[0]);
+}
+
+
+static void bin_handler(const uint8_t *buf, size_t len, void *arg)
+{
+	std::vector<uint8_t> *bin = (std::vector<uint8_t> *)arg;
+
+	bin->insert(bin->end(), buf, buf + len);
+}
+
+
+TEST_F(Log, bin_records_below_text_level)
+{
+	std::vector<uint8_t> bin;
+	std::vector<int> typev;
+	struct log lb;
+	struct pl pl = PL("pl");
+	struct sa sa;
+	size_t pos;
+
+	memset(&lb, 0, sizeof(lb));
+	lb.binh = bin_handler;
+	lb.arg = &bin;
+	log_register_handler(&lb);
+
+	/* INFO goes to the binary handler only */
+	log_set_min_level(LOG_LEVEL_WARN);
+
+	ASSERT_EQ(0, sa_set_str(&sa, "10.0.0.1", 3478));
+
+	log_bin_example(&sa, &pl);
+	log_bin_example(&sa, &pl);
+	info("logtest: text\n");
+
+	log_flush();
+	log_unregister_handler(&lb);
+
+	ASSERT_EQ(0, (int)logged.size());
+
+	for (pos = 0; pos + 3 <= bin.size(); ) {
+		uint16_t len;
+
+		memcpy(&len, &bin[pos + 1], 2);
+		typev.push_back(bin[pos]);
+		pos += 3 + len;
+	}
+	ASSERT_EQ(bin.size(), pos);
+
+	/* the format is only sent once */
+	ASSERT_EQ(5, (int)typev.size());
+	ASSERT_EQ(LOG_BIN_HEAD, typev[0]);
+	ASSERT_EQ(LOG_BIN_FMT,  typev[1]);
+	ASSERT_EQ(LOG_BIN_MSG,  typev[2]);
+	ASSERT_EQ(LOG_BIN_MSG,  typev[3]);
+	ASSERT_EQ(LOG_BIN_TEXT, typev[4]);
+}
@@ -175,6 +175,32 @@ TEST_F(TestMedia, alloc_and_not_ready)
 }
 
 
+TEST_F(TestMedia, txbuf_alloc_and_not_ready)
+{
+	struct mbuf *mb;
+
+	mb = mediaflow_txbuf_alloc(mf, 160);
+	ASSERT_TRUE(mb != NULL);
+
+	/* no relay candidate selected, so no headroom */
+	ASSERT_EQ(0, mb->pos);
+	ASSERT_EQ(0, mbuf_get_left(mb));
+
+	/* room for the packet and the SRTP trailer */
+	ASSERT_GE(mbuf_get_space(mb), 160 + 14);
+
+	ASSERT_EQ(0, mbuf_fill(mb, 0x00, 160));
+	mb->pos = 0;
+	mb->buf[0] = 0x80;
+
+	ASSERT_EQ(EINTR, mediaflow_send_rtp_mbuf(mf, mb));
+	ASSERT_EQ(EINTR, mediaflow_send_rtcp_mbuf(mf, mb));
+	ASSERT_EQ(160, mbuf_get_left(mb));
+
+	mem_deref(mb);
+}
+
+
 TEST_F(TestMedia, init)
 {
 	ASSERT_EQ(0, candc);
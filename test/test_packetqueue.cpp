@@ -15,6 +15,8 @@
 * You should have received a copy of the GNU General Public License
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
+#include <pthread.h>
+#include <sched.h>
 #include <re.h>
 #include <avs.h>
 #include <gtest/gtest.h>
@@ -63,3 +65,275 @@ TEST(packetqueue, 1)
 
 	mem_deref(pq);
 }
+
+
+TEST(packetqueue, ring)
+{
+	packet_queue_t *pq = 0;
+	struct packet_queue_slot *slot;
+	packet_type_t packet_type;
+	uint8_t *packet_data;
+	size_t packet_size;
+	int err;
+
+	err = packet_queue_alloc_ring(&pq, false, 3, 64);
+	ASSERT_EQ(EINVAL, err);
+
+	err = packet_queue_alloc_ring(&pq, false, 4, 64);
+	ASSERT_EQ(0, err);
+	ASSERT_TRUE(pq != NULL);
+
+	// empty queue
+	err = packet_queue_borrow(pq, &slot);
+	ASSERT_EQ(ENODATA, err);
+
+	err = packet_queue_push(pq, PACKET_TYPE_RTP, (uint8_t *)"RTP", 3);
+	ASSERT_EQ(0, err);
+
+	err = packet_queue_reserve(pq, &slot);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(64, slot->slot_size);
+	memcpy(slot->packet_data, "RTCP", 4);
+	slot->packet_type = PACKET_TYPE_RTCP;
+	slot->packet_size = 4;
+	err = packet_queue_commit(pq, slot);
+	ASSERT_EQ(0, err);
+
+	err = packet_queue_push(pq, PACKET_TYPE_RTP, (uint8_t *)"RTP", 3);
+	ASSERT_EQ(0, err);
+	err = packet_queue_push(pq, PACKET_TYPE_RTP, (uint8_t *)"RTP", 3);
+	ASSERT_EQ(0, err);
+
+	// ring is full now
+	err = packet_queue_reserve(pq, &slot);
+	ASSERT_EQ(ENOSPC, err);
+
+	err = packet_queue_pop(pq, &packet_type, &packet_data, &packet_size);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(PACKET_TYPE_RTP, packet_type);
+	ASSERT_EQ(3, packet_size);
+	ASSERT_TRUE(0 == memcmp("RTP", packet_data, 3));
+	mem_deref(packet_data);
+
+	err = packet_queue_borrow(pq, &slot);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(PACKET_TYPE_RTCP, slot->packet_type);
+	ASSERT_EQ(4, slot->packet_size);
+	ASSERT_TRUE(0 == memcmp("RTCP", slot->packet_data, 4));
+	err = packet_queue_release(pq, slot);
+	ASSERT_EQ(0, err);
+
+	// two slots were released, the ring wraps around
+	err = packet_queue_push(pq, PACKET_TYPE_RTP, (uint8_t *)"RTP", 3);
+	ASSERT_EQ(0, err);
+	err = packet_queue_push(pq, PACKET_TYPE_RTP, (uint8_t *)"RTP", 3);
+	ASSERT_EQ(0, err);
+
+	for (int i = 0; i < 4; i++) {
+		err = packet_queue_borrow(pq, &slot);
+		ASSERT_EQ(0, err);
+		ASSERT_EQ(3, slot->packet_size);
+		packet_queue_release(pq, slot);
+	}
+
+	// empty queue
+	err = packet_queue_borrow(pq, &slot);
+	ASSERT_EQ(ENODATA, err);
+
+	// packet too large for a slot
+	uint8_t big[65] = {0};
+	err = packet_queue_push(pq, PACKET_TYPE_RTP, big, sizeof(big));
+	ASSERT_EQ(EMSGSIZE, err);
+
+	mem_deref(pq);
+}
+
+
+#define NUM_PRODUCERS 4
+#define NUM_PACKETS 100000
+
+
+struct producer {
+	packet_queue_t *pq;
+	uint32_t id;
+	bool ring;
+};
+
+
+static void *producer_thread(void *arg)
+{
+	struct producer *p = (struct producer *)arg;
+	uint8_t buf[8];
+	int err;
+
+	for (uint32_t i = 0; i < NUM_PACKETS; i++) {
+
+		memcpy(buf, &p->id, 4);
+		memcpy(buf + 4, &i, 4);
+
+		for (;;) {
+			err = packet_queue_push(p->pq, PACKET_TYPE_RTP,
+						buf, sizeof(buf));
+			if (err != ENOSPC)
+				break;
+
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+
+static uint64_t run_threads(packet_queue_t *pq, bool ring, int nprod)
+{
+	struct producer prodv[NUM_PRODUCERS];
+	pthread_t tidv[NUM_PRODUCERS];
+	uint32_t next[NUM_PRODUCERS] = {0};
+	uint64_t t1, t2;
+
+	t1 = tmr_jiffies();
+
+	for (int i = 0; i < nprod; i++) {
+		prodv[i].pq = pq;
+		prodv[i].id = i;
+		prodv[i].ring = ring;
+		pthread_create(&tidv[i], NULL, producer_thread, &prodv[i]);
+	}
+
+	for (int n = 0; n < nprod * NUM_PACKETS; n++) {
+		uint32_t id, seq;
+
+		if (ring) {
+			struct packet_queue_slot *slot;
+
+			EXPECT_EQ(0, packet_queue_borrow(pq, &slot));
+			memcpy(&id, slot->packet_data, 4);
+			memcpy(&seq, slot->packet_data + 4, 4);
+			packet_queue_release(pq, slot);
+		}
+		else {
+			packet_type_t type;
+			uint8_t *data;
+			size_t size;
+
+			EXPECT_EQ(0, packet_queue_pop(pq, &type,
+						      &data, &size));
+			memcpy(&id, data, 4);
+			memcpy(&seq, data + 4, 4);
+			mem_deref(data);
+		}
+
+		// packets of one producer arrive in order
+		EXPECT_EQ(next[id], seq);
+		next[id] = seq + 1;
+	}
+
+	for (int i = 0; i < nprod; i++)
+		pthread_join(tidv[i], NULL);
+
+	t2 = tmr_jiffies();
+
+	return t2 - t1;
+}
+
+
+TEST(packetqueue, ring_mpsc)
+{
+	packet_queue_t *pq = 0;
+	int err;
+
+	err = packet_queue_alloc_ring(&pq, true, 256, 8);
+	ASSERT_EQ(0, err);
+
+	run_threads(pq, true, NUM_PRODUCERS);
+
+	mem_deref(pq);
+}
+
+
+TEST(packetqueue, performance)
+{
+#define PERF_PACKETS 1000000
+#define PERF_SIZE 1200
+	packet_queue_t *lpq = 0, *rpq = 0;
+	struct packet_queue_slot *slot;
+	packet_type_t type;
+	uint8_t *data;
+	size_t size;
+	uint64_t t1, t2, t_list, t_ring, t_copy;
+	uint64_t tt_list[2], tt_ring[2];
+	int err;
+
+	uint8_t *pkt = (uint8_t *)mem_alloc(PERF_SIZE, NULL);
+	rand_bytes(pkt, PERF_SIZE);
+
+	err = packet_queue_alloc(&lpq, false);
+	ASSERT_EQ(0, err);
+	err = packet_queue_alloc_ring(&rpq, false, 1024, 1500);
+	ASSERT_EQ(0, err);
+
+	t1 = tmr_jiffies();
+	for (int i = 0; i < PERF_PACKETS; i++) {
+		packet_queue_push(lpq, PACKET_TYPE_RTP, pkt, PERF_SIZE);
+		packet_queue_pop(lpq, &type, &data, &size);
+		mem_deref(data);
+	}
+	t2 = tmr_jiffies();
+	t_list = t2 - t1;
+
+	t1 = tmr_jiffies();
+	for (int i = 0; i < PERF_PACKETS; i++) {
+		packet_queue_push(rpq, PACKET_TYPE_RTP, pkt, PERF_SIZE);
+		packet_queue_borrow(rpq, &slot);
+		packet_queue_release(rpq, slot);
+	}
+	t2 = tmr_jiffies();
+	t_copy = t2 - t1;
+
+	t1 = tmr_jiffies();
+	for (int i = 0; i < PERF_PACKETS; i++) {
+		packet_queue_reserve(rpq, &slot);
+		slot->packet_type = PACKET_TYPE_RTP;
+		slot->packet_size = PERF_SIZE;
+		packet_queue_commit(rpq, slot);
+		packet_queue_borrow(rpq, &slot);
+		packet_queue_release(rpq, slot);
+	}
+	t2 = tmr_jiffies();
+	t_ring = t2 - t1;
+
+	mem_deref(lpq);
+	mem_deref(rpq);
+
+	for (int i = 0; i < 2; i++) {
+		int nprod = i ? NUM_PRODUCERS : 1;
+
+		err = packet_queue_alloc(&lpq, true);
+		ASSERT_EQ(0, err);
+		tt_list[i] = run_threads(lpq, false, nprod);
+		mem_deref(lpq);
+
+		err = packet_queue_alloc_ring(&rpq, true, 1024, 8);
+		ASSERT_EQ(0, err);
+		tt_ring[i] = run_threads(rpq, true, nprod);
+		mem_deref(rpq);
+	}
+
+	re_printf("~~~ performance report ~~~\n");
+	re_printf("packets:             %d x %d bytes\n",
+		  PERF_PACKETS, PERF_SIZE);
+	re_printf("list push/pop:       %d ms\n", (int)t_list);
+	re_printf("ring push/borrow:    %d ms\n", (int)t_copy);
+	re_printf("ring reserve/borrow: %d ms\n", (int)t_ring);
+	re_printf("threaded:            %d x 1 and %d x %d packets\n",
+		  NUM_PACKETS, NUM_PRODUCERS, NUM_PACKETS);
+	re_printf("list spsc/mpsc:      %d / %d ms\n",
+		  (int)tt_list[0], (int)tt_list[1]);
+	re_printf("ring spsc/mpsc:      %d / %d ms\n",
+		  (int)tt_ring[0], (int)tt_ring[1]);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+
+	mem_deref(pkt);
+}
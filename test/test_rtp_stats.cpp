@@ -0,0 +1,220 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+extern "C" {
+#include "../src/media/rtp_stats.h"
+}
+
+
+#define PT      96
+#define SRATE   48000
+#define PTIME   20       /* [ms] */
+#define PKTSZ   100      /* [bytes] */
+
+
+class RtpStatsTest : public ::testing::Test {
+
+public:
+
+	virtual void SetUp() override
+	{
+		rtp_stats_init(&rs, PT, SRATE, 200);
+	}
+
+	/* one packet with marker bit, arriving at now [us] */
+	void packet(uint16_t seq, uint32_t ts, uint64_t now, int pt = PT)
+	{
+		uint8_t pkt[PKTSZ];
+
+		memset(pkt, 0, sizeof(pkt));
+		pkt[0] = 0x80;
+		pkt[1] = 0x80 | pt;
+		pkt[2] = seq >> 8;
+		pkt[3] = seq & 0xff;
+		pkt[4] = ts >> 24;
+		pkt[5] = ts >> 16;
+		pkt[6] = ts >> 8;
+		pkt[7] = ts & 0xff;
+
+		rtp_stats_update_at(&rs, pkt, sizeof(pkt), now);
+	}
+
+	/*
+	 * A stream of n packets every PTIME, with every loss_nth packet
+	 * lost and every other packet delayed by offs [us].
+	 */
+	void stream(unsigned n, unsigned loss_nth = 0, uint64_t offs = 0)
+	{
+		const uint64_t t0 = 1000000;
+		unsigned i;
+
+		for (i = 0; i < n; i++) {
+			uint64_t now = t0 + (uint64_t)i * PTIME * 1000;
+
+			if (loss_nth && i % loss_nth == loss_nth - 1)
+				continue;
+
+			now += (i & 1) ? offs : 0;
+
+			packet(1000 + i, 5000 + i * (SRATE / 1000 * PTIME),
+			       now);
+		}
+	}
+
+protected:
+	struct rtp_stats rs;
+	struct rtp_stats_snap snap;
+};
+
+
+TEST_F(RtpStatsTest, init)
+{
+	rtp_stats_snapshot(&rs, &snap);
+
+	ASSERT_EQ(0, snap.intervals);
+	ASSERT_EQ(-1, snap.bit_rate_stats.avg);
+	ASSERT_EQ(-1, snap.pctv[RTP_HIST_JITTER].p50);
+	ASSERT_EQ(-1, snap.pctv[RTP_HIST_LOSS].p99);
+	ASSERT_EQ(0, snap.dropouts);
+}
+
+
+TEST_F(RtpStatsTest, nothing_published_within_interval)
+{
+	stream(INTERVAL_MS / PTIME / 2);
+
+	rtp_stats_snapshot(&rs, &snap);
+
+	ASSERT_EQ(0, snap.intervals);
+	ASSERT_EQ(-1, snap.bit_rate_stats.avg);
+}
+
+
+TEST_F(RtpStatsTest, steady_stream)
+{
+	stream(INTERVAL_MS / PTIME + 2);
+
+	rtp_stats_snapshot(&rs, &snap);
+
+	ASSERT_EQ(1, snap.intervals);
+
+	ASSERT_NEAR(1000 / PTIME, snap.pkt_rate_stats.avg, 1);
+	ASSERT_NEAR(8 * PKTSZ / PTIME, snap.bit_rate_stats.avg, 1);
+	ASSERT_NEAR(1000 / PTIME, snap.frame_rate_stats.avg, 1);
+	ASSERT_EQ(0, snap.pkt_loss_stats.avg);
+	ASSERT_EQ(0, snap.pctv[RTP_HIST_LOSS].p99);
+
+	ASSERT_NEAR(0, snap.jitter, 0.01);
+	ASSERT_EQ(1, snap.pctv[RTP_HIST_JITTER].p99);
+	ASSERT_EQ(0, snap.dropouts);
+}
+
+
+TEST_F(RtpStatsTest, loss)
+{
+	stream(INTERVAL_MS / PTIME + 2, 10);
+
+	rtp_stats_snapshot(&rs, &snap);
+
+	ASSERT_EQ(1, snap.intervals);
+	ASSERT_NEAR(10, snap.pkt_loss_stats.avg, 0.5);
+	ASSERT_EQ(10, snap.pctv[RTP_HIST_LOSS].p50);
+}
+
+
+TEST_F(RtpStatsTest, jitter_is_smoothed_estimate)
+{
+	/* every transit time differs by 5 ms from the previous one */
+	stream(INTERVAL_MS / PTIME + 2, 0, 5000);
+
+	rtp_stats_snapshot(&rs, &snap);
+
+	ASSERT_EQ(1, snap.intervals);
+	ASSERT_NEAR(5, snap.jitter, 0.1);
+
+	/* the estimate converges from below, not per-packet |D| */
+	ASSERT_EQ(5, snap.pctv[RTP_HIST_JITTER].p50);
+	ASSERT_EQ(5, snap.pctv[RTP_HIST_JITTER].p99);
+	ASSERT_LT(rtp_hist_percentile(&rs.histv[RTP_HIST_JITTER],
+				      RTP_HIST_JITTER, .01f), 5);
+}
+
+
+TEST_F(RtpStatsTest, dropout)
+{
+	const uint64_t t0 = 1000000;
+
+	packet(1, 0, t0);
+	packet(2, 960, t0 + 20000);
+	packet(3, 1920, t0 + 20000 + 500000);
+	packet(4, 2880, t0 + INTERVAL_MS * 1000 + 100000);
+
+	rtp_stats_snapshot(&rs, &snap);
+
+	ASSERT_EQ(1, snap.intervals);
+	ASSERT_EQ(2, snap.dropouts);
+}
+
+
+TEST_F(RtpStatsTest, other_payload_type_is_ignored)
+{
+	const uint64_t t0 = 1000000;
+	unsigned i;
+
+	for (i = 0; i < INTERVAL_MS / PTIME + 2; i++)
+		packet(i, i * 960, t0 + i * PTIME * 1000, PT + 1);
+
+	rtp_stats_snapshot(&rs, &snap);
+
+	ASSERT_EQ(0, snap.intervals);
+	ASSERT_EQ(0, rs.packet_cnt);
+}
+
+
+TEST(rtp_hist, percentile)
+{
+	struct rtp_hist hist;
+	unsigned i;
+
+	memset(&hist, 0, sizeof(hist));
+
+	ASSERT_EQ(-1, rtp_hist_percentile(&hist, RTP_HIST_LOSS, .5f));
+	ASSERT_EQ(-1, rtp_hist_percentile(NULL, RTP_HIST_LOSS, .5f));
+
+	/* 90 x 0%, 9 x 3%, 1 x 100% */
+	hist.cntv[0] = 90;
+	hist.cntv[3] = 9;
+	hist.cntv[RTP_HIST_BUCKETS - 1] = 1;
+	hist.n = 100;
+
+	ASSERT_EQ(0, rtp_hist_percentile(&hist, RTP_HIST_LOSS, .50f));
+	ASSERT_EQ(0, rtp_hist_percentile(&hist, RTP_HIST_LOSS, .90f));
+	ASSERT_EQ(3, rtp_hist_percentile(&hist, RTP_HIST_LOSS, .95f));
+	ASSERT_EQ(3, rtp_hist_percentile(&hist, RTP_HIST_LOSS, .99f));
+
+	/* the open bucket reports its lower edge */
+	ASSERT_EQ(75, rtp_hist_percentile(&hist, RTP_HIST_LOSS, 1.0f));
+
+	for (i = 0; i < RTP_HIST_BUCKETS; i++)
+		hist.cntv[i] = 0;
+	hist.cntv[0] = 1;
+	hist.n = 1;
+	ASSERT_EQ(0, rtp_hist_percentile(&hist, RTP_HIST_LOSS, .01f));
+}
@@ -0,0 +1,535 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+#include "fakes.hpp"
+#include "ztest.h"
+
+
+/*
+ * A number of audummy endpoints, each connected over loopback to its
+ * own mediaflow in the SFU:
+ *
+ *   client[i].mf  <--- ICE/DTLS/SRTP --->  client[i].sfu_mf --+-- SFU
+ */
+
+
+#define NUM_CLIENTS 3
+#define MAX_SSRCS   8
+#define FAKE_PT     127
+#define NUM_FAKE    (2 * SFU_MAX_SRCS)
+
+
+struct client {
+	struct test *test;
+	struct tls *dtls;
+	struct tls *sfu_dtls;
+	struct mediaflow *mf;       /* the endpoint      */
+	struct mediaflow *sfu_mf;   /* its SFU side      */
+	struct sfu_part *part;
+	unsigned n_estab;
+
+	uint32_t ssrcv[MAX_SSRCS];  /* SSRCs received   */
+	size_t ssrcc;
+	size_t n_rtp_recv;
+	size_t n_rtcp_recv;
+	size_t n_pli_recv;
+	uint32_t pli_ssrc;
+	size_t n_nack_recv;
+	uint32_t nack_ssrc;
+	size_t n_remb_recv;
+	uint64_t remb_bitrate;
+	uint32_t remb_ssrc;
+	size_t n_fake_recv;
+};
+
+struct test {
+	struct list aucodecl;
+	StunServer *stun_srv;
+	struct mediaflow_mux *mux;  /* optional, for the SFU side */
+	struct sfu *sfu;
+	struct client clientv[NUM_CLIENTS];
+	struct tmr tmr;
+	uint64_t ts_kfreq;
+	int err;
+};
+
+
+static uint32_t read_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+
+static bool client_packet_handler(const struct sa *src, struct mbuf *mb,
+				  bool rtcp, void *arg)
+{
+	struct client *cli = static_cast<struct client *>(arg);
+	const uint8_t *p = mbuf_buf(mb);
+	uint32_t ssrc;
+	size_t i;
+	(void)src;
+
+	if (rtcp) {
+		++cli->n_rtcp_recv;
+
+		if (p[1] == RTCP_PSFB && (p[0] & 0x1f) == RTCP_PSFB_PLI) {
+			++cli->n_pli_recv;
+			cli->pli_ssrc = read_u32(p + 8);
+		}
+		else if (p[1] == RTCP_RTPFB &&
+			 (p[0] & 0x1f) == RTCP_RTPFB_GNACK) {
+			++cli->n_nack_recv;
+			cli->nack_ssrc = read_u32(p + 8);
+		}
+		else if (p[1] == RTCP_PSFB &&
+			 (p[0] & 0x1f) == RTCP_PSFB_AFB &&
+			 0 == memcmp(p + 12, "REMB", 4)) {
+			++cli->n_remb_recv;
+			cli->remb_bitrate = ((uint64_t)(p[17] & 3) << 16 |
+					     p[18] << 8 | p[19]) << (p[17] >> 2);
+			cli->remb_ssrc = read_u32(p + 20);
+		}
+
+		return false;
+	}
+
+	if ((p[1] & 0x7f) == FAKE_PT) {
+		++cli->n_fake_recv;
+		return true;
+	}
+
+	++cli->n_rtp_recv;
+
+	ssrc = read_u32(p + 8);
+	for (i = 0; i < cli->ssrcc; i++) {
+		if (cli->ssrcv[i] == ssrc)
+			return false;
+	}
+	if (cli->ssrcc < MAX_SSRCS)
+		cli->ssrcv[cli->ssrcc++] = ssrc;
+
+	return false;  /* let audummy have it too */
+}
+
+
+static void estab_handler(const char *crypto, const char *codec,
+			  const char *type, const struct sa *sa, void *arg)
+{
+	struct client *cli = static_cast<struct client *>(arg);
+	int err;
+
+	if (cli->n_estab++)
+		return;
+
+	/* only the endpoint sends media, the SFU side never starts */
+	err = mediaflow_start_media(cli->mf);
+	ASSERT_EQ(0, err);
+}
+
+
+static void sfu_estab_handler(const char *crypto, const char *codec,
+			      const char *type, const struct sa *sa,
+			      void *arg)
+{
+}
+
+
+static void close_handler(int err, void *arg)
+{
+	struct client *cli = static_cast<struct client *>(arg);
+
+	cli->test->err = err ? err : EPROTO;
+	re_cancel();
+}
+
+
+static int nack_encode(struct mbuf *mb, void *arg)
+{
+	(void)arg;
+
+	return mbuf_write_u32(mb, htonl(0x00420005));  /* PID, BLP */
+}
+
+
+static int remb_encode(struct mbuf *mb, void *arg)
+{
+	const uint32_t *remb = static_cast<const uint32_t *>(arg);
+	uint32_t mantissa = remb[1];
+	uint8_t exp = 0;
+	int err;
+
+	while (mantissa > 0x3ffff) {
+		mantissa >>= 1;
+		++exp;
+	}
+
+	err  = mbuf_write_str(mb, "REMB");
+	err |= mbuf_write_u8(mb, 1);
+	err |= mbuf_write_u8(mb, exp << 2 | mantissa >> 16);
+	err |= mbuf_write_u16(mb, htons(mantissa & 0xffff));
+	err |= mbuf_write_u32(mb, htonl(remb[0]));
+
+	return err;
+}
+
+
+/* remb is {media SSRC, bitrate} */
+static void send_rtcp(struct client *cli, enum rtcp_type type,
+		      uint32_t media_ssrc, uint32_t fmt = RTCP_PSFB_PLI,
+		      uint32_t bitrate = 0)
+{
+	struct mbuf *mb = mbuf_alloc(64);
+	uint32_t ssrc = mediaflow_get_local_ssrc(cli->mf, MEDIA_AUDIO);
+	uint32_t remb[2] = {media_ssrc, bitrate};
+	int err;
+
+	ASSERT_TRUE(mb != NULL);
+
+	if (type == RTCP_PSFB && fmt == RTCP_PSFB_AFB) {
+		err = rtcp_encode(mb, RTCP_PSFB, RTCP_PSFB_AFB,
+				  ssrc, 0, remb_encode, remb);
+	}
+	else if (type == RTCP_PSFB) {
+		err = rtcp_encode(mb, RTCP_PSFB, RTCP_PSFB_PLI,
+				  ssrc, media_ssrc, NULL, NULL);
+	}
+	else if (type == RTCP_RTPFB) {
+		err = rtcp_encode(mb, RTCP_RTPFB, RTCP_RTPFB_GNACK,
+				  ssrc, media_ssrc, nack_encode, NULL);
+	}
+	else {
+		err = rtcp_encode(mb, RTCP_SR, 0, ssrc, 0, 0, 0, 0, 0,
+				  NULL, NULL);
+	}
+	ASSERT_EQ(0, err);
+
+	err = mediaflow_send_raw_rtcp(cli->mf, mb->buf, mb->end);
+	ASSERT_EQ(0, err);
+
+	mem_deref(mb);
+}
+
+
+/* RTP from more SSRCs than the SFU takes from one participant */
+static void send_fake_rtp(struct client *cli)
+{
+	for (uint32_t i = 0; i < NUM_FAKE; i++) {
+		struct rtp_header hdr;
+		struct mbuf *mb = mbuf_alloc(64);
+		int err;
+
+		ASSERT_TRUE(mb != NULL);
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.ver  = RTP_VERSION;
+		hdr.pt   = FAKE_PT;
+		hdr.ssrc = 0xfa4e0000 + i;
+
+		err  = rtp_hdr_encode(mb, &hdr);
+		err |= mbuf_fill(mb, 0, 20);
+		ASSERT_EQ(0, err);
+
+		err = mediaflow_send_raw_rtp(cli->mf, mb->buf, mb->end);
+		ASSERT_EQ(0, err);
+
+		mem_deref(mb);
+	}
+}
+
+
+static bool all_forwarded(const struct test *test)
+{
+	for (int i = 0; i < NUM_CLIENTS; i++) {
+		if (test->clientv[i].ssrcc < NUM_CLIENTS - 1)
+			return false;
+	}
+
+	return true;
+}
+
+
+static void tmr_handler(void *arg)
+{
+	struct test *test = static_cast<struct test *>(arg);
+
+	tmr_start(&test->tmr, 10, tmr_handler, test);
+
+	if (!test->ts_kfreq) {
+		struct client *src = &test->clientv[0];
+		uint32_t fwd;
+
+		if (!all_forwarded(test))
+			return;
+
+		fwd = sfu_part_ssrc(src->part,
+				    mediaflow_get_local_ssrc(src->mf,
+							     MEDIA_AUDIO));
+		ASSERT_NE(0u, fwd);
+
+		/* all receivers ask for a keyframe from client 0, twice,
+		 * for a retransmission and report their bandwidth
+		 */
+		for (int i = 1; i < NUM_CLIENTS; i++) {
+			send_rtcp(&test->clientv[i], RTCP_PSFB, fwd);
+			send_rtcp(&test->clientv[i], RTCP_PSFB, fwd);
+			send_rtcp(&test->clientv[i], RTCP_SR, 0);
+			send_rtcp(&test->clientv[i], RTCP_RTPFB, fwd);
+			send_rtcp(&test->clientv[i], RTCP_PSFB, fwd,
+				  RTCP_PSFB_AFB, 100000 * (NUM_CLIENTS + 1 - i));
+		}
+
+		/* a higher estimate again is held back */
+		send_rtcp(&test->clientv[1], RTCP_PSFB, fwd,
+			  RTCP_PSFB_AFB, 1000000);
+
+		send_fake_rtp(&test->clientv[NUM_CLIENTS - 1]);
+
+		test->ts_kfreq = tmr_jiffies();
+	}
+	else if (tmr_jiffies() > test->ts_kfreq + 200) {
+		re_cancel();
+	}
+}
+
+
+static void client_connect(struct client *cli)
+{
+	char offer[4096], answer[4096];
+	int err;
+
+	err = mediaflow_generate_offer(cli->mf, offer, sizeof(offer));
+	ASSERT_EQ(0, err);
+
+	err = mediaflow_offeranswer(cli->sfu_mf, answer, sizeof(answer),
+				    offer);
+	ASSERT_EQ(0, err);
+
+	err = mediaflow_handle_answer(cli->mf, answer);
+	ASSERT_EQ(0, err);
+
+	err = mediaflow_start_ice(cli->mf);
+	ASSERT_EQ(0, err);
+}
+
+
+static void gather_handler(void *arg)
+{
+	struct client *cli = static_cast<struct client *>(arg);
+
+	client_connect(cli);
+}
+
+
+static void client_alloc(struct client *cli, struct test *test)
+{
+	struct sa laddr;
+	int err;
+
+	cli->test = test;
+
+	sa_set_str(&laddr, "127.0.0.1", 0);
+
+	err  = create_dtls_srtp_context(&cli->dtls, CERT_TYPE_RSA);
+	err |= create_dtls_srtp_context(&cli->sfu_dtls, CERT_TYPE_RSA);
+	ASSERT_EQ(0, err);
+
+	err = mediaflow_alloc(&cli->mf, cli->dtls, &test->aucodecl, &laddr,
+			      MEDIAFLOW_TRICKLEICE_DUALSTACK,
+			      CRYPTO_DTLS_SRTP, true,
+			      NULL, estab_handler, close_handler, cli);
+	ASSERT_EQ(0, err);
+
+	err = mediaflow_alloc_mux(&cli->sfu_mf, test->mux, cli->sfu_dtls,
+				  &test->aucodecl, &laddr, MEDIAFLOW_ICELITE,
+				  CRYPTO_DTLS_SRTP, true,
+				  NULL, sfu_estab_handler, close_handler, cli);
+	ASSERT_EQ(0, err);
+
+	err  = mediaflow_add_local_host_candidate(cli->mf, "en0", &laddr);
+	err |= mediaflow_add_local_host_candidate(cli->sfu_mf, "en0",
+						  &laddr);
+	ASSERT_EQ(0, err);
+
+	mediaflow_set_gather_handler(cli->mf, gather_handler);
+	mediaflow_set_packet_handler(cli->mf, client_packet_handler, cli);
+
+	err = sfu_add(&cli->part, test->sfu, cli->sfu_mf);
+	ASSERT_EQ(0, err);
+
+	err = mediaflow_gather_stun(cli->mf, &test->stun_srv->addr);
+	ASSERT_EQ(0, err);
+}
+
+
+static void client_close(struct client *cli)
+{
+	cli->part = (struct sfu_part *)mem_deref(cli->part);
+	cli->sfu_mf = (struct mediaflow *)mem_deref(cli->sfu_mf);
+	cli->mf = (struct mediaflow *)mem_deref(cli->mf);
+	cli->dtls = (struct tls *)mem_deref(cli->dtls);
+	cli->sfu_dtls = (struct tls *)mem_deref(cli->sfu_dtls);
+}
+
+
+static void test_forward(bool shared)
+{
+	struct test test;
+	const struct sfu_stats *stats;
+	int i, j;
+	int err;
+
+	memset(&test, 0, sizeof(test));
+
+	err = audummy_init(&test.aucodecl);
+	ASSERT_EQ(0, err);
+
+	if (shared) {
+		struct sa laddr;
+
+		sa_set_str(&laddr, "127.0.0.1", 0);
+
+		err = mediaflow_mux_alloc(&test.mux, &laddr);
+		ASSERT_EQ(0, err);
+	}
+
+	err = sfu_alloc(&test.sfu);
+	ASSERT_EQ(0, err);
+
+	test.stun_srv = new StunServer;
+
+	for (i = 0; i < NUM_CLIENTS; i++) {
+		struct client *cli = &test.clientv[i];
+
+		client_alloc(cli, &test);
+	}
+
+	tmr_start(&test.tmr, 10, tmr_handler, &test);
+
+	err = re_main_wait(10000);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, test.err);
+
+	stats = sfu_stats(test.sfu);
+	ASSERT_TRUE(stats->n_rtp_recv > 0);
+	ASSERT_TRUE(stats->n_rtp_sent > 0);
+
+	/* all the SFU mediaflows on the one port */
+	if (shared) {
+		for (i = 0; i < NUM_CLIENTS; i++) {
+			ASSERT_EQ(sa_port(mediaflow_mux_laddr(test.mux)),
+				  mediaflow_lport(test.clientv[i].sfu_mf));
+		}
+	}
+
+	for (i = 0; i < NUM_CLIENTS; i++) {
+		struct client *cli = &test.clientv[i];
+		uint32_t own;
+
+		own = mediaflow_get_local_ssrc(cli->mf, MEDIA_AUDIO);
+
+		/* one stream from every other client, under a new SSRC */
+		ASSERT_EQ(NUM_CLIENTS - 1, cli->ssrcc);
+
+		for (j = 0; j < NUM_CLIENTS; j++) {
+			struct client *other = &test.clientv[j];
+			uint32_t fwd;
+
+			fwd = sfu_part_ssrc(other->part,
+				mediaflow_get_local_ssrc(other->mf,
+							 MEDIA_AUDIO));
+			ASSERT_NE(0u, fwd);
+			ASSERT_NE(own, fwd);
+
+			if (j == i)
+				continue;
+
+			ASSERT_TRUE(cli->ssrcv[0] == fwd ||
+				    cli->ssrcv[1] == fwd);
+		}
+	}
+
+	/* 4 requests from 2 receivers, aggregated into 1 towards client 0,
+	 * with the SSRC client 0 actually sends with. The sender reports
+	 * are terminated in the SFU.
+	 */
+	ASSERT_EQ(2 * (NUM_CLIENTS - 1), stats->n_kfreq_recv);
+	ASSERT_EQ(1, stats->n_kfreq_sent);
+	ASSERT_EQ(NUM_CLIENTS - 1, stats->n_rtcp_dropped);
+
+	uint32_t ssrc0 = mediaflow_get_local_ssrc(test.clientv[0].mf,
+						  MEDIA_AUDIO);
+
+	ASSERT_EQ(1, test.clientv[0].n_pli_recv);
+	ASSERT_EQ(ssrc0, test.clientv[0].pli_ssrc);
+
+	/* every NACK goes on to the source */
+	ASSERT_EQ(NUM_CLIENTS - 1, stats->n_nack_recv);
+	ASSERT_EQ(NUM_CLIENTS - 1, stats->n_nack_sent);
+	ASSERT_EQ(NUM_CLIENTS - 1, test.clientv[0].n_nack_recv);
+	ASSERT_EQ(ssrc0, test.clientv[0].nack_ssrc);
+
+	/* the lowest estimate goes through, whichever arrived first;
+	 * 300k may go out before it, 1M is always held back
+	 */
+	ASSERT_EQ(NUM_CLIENTS, stats->n_remb_recv);
+	ASSERT_GE(stats->n_remb_sent, 1);
+	ASSERT_LE(stats->n_remb_sent, 2);
+	ASSERT_EQ(stats->n_remb_sent, test.clientv[0].n_remb_recv);
+	ASSERT_EQ(200000, test.clientv[0].remb_bitrate);
+	ASSERT_EQ(ssrc0, test.clientv[0].remb_ssrc);
+
+	ASSERT_EQ(1 + (NUM_CLIENTS - 1) + test.clientv[0].n_remb_recv,
+		  test.clientv[0].n_rtcp_recv);
+	for (i = 1; i < NUM_CLIENTS; i++)
+		ASSERT_EQ(0, test.clientv[i].n_rtcp_recv);
+
+	/* the fake sources beyond the limit are dropped */
+	struct client *faker = &test.clientv[NUM_CLIENTS - 1];
+
+	ASSERT_EQ(NUM_FAKE - (SFU_MAX_SRCS - 1), stats->n_rtp_dropped);
+	ASSERT_NE(0u, sfu_part_ssrc(faker->part, 0xfa4e0000));
+	ASSERT_EQ(0u, sfu_part_ssrc(faker->part, 0xfa4e0000 + NUM_FAKE - 1));
+	for (i = 0; i < NUM_CLIENTS - 1; i++) {
+		ASSERT_EQ(SFU_MAX_SRCS - 1, test.clientv[i].n_fake_recv);
+	}
+
+	tmr_cancel(&test.tmr);
+
+	for (i = 0; i < NUM_CLIENTS; i++)
+		client_close(&test.clientv[i]);
+
+	mem_deref(test.sfu);
+	mem_deref(test.mux);
+	delete test.stun_srv;
+
+	audummy_close();
+}
+
+
+TEST(sfu, forward_between_audummy_endpoints)
+{
+	test_forward(false);
+}
+
+
+TEST(sfu, forward_on_shared_socket)
+{
+	test_forward(true);
+}
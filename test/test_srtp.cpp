@@ -54,3 +54,613 @@ TEST(srtp, srtcp_packet)
 	mem_deref(srtp);
 	mem_deref(mb);
 }
+
+
+static struct mbuf *rtp_packet_ssrc(uint32_t ssrc, uint16_t seq,
+				    size_t pld_len)
+{
+	struct rtp_header hdr;
+	struct mbuf *mb = mbuf_alloc(RTP_HEADER_SIZE + pld_len + 32);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.pt   = 96;
+	hdr.seq  = seq;
+	hdr.ts   = 160 * seq;
+	hdr.ssrc = ssrc;
+
+	rtp_hdr_encode(mb, &hdr);
+	mbuf_fill(mb, 0xa5, pld_len);
+	mb->pos = 0;
+
+	return mb;
+}
+
+
+static struct mbuf *rtp_packet(uint16_t seq, size_t pld_len)
+{
+	return rtp_packet_ssrc(0x01020304, seq, pld_len);
+}
+
+
+static void test_roundtrip(enum srtp_suite suite, size_t key_len,
+			   size_t tag_len)
+{
+	struct srtp *tx, *rx;
+	uint8_t key[46];
+	int err;
+
+	ASSERT_TRUE(key_len <= sizeof(key));
+	rand_bytes(key, key_len);
+
+	err  = srtp_alloc(&tx, suite, key, key_len, 0);
+	err |= srtp_alloc(&rx, suite, key, key_len, 0);
+	ASSERT_EQ(0, err);
+
+	for (uint16_t seq = 65530; seq != 10; ++seq) {
+		struct mbuf *mb = rtp_packet(seq, 160);
+		struct mbuf *ref = rtp_packet(seq, 160);
+
+		err = srtp_encrypt(tx, mb);
+		ASSERT_EQ(0, err);
+		ASSERT_EQ(RTP_HEADER_SIZE + 160 + tag_len, mb->end);
+		ASSERT_NE(0, memcmp(mb->buf + RTP_HEADER_SIZE,
+				    ref->buf + RTP_HEADER_SIZE, 160));
+
+		err = srtp_decrypt(rx, mb);
+		ASSERT_EQ(0, err);
+		ASSERT_EQ(ref->end, mb->end);
+		ASSERT_EQ(0, memcmp(mb->buf, ref->buf, ref->end));
+
+		/* the same packet again is a replay */
+		err = srtp_encrypt(tx, ref);
+		ASSERT_EQ(0, err);
+		ASSERT_EQ(EALREADY, srtp_decrypt(rx, ref));
+
+		mem_deref(ref);
+		mem_deref(mb);
+	}
+
+	/* SRTCP with a Sender Report */
+	for (int i = 0; i < 4; i++) {
+		static const char *sr =
+			"80c8000601020304"
+			"0000000100000002000000030000000400000005";
+		struct mbuf *mb = mbuf_alloc(64);
+		uint8_t pkt[28];
+
+		str_hex(pkt, sizeof(pkt), sr);
+		mbuf_write_mem(mb, pkt, sizeof(pkt));
+		mb->pos = 0;
+
+		err = srtcp_encrypt(tx, mb);
+		ASSERT_EQ(0, err);
+		ASSERT_EQ(sizeof(pkt) + 4 + tag_len, mb->end);
+
+		err = srtcp_decrypt(rx, mb);
+		ASSERT_EQ(0, err);
+		ASSERT_EQ(sizeof(pkt), mb->end);
+		ASSERT_EQ(0, memcmp(mb->buf, pkt, sizeof(pkt)));
+
+		mem_deref(mb);
+	}
+
+	/* a modified packet must not authenticate */
+	struct mbuf *mb = rtp_packet(42, 160);
+
+	err = srtp_encrypt(tx, mb);
+	ASSERT_EQ(0, err);
+	mb->buf[RTP_HEADER_SIZE + 10] ^= 0x01;
+	ASSERT_EQ(EAUTH, srtp_decrypt(rx, mb));
+
+	mem_deref(mb);
+	mem_deref(rx);
+	mem_deref(tx);
+}
+
+
+TEST(srtp, aes_cm_128_hmac_sha1_80)
+{
+	test_roundtrip(SRTP_AES_CM_128_HMAC_SHA1_80, 30, 10);
+}
+
+
+TEST(srtp, aead_aes_128_gcm)
+{
+	test_roundtrip(SRTP_AES_128_GCM, 28, 16);
+}
+
+
+TEST(srtp, aead_aes_256_gcm)
+{
+	test_roundtrip(SRTP_AES_256_GCM, 44, 16);
+}
+
+
+/*
+ * Known-answer test with the session key, salt and RTP packet of
+ * RFC 7714 section 16. The IV is formed as in section 8.1 and the
+ * RTP header is the associated data.
+ */
+static void test_gcm_kat(size_t key_bits, const char *srtp_str)
+{
+	static const char *salt_str = "517569642070726f2071756f";
+	static const char *iv_str   = "51753c6580c2726f20718414";
+	static const char *rtp_str =
+		"8040f17b8041f8d35501a0b2"
+		"47616c6c696120657374206f6d6e6973"
+		"20646976697361"
+		"20696e207061727465732074726573";
+	uint8_t key[32], salt[12], iv[AES_BLOCK_SIZE], iv_ref[12];
+	uint8_t rtp[50], srtp_ref[66], pkt[66];
+	const uint32_t ssrc = 0x5501a0b2, roc = 0;
+	const uint16_t seq = 0xf17b;
+	struct aes *aes = NULL;
+	size_t i;
+	int err = 0;
+
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = (uint8_t)i;
+
+	err |= str_hex(salt, sizeof(salt), salt_str);
+	err |= str_hex(iv_ref, sizeof(iv_ref), iv_str);
+	err |= str_hex(rtp, sizeof(rtp), rtp_str);
+	err |= str_hex(srtp_ref, sizeof(srtp_ref), srtp_str);
+	ASSERT_EQ(0, err);
+
+	/* IV = (00 00 || SSRC || ROC || SEQ) XOR salt */
+	memset(iv, 0, sizeof(iv));
+	for (i = 0; i < 4; i++) {
+		iv[2 + i] = (uint8_t)(ssrc >> (24 - 8 * i));
+		iv[6 + i] = (uint8_t)(roc >> (24 - 8 * i));
+	}
+	iv[10] = (uint8_t)(seq >> 8);
+	iv[11] = (uint8_t)seq;
+	for (i = 0; i < sizeof(salt); i++)
+		iv[i] ^= salt[i];
+	ASSERT_TRUE(0 == memcmp(iv_ref, iv, sizeof(iv_ref)));
+
+	err = aes_alloc(&aes, AES_MODE_GCM, key, key_bits, iv);
+	if (err == ENOTSUP) {
+		re_printf("srtp: no AES-GCM in this AES backend\n");
+		return;
+	}
+	ASSERT_EQ(0, err);
+
+	/* protect */
+	memcpy(pkt, rtp, sizeof(rtp));
+	err |= aes_encr(aes, NULL, pkt, 12);
+	err |= aes_encr(aes, pkt + 12, pkt + 12, sizeof(rtp) - 12);
+	err |= aes_get_authtag(aes, pkt + sizeof(rtp), 16);
+	ASSERT_EQ(0, err);
+	ASSERT_TRUE(0 == memcmp(srtp_ref, pkt, sizeof(srtp_ref)));
+
+	/* unprotect */
+	aes_set_iv(aes, iv);
+	err |= aes_decr(aes, NULL, pkt, 12);
+	err |= aes_decr(aes, pkt + 12, pkt + 12, sizeof(rtp) - 12);
+	err |= aes_authenticate(aes, pkt + sizeof(rtp), 16);
+	ASSERT_EQ(0, err);
+	ASSERT_TRUE(0 == memcmp(rtp, pkt, sizeof(rtp)));
+
+	/* a modified tag must not authenticate */
+	memcpy(pkt, srtp_ref, sizeof(srtp_ref));
+	pkt[sizeof(pkt) - 1] ^= 0x01;
+	aes_set_iv(aes, iv);
+	err |= aes_decr(aes, NULL, pkt, 12);
+	err |= aes_decr(aes, pkt + 12, pkt + 12, sizeof(rtp) - 12);
+	ASSERT_EQ(0, err);
+	ASSERT_NE(0, aes_authenticate(aes, pkt + sizeof(rtp), 16));
+
+	mem_deref(aes);
+}
+
+
+TEST(srtp, aead_aes_128_gcm_rfc7714)
+{
+	test_gcm_kat(128,
+		     "8040f17b8041f8d35501a0b2"
+		     "f24de3a3fb34de6cacba861c9d7e4bca"
+		     "be633bd50d294e6f42a5f47a51c7d19b"
+		     "36de3adf8833"
+		     "899d7f27beb16a9152cf765ee4390cce");
+}
+
+
+TEST(srtp, aead_aes_256_gcm_rfc7714)
+{
+	test_gcm_kat(256,
+		     "8040f17b8041f8d35501a0b2"
+		     "32b1de78a822fe12ef9f78fa332e33aa"
+		     "b18012389a58e2f3b50b2a0276ffae0f"
+		     "1ba63799b87b"
+		     "7aa3db36dfffd6b0f9bb7878d7a76c13");
+}
+
+
+TEST(srtp, gcm_key_length)
+{
+	struct srtp *srtp = NULL;
+	uint8_t key[44] = {0};
+
+	/* AES-CM master key and salt are two bytes longer */
+	ASSERT_EQ(EINVAL, srtp_alloc(&srtp, SRTP_AES_128_GCM, key, 30, 0));
+	ASSERT_EQ(ENOTSUP, srtp_alloc(&srtp, SRTP_AES_128_GCM, key, 28,
+				      SRTP_UNENCRYPTED_SRTCP));
+	ASSERT_TRUE(srtp == NULL);
+}
+
+
+TEST(srtp, batch)
+{
+#define BATCH_SIZE 40
+	struct mbuf *mbv[BATCH_SIZE], *refv[BATCH_SIZE];
+	struct srtp *tx_batch, *tx_single, *rx;
+	int errv[BATCH_SIZE];
+	uint8_t key[30];
+	int err;
+
+	rand_bytes(key, sizeof(key));
+
+	err  = srtp_alloc(&tx_batch, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  key, sizeof(key), 0);
+	err |= srtp_alloc(&tx_single, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  key, sizeof(key), 0);
+	err |= srtp_alloc(&rx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  key, sizeof(key), 0);
+	ASSERT_EQ(0, err);
+
+	/* uneven sizes and a sequence wrap inside the batch */
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		mbv[i]  = rtp_packet(65520 + i, 7 * i + 1);
+		refv[i] = rtp_packet(65520 + i, 7 * i + 1);
+	}
+
+	err = srtp_encrypt_batch(tx_batch, mbv, errv, BATCH_SIZE);
+	ASSERT_EQ(0, err);
+
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		ASSERT_EQ(0, errv[i]);
+
+		err = srtp_encrypt(tx_single, refv[i]);
+		ASSERT_EQ(0, err);
+		ASSERT_EQ(refv[i]->end, mbv[i]->end);
+		ASSERT_EQ(0, mbv[i]->pos);
+		ASSERT_EQ(0, memcmp(mbv[i]->buf, refv[i]->buf, refv[i]->end));
+	}
+
+	/* a modified packet fails alone */
+	mbv[5]->buf[RTP_HEADER_SIZE] ^= 0x80;
+
+	err = srtp_decrypt_batch(rx, mbv, errv, BATCH_SIZE);
+	ASSERT_EQ(EAUTH, err);
+
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		struct mbuf *ref = rtp_packet(65520 + i, 7 * i + 1);
+
+		if (i == 5) {
+			ASSERT_EQ(EAUTH, errv[i]);
+		}
+		else {
+			ASSERT_EQ(0, errv[i]);
+			ASSERT_EQ(ref->end, mbv[i]->end);
+			ASSERT_EQ(0, memcmp(mbv[i]->buf, ref->buf, ref->end));
+		}
+
+		mem_deref(ref);
+		mem_deref(refv[i]);
+		mem_deref(mbv[i]);
+	}
+
+	mem_deref(rx);
+	mem_deref(tx_single);
+	mem_deref(tx_batch);
+}
+
+
+TEST(srtp, replay_window)
+{
+	struct mbuf *mbv[301];
+	struct srtp *tx, *rx;
+	uint8_t key[30];
+	int err;
+
+	rand_bytes(key, sizeof(key));
+
+	err  = srtp_alloc(&tx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  key, sizeof(key), 0);
+	err |= srtp_alloc(&rx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  key, sizeof(key), 0);
+	ASSERT_EQ(0, err);
+
+	for (int i = 0; i <= 300; i++) {
+		mbv[i] = rtp_packet(i, 20);
+		err = srtp_encrypt(tx, mbv[i]);
+		ASSERT_EQ(0, err);
+	}
+
+	ASSERT_EQ(0, srtp_decrypt(rx, mbv[300]));
+
+	/* 100 packets late is inside the 128 packet window */
+	ASSERT_EQ(0, srtp_decrypt(rx, mbv[200]));
+
+	/* 200 packets late is not */
+	ASSERT_EQ(EALREADY, srtp_decrypt(rx, mbv[100]));
+
+	/* 65 late lands in the second bitmap word; replayed, it is
+	 * rejected
+	 */
+	struct mbuf *dup = rtp_packet(235, 20);
+	ASSERT_EQ(0, srtp_encrypt(tx, dup));
+	ASSERT_EQ(0, srtp_decrypt(rx, mbv[235]));
+	ASSERT_EQ(EALREADY, srtp_decrypt(rx, dup));
+	mem_deref(dup);
+
+	for (int i = 0; i <= 300; i++)
+		mem_deref(mbv[i]);
+
+	mem_deref(rx);
+	mem_deref(tx);
+}
+
+
+TEST(srtp, many_ssrcs)
+{
+#define NUM_SSRC 300
+	struct srtp *tx, *rx;
+	uint8_t key[30];
+	int err;
+
+	rand_bytes(key, sizeof(key));
+
+	err  = srtp_alloc(&tx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  key, sizeof(key), 0);
+	err |= srtp_alloc(&rx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  key, sizeof(key), 0);
+	ASSERT_EQ(0, err);
+
+	/* more SSRCs than streams: the least recently used are evicted */
+	for (int round = 0; round < 3; round++) {
+		for (uint32_t ssrc = 0; ssrc < NUM_SSRC; ssrc++) {
+			struct mbuf *mb, *ref;
+
+			mb  = rtp_packet_ssrc(ssrc * 7919, round, 20);
+			ref = rtp_packet_ssrc(ssrc * 7919, round, 20);
+
+			err = srtp_encrypt(tx, mb);
+			ASSERT_EQ(0, err);
+
+			err = srtp_decrypt(rx, mb);
+			ASSERT_EQ(0, err);
+			ASSERT_EQ(0, memcmp(mb->buf, ref->buf, ref->end));
+
+			mem_deref(ref);
+			mem_deref(mb);
+		}
+	}
+
+	/* a small set of active streams is never evicted, or their
+	 * Roll-Over Counters would go out of sync after the wrap
+	 */
+	for (int i = 0; i < 2000; i++) {
+		const uint16_t seq = 65000 + i;
+		struct mbuf *mb = rtp_packet_ssrc(1000000 + i % 4, seq, 20);
+
+		err = srtp_encrypt(tx, mb);
+		ASSERT_EQ(0, err);
+		err = srtp_decrypt(rx, mb);
+		ASSERT_EQ(0, err);
+
+		/* and one new SSRC per packet */
+		mem_deref(mb);
+		mb = rtp_packet_ssrc(2000000 + i, 0, 20);
+		err = srtp_encrypt(tx, mb);
+		ASSERT_EQ(0, err);
+
+		mem_deref(mb);
+	}
+
+	mem_deref(rx);
+	mem_deref(tx);
+}
+
+
+TEST(srtp, forged_ssrcs_do_not_evict)
+{
+#define NUM_STREAMS 256
+	struct srtp *tx, *rx;
+	struct mbuf *mb;
+	uint8_t key[30], tag[10];
+	int err;
+
+	rand_bytes(key, sizeof(key));
+
+	err  = srtp_alloc(&tx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  key, sizeof(key), 0);
+	err |= srtp_alloc(&rx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  key, sizeof(key), 0);
+	ASSERT_EQ(0, err);
+
+	/* fill the receiver with authenticated streams */
+	for (uint32_t ssrc = 1; ssrc <= NUM_STREAMS; ssrc++) {
+		mb = rtp_packet_ssrc(ssrc, 100, 20);
+		ASSERT_EQ(0, srtp_encrypt(tx, mb));
+		ASSERT_EQ(0, srtp_decrypt(rx, mb));
+		mem_deref(mb);
+	}
+
+	/* a flood of new SSRCs with bogus tags */
+	for (uint32_t ssrc = 1000; ssrc < 3000; ssrc++) {
+		mb = rtp_packet_ssrc(ssrc, 0, 20);
+		mb->pos = mb->end;
+		rand_bytes(tag, sizeof(tag));
+		mbuf_write_mem(mb, tag, sizeof(tag));
+		mb->pos = 0;
+
+		ASSERT_EQ(EAUTH, srtp_decrypt(rx, mb));
+		mem_deref(mb);
+	}
+
+	/* all streams are still there: a replay is detected */
+	for (uint32_t ssrc = 1; ssrc <= NUM_STREAMS; ssrc++) {
+		mb = rtp_packet_ssrc(ssrc, 100, 20);
+		ASSERT_EQ(0, srtp_encrypt(tx, mb));
+		ASSERT_EQ(EALREADY, srtp_decrypt(rx, mb));
+		mem_deref(mb);
+
+		mb = rtp_packet_ssrc(ssrc, 101, 20);
+		ASSERT_EQ(0, srtp_encrypt(tx, mb));
+		ASSERT_EQ(0, srtp_decrypt(rx, mb));
+		mem_deref(mb);
+	}
+
+	mem_deref(rx);
+	mem_deref(tx);
+}
+
+
+TEST(srtp, ssrc_lookup_performance)
+{
+	static const size_t ssrcv[] = {2, 8, 32, 64, 200};
+	uint8_t key[30];
+
+	rand_bytes(key, sizeof(key));
+
+	re_printf("~~~ SRTP encrypt, 20 byte payloads, per SSRC count ~~~\n");
+
+	for (size_t k = 0; k < ARRAY_SIZE(ssrcv); k++) {
+		const size_t nssrc = ssrcv[k];
+		const int rounds = 200000 / nssrc;
+		struct mbuf **mbv;
+		struct srtp *tx;
+		uint64_t t0, t1;
+		size_t len;
+		int err = 0;
+
+		err = srtp_alloc(&tx, SRTP_AES_CM_128_HMAC_SHA1_80,
+				 key, sizeof(key), 0);
+		ASSERT_EQ(0, err);
+
+		mbv = (struct mbuf **)mem_zalloc(nssrc * sizeof(*mbv), NULL);
+		ASSERT_TRUE(mbv != NULL);
+
+		for (size_t i = 0; i < nssrc; i++)
+			mbv[i] = rtp_packet_ssrc(0x10000 + i * 977, 0, 20);
+		len = mbv[0]->end;
+
+		t0 = tmr_jiffies();
+
+		for (int r = 0; r < rounds; r++) {
+			for (size_t i = 0; i < nssrc; i++) {
+				struct mbuf *mb = mbv[i];
+
+				mb->pos = 0;
+				mb->end = len;
+				err |= srtp_encrypt(tx, mb);
+			}
+		}
+
+		t1 = tmr_jiffies();
+
+		ASSERT_EQ(0, err);
+
+		re_printf("%3zu SSRCs: %6.1f ns/packet\n", nssrc,
+			  1e6 * (t1 - t0) / ((double)rounds * nssrc));
+
+		for (size_t i = 0; i < nssrc; i++)
+			mem_deref(mbv[i]);
+		mem_deref(mbv);
+		mem_deref(tx);
+	}
+
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+}
+
+
+static void perf_suite(enum srtp_suite suite, size_t key_len,
+		       size_t pld_size, bool batch)
+{
+#define PERF_BYTES 24000000
+#define PERF_BATCH 16
+	const size_t n = PERF_BYTES / pld_size / PERF_BATCH * PERF_BATCH;
+	struct mbuf **mbv;
+	struct srtp *tx, *rx;
+	uint8_t key[46];
+	uint64_t t0, t1, t2;
+	double mb_total = 1.0 * n * pld_size / 1000000.0;
+	int err = 0;
+
+	rand_bytes(key, key_len);
+
+	err  = srtp_alloc(&tx, suite, key, key_len, 0);
+	err |= srtp_alloc(&rx, suite, key, key_len, 0);
+	ASSERT_EQ(0, err);
+
+	mbv = (struct mbuf **)mem_zalloc(n * sizeof(*mbv), NULL);
+	ASSERT_TRUE(mbv != NULL);
+
+	for (size_t i = 0; i < n; i++)
+		mbv[i] = rtp_packet(i, pld_size);
+
+	t0 = tmr_jiffies();
+
+	for (size_t i = 0; i < n; i += PERF_BATCH) {
+		if (batch) {
+			err |= srtp_encrypt_batch(tx, &mbv[i], NULL,
+						  PERF_BATCH);
+			continue;
+		}
+		for (size_t j = i; j < i + PERF_BATCH; j++)
+			err |= srtp_encrypt(tx, mbv[j]);
+	}
+
+	t1 = tmr_jiffies();
+
+	for (size_t i = 0; i < n; i += PERF_BATCH) {
+		if (batch) {
+			err |= srtp_decrypt_batch(rx, &mbv[i], NULL,
+						  PERF_BATCH);
+			continue;
+		}
+		for (size_t j = i; j < i + PERF_BATCH; j++)
+			err |= srtp_decrypt(rx, mbv[j]);
+	}
+
+	t2 = tmr_jiffies();
+
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(RTP_HEADER_SIZE + pld_size, mbv[n-1]->end);
+
+	re_printf("%-24s %4zu %-6s encrypt %7.1f MB/s   decrypt %7.1f MB/s\n",
+		  srtp_suite_name(suite), pld_size,
+		  batch ? "batch" : "single",
+		  mb_total * 1000.0 / (t1 - t0 + 1),
+		  mb_total * 1000.0 / (t2 - t1 + 1));
+
+	for (size_t i = 0; i < n; i++)
+		mem_deref(mbv[i]);
+
+	mem_deref(mbv);
+	mem_deref(rx);
+	mem_deref(tx);
+}
+
+
+TEST(srtp, performance)
+{
+	static const size_t pldv[] = {160, 1200};
+
+	re_printf("~~~ SRTP throughput, batches of %d packets ~~~\n",
+		  PERF_BATCH);
+
+	for (size_t i = 0; i < ARRAY_SIZE(pldv); i++) {
+		perf_suite(SRTP_AES_CM_128_HMAC_SHA1_80, 30, pldv[i], false);
+		perf_suite(SRTP_AES_CM_128_HMAC_SHA1_80, 30, pldv[i], true);
+		perf_suite(SRTP_AES_128_GCM, 28, pldv[i], false);
+		perf_suite(SRTP_AES_128_GCM, 28, pldv[i], true);
+		perf_suite(SRTP_AES_256_GCM, 44, pldv[i], false);
+		perf_suite(SRTP_AES_256_GCM, 44, pldv[i], true);
+	}
+
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+}
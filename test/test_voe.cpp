@@ -20,6 +20,8 @@
 #include <avs_voe.h>
 #include <gtest/gtest.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
 #include <re/re.h>
 #include "avs_audio_io.h"
 #include "webrtc/base/logging.h"
@@ -511,3 +513,162 @@ TEST(voe, enc_dec_alloc_start_stop_interrupt)
 }
 #endif
 
+
+
+struct fanout_peer {
+	pthread_mutex_t mutex;
+	uint32_t ssrc;
+	uint16_t seq;
+	size_t n_pkt;
+	size_t n_seq_err;
+	size_t n_ssrc_err;
+};
+
+
+static int fanout_rtp(const uint8_t *pkt, size_t len, void *arg)
+{
+	struct fanout_peer *peer = (struct fanout_peer *)arg;
+	uint16_t seq = read_uint16(&pkt[2]);
+
+	pthread_mutex_lock(&peer->mutex);
+
+	if (peer->n_pkt && seq != (uint16_t)(peer->seq + 1))
+		++peer->n_seq_err;
+	if (read_uint32(&pkt[8]) != peer->ssrc)
+		++peer->n_ssrc_err;
+
+	peer->seq = seq;
+	++peer->n_pkt;
+
+	pthread_mutex_unlock(&peer->mutex);
+
+	return 0;
+}
+
+
+static uint64_t cpu_usage_us(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+		+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+
+/* Run N encoders for a while, and return the CPU time used */
+static uint64_t run_peers(struct list *aucodecl, struct fanout_peer *peerv,
+			  size_t n, unsigned ms)
+{
+	struct auenc_state *aesv[8];
+	const struct aucodec *ac;
+	struct aucodec_param prm;
+	uint64_t cpu;
+	size_t i;
+	int err;
+
+	if (n > ARRAY_SIZE(aesv))
+		return 0;
+
+	ac = aucodec_find(aucodecl, "opus", 48000, 2);
+	if (!ac)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		struct media_ctx *mctx = NULL;
+
+		memset(&peerv[i], 0, sizeof(peerv[i]));
+		pthread_mutex_init(&peerv[i].mutex, NULL);
+		peerv[i].ssrc = 0x10000000 + i;
+
+		memset(&prm, 0, sizeof(prm));
+		prm.local_ssrc = peerv[i].ssrc;
+		prm.pt = 96;
+		prm.srate = 48000;
+		prm.ch = 2;
+
+		aesv[i] = NULL;
+		err = ac->enc_alloc(&aesv[i], &mctx, ac, NULL, &prm,
+				    fanout_rtp, NULL, NULL, NULL, &peerv[i]);
+		if (err)
+			return 0;
+	}
+
+	cpu = cpu_usage_us();
+
+	for (i = 0; i < n; i++)
+		ac->enc_start(aesv[i]);
+
+	usleep(ms * 1000);
+
+	for (i = 0; i < n; i++)
+		ac->enc_stop(aesv[i]);
+
+	cpu = cpu_usage_us() - cpu;
+
+	for (i = 0; i < n; i++)
+		mem_deref(aesv[i]);
+
+	return cpu;
+}
+
+
+TEST_F(Voe, shared_encoder)
+{
+	struct fanout_peer peerv[4];
+	size_t i;
+	int err;
+
+	err = voe_enable_shared_encoder(true);
+	ASSERT_EQ(0, err);
+
+	run_peers(&aucodecl, peerv, ARRAY_SIZE(peerv), 1000);
+
+	for (i = 0; i < ARRAY_SIZE(peerv); i++) {
+
+		/* every peer gets the packets, with its own header */
+		ASSERT_GE(peerv[i].n_pkt, 10);
+		ASSERT_EQ(0, peerv[i].n_seq_err);
+		ASSERT_EQ(0, peerv[i].n_ssrc_err);
+	}
+
+	err = voe_enable_shared_encoder(false);
+	ASSERT_EQ(0, err);
+}
+
+
+TEST_F(Voe, shared_encoder_performance)
+{
+	static const size_t peers[] = {2, 8};
+	struct fanout_peer peerv[8];
+	uint64_t cpu_mesh, cpu_shared;
+	size_t i;
+
+	re_printf("~~~ performance report ~~~\n");
+
+	for (i = 0; i < ARRAY_SIZE(peers); i++) {
+
+		voe_enable_shared_encoder(false);
+		cpu_mesh = run_peers(&aucodecl, peerv, peers[i], 1000);
+
+		voe_enable_shared_encoder(true);
+		cpu_shared = run_peers(&aucodecl, peerv, peers[i], 1000);
+
+		/* the shared encoder still reaches every peer */
+		ASSERT_GT(cpu_shared, 0);
+		for (size_t j = 0; j < peers[i]; j++)
+			ASSERT_GE(peerv[j].n_pkt, 10);
+
+		re_printf("%zu peers: cpu per encoder %llu ms,"
+			  " shared encoder %llu ms (%.1fx)\n",
+			  peers[i],
+			  (unsigned long long)cpu_mesh / 1000,
+			  (unsigned long long)cpu_shared / 1000,
+			  (double)cpu_mesh / cpu_shared);
+	}
+
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+
+	voe_enable_shared_encoder(false);
+}
@@ -0,0 +1,121 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+struct wd_test {
+	struct watchdog_deadline dl;
+	struct tmr tmr_touch;
+	struct tmr tmr_stop;
+	int expired;
+	int touches;
+	bool recovered;
+};
+
+
+static void expired_handler(void *arg)
+{
+	struct wd_test *wt = (struct wd_test *)arg;
+
+	++wt->expired;
+}
+
+
+static void touch_handler(void *arg)
+{
+	struct wd_test *wt = (struct wd_test *)arg;
+
+	/* touch for a while, then go quiet so the deadline expires */
+	if (wt->touches++ < 10) {
+		watchdog_touch(&wt->dl);
+		tmr_start(&wt->tmr_touch, 5, touch_handler, wt);
+	}
+}
+
+
+static void stop_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+TEST(watchdog, alloc_invalid)
+{
+	struct watchdog *wd = NULL;
+
+	ASSERT_EQ(EINVAL, watchdog_alloc(NULL, 10));
+	ASSERT_EQ(EINVAL, watchdog_alloc(&wd, 0));
+}
+
+
+TEST(watchdog, expire_once_and_recover)
+{
+	struct watchdog *wd = NULL;
+	struct wd_test wt;
+	int err;
+
+	memset(&wt, 0, sizeof(wt));
+
+	err = watchdog_alloc(&wd, 5);
+	ASSERT_EQ(0, err);
+
+	watchdog_add(wd, &wt.dl, 30, expired_handler, &wt);
+
+	tmr_start(&wt.tmr_touch, 0, touch_handler, &wt);
+	tmr_start(&wt.tmr_stop, 200, stop_handler, &wt);
+
+	err = re_main(NULL);
+	ASSERT_EQ(0, err);
+
+	/* went quiet after ~50ms, expired only once in the remaining time */
+	ASSERT_EQ(1, wt.expired);
+
+	ASSERT_TRUE(watchdog_touch(&wt.dl));
+	ASSERT_FALSE(watchdog_touch(&wt.dl));
+
+	mem_deref(wd);
+}
+
+
+TEST(watchdog, not_armed_until_touched)
+{
+	struct watchdog *wd = NULL;
+	struct wd_test wt;
+	int err;
+
+	memset(&wt, 0, sizeof(wt));
+
+	err = watchdog_alloc(&wd, 5);
+	ASSERT_EQ(0, err);
+
+	watchdog_add(wd, &wt.dl, 10, expired_handler, &wt);
+	tmr_start(&wt.tmr_stop, 50, stop_handler, &wt);
+
+	err = re_main(NULL);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(0, wt.expired);
+
+	watchdog_remove(&wt.dl);
+	mem_deref(wd);
+}